@@ -0,0 +1,459 @@
+#define _XOPEN_SOURCE 700
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <threads.h>
+#include "scall.h"
+#include "logger.h"
+#include "env.h"
+#include "rescuers.h"
+#include "emergency_types.h"
+#include "emergency.h"
+#include "worker_thread.h"
+#include "intent.h"
+#include "reach.h"
+#include "fleet.h"
+#include "event.h"
+#include "simclock.h"
+#include "scratch.h"
+#include "metrics.h"
+#include "synth.h"
+
+// Microbenchmark dei percorsi caldi del dispatcher, su scale crescenti della
+// flotta. Per ogni scala genera (o copia) le configurazioni in una directory
+// temporanea, le carica come il server e misura ogni operazione singolarmente:
+// media in ns/op e percentili, scritti in JSON per il confronto tra versioni.
+// Uso: bench [-s scala,...] [-n iterazioni] [-t ms] [-l livello] [-c dir] [-o file.json] [-k]
+//      bench -g twin:tipi [-d dir]      (scrive solo le configurazioni sintetiche)
+// Una scala è "shipped" (configurazioni del repository, lette da -c dir)
+// oppure twin:tipi. Il livello di log (default error) vale per le funzioni
+// misurate; log_event scrive sempre.
+
+#define BENCH_DEFAULT_SCALES "shipped,2048:64,65536:256,1048576:1024"
+// Emergenze preparate per ogni scala, usate a rotazione
+#define BENCH_POOL 64
+// Intent registrati per can_proceed
+#define BENCH_REGISTERED 16
+// Lato della griglia delle scale sintetiche (l'indice di raggiungibilità
+// alloca (2 * lato)^2 celle per gruppo di tipo)
+#define BENCH_GRID 100
+#define BENCH_SEED 2463534242u
+#define BENCH_MSG_SIZE 128
+
+// Risultato di una misura
+typedef struct {
+    char scale[32];
+    int twins, rescuer_types, emergency_types;
+    const char *name;
+    long iterations;
+    double mean;
+    long long p50, p90, p99, p999, max;
+} bench_result_t;
+
+// Stato di una scala caricata
+typedef struct {
+    rescuer_data_t rdata;
+    emergency_data_t edata;
+    env_config_t env;
+    mtx_t *twin_locks;
+    intent_table_t itable;
+    char messages[BENCH_POOL][BENCH_MSG_SIZE];
+    emergency_request_withID_t requests[BENCH_POOL];
+    emergency_withID_t *pool[BENCH_POOL];
+    emergency_status_t pool_status[BENCH_POOL];
+    rescuer_digital_twin_t **assigned;
+    int assigned_count;
+    intent_t *intent;
+} bench_ctx_t;
+
+typedef void (*bench_op)(bench_ctx_t *ctx, long i);
+
+static bench_result_t *results = NULL;
+static int result_count = 0, result_capacity = 0;
+static long max_iterations = 100000;
+static long long budget_ns = 500LL * 1000000;
+static long long timer_overhead = 0;
+static long long *samples = NULL;
+static bench_result_t current;
+
+
+// Funzione di confronto per qsort
+static int cmp_ll(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+// Funzione che restituisce il percentile p (0-100) di campioni ordinati
+static long long percentile(const long long *sorted, long n, double p) {
+    long rank = (long)(p / 100.0 * n);
+    if (rank >= n) rank = n - 1;
+    return sorted[rank];
+}
+
+// Funzione che aggiunge un risultato con i campioni raccolti
+static void bench_add(const char *name, long n) {
+    if (result_count == result_capacity) {
+        result_capacity = result_capacity ? result_capacity * 2 : 32;
+        SNCALL(results, realloc(results, sizeof(bench_result_t) * result_capacity), "realloc results");
+    }
+    qsort(samples, n, sizeof(long long), cmp_ll);
+    double sum = 0;
+    for (long k = 0; k < n; ++k) sum += samples[k];
+    bench_result_t *r = &results[result_count++];
+    *r = current;
+    r->name = name;
+    r->iterations = n;
+    r->mean = n ? sum / n : 0;
+    r->p50 = percentile(samples, n, 50);
+    r->p90 = percentile(samples, n, 90);
+    r->p99 = percentile(samples, n, 99);
+    r->p999 = percentile(samples, n, 99.9);
+    r->max = samples[n - 1];
+    fprintf(stderr, "  %-30s %8ld op  %12.1f ns/op  p99 %lld ns\n", name, n, r->mean, r->p99);
+}
+
+// Funzione che misura op singolarmente fino a max_iterations o alla scadenza
+// del budget di tempo; before e after (opzionali) preparano e ripristinano lo
+// stato fuori dalla misura
+static void bench_measure(const char *name, bench_ctx_t *ctx, bench_op before, bench_op op, bench_op after) {
+    long long deadline = metrics_now_ns() + budget_ns;
+    long n = 0;
+    while (n < max_iterations && (n < 5 || metrics_now_ns() < deadline)) {
+        if (before) before(ctx, n);
+        long long t0 = metrics_now_ns();
+        op(ctx, n);
+        long long dt = metrics_now_ns() - t0 - timer_overhead;
+        samples[n++] = dt > 0 ? dt : 0;
+        if (after) after(ctx, n - 1);
+    }
+    bench_add(name, n);
+}
+
+// Funzione che stima il costo di una coppia di letture dell'orologio
+static void calibrate_timer(void) {
+    long long best = -1;
+    for (int k = 0; k < 10000; ++k) {
+        long long t0 = metrics_now_ns();
+        long long dt = metrics_now_ns() - t0;
+        if (best < 0 || dt < best) best = dt;
+    }
+    timer_overhead = best;
+}
+
+
+// --- Operazioni misurate ---
+
+static void op_parse(bench_ctx_t *ctx, long i) {
+    emergency_request_withID_t req;
+    req.id = (int)i + 1;
+    parse_MQrequest(ctx->messages[i % BENCH_POOL], &req);
+}
+
+static void op_validate(bench_ctx_t *ctx, long i) {
+    validate_MQrequest(&ctx->requests[i % BENCH_POOL], ctx->edata.types, ctx->edata.num_types, &ctx->env);
+}
+
+static void op_reach(bench_ctx_t *ctx, long i) {
+    check_reachability(ctx->pool[i % BENCH_POOL], &ctx->rdata);
+}
+
+// Ripristina lo stato dell'emergenza (check_reachability può impostare TIMEOUT)
+static void restore_status(bench_ctx_t *ctx, long i) {
+    ctx->pool[i % BENCH_POOL]->emergency.status = ctx->pool_status[i % BENCH_POOL];
+}
+
+static void before_assign(bench_ctx_t *ctx, long i) {
+    (void)ctx;
+    (void)i;
+    scratch_reset();
+}
+
+static void op_assign(bench_ctx_t *ctx, long i) {
+    ctx->assigned_count = assign_rescuers_to_emergency(ctx->pool[i % BENCH_POOL], &ctx->rdata,
+                                                       ctx->assigned, ctx->twin_locks);
+}
+
+// Riporta IDLE i twin assegnati e libera l'assegnazione dell'emergenza
+static void after_assign(bench_ctx_t *ctx, long i) {
+    for (int k = 0; k < ctx->assigned_count; ++k) {
+        rescuer_digital_twin_t *t = ctx->assigned[k];
+        t->emergency_id = 0;
+        t->emergency_priority = -1;
+        t->reserved_by = 0;
+        fleet_update_twin(t, IDLE, t->x, t->y);
+    }
+    emergency_t *em = &ctx->pool[i % BENCH_POOL]->emergency;
+    free(em->rescuers_dt);
+    free(em->rescuers_req);
+    em->rescuers_dt = NULL;
+    em->rescuers_req = NULL;
+    em->rescuer_count = 0;
+    restore_status(ctx, i);
+}
+
+static void op_create_intent(bench_ctx_t *ctx, long i) {
+    ctx->intent = create_intent_from_emergency(ctx->pool[i % BENCH_POOL], &ctx->rdata);
+}
+
+static void after_create_intent(bench_ctx_t *ctx, long i) {
+    (void)i;
+    free(ctx->intent);
+    ctx->intent = NULL;
+}
+
+static void op_can_proceed(bench_ctx_t *ctx, long i) {
+    can_proceed(&ctx->itable, ctx->pool[i % BENCH_REGISTERED]->id);
+}
+
+static void op_log_event(bench_ctx_t *ctx, long i) {
+    (void)ctx;
+    (void)i;
+    log_event("bench.c", "BENCH", "Evento di prova del benchmark");
+}
+
+
+// Funzione che copia un file di configurazione del repository nella directory corrente
+static void copy_conf(const char *from, const char *to) {
+    FILE *in = fopen(from, "r");
+    FILE *out = fopen(to, "w");
+    if (!in || !out) {
+        perror(from);
+        exit(EXIT_FAILURE);
+    }
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0)
+        fwrite(buf, 1, n, out);
+    fclose(in);
+    fclose(out);
+}
+
+// Funzione che carica una scala, esegue tutte le misure e libera lo stato
+static void bench_scale(const char *spec, const char *conf_dir) {
+    bench_ctx_t *ctx;
+    SNCALL(ctx, calloc(1, sizeof(bench_ctx_t)), "calloc bench ctx");
+    memset(&current, 0, sizeof(current));
+    snprintf(current.scale, sizeof(current.scale), "%s", spec);
+
+    ctx->env.queue_name = NULL;
+    ctx->env.trace_path = NULL;
+    ctx->env.metrics_socket = NULL;
+    if (strcmp(spec, "shipped") == 0) {
+        char path[4096 + 32];
+        snprintf(path, sizeof(path), "%s/rescuers.conf", conf_dir);
+        copy_conf(path, "rescuers.conf");
+        snprintf(path, sizeof(path), "%s/emergency_types.conf", conf_dir);
+        copy_conf(path, "emergency_types.conf");
+        ctx->env.height = 300;
+        ctx->env.width = 400;
+    } else {
+        int twins, types;
+        if (sscanf(spec, "%d:%d", &twins, &types) != 2 || twins < 1 || types < 1 ||
+            twins > MAX_TWINS || types > MAX_TYPES) {
+            fprintf(stderr, "Scala non valida: %s (massimo %d twin, %d tipi)\n", spec, MAX_TWINS, MAX_TYPES);
+            exit(EXIT_FAILURE);
+        }
+        synth_write_conf(".", twins, types, BENCH_GRID, BENCH_SEED);
+        ctx->env.height = BENCH_GRID;
+        ctx->env.width = BENCH_GRID;
+    }
+    fprintf(stderr, "Scala %s\n", spec);
+
+    // Caricamento come nel server; parsing e indice sono misurati una volta
+    long long t0 = metrics_now_ns();
+    if (parse_rescuers("rescuers.conf", &ctx->rdata) != 0) exit(EXIT_FAILURE);
+    samples[0] = metrics_now_ns() - t0;
+    current.twins = ctx->rdata.num_twins;
+    current.rescuer_types = ctx->rdata.num_types;
+    bench_add("parse_rescuers", 1);
+    log_declare_fleet(&ctx->rdata);
+    if (parse_emergency_types("emergency_types.conf", &ctx->rdata, &ctx->edata) != 0) exit(EXIT_FAILURE);
+    current.emergency_types = ctx->edata.num_types;
+    results[result_count - 1].emergency_types = current.emergency_types;
+    fleet_attach(&ctx->rdata);
+    t0 = metrics_now_ns();
+    reach_index_init(&ctx->rdata, &ctx->env);
+    samples[0] = metrics_now_ns() - t0;
+    bench_add("reach_index_init", 1);
+    event_engine_start_manual();
+    init_intent_table(&ctx->itable);
+    SNCALL(ctx->twin_locks, malloc(sizeof(mtx_t) * ctx->rdata.num_twins), "malloc twin locks");
+    for (int k = 0; k < ctx->rdata.num_twins; ++k)
+        MCALL_INIT(&ctx->twin_locks[k], mtx_plain, "errore in init twin lock");
+    int max_slots = 1;
+    for (int k = 0; k < ctx->edata.num_types; ++k) {
+        int slots = 0;
+        for (int r = 0; r < ctx->edata.types[k].rescuers_req_number; ++r)
+            slots += ctx->edata.types[k].rescuers[r].required_count;
+        if (slots > max_slots) max_slots = slots;
+    }
+    SNCALL(ctx->assigned, malloc(sizeof(rescuer_digital_twin_t *) * max_slots), "malloc assigned");
+
+    // Emergenze a rotazione: tipi e posizioni pseudo-casuali nella griglia
+    unsigned seed = BENCH_SEED;
+    for (int k = 0; k < BENCH_POOL; ++k) {
+        seed = seed * 1103515245u + 12345u;
+        emergency_type_t *type = &ctx->edata.types[(seed >> 8) % ctx->edata.num_types];
+        seed = seed * 1103515245u + 12345u;
+        int x = (seed >> 8) % (ctx->env.height + 1);
+        seed = seed * 1103515245u + 12345u;
+        int y = (seed >> 8) % (ctx->env.width + 1);
+        snprintf(ctx->messages[k], BENCH_MSG_SIZE, "%s %d %d %ld", type->emergency_desc, x, y, (long)sim_now());
+        emergency_request_withID_t *req = &ctx->requests[k];
+        req->id = k + 1;
+        SNCALL(ctx->pool[k], malloc(sizeof(emergency_withID_t)), "malloc bench emergency");
+        if (parse_MQrequest(ctx->messages[k], req) != 0 ||
+            validate_MQrequest(req, ctx->edata.types, ctx->edata.num_types, &ctx->env) != 0 ||
+            create_emergency_instance(ctx->pool[k], req, ctx->edata.types, ctx->edata.num_types) != 0) {
+            fprintf(stderr, "Emergenza di prova non valida: %s\n", ctx->messages[k]);
+            exit(EXIT_FAILURE);
+        }
+        ctx->pool_status[k] = ctx->pool[k]->emergency.status;
+    }
+    for (int k = 0; k < BENCH_REGISTERED; ++k) {
+        intent_t *intent = create_intent_from_emergency(ctx->pool[k], &ctx->rdata);
+        if (!intent || register_intent(&ctx->itable, intent) != 0) {
+            fprintf(stderr, "Registrazione dell'intent di prova fallita\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    bench_measure("parse_MQrequest", ctx, NULL, op_parse, NULL);
+    bench_measure("validate_MQrequest", ctx, NULL, op_validate, NULL);
+    bench_measure("check_reachability", ctx, NULL, op_reach, restore_status);
+    bench_measure("assign_rescuers_to_emergency", ctx, before_assign, op_assign, after_assign);
+    bench_measure("create_intent_from_emergency", ctx, NULL, op_create_intent, after_create_intent);
+    bench_measure("can_proceed", ctx, NULL, op_can_proceed, NULL);
+    bench_measure("log_event", ctx, NULL, op_log_event, NULL);
+
+    // Rilascio dello stato della scala
+    free_intent_table(&ctx->itable);
+    event_engine_stop();
+    for (int k = 0; k < BENCH_POOL; ++k)
+        free_emergency_instance(ctx->pool[k]);
+    for (int k = 0; k < ctx->rdata.num_twins; ++k)
+        mtx_destroy(&ctx->twin_locks[k]);
+    free(ctx->twin_locks);
+    free(ctx->assigned);
+    reach_index_free();
+    free_emergency_types(&ctx->edata);
+    free_rescuers_data(&ctx->rdata);
+    free(ctx);
+}
+
+// Funzione che scrive i risultati in JSON
+static void write_json(FILE *out, const char *log_level) {
+    fprintf(out, "{\n  \"benchmark\": \"ems-dispatch\",\n  \"version\": 1,\n");
+    fprintf(out, "  \"timestamp\": %ld,\n", (long)time(NULL));
+    fprintf(out, "  \"max_twins\": %d,\n  \"max_types\": %d,\n", MAX_TWINS, MAX_TYPES);
+    fprintf(out, "  \"log_level\": \"%s\",\n  \"timer_overhead_ns\": %lld,\n", log_level, timer_overhead);
+    fprintf(out, "  \"results\": [\n");
+    for (int k = 0; k < result_count; ++k) {
+        bench_result_t *r = &results[k];
+        fprintf(out, "    {\"scale\": \"%s\", \"twins\": %d, \"rescuer_types\": %d, \"emergency_types\": %d, "
+                "\"name\": \"%s\", \"iterations\": %ld, \"ns_per_op\": %.1f, "
+                "\"p50_ns\": %lld, \"p90_ns\": %lld, \"p99_ns\": %lld, \"p999_ns\": %lld, \"max_ns\": %lld}%s\n",
+                r->scale, r->twins, r->rescuer_types, r->emergency_types, r->name, r->iterations, r->mean,
+                r->p50, r->p90, r->p99, r->p999, r->max, k + 1 < result_count ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+// Funzione che restituisce il livello di log dal nome (debug, info, state, error)
+static log_level_t parse_level(const char *name) {
+    for (int l = LOG_LEVEL_DEBUG; l <= LOG_LEVEL_ERROR; ++l)
+        if (strcmp(name, log_level_name(l)) == 0) return l;
+    fprintf(stderr, "Livello di log non valido: %s\n", name);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    const char *scales = BENCH_DEFAULT_SCALES;
+    const char *out_path = NULL;
+    const char *gen = NULL;
+    const char *gen_dir = ".";
+    const char *level = "error";
+    const char *conf_dir = ".";
+    int keep = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "s:n:t:l:c:o:kg:d:")) != -1) {
+        switch (opt) {
+            case 's': scales = optarg; break;
+            case 'n': max_iterations = atol(optarg); break;
+            case 't': budget_ns = atoll(optarg) * 1000000LL; break;
+            case 'l': level = optarg; break;
+            case 'c': conf_dir = optarg; break;
+            case 'o': out_path = optarg; break;
+            case 'k': keep = 1; break;
+            case 'g': gen = optarg; break;
+            case 'd': gen_dir = optarg; break;
+            default:
+                fprintf(stderr, "Uso: %s [-s scala,...] [-n iterazioni] [-t ms] [-l livello] [-c dir] [-o file.json] [-k]\n"
+                                "     %s -g twin:tipi [-d dir]\n", argv[0], argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+    if (max_iterations < 5) max_iterations = 5;
+
+    // Sola generazione delle configurazioni
+    if (gen) {
+        int twins, types;
+        if (sscanf(gen, "%d:%d", &twins, &types) != 2) {
+            fprintf(stderr, "Formato atteso twin:tipi, ricevuto %s\n", gen);
+            exit(EXIT_FAILURE);
+        }
+        synth_write_conf(gen_dir, twins, types, BENCH_GRID, BENCH_SEED);
+        return 0;
+    }
+
+    // Le configurazioni e il log vengono scritti in una directory temporanea
+    char repo_dir[4096], conf_abs[4096];
+    if (!getcwd(repo_dir, sizeof(repo_dir)) || !realpath(conf_dir, conf_abs)) {
+        perror(conf_dir);
+        exit(EXIT_FAILURE);
+    }
+    char work_dir[] = "/tmp/ems-bench-XXXXXX";
+    if (!mkdtemp(work_dir) || chdir(work_dir) != 0) {
+        perror("mkdtemp");
+        exit(EXIT_FAILURE);
+    }
+    FILE *out = stdout;
+    char out_abs[4096 + 256];
+    if (out_path) {
+        snprintf(out_abs, sizeof(out_abs), "%s%s%s", out_path[0] == '/' ? "" : repo_dir,
+                 out_path[0] == '/' ? "" : "/", out_path);
+        SNCALL(out, fopen(out_abs, "w"), "fopen output");
+    }
+
+    SNCALL(samples, malloc(sizeof(long long) * max_iterations), "malloc samples");
+    // Tempo virtuale fermo: le misure non dipendono dall'orologio
+    sim_clock_init(SIM_CLOCK_MANUAL, 1.0);
+    init_log();
+    log_set_level(parse_level(level));
+    calibrate_timer();
+
+    char *list;
+    SNCALL(list, strdup(scales), "strdup scales");
+    char *save = NULL;
+    for (char *spec = strtok_r(list, ",", &save); spec; spec = strtok_r(NULL, ",", &save))
+        bench_scale(spec, conf_abs);
+    free(list);
+
+    close_log();
+    write_json(out, level);
+    if (out != stdout) fclose(out);
+    free(samples);
+    free(results);
+
+    if (!keep) {
+        unlink("rescuers.conf");
+        unlink("emergency_types.conf");
+        unlink("emergency.log");
+        if (chdir(repo_dir) == 0) rmdir(work_dir);
+    } else {
+        fprintf(stderr, "Configurazioni e log conservati in %s\n", work_dir);
+    }
+    return 0;
+}
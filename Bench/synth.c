@@ -0,0 +1,82 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include "synth.h"
+
+// Basi (righe di rescuers.conf) per nome di tipo
+#define SYNTH_BASES_PER_NAME 4
+
+// Generatore pseudo-casuale xorshift32, riproducibile tra piattaforme
+static unsigned synth_next(unsigned *state) {
+    unsigned x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+// Funzione che restituisce un intero in [0, n)
+static int synth_range(unsigned *state, int n) {
+    return n > 0 ? (int)(synth_next(state) % (unsigned)n) : 0;
+}
+
+// Funzione che apre in scrittura dir/name, termina il programma in caso di errore
+static FILE *synth_open(const char *dir, const char *name) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    return f;
+}
+
+// Funzione che scrive le due configurazioni sintetiche (vedi synth.h)
+void synth_write_conf(const char *dir, int twins, int types, int grid, unsigned seed) {
+    unsigned state = seed ? seed : 1;
+    if (types < 1) types = 1;
+    if (twins < types) twins = types;
+    int names = (types + SYNTH_BASES_PER_NAME - 1) / SYNTH_BASES_PER_NAME;
+    int *per_name;
+    if (!(per_name = calloc(names, sizeof(int)))) {
+        perror("calloc synth");
+        exit(EXIT_FAILURE);
+    }
+
+    // rescuers.conf: una riga per base, twin ripartiti in parti uguali
+    FILE *f = synth_open(dir, "rescuers.conf");
+    for (int j = 0; j < types; ++j) {
+        int name = j % names;
+        int count = twins / types + (j < twins % types ? 1 : 0);
+        per_name[name] += count;
+        fprintf(f, "[Tipo%04d][%d][%d][%d;%d]\n", name, count, 1 + name % 5,
+                synth_range(&state, grid + 1), synth_range(&state, grid + 1));
+    }
+    fclose(f);
+
+    // emergency_types.conf: priorità a rotazione, da 1 a 3 richieste per tipo
+    int etypes = types < SYNTH_MAX_EMERGENCY_TYPES ? types : SYNTH_MAX_EMERGENCY_TYPES;
+    f = synth_open(dir, "emergency_types.conf");
+    for (int e = 0; e < etypes; ++e) {
+        int priority = e % 3;
+        fprintf(f, "[Emergenza%04d] [%d] ", e, priority);
+        int requests = 1 + e % 3;
+        int first = synth_range(&state, names);
+        for (int r = 0; r < requests && r < names; ++r) {
+            int name = (first + r) % names;
+            int available = per_name[name] < 5 ? per_name[name] : 5;
+            int count = 1 + synth_range(&state, available);
+            fprintf(f, "Tipo%04d", name);
+            // Un tipo su otto accetta un sostituto per la prima richiesta
+            if (r == 0 && e % 8 == 2 && names > requests)
+                fprintf(f, "|Tipo%04d+3", (first + requests) % names);
+            fprintf(f, ":%d,%d;", count, 1 + synth_range(&state, 10));
+        }
+        if (e % 4 == 0) fprintf(f, "partial;");
+        else if (priority == 2 && e % 4 == 1) fprintf(f, "preempt=0;");
+        fprintf(f, "\n");
+    }
+    fclose(f);
+    free(per_name);
+}
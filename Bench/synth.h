@@ -0,0 +1,18 @@
+#ifndef SYNTH_H
+#define SYNTH_H
+
+// Generatore di configurazioni sintetiche per il benchmark: scrive
+// rescuers.conf ed emergency_types.conf nella directory dir con twins twin
+// distribuiti su types righe (basi) di rescuers.conf. Ogni nome di tipo ha
+// quattro basi, come nella flotta di esempio; i tipi di emergenza sono
+// min(types, SYNTH_MAX_EMERGENCY_TYPES) e richiedono da 1 a 3 tipi di
+// soccorritori, con assegnazione parziale, preemption e sostituti.
+// Basi ed emergenze cadono nella griglia [0..grid] x [0..grid].
+// La generazione è deterministica per un dato seed.
+
+// Limite di parse_emergency_types (MAX_EMERGENCIES)
+#define SYNTH_MAX_EMERGENCY_TYPES 256
+
+void synth_write_conf(const char *dir, int twins, int types, int grid, unsigned seed);
+
+#endif
@@ -0,0 +1,481 @@
+#define _XOPEN_SOURCE 700
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <mqueue.h>
+#include <sys/wait.h>
+#include "scall.h"
+#include "env.h"
+#include "rescuers.h"
+#include "emergency_types.h"
+#include "emergency.h"
+#include "simclock.h"
+#include "trace.h"
+#include "scenario.h"
+#include "sla.h"
+
+// Harness di carico end-to-end: avvia il server in una directory temporanea
+// con le configurazioni di -c dir, gli invia uno scenario e ricava dal log
+// binario degli eventi il rapporto SLA (sla.h).
+//  - modo replay (default): lo scenario diventa un trace (trace.h) eseguito
+//    con ./main -r, in tempo virtuale a thread singolo: una settimana di
+//    carico richiede il tempo di calcolo delle decisioni, non quello simulato
+//  - modo live: il server gira con l'orologio scaled (-x volte il tempo
+//    reale) e riceve le richieste dalla coda, nel formato del client
+// Uso: load [-c dir] [-e server] [-m replay|live] [-x scala] [-f script]
+//           [-p richieste/h:durata] [-b n@istante[:raggio]] [-S seed]
+//           [-R fattore,...] [-T soglia%] [-w s] [-k]
+// Durate e istanti accettano i suffissi s, m, h, d (es. -p 30:7d -b 40@3d).
+// Con -R lo scenario si ripete moltiplicando tassi di Poisson e raffiche per
+// ogni fattore; il tetto misurato è il fattore più alto con TIMEOUT entro -T.
+
+#define LOAD_DEFAULT_SCALE 60.0
+#define LOAD_DEFAULT_THRESHOLD 5.0
+#define LOAD_BURST_RADIUS 30
+#define LOAD_SEED 2463534242u
+#define LOAD_MAX_SOURCES 16
+#define LOAD_MSG_SIZE 512
+// Attesa massima dell'avvio del server (creazione della coda)
+#define LOAD_START_MS 10000
+// Intervallo di lettura del log durante lo smaltimento (modo live)
+#define LOAD_POLL_MS 100
+#define LOAD_PATH_SIZE 4096
+
+typedef enum {
+    SOURCE_SCRIPT,
+    SOURCE_POISSON,
+    SOURCE_BURST
+} load_source_kind_t;
+
+// Sorgente dello scenario, come data sulla riga di comando
+typedef struct {
+    load_source_kind_t kind;
+    const char *path;     // script
+    double per_hour;      // Poisson
+    long long duration_ms;
+    int count;            // raffica
+    long long at_ms;
+    int radius;
+} load_source_t;
+
+static load_source_t sources[LOAD_MAX_SOURCES];
+static int num_sources = 0;
+static char conf_dir[LOAD_PATH_SIZE];
+static char server_path[LOAD_PATH_SIZE];
+static int live = 0;
+static double scale = LOAD_DEFAULT_SCALE;
+static long long drain_ms = -1;
+static int keep = 0;
+static env_config_t env;
+static rescuer_data_t rdata;
+static emergency_data_t edata;
+
+
+// Funzione che termina con il messaggio d'uso
+static void usage(const char *name) {
+    fprintf(stderr, "Uso: %s [-c dir] [-e server] [-m replay|live] [-x scala] [-f script]\n"
+                    "       [-p richieste/h:durata] [-b n@istante[:raggio]] [-S seed]\n"
+                    "       [-R fattore,...] [-T soglia%%] [-w s] [-k]\n", name);
+    exit(EXIT_FAILURE);
+}
+
+// Funzione che aggiunge una sorgente dello scenario
+static load_source_t *add_source(const char *name) {
+    if (num_sources == LOAD_MAX_SOURCES) {
+        fprintf(stderr, "Al massimo %d sorgenti per scenario\n", LOAD_MAX_SOURCES);
+        usage(name);
+    }
+    load_source_t *src = &sources[num_sources++];
+    memset(src, 0, sizeof(*src));
+    return src;
+}
+
+// Funzione che interpreta -p richieste/h:durata
+static void parse_poisson(const char *name, const char *arg) {
+    load_source_t *src = add_source(name);
+    src->kind = SOURCE_POISSON;
+    char *end;
+    src->per_hour = strtod(arg, &end);
+    if (*end != ':' || src->per_hour <= 0 || (src->duration_ms = parse_duration_ms(end + 1)) <= 0) {
+        fprintf(stderr, "Formato atteso richieste/h:durata, ricevuto %s\n", arg);
+        usage(name);
+    }
+}
+
+// Funzione che interpreta -b n@istante[:raggio]
+static void parse_burst(const char *name, const char *arg) {
+    load_source_t *src = add_source(name);
+    src->kind = SOURCE_BURST;
+    src->radius = LOAD_BURST_RADIUS;
+    char at[64];
+    if (sscanf(arg, "%d@%63[^:]:%d", &src->count, at, &src->radius) < 2 || src->count <= 0 ||
+        src->radius < 0 || (src->at_ms = parse_duration_ms(at)) < 0) {
+        fprintf(stderr, "Formato atteso n@istante[:raggio], ricevuto %s\n", arg);
+        usage(name);
+    }
+}
+
+// Funzione che costruisce lo scenario, con tassi e raffiche moltiplicati per factor
+static void build_scenario(scenario_t *s, unsigned seed, double factor) {
+    scenario_init(s, env.height, env.width, seed);
+    for (int i = 0; i < num_sources; ++i) {
+        const load_source_t *src = &sources[i];
+        switch (src->kind) {
+            case SOURCE_SCRIPT:
+                if (scenario_add_script(s, src->path, &edata) != 0)
+                    exit(EXIT_FAILURE);
+                break;
+            case SOURCE_POISSON:
+                scenario_add_poisson(s, &edata, src->per_hour * factor, src->duration_ms);
+                break;
+            case SOURCE_BURST:
+                scenario_add_burst(s, &edata, (int)(src->count * factor + 0.5), src->at_ms, src->radius);
+                break;
+        }
+    }
+    scenario_sort(s);
+}
+
+// Funzione che restituisce il tasso di Poisson offerto (richieste all'ora) con il fattore factor
+static double offered_per_hour(double factor) {
+    double rate = 0;
+    for (int i = 0; i < num_sources; ++i)
+        if (sources[i].kind == SOURCE_POISSON)
+            rate += sources[i].per_hour * factor;
+    return rate;
+}
+
+
+// Funzione che copia un file di configurazione in dir
+static void copy_conf(const char *name, const char *dir) {
+    char from[LOAD_PATH_SIZE + 64], to[LOAD_PATH_SIZE + 64];
+    snprintf(from, sizeof(from), "%s/%s", conf_dir, name);
+    snprintf(to, sizeof(to), "%s/%s", dir, name);
+    FILE *in = fopen(from, "r");
+    FILE *out = fopen(to, "w");
+    if (!in || !out) {
+        perror(in ? to : from);
+        exit(EXIT_FAILURE);
+    }
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0)
+        fwrite(buf, 1, n, out);
+    fclose(in);
+    fclose(out);
+}
+
+// Funzione che scrive l'env.conf della prova: le chiavi di -c dir, tranne
+// quelle che il harness imposta (coda propria, orologio, log binario dei soli
+// eventi di stato, nessun trace né socket delle metriche)
+static void write_env(const char *dir) {
+    static const char *overridden[] = {"queue", "clock", "clock_scale", "trace", "log_overflow", "log_format",
+                                       "log_level", "log_categories", "log_segment_mb", "metrics_socket"};
+    char from[LOAD_PATH_SIZE + 64], to[LOAD_PATH_SIZE + 64];
+    snprintf(from, sizeof(from), "%s/env.conf", conf_dir);
+    snprintf(to, sizeof(to), "%s/env.conf", dir);
+    FILE *in = fopen(from, "r");
+    FILE *out = fopen(to, "w");
+    if (!in || !out) {
+        perror(in ? to : from);
+        exit(EXIT_FAILURE);
+    }
+    char line[512];
+    while (fgets(line, sizeof(line), in)) {
+        int skip = 0;
+        size_t key_len = strcspn(line, "=");
+        for (size_t k = 0; k < sizeof(overridden) / sizeof(overridden[0]) && !skip; ++k)
+            skip = strlen(overridden[k]) == key_len && strncmp(line, overridden[k], key_len) == 0;
+        if (!skip) fputs(line, out);
+    }
+    fprintf(out, "queue=emsload%d\n", (int)getpid());
+    fprintf(out, "clock=%s\nclock_scale=%g\n", live ? "scaled" : "realtime", live ? scale : 1.0);
+    fprintf(out, "log_overflow=block\nlog_format=binary\nlog_level=state\n");
+    fprintf(out, "log_categories=emergency,rescuer\nlog_segment_mb=0\n");
+    fclose(in);
+    fclose(out);
+}
+
+// Funzione che scrive lo scenario come trace del replay, con le stesse
+// funzioni della cattura del server: l'orologio manuale viene portato
+// all'istante di ogni arrivo
+static void write_trace(const char *path, const scenario_t *s) {
+    trace_open(path, &rdata, &edata);
+    long long base = sim_now_ms();
+    for (int i = 0; i < s->count; ++i) {
+        const load_arrival_t *a = &s->arrivals[i];
+        sim_clock_set(base + a->at_ms);
+        emergency_request_withID_t req;
+        req.id = i + 1;
+        snprintf(req.req.emergency_name, sizeof(req.req.emergency_name), "%s", edata.types[a->type].emergency_desc);
+        req.req.x = a->x;
+        req.req.y = a->y;
+        req.req.timestamp = sim_now();
+        trace_record_request(&req);
+    }
+    trace_close();
+}
+
+// Funzione che avvia il server in dir con stdout e stderr su server.out
+static pid_t start_server(const char *dir) {
+    pid_t pid;
+    SCALL(pid, fork(), "errore in fork");
+    if (pid == 0) {
+        int fd;
+        if (chdir(dir) != 0 || (fd = open("server.out", O_CREAT | O_WRONLY | O_TRUNC, 0644)) == -1) {
+            perror(dir);
+            _exit(EXIT_FAILURE);
+        }
+        dup2(fd, STDOUT_FILENO);
+        dup2(fd, STDERR_FILENO);
+        close(fd);
+        if (live)
+            execl(server_path, server_path, (char *)NULL);
+        else
+            execl(server_path, server_path, "-r", "scenario.trace", "-o", "decisions.log", (char *)NULL);
+        perror(server_path);
+        _exit(EXIT_FAILURE);
+    }
+    return pid;
+}
+
+// Funzione che attende ms millisecondi reali
+static void sleep_ms(long long ms) {
+    nanosleep(&(struct timespec){.tv_sec = ms / 1000, .tv_nsec = (ms % 1000) * 1000000}, NULL);
+}
+
+// Funzione che restituisce l'istante monotono in millisecondi
+static long long mono_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+// Stato di uscita del server, quando è già stato raccolto
+static int server_reaped = 0;
+static int server_status = 0;
+
+// Funzione che restituisce 1 se il server è ancora in esecuzione
+static int server_running(pid_t pid) {
+    if (!server_reaped && waitpid(pid, &server_status, WNOHANG) == pid)
+        server_reaped = 1;
+    return !server_reaped;
+}
+
+// Funzione che invia lo scenario sulla coda del server in tempo reale
+// (at_ms / scala), nel formato del client, e attende che tutte le emergenze
+// si concludano nel log. Restituisce 0, oppure -1 se il server termina prima.
+static int drive_live(pid_t pid, const scenario_t *s, sla_t *sla, const char *evlog) {
+    char queue[64];
+    snprintf(queue, sizeof(queue), "/emsload%d", (int)getpid());
+    mqd_t mq = (mqd_t)-1;
+    long long start = mono_ms();
+    while ((mq = mq_open(queue, O_WRONLY)) == (mqd_t)-1) {
+        if (!server_running(pid) || mono_ms() - start > LOAD_START_MS) {
+            fprintf(stderr, "Il server non ha creato la coda %s\n", queue);
+            return -1;
+        }
+        sleep_ms(10);
+    }
+
+    start = mono_ms();
+    for (int i = 0; i < s->count; ++i) {
+        const load_arrival_t *a = &s->arrivals[i];
+        long long due = start + (long long)(a->at_ms / scale);
+        long long now = mono_ms();
+        if (due > now) sleep_ms(due - now);
+        // Il log si consuma anche durante l'invio, per non rileggerlo tutto alla fine
+        sla_feed(sla, evlog);
+        char msg[LOAD_MSG_SIZE];
+        snprintf(msg, sizeof(msg), "%s %d %d %ld", edata.types[a->type].emergency_desc, a->x, a->y, (long)time(NULL));
+        if (mq_send(mq, msg, strlen(msg) + 1, 0) == -1) {
+            perror("mq_send");
+            mq_close(mq);
+            return -1;
+        }
+    }
+    mq_close(mq);
+
+    // Smaltimento: fino alla conclusione di tutte le emergenze inviate
+    long long limit = drain_ms >= 0 ? drain_ms : (long long)(3600 * 1000 / scale);
+    long long sent = mono_ms();
+    for (;;) {
+        sla_feed(sla, evlog);
+        if (sla->received >= (unsigned long)s->count && sla_open(sla) == 0)
+            break;
+        if (!server_running(pid)) {
+            fprintf(stderr, "Il server è terminato durante la prova\n");
+            return -1;
+        }
+        if (mono_ms() - sent > limit) {
+            fprintf(stderr, "Smaltimento interrotto dopo %lld ms: %lu emergenze ancora aperte\n",
+                    limit, sla_open(sla) + (unsigned long)s->count - sla->received);
+            break;
+        }
+        sleep_ms(LOAD_POLL_MS);
+    }
+    kill(pid, SIGINT);
+    return 0;
+}
+
+// Funzione che esegue una prova: prepara la directory, avvia il server, gli
+// fa eseguire lo scenario e legge il log in sla. Restituisce 0 in caso di successo.
+static int load_run(const scenario_t *s, sla_t *sla) {
+    char dir[] = "/tmp/ems-load-XXXXXX";
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        exit(EXIT_FAILURE);
+    }
+    char path[LOAD_PATH_SIZE], evlog[LOAD_PATH_SIZE];
+    copy_conf("rescuers.conf", dir);
+    copy_conf("emergency_types.conf", dir);
+    write_env(dir);
+    snprintf(evlog, sizeof(evlog), "%s/emergency.evlog", dir);
+    if (!live) {
+        snprintf(path, sizeof(path), "%s/scenario.trace", dir);
+        write_trace(path, s);
+    }
+
+    server_reaped = 0;
+    pid_t pid = start_server(dir);
+    int rc = live ? drive_live(pid, s, sla, evlog) : 0;
+    if (rc != 0 && server_running(pid)) kill(pid, SIGKILL);
+    if (!server_reaped && waitpid(pid, &server_status, 0) == -1) {
+        perror("errore in waitpid");
+        exit(EXIT_FAILURE);
+    }
+    // Il replay termina con errore se restano emergenze aperte
+    if (!WIFEXITED(server_status) || WEXITSTATUS(server_status) != 0) {
+        fprintf(stderr, "Il server è terminato con stato %d (vedi %s/server.out)\n",
+                WIFEXITED(server_status) ? WEXITSTATUS(server_status) : -1, dir);
+        rc = -1;
+        keep = 1;
+    }
+    sla_feed(sla, evlog);
+
+    static const char *files[] = {"env.conf", "rescuers.conf", "emergency_types.conf", "scenario.trace",
+                                  "decisions.log", "emergency.log", "emergency.evlog", "server.out"};
+    if (!keep) {
+        for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); ++i) {
+            snprintf(path, sizeof(path), "%s/%s", dir, files[i]);
+            unlink(path);
+        }
+        rmdir(dir);
+    } else {
+        fprintf(stderr, "Configurazioni, log e uscita del server conservati in %s\n", dir);
+    }
+    return rc;
+}
+
+
+int main(int argc, char *argv[]) {
+    const char *conf = "..";
+    const char *server = NULL;
+    const char *factors = NULL;
+    double threshold = LOAD_DEFAULT_THRESHOLD;
+    unsigned seed = LOAD_SEED;
+    int opt;
+    while ((opt = getopt(argc, argv, "c:e:m:x:f:p:b:S:R:T:w:k")) != -1) {
+        switch (opt) {
+            case 'c': conf = optarg; break;
+            case 'e': server = optarg; break;
+            case 'm':
+                if (strcmp(optarg, "live") == 0) live = 1;
+                else if (strcmp(optarg, "replay") == 0) live = 0;
+                else usage(argv[0]);
+                break;
+            case 'x': scale = atof(optarg); break;
+            case 'f': {
+                load_source_t *src = add_source(argv[0]);
+                src->kind = SOURCE_SCRIPT;
+                src->path = optarg;
+                break;
+            }
+            case 'p': parse_poisson(argv[0], optarg); break;
+            case 'b': parse_burst(argv[0], optarg); break;
+            case 'S': seed = (unsigned)strtoul(optarg, NULL, 10); break;
+            case 'R': factors = optarg; break;
+            case 'T': threshold = atof(optarg); break;
+            case 'w': drain_ms = atoll(optarg) * 1000; break;
+            case 'k': keep = 1; break;
+            default: usage(argv[0]);
+        }
+    }
+    if (num_sources == 0 || scale <= 0) usage(argv[0]);
+
+    // Configurazioni e server con percorsi assoluti: il server gira nella directory della prova
+    char server_rel[LOAD_PATH_SIZE + 8];
+    snprintf(server_rel, sizeof(server_rel), "%s/main", conf);
+    if (!realpath(conf, conf_dir) || !realpath(server ? server : server_rel, server_path) ||
+        access(server_path, X_OK) != 0) {
+        perror(server ? server : server_rel);
+        exit(EXIT_FAILURE);
+    }
+
+    // Le configurazioni servono per tipi, griglia e flotta dello scenario;
+    // l'orologio manuale dà gli istanti degli arrivi scritti nel trace
+    sim_clock_init(SIM_CLOCK_MANUAL, 1.0);
+    char path[LOAD_PATH_SIZE + 64];
+    snprintf(path, sizeof(path), "%s/env.conf", conf_dir);
+    if (parse_env(path, &env) != 0) exit(EXIT_FAILURE);
+    snprintf(path, sizeof(path), "%s/rescuers.conf", conf_dir);
+    if (parse_rescuers(path, &rdata) != 0) exit(EXIT_FAILURE);
+    snprintf(path, sizeof(path), "%s/emergency_types.conf", conf_dir);
+    if (parse_emergency_types(path, &rdata, &edata) != 0) exit(EXIT_FAILURE);
+
+    sla_t *sla;
+    SNCALL(sla, malloc(sizeof(sla_t)), "malloc sla");
+    int rc = 0;
+    if (!factors) {
+        // Prova singola: rapporto completo
+        scenario_t s;
+        build_scenario(&s, seed, 1.0);
+        printf("Scenario: %d richieste in %.1f s di tempo virtuale, modo %s",
+               s.count, scenario_end_ms(&s) / 1000.0, live ? "live" : "replay");
+        if (live) printf(" (scala %g)", scale);
+        printf("\n");
+        fflush(stdout);
+        sla_init(sla);
+        rc = load_run(&s, sla);
+        sla_print_report(sla, stdout);
+        free_sla(sla);
+        free_scenario(&s);
+    } else {
+        // Serie di prove a carico crescente: una riga per fattore
+        char *list;
+        SNCALL(list, strdup(factors), "strdup factors");
+        double ceiling = -1;
+        sla_print_sweep_header(stdout);
+        char *save = NULL;
+        for (char *f = strtok_r(list, ",", &save); f; f = strtok_r(NULL, ",", &save)) {
+            double factor = atof(f);
+            scenario_t s;
+            build_scenario(&s, seed, factor);
+            sla_init(sla);
+            if (load_run(&s, sla) != 0) rc = -1;
+            sla_print_sweep_row(sla, stdout, factor, offered_per_hour(factor));
+            fflush(stdout);
+            if (100.0 * sla_timeout_rate(sla) <= threshold && sla_open(sla) == 0 && factor > ceiling)
+                ceiling = factor;
+            free_sla(sla);
+            free_scenario(&s);
+        }
+        free(list);
+        if (ceiling >= 0)
+            printf("Tetto misurato: fattore %.2f (%.1f richieste/h di Poisson) con TIMEOUT entro il %.1f%%\n",
+                   ceiling, offered_per_hour(ceiling), threshold);
+        else
+            printf("Nessun fattore con TIMEOUT entro il %.1f%%\n", threshold);
+    }
+    free(sla);
+
+    free_env_config(&env);
+    free_emergency_types(&edata);
+    free_rescuers_data(&rdata);
+    return rc == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,178 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "scall.h"
+#include "scenario.h"
+
+#define SCENARIO_LINE_SIZE 512
+#define SCENARIO_NAME_SIZE 64
+
+// Generatore pseudo-casuale xorshift32, riproducibile tra piattaforme
+static unsigned scenario_next(scenario_t *s) {
+    unsigned x = s->seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return s->seed = x;
+}
+
+// Funzione che restituisce un intero in [0, n)
+static int scenario_range(scenario_t *s, int n) {
+    return n > 0 ? (int)(scenario_next(s) % (unsigned)n) : 0;
+}
+
+// Funzione che restituisce un reale uniforme in (0, 1]: mai 0, di cui
+// scenario_add_poisson calcola il logaritmo
+static double scenario_uniform(scenario_t *s) {
+    return (scenario_next(s) + 1.0) / 4294967296.0;
+}
+
+// Funzione che accoda un arrivo, ingrandendo l'elenco quando serve
+static void scenario_push(scenario_t *s, long long at_ms, int type, int x, int y) {
+    if (s->count == s->capacity) {
+        s->capacity = s->capacity ? s->capacity * 2 : 256;
+        SNCALL(s->arrivals, realloc(s->arrivals, sizeof(load_arrival_t) * s->capacity), "realloc scenario");
+    }
+    s->arrivals[s->count++] = (load_arrival_t){.at_ms = at_ms, .type = type, .x = x, .y = y};
+}
+
+// Funzione che restituisce l'indice del tipo di emergenza name (-1 se assente)
+static int scenario_type(const emergency_data_t *edata, const char *name) {
+    for (int i = 0; i < edata->num_types; ++i)
+        if (strcmp(edata->types[i].emergency_desc, name) == 0)
+            return i;
+    return -1;
+}
+
+void scenario_init(scenario_t *s, int max_x, int max_y, unsigned seed) {
+    s->arrivals = NULL;
+    s->count = 0;
+    s->capacity = 0;
+    s->max_x = max_x;
+    s->max_y = max_y;
+    s->seed = seed ? seed : 1;
+}
+
+// Funzione che aggiunge le righe di uno script nel formato di Client/input.txt.
+// Le righe malformate o con un tipo sconosciuto vengono saltate, come fa il client
+// (il server le scarterebbe). Restituisce 0 in caso di successo, -1 se il file non si apre.
+int scenario_add_script(scenario_t *s, const char *path, const emergency_data_t *edata) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    char line[SCENARIO_LINE_SIZE];
+    char name[SCENARIO_NAME_SIZE];
+    long long at_ms = 0;
+    int x, y, delay, line_no = 0;
+    while (fgets(line, sizeof(line), f)) {
+        line_no++;
+        if (sscanf(line, "%63s %d %d %d", name, &x, &y, &delay) != 4)
+            continue;
+        at_ms += (long long)delay * 1000;
+        int type = scenario_type(edata, name);
+        if (type < 0) {
+            fprintf(stderr, "%s:%d: tipo di emergenza %s sconosciuto, riga saltata\n", path, line_no, name);
+            continue;
+        }
+        if (x < 0 || x > s->max_x || y < 0 || y > s->max_y) {
+            fprintf(stderr, "%s:%d: coordinate (%d,%d) fuori dalla griglia, riga saltata\n", path, line_no, x, y);
+            continue;
+        }
+        scenario_push(s, at_ms, type, x, y);
+    }
+    fclose(f);
+    return 0;
+}
+
+// Funzione che aggiunge arrivi di Poisson con tasso per_hour richieste all'ora
+// per duration_ms millisecondi: intervalli esponenziali, tipo e posizione uniformi
+void scenario_add_poisson(scenario_t *s, const emergency_data_t *edata, double per_hour, long long duration_ms) {
+    if (per_hour <= 0) return;
+    double mean_ms = 3600.0 * 1000.0 / per_hour;
+    double at = 0;
+    for (;;) {
+        at += -log(scenario_uniform(s)) * mean_ms;
+        if (at >= duration_ms) break;
+        scenario_push(s, (long long)at, scenario_range(s, edata->num_types),
+                      scenario_range(s, s->max_x + 1), scenario_range(s, s->max_y + 1));
+    }
+}
+
+// Funzione che aggiunge una raffica di count richieste all'istante at_ms,
+// entro radius dal centro scelto a caso (posizioni ricondotte nella griglia)
+void scenario_add_burst(scenario_t *s, const emergency_data_t *edata, int count, long long at_ms, int radius) {
+    int cx = scenario_range(s, s->max_x + 1);
+    int cy = scenario_range(s, s->max_y + 1);
+    for (int i = 0; i < count; ++i) {
+        int x = cx + scenario_range(s, 2 * radius + 1) - radius;
+        int y = cy + scenario_range(s, 2 * radius + 1) - radius;
+        x = x < 0 ? 0 : x > s->max_x ? s->max_x : x;
+        y = y < 0 ? 0 : y > s->max_y ? s->max_y : y;
+        scenario_push(s, at_ms, scenario_range(s, edata->num_types), x, y);
+    }
+}
+
+// Chiave di ordinamento: istante di arrivo e posizione di inserimento
+typedef struct {
+    long long at_ms;
+    int index;
+} arrival_key_t;
+
+// Confronto per istante di arrivo; a parità vale l'ordine di inserimento
+static int cmp_arrival_key(const void *a, const void *b) {
+    const arrival_key_t *x = a, *y = b;
+    if (x->at_ms != y->at_ms) return x->at_ms < y->at_ms ? -1 : 1;
+    return (x->index > y->index) - (x->index < y->index);
+}
+
+// Funzione che ordina gli arrivi per istante di invio (ordinamento stabile:
+// le richieste di una raffica o di uno script restano nel loro ordine)
+void scenario_sort(scenario_t *s) {
+    if (s->count == 0) return;
+    arrival_key_t *keys;
+    load_arrival_t *sorted;
+    SNCALL(keys, malloc(sizeof(arrival_key_t) * s->count), "malloc scenario sort");
+    SNCALL(sorted, malloc(sizeof(load_arrival_t) * s->count), "malloc scenario sort");
+    for (int i = 0; i < s->count; ++i)
+        keys[i] = (arrival_key_t){.at_ms = s->arrivals[i].at_ms, .index = i};
+    qsort(keys, s->count, sizeof(arrival_key_t), cmp_arrival_key);
+    for (int i = 0; i < s->count; ++i)
+        sorted[i] = s->arrivals[keys[i].index];
+    free(keys);
+    free(s->arrivals);
+    s->arrivals = sorted;
+    s->capacity = s->count;
+}
+
+// Funzione che restituisce l'istante dell'ultimo arrivo (scenario ordinato)
+long long scenario_end_ms(const scenario_t *s) {
+    return s->count > 0 ? s->arrivals[s->count - 1].at_ms : 0;
+}
+
+void free_scenario(scenario_t *s) {
+    free(s->arrivals);
+    s->arrivals = NULL;
+    s->count = s->capacity = 0;
+}
+
+// Funzione che converte una durata con suffisso opzionale (s, m, h, d; senza
+// suffisso sono secondi) in millisecondi. Restituisce -1 se il formato non è valido.
+long long parse_duration_ms(const char *text) {
+    char *end;
+    double value = strtod(text, &end);
+    if (end == text || value < 0) return -1;
+    double unit = 1000;
+    switch (*end) {
+        case '\0': case 's': break;
+        case 'm': unit = 60 * 1000.0; break;
+        case 'h': unit = 3600 * 1000.0; break;
+        case 'd': unit = 86400 * 1000.0; break;
+        default: return -1;
+    }
+    if (*end && end[1] != '\0') return -1;
+    return (long long)(value * unit);
+}
@@ -0,0 +1,42 @@
+#ifndef SCENARIO_H
+#define SCENARIO_H
+
+#include "emergency_types.h"
+
+// Scenario di carico: elenco delle richieste da inviare al server, con
+// l'istante di invio in millisecondi di tempo virtuale dall'inizio della
+// prova. Le sorgenti si possono combinare, gli arrivi vengono poi ordinati:
+//  - script nel formato di Client/input.txt ("Tipo x y ritardo", il ritardo
+//    in secondi precede l'invio della riga, come nel client)
+//  - carico di Poisson: arrivi con tasso costante (richieste all'ora) per una
+//    durata, tipo e posizione uniformi
+//  - raffica: count richieste nello stesso istante, raccolte in un raggio
+//    attorno ad un punto casuale (es. una calamità)
+// La generazione è deterministica per un dato seed.
+
+typedef struct {
+    long long at_ms;
+    int type;   // indice in emergency_data_t.types
+    int x;
+    int y;
+} load_arrival_t;
+
+typedef struct {
+    load_arrival_t *arrivals;
+    int count;
+    int capacity;
+    int max_x;   // limiti delle posizioni generate, come in validate_MQrequest
+    int max_y;   // (x <= height, y <= width di env.conf)
+    unsigned seed;
+} scenario_t;
+
+void scenario_init(scenario_t *s, int max_x, int max_y, unsigned seed);
+int scenario_add_script(scenario_t *s, const char *path, const emergency_data_t *edata);
+void scenario_add_poisson(scenario_t *s, const emergency_data_t *edata, double per_hour, long long duration_ms);
+void scenario_add_burst(scenario_t *s, const emergency_data_t *edata, int count, long long at_ms, int radius);
+void scenario_sort(scenario_t *s);
+long long scenario_end_ms(const scenario_t *s);
+void free_scenario(scenario_t *s);
+long long parse_duration_ms(const char *text);
+
+#endif
@@ -0,0 +1,329 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "scall.h"
+#include "sla.h"
+
+// Percentili riportati nelle tabelle dei tempi di risposta
+static const double sla_pct[] = {50, 90, 99};
+#define SLA_PCT_COUNT 3
+
+static const char *phase_names[2] = {"assegnazione", "sul posto"};
+
+
+void sla_init(sla_t *sla) {
+    sla->in = NULL;
+    sla->offset = 0;
+    log_names_init(&sla->names);
+    sla->em = NULL;
+    sla->em_capacity = 0;
+    for (int i = 0; i <= MAX_TWINS; ++i) {
+        sla->busy_since[i] = -1;
+        sla->busy_total[i] = 0;
+    }
+    sla->last_time = 0;
+    sla->first_mono = sla->last_mono = 0;
+    sla->records = sla->received = sla->completed = sla->paused = 0;
+    memset(sla->timeouts, 0, sizeof(sla->timeouts));
+    memset(sla->by_priority, 0, sizeof(sla->by_priority));
+}
+
+void free_sla(sla_t *sla) {
+    if (sla->in) fclose(sla->in);
+    sla->in = NULL;
+    log_names_free(&sla->names);
+    free(sla->em);
+    sla->em = NULL;
+    sla->em_capacity = 0;
+}
+
+// Funzione che restituisce l'emergenza id, ingrandendo la tabella quando serve
+// (NULL per id non validi)
+static sla_emergency_t *sla_emergency(sla_t *sla, int id) {
+    if (id < 1) return NULL;
+    if (id >= sla->em_capacity) {
+        int capacity = sla->em_capacity ? sla->em_capacity : 1024;
+        while (capacity <= id) capacity *= 2;
+        SNCALL(sla->em, realloc(sla->em, sizeof(sla_emergency_t) * capacity), "realloc sla");
+        for (int i = sla->em_capacity; i < capacity; ++i)
+            sla->em[i] = (sla_emergency_t){.priority = -1, .origin = 0, .assigned = -1,
+                                           .on_scene = -1, .outcome = SLA_OPEN};
+        sla->em_capacity = capacity;
+    }
+    return &sla->em[id];
+}
+
+// Funzione che legge l'argomento int32 in posizione i del payload (0 se assente)
+static int sla_arg(const log_bin_header_t *h, const unsigned char *payload, int i) {
+    int32_t v = 0;
+    if ((size_t)(i + 1) * sizeof(int32_t) <= h->payload_len)
+        memcpy(&v, payload + i * sizeof(int32_t), sizeof(int32_t));
+    return v;
+}
+
+// Funzione che chiude un'emergenza con il suo esito (solo il primo conta)
+static void sla_close(sla_t *sla, sla_emergency_t *e, sla_outcome_t outcome) {
+    if (e->outcome != SLA_OPEN) return;
+    e->outcome = outcome;
+    if (outcome == SLA_COMPLETED) {
+        sla->completed++;
+    } else if (e->priority >= 0 && e->priority < SLA_PRIORITIES) {
+        sla->timeouts[e->priority][outcome == SLA_TIMEOUT_REACH ? 0 : 1]++;
+    }
+}
+
+// Funzione che aggiorna lo stato ricostruito con un record del log
+static void sla_apply(sla_t *sla, const log_bin_header_t *h, const unsigned char *payload) {
+    char line[LOG_LINE_MAX];
+    int t = h->time;
+    if (t > sla->last_time) sla->last_time = t;
+    if (sla->records++ == 0) sla->first_mono = h->mono_ns;
+    sla->last_mono = h->mono_ns;
+    sla_emergency_t *e = sla_emergency(sla, h->emergency_id);
+    int twin = h->twin_id;
+
+    switch (h->code) {
+        case LOG_EV_SESSION:
+        case LOG_EV_RESCUER_TYPE:
+        case LOG_EV_FLEET:
+            // Dichiarazioni: aggiornano i nomi dei tipi e dei twin
+            log_render(&sla->names, h, payload, line, sizeof(line));
+            break;
+        case LOG_EV_EM_RECEIVED:
+            if (!e) break;
+            e->priority = sla_arg(h, payload, 0);
+            e->origin = t - sla_arg(h, payload, 1);
+            sla->received++;
+            if (e->priority >= 0 && e->priority < SLA_PRIORITIES)
+                sla->by_priority[e->priority]++;
+            break;
+        case LOG_EV_EM_ASSIGNED:
+        case LOG_EV_EM_PARTIAL:
+            if (e && e->assigned < 0) e->assigned = t;
+            break;
+        case LOG_EV_EM_IN_PROGRESS:
+            if (e && e->on_scene < 0) e->on_scene = t;
+            break;
+        case LOG_EV_EM_PAUSED:
+            sla->paused++;
+            break;
+        case LOG_EV_EM_COMPLETED:
+            if (e) sla_close(sla, e, SLA_COMPLETED);
+            break;
+        case LOG_EV_EM_TIMEOUT_REACH:
+            if (e) sla_close(sla, e, SLA_TIMEOUT_REACH);
+            break;
+        case LOG_EV_EM_TIMEOUT_DEADLINE:
+            if (e) sla_close(sla, e, SLA_TIMEOUT_DEADLINE);
+            break;
+        case LOG_EV_TW_ASSIGNED:
+        case LOG_EV_TW_TAKEN_OVER:
+            if (twin >= 1 && twin <= MAX_TWINS && sla->busy_since[twin] < 0)
+                sla->busy_since[twin] = t;
+            break;
+        case LOG_EV_TW_IDLE:
+        case LOG_EV_TW_IDLE_PAUSED:
+            if (twin >= 1 && twin <= MAX_TWINS && sla->busy_since[twin] >= 0) {
+                sla->busy_total[twin] += t - sla->busy_since[twin];
+                sla->busy_since[twin] = -1;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+// Funzione che legge i record completi aggiunti al log da path dopo l'ultima
+// lettura. Restituisce il numero di record letti (0 se il file non esiste ancora).
+int sla_feed(sla_t *sla, const char *path) {
+    if (!sla->in && !(sla->in = fopen(path, "rb")))
+        return 0;
+    if (fseek(sla->in, sla->offset, SEEK_SET) != 0) {
+        perror("fseek log");
+        return 0;
+    }
+    log_bin_header_t h;
+    unsigned char payload[LOG_BIN_PAYLOAD_MAX];
+    int count = 0;
+    while (fread(&h, sizeof(h), 1, sla->in) == 1) {
+        // Record ancora in scrittura: si riprende dalla sua intestazione
+        if (h.payload_len > sizeof(payload) || fread(payload, 1, h.payload_len, sla->in) != h.payload_len)
+            break;
+        sla_apply(sla, &h, payload);
+        sla->offset = ftell(sla->in);
+        count++;
+    }
+    return count;
+}
+
+// Funzione che restituisce le emergenze ricevute e non ancora concluse
+unsigned long sla_open(const sla_t *sla) {
+    unsigned long closed = sla->completed;
+    for (int p = 0; p < SLA_PRIORITIES; ++p)
+        closed += sla->timeouts[p][0] + sla->timeouts[p][1];
+    return sla->received > closed ? sla->received - closed : 0;
+}
+
+// Funzione che restituisce la frazione di emergenze ricevute finite in TIMEOUT
+double sla_timeout_rate(const sla_t *sla) {
+    unsigned long timeouts = 0;
+    for (int p = 0; p < SLA_PRIORITIES; ++p)
+        timeouts += sla->timeouts[p][0] + sla->timeouts[p][1];
+    return sla->received ? (double)timeouts / sla->received : 0.0;
+}
+
+static int cmp_int(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+// Funzione che raccoglie e ordina i tempi di una fase (0 assegnazione,
+// 1 sul posto) per le emergenze di priorità priority. Restituisce quanti sono.
+static int sla_collect(const sla_t *sla, int priority, int phase, int *values) {
+    int n = 0;
+    for (int id = 1; id < sla->em_capacity; ++id) {
+        const sla_emergency_t *e = &sla->em[id];
+        int at = phase == 0 ? e->assigned : e->on_scene;
+        if (e->priority == priority && at >= 0)
+            values[n++] = at - e->origin;
+    }
+    qsort(values, n, sizeof(int), cmp_int);
+    return n;
+}
+
+// Funzione che restituisce il percentile pct di n valori ordinati (nearest rank)
+static int sla_percentile(const int *values, int n, double pct) {
+    int rank = (int)(pct / 100.0 * n + 0.999999);
+    if (rank < 1) rank = 1;
+    return values[rank - 1];
+}
+
+// Funzione che calcola l'utilizzo dei twin per nome di tipo: usage[k] e
+// twins[k] sono riferiti al primo indice di tipo con quel nome.
+// Restituisce l'utilizzo massimo, con il suo tipo in *bottleneck.
+static double sla_usage(const sla_t *sla, double *usage, int *twins, int *bottleneck) {
+    const log_names_t *names = &sla->names;
+    int first[MAX_TYPES];
+    for (int k = 0; k < MAX_TYPES; ++k) {
+        usage[k] = 0;
+        twins[k] = 0;
+        first[k] = k;
+        for (int j = 0; j < k && names->type_names[k]; ++j)
+            if (names->type_names[j] && strcmp(names->type_names[j], names->type_names[k]) == 0) {
+                first[k] = j;
+                break;
+            }
+    }
+    for (int id = 1; id <= MAX_TWINS; ++id) {
+        int type = names->twin_type[id];
+        if (type < 0) continue;
+        long long busy = sla->busy_total[id];
+        if (sla->busy_since[id] >= 0) busy += sla->last_time - sla->busy_since[id];
+        usage[first[type]] += busy;
+        twins[first[type]]++;
+    }
+    double max = 0;
+    *bottleneck = -1;
+    for (int k = 0; k < MAX_TYPES; ++k) {
+        if (twins[k] == 0) continue;
+        usage[k] = sla->last_time > 0 ? usage[k] / ((double)twins[k] * sla->last_time) : 0;
+        if (usage[k] > max || *bottleneck < 0) {
+            max = usage[k];
+            *bottleneck = k;
+        }
+    }
+    return max;
+}
+
+// Funzione che stampa il rapporto SLA completo
+void sla_print_report(sla_t *sla, FILE *out) {
+    double hours = sla->last_time / 3600.0;
+    unsigned long timeouts = 0;
+    for (int p = 0; p < SLA_PRIORITIES; ++p)
+        timeouts += sla->timeouts[p][0] + sla->timeouts[p][1];
+
+    fprintf(out, "===== Rapporto SLA =====\n");
+    fprintf(out, "Tempo simulato: %d s (%.1f h), %lu record del log\n", sla->last_time, hours, sla->records);
+    fprintf(out, "Emergenze: %lu ricevute, %lu completate, %lu in TIMEOUT, %lu aperte al termine, %lu sospensioni\n",
+            sla->received, sla->completed, timeouts, sla_open(sla), sla->paused);
+
+    // Tempi di risposta per priorità, dalla richiesta
+    int *values;
+    SNCALL(values, malloc(sizeof(int) * (sla->em_capacity > 0 ? sla->em_capacity : 1)), "malloc sla values");
+    fprintf(out, "Tempi di risposta (s dalla richiesta)\n");
+    fprintf(out, "%-9s %-13s %8s %7s %7s %7s %7s\n", "priorita'", "fase", "n", "p50", "p90", "p99", "max");
+    for (int p = SLA_PRIORITIES - 1; p >= 0; --p) {
+        for (int phase = 0; phase < 2; ++phase) {
+            int n = sla_collect(sla, p, phase, values);
+            fprintf(out, "%-9d %-13s %8d", p, phase_names[phase], n);
+            for (int k = 0; k < SLA_PCT_COUNT; ++k) {
+                if (n > 0) fprintf(out, " %7d", sla_percentile(values, n, sla_pct[k]));
+                else fprintf(out, " %7s", "-");
+            }
+            if (n > 0) fprintf(out, " %7d\n", values[n - 1]);
+            else fprintf(out, " %7s\n", "-");
+        }
+    }
+    free(values);
+
+    // TIMEOUT per causa
+    fprintf(out, "TIMEOUT per causa\n");
+    fprintf(out, "%-9s %8s %9s %8s %9s %8s\n", "priorita'", "ricevute", "distanza", "%", "carenza", "%");
+    for (int p = SLA_PRIORITIES - 1; p >= 0; --p) {
+        unsigned long n = sla->by_priority[p];
+        fprintf(out, "%-9d %8lu %9lu %7.1f%% %9lu %7.1f%%\n", p, n,
+                sla->timeouts[p][0], n ? 100.0 * sla->timeouts[p][0] / n : 0.0,
+                sla->timeouts[p][1], n ? 100.0 * sla->timeouts[p][1] / n : 0.0);
+    }
+
+    // Utilizzo della flotta per nome di tipo
+    double usage[MAX_TYPES];
+    int twins[MAX_TYPES];
+    int bottleneck;
+    double max_usage = sla_usage(sla, usage, twins, &bottleneck);
+    fprintf(out, "Utilizzo dei twin (tempo fuori da IDLE)\n");
+    fprintf(out, "%-22s %6s %8s\n", "tipo", "twin", "utilizzo");
+    for (int k = 0; k < MAX_TYPES; ++k)
+        if (twins[k] > 0)
+            fprintf(out, "%-22s %6d %7.1f%%\n", sla->names.type_names[k] ? sla->names.type_names[k] : "?",
+                    twins[k], 100.0 * usage[k]);
+
+    // Throughput: carico offerto e smaltito in tempo virtuale, tetto stimato
+    // dal tipo più utilizzato, velocità di elaborazione in tempo reale
+    double offered = hours > 0 ? sla->received / hours : 0;
+    double wall = (sla->last_mono - sla->first_mono) / 1e9;
+    fprintf(out, "Throughput\n");
+    fprintf(out, "  offerto:      %.1f emergenze/h\n", offered);
+    fprintf(out, "  completato:   %.1f emergenze/h\n", hours > 0 ? sla->completed / hours : 0.0);
+    if (bottleneck >= 0 && max_usage > 0)
+        fprintf(out, "  tetto stimato: %.1f emergenze/h (%s al %.1f%%)\n", offered / max_usage,
+                sla->names.type_names[bottleneck] ? sla->names.type_names[bottleneck] : "?", 100.0 * max_usage);
+    fprintf(out, "  elaborazione: %.3f s reali (%.1fx il tempo reale, %.0f emergenze/s)\n", wall,
+            wall > 0 ? sla->last_time / wall : 0.0, wall > 0 ? sla->received / wall : 0.0);
+}
+
+// Funzione che stampa l'intestazione della tabella di una serie di prove (-R)
+void sla_print_sweep_header(FILE *out) {
+    fprintf(out, "%-8s %10s %9s %9s %8s %11s %11s %9s\n", "fattore", "offerto/h", "ricevute",
+            "completate", "timeout", "p99 ass. 2", "p99 posto 2", "utilizzo");
+}
+
+// Funzione che stampa la riga riassuntiva di una prova della serie
+void sla_print_sweep_row(sla_t *sla, FILE *out, double factor, double offered_per_hour) {
+    int *values;
+    SNCALL(values, malloc(sizeof(int) * (sla->em_capacity > 0 ? sla->em_capacity : 1)), "malloc sla values");
+    char p99[2][16];
+    for (int phase = 0; phase < 2; ++phase) {
+        int n = sla_collect(sla, SLA_PRIORITIES - 1, phase, values);
+        if (n > 0) snprintf(p99[phase], sizeof(p99[phase]), "%d", sla_percentile(values, n, 99));
+        else snprintf(p99[phase], sizeof(p99[phase]), "-");
+    }
+    free(values);
+    double usage[MAX_TYPES];
+    int twins[MAX_TYPES];
+    int bottleneck;
+    double max_usage = sla_usage(sla, usage, twins, &bottleneck);
+    fprintf(out, "%-8.2f %10.1f %9lu %9lu %7.1f%% %11s %11s %8.1f%%\n", factor, offered_per_hour,
+            sla->received, sla->completed, 100.0 * sla_timeout_rate(sla), p99[0], p99[1], 100.0 * max_usage);
+}
@@ -0,0 +1,64 @@
+#ifndef SLA_H
+#define SLA_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "logfmt.h"
+
+// Rapporto SLA ricavato dal log binario del server (emergency.evlog, logfmt.h).
+// Il log si legge anche mentre il server lo scrive: sla_feed consuma solo i
+// record completi e riprende dal primo incompleto alla chiamata successiva.
+// I tempi del log sono secondi di tempo virtuale, per cui i percentili hanno
+// la risoluzione di un secondo:
+//  - tempo di assegnazione: dalla richiesta (EM_RECEIVED meno l'età) al primo
+//    ASSIGNED o assegnazione parziale
+//  - tempo di arrivo sul posto: dalla richiesta al primo IN_PROGRESS (tutti i twin sul posto)
+//  - TIMEOUT per causa: distanza (check_reachability) o carenza (check_deadline)
+//  - utilizzo dei twin: frazione del tempo fuori da IDLE, per nome di tipo
+//  - throughput: carico offerto e smaltito, e tetto stimato dal tipo più
+//    utilizzato (il carico con cui arriverebbe al 100%)
+
+// Priorità distinte nei rapporti (0..2, come in check_deadline)
+#define SLA_PRIORITIES 3
+
+typedef enum {
+    SLA_OPEN,
+    SLA_COMPLETED,
+    SLA_TIMEOUT_REACH,
+    SLA_TIMEOUT_DEADLINE
+} sla_outcome_t;
+
+// Emergenza ricostruita dagli eventi del log (tempi in secondi dal tempo base)
+typedef struct {
+    int priority;   // -1 se l'arrivo non è nel log
+    int origin;     // istante della richiesta
+    int assigned;   // -1 finché non viene assegnata
+    int on_scene;   // -1 finché non è IN_PROGRESS
+    int outcome;    // sla_outcome_t
+} sla_emergency_t;
+
+typedef struct {
+    FILE *in;
+    long offset;              // inizio del primo record non ancora letto
+    log_names_t names;        // tipi e flotta dichiarati nel log
+    sla_emergency_t *em;      // indice = id dell'emergenza
+    int em_capacity;
+    int busy_since[MAX_TWINS + 1];        // -1 se il twin è IDLE
+    long long busy_total[MAX_TWINS + 1];  // secondi fuori da IDLE
+    int last_time;
+    uint64_t first_mono, last_mono;       // istanti reali del primo e dell'ultimo record
+    unsigned long records, received, completed, paused;
+    unsigned long timeouts[SLA_PRIORITIES][2];  // per priorità: distanza, carenza
+    unsigned long by_priority[SLA_PRIORITIES];
+} sla_t;
+
+void sla_init(sla_t *sla);
+int sla_feed(sla_t *sla, const char *path);
+unsigned long sla_open(const sla_t *sla);
+double sla_timeout_rate(const sla_t *sla);
+void sla_print_report(sla_t *sla, FILE *out);
+void sla_print_sweep_header(FILE *out);
+void sla_print_sweep_row(sla_t *sla, FILE *out, double factor, double offered_per_hour);
+void free_sla(sla_t *sla);
+
+#endif
@@ -0,0 +1,193 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include "scall.h"
+#include "logger.h"
+#include "env.h"
+#include "rescuers.h"
+#include "emergency_types.h"
+#include "emergency.h"
+#include "worker_thread.h"
+#include "intent.h"
+#include "reach.h"
+#include "fleet.h"
+#include "event.h"
+#include "simclock.h"
+
+// Test di regressione della preemption (voce preempt=N del tipo: le emergenze
+// del tipo possono sottrarre twin ad emergenze di priorità <= N).
+// Un solo Pompieri, con la base nel luogo delle emergenze. In ciascuna fase
+// una prima emergenza lo tiene al lavoro per 30s; dopo 5s arriva Incendio
+// (priorità 2, preempt=0, deadline 10s):
+//  - Frana (priorità 1) è oltre la regola: Incendio non può sottrarle il
+//    twin né prenotarlo entro la deadline, e va in TIMEOUT; Frana completa
+//    senza essere mai sospesa
+//  - Trasporto (priorità 0) rientra nella regola: Incendio le sottrae il twin
+//    e completa, Trasporto passa PAUSED, torna in coda con il lavoro residuo
+//    e completa anch'essa, con il twin prenotato alla fine di Incendio
+// Il dispatcher è quello del server (dispatch_step), con lo stesso scheduler
+// deterministico del replay.
+// Uso: preemption (dalla directory Test/, con le sue configurazioni di prova)
+
+// Orizzonte simulato (ms virtuali) di ciascuna fase
+#define TEST_HORIZON_MS (120 * 1000LL)
+// Arrivo di Incendio (ms virtuali dall'inizio della fase)
+#define TEST_PREEMPTOR_AT_MS 5000LL
+
+// Stato del dispatcher di un'emergenza del test
+typedef struct {
+    dispatch_ctx_t ctx;
+    int started;
+    int done;
+    int was_paused;
+    emergency_status_t final_status;
+} test_emergency_t;
+
+// Esito atteso di un'emergenza della fase
+typedef struct {
+    const char *type;
+    emergency_status_t status;
+    int paused;
+} test_expect_t;
+
+
+// Funzione che crea l'emergenza in (10,10) e ne prepara il dispatcher
+static void start_emergency(test_emergency_t *t, int id, emergency_data_t *edata, const char *type,
+                            rescuer_data_t *rdata, intent_table_t *itable, mtx_t *twin_locks) {
+    emergency_request_withID_t req = {.id = id};
+    emergency_withID_t *e;
+    SNCALL(e, malloc(sizeof(emergency_withID_t)), "malloc test emergency");
+    snprintf(req.req.emergency_name, sizeof(req.req.emergency_name), "%s", type);
+    req.req.x = 10;
+    req.req.y = 10;
+    req.req.timestamp = sim_now();
+    if (create_emergency_instance(e, &req, edata->types, edata->num_types) != 0) {
+        fprintf(stderr, "Creazione dell'emergenza %s fallita\n", type);
+        exit(EXIT_FAILURE);
+    }
+    dispatch_init(&t->ctx, e, rdata, itable, twin_locks);
+    t->started = 1;
+    t->done = 0;
+    t->was_paused = 0;
+}
+
+// Funzione che registra la sospensione dell'emergenza: PAUSED dura dalla
+// sottrazione del twin fino al passo successivo del dispatcher
+static void observe_emergency(test_emergency_t *t) {
+    if (t->started && !t->done && t->ctx.e->emergency.status == PAUSED)
+        t->was_paused = 1;
+}
+
+// Funzione che esegue un passo del dispatcher dell'emergenza (come il replay, trace.c)
+static void step_emergency(test_emergency_t *t) {
+    if (!t->started || t->done)
+        return;
+    dispatch_result_t result;
+    do {
+        result = dispatch_step(&t->ctx);
+    } while (result == DISPATCH_AGAIN);
+    if (result != DISPATCH_DONE)
+        return;
+    t->final_status = t->ctx.e->emergency.status;
+    t->done = 1;
+}
+
+// Funzione che esegue una fase: la prima emergenza subito, Incendio dopo
+// TEST_PREEMPTOR_AT_MS, fino alla fine di entrambe o all'orizzonte.
+// Restituisce il numero di esiti diversi da quelli attesi.
+static int run_phase(int first_id, const test_expect_t expect[2], emergency_data_t *edata,
+                     rescuer_data_t *rdata, mtx_t *twin_locks) {
+    intent_table_t itable;
+    init_intent_table(&itable);
+    test_emergency_t emergencies[2] = {0};
+    long long now = sim_now_ms();
+    long long start = now;
+    start_emergency(&emergencies[0], first_id, edata, expect[0].type, rdata, &itable, twin_locks);
+    while (now <= start + TEST_HORIZON_MS && !(emergencies[0].done && emergencies[1].done)) {
+        sim_clock_set(now);
+        if (!emergencies[1].started && now >= start + TEST_PREEMPTOR_AT_MS)
+            start_emergency(&emergencies[1], first_id + 1, edata, expect[1].type, rdata, &itable, twin_locks);
+        event_run_due(now);
+        for (int k = 0; k < 2; ++k)
+            observe_emergency(&emergencies[k]);
+        for (int k = 0; k < 2; ++k)
+            step_emergency(&emergencies[k]);
+        event_run_due(now);
+        for (int k = 0; k < 2; ++k)
+            observe_emergency(&emergencies[k]);
+        now += DISPATCH_RETRY_MS;
+    }
+    // I twin rientrati (la base è sul posto) tornano IDLE prima della fase successiva
+    sim_clock_set(now);
+    event_run_due(now);
+
+    int failures = 0;
+    for (int k = 0; k < 2; ++k) {
+        test_emergency_t *t = &emergencies[k];
+        emergency_withID_t *e = t->ctx.e;
+        if (!t->done) {
+            printf("FAIL: %s (id %d) non terminata entro %lld s simulati\n",
+                   expect[k].type, e->id, TEST_HORIZON_MS / 1000);
+            failures++;
+        } else if (t->final_status != expect[k].status) {
+            printf("FAIL: %s (id %d) terminata in stato %s invece di %s\n", expect[k].type, e->id,
+                   emergency_status_str(t->final_status), emergency_status_str(expect[k].status));
+            failures++;
+        }
+        if (t->was_paused != expect[k].paused) {
+            printf("FAIL: %s (id %d) %s\n", expect[k].type, e->id,
+                   expect[k].paused ? "non sospesa dalla preemption" : "sospesa senza regola di preemption");
+            failures++;
+        }
+        if (!t->done) {
+            // Ancora in gestione: i suoi job restano al motore, che li scarta alla chiusura
+            continue;
+        }
+        free_emergency_instance(e);
+    }
+    free_intent_table(&itable);
+    return failures;
+}
+
+int main(void) {
+    env_config_t env = {.height = 100, .width = 100};
+    rescuer_data_t rdata;
+    emergency_data_t edata;
+
+    sim_clock_init(SIM_CLOCK_MANUAL, 1.0);
+    sim_clock_set(1000);
+    init_log();
+    log_set_level(LOG_LEVEL_ERROR);
+    if (parse_rescuers("rescuers.conf", &rdata) != 0 ||
+        parse_emergency_types("emergency_types.conf", &rdata, &edata) != 0) {
+        fprintf(stderr, "Configurazioni di prova non valide (eseguire dalla directory Test/)\n");
+        return EXIT_FAILURE;
+    }
+    log_declare_fleet(&rdata);
+    fleet_attach(&rdata);
+    reach_index_init(&rdata, &env);
+    event_engine_start_manual();
+    mtx_t *twin_locks;
+    SNCALL(twin_locks, malloc(sizeof(mtx_t) * rdata.num_twins), "malloc twin locks");
+    for (int i = 0; i < rdata.num_twins; ++i)
+        MCALL_INIT(&twin_locks[i], mtx_plain, "errore in init twin lock");
+
+    const test_expect_t protected_phase[2] = {{"Frana", COMPLETED, 0}, {"Incendio", TIMEOUT, 0}};
+    const test_expect_t preempted_phase[2] = {{"Trasporto", COMPLETED, 1}, {"Incendio", COMPLETED, 0}};
+    int failures = run_phase(1, protected_phase, &edata, &rdata, twin_locks);
+    failures += run_phase(3, preempted_phase, &edata, &rdata, twin_locks);
+    if (!failures)
+        printf("OK: Incendio non sottrae il twin a Frana (priorita' 1), lo sottrae a Trasporto "
+               "(priorita' 0), che passa PAUSED e poi completa\n");
+
+    event_engine_stop();
+    for (int i = 0; i < rdata.num_twins; ++i)
+        mtx_destroy(&twin_locks[i]);
+    free(twin_locks);
+    reach_index_free();
+    free_emergency_types(&edata);
+    free_rescuers_data(&rdata);
+    close_log();
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include "scall.h"
+#include "logger.h"
+#include "env.h"
+#include "rescuers.h"
+#include "emergency_types.h"
+#include "emergency.h"
+#include "worker_thread.h"
+#include "reach.h"
+#include "fleet.h"
+#include "event.h"
+#include "simclock.h"
+#include "scratch.h"
+
+// Test di regressione delle prenotazioni con l'assegnazione parziale.
+// Due emergenze parziali nello stesso luogo si dividono la flotta (un
+// Pompieri e un'Ambulanza): ognuna ha sul posto il twin che manca all'altra,
+// fermo alla barriera in attesa del secondo. Se potessero prenotarsi a
+// vicenda il twin dell'altra, nessuna delle due inizierebbe mai l'intervento
+// (ciclo di prenotazioni). Il test verifica che il ciclo non si formi e che
+// entrambe le emergenze terminino entro l'orizzonte simulato: Allagamento
+// (priorità 1) va in TIMEOUT alla deadline e libera il suo twin, con cui
+// Crollo (priorità 0, senza deadline) completa l'intervento.
+// Uso: reservation (dalla directory Test/, con le sue configurazioni di prova)
+
+// Orizzonte simulato (ms virtuali) entro cui le emergenze devono terminare
+#define TEST_HORIZON_MS (120 * 1000LL)
+
+// Stato del dispatcher di una delle due emergenze
+typedef struct {
+    emergency_withID_t *e;
+    emergency_sync_t *sync;
+    rescuer_digital_twin_t *assigned[2];
+    int filling;
+    int done;
+    emergency_status_t final_status;
+} test_emergency_t;
+
+
+// Funzione che restituisce l'unico twin del tipo indicato
+static rescuer_digital_twin_t *find_twin(rescuer_data_t *rdata, const char *type) {
+    for (int i = 0; i < rdata->num_twins; ++i) {
+        if (strcmp(rdata->twins[i].rescuer->rescuer_type_name, type) == 0)
+            return &rdata->twins[i];
+    }
+    fprintf(stderr, "Twin %s assente in rescuers.conf\n", type);
+    exit(EXIT_FAILURE);
+}
+
+// Funzione che crea l'emergenza e le assegna i twin disponibili, tenendo
+// fuori held (segnato come prenotato durante l'assegnazione)
+static void start_emergency(test_emergency_t *t, int id, emergency_data_t *edata, const char *type,
+                            rescuer_data_t *rdata, mtx_t *twin_locks, rescuer_digital_twin_t *held) {
+    emergency_request_withID_t req = {.id = id};
+    SNCALL(t->e, malloc(sizeof(emergency_withID_t)), "malloc test emergency");
+    snprintf(req.req.emergency_name, sizeof(req.req.emergency_name), "%s", type);
+    req.req.x = 10;
+    req.req.y = 10;
+    req.req.timestamp = sim_now();
+    if (create_emergency_instance(t->e, &req, edata->types, edata->num_types) != 0) {
+        fprintf(stderr, "Creazione dell'emergenza %s fallita\n", type);
+        exit(EXIT_FAILURE);
+    }
+    held->reserved_by = -1;
+    scratch_reset();
+    int assigned = assign_rescuers_to_emergency(t->e, rdata, t->assigned, twin_locks);
+    held->reserved_by = 0;
+    if (assigned != 1) {
+        fprintf(stderr, "%s: attesi 1 twin assegnati, ottenuti %d\n", type, assigned);
+        exit(EXIT_FAILURE);
+    }
+    t->sync = emergency_begin(t->e, t->assigned, twin_locks);
+    t->filling = 1;
+    t->done = 0;
+}
+
+// Funzione che esegue un passo del dispatcher dell'emergenza (vedi dispatch_step)
+static void step_emergency(test_emergency_t *t, rescuer_data_t *rdata, mtx_t *twin_locks) {
+    if (t->done)
+        return;
+    if (t->filling) {
+        scratch_reset();
+        t->filling = emergency_fill_step(t->e, t->sync, rdata, t->assigned, twin_locks);
+        if (t->filling)
+            return;
+    }
+    if (!emergency_settled(t->sync))
+        return;
+    // Lo stato finale va letto prima che emergency_end lo riporti in attesa
+    t->final_status = t->e->emergency.status;
+    emergency_end(t->e, t->sync);
+    t->sync = NULL;
+    t->done = 1;
+}
+
+int main(void) {
+    env_config_t env = {.height = 100, .width = 100};
+    rescuer_data_t rdata;
+    emergency_data_t edata;
+
+    sim_clock_init(SIM_CLOCK_MANUAL, 1.0);
+    sim_clock_set(1000);
+    init_log();
+    log_set_level(LOG_LEVEL_ERROR);
+    if (parse_rescuers("rescuers.conf", &rdata) != 0 ||
+        parse_emergency_types("emergency_types.conf", &rdata, &edata) != 0) {
+        fprintf(stderr, "Configurazioni di prova non valide (eseguire dalla directory Test/)\n");
+        return EXIT_FAILURE;
+    }
+    log_declare_fleet(&rdata);
+    fleet_attach(&rdata);
+    reach_index_init(&rdata, &env);
+    event_engine_start_manual();
+    mtx_t *twin_locks;
+    SNCALL(twin_locks, malloc(sizeof(mtx_t) * rdata.num_twins), "malloc twin locks");
+    for (int i = 0; i < rdata.num_twins; ++i)
+        MCALL_INIT(&twin_locks[i], mtx_plain, "errore in init twin lock");
+
+    // Ognuna delle due emergenze ottiene solo il twin che manca all'altra
+    rescuer_digital_twin_t *pompieri = find_twin(&rdata, "Pompieri");
+    rescuer_digital_twin_t *ambulanza = find_twin(&rdata, "Ambulanza");
+    test_emergency_t emergencies[2];
+    start_emergency(&emergencies[0], 1, &edata, "Allagamento", &rdata, twin_locks, ambulanza);
+    start_emergency(&emergencies[1], 2, &edata, "Crollo", &rdata, twin_locks, pompieri);
+
+    // Scheduler deterministico: eventi scaduti, poi un passo per emergenza ogni 5ms
+    int failures = 0;
+    int cycle = 0;
+    long long now = sim_now_ms();
+    long long horizon = now + TEST_HORIZON_MS;
+    while (now <= horizon && !(emergencies[0].done && emergencies[1].done)) {
+        sim_clock_set(now);
+        event_run_due(now);
+        for (int k = 0; k < 2; ++k)
+            step_emergency(&emergencies[k], &rdata, twin_locks);
+        event_run_due(now);
+        if (pompieri->reserved_by == emergencies[1].e->id && ambulanza->reserved_by == emergencies[0].e->id)
+            cycle = 1;
+        now += DISPATCH_RETRY_MS;
+    }
+
+    if (cycle) {
+        printf("FAIL: le due emergenze si sono prenotate a vicenda il twin alla barriera\n");
+        failures++;
+    }
+    const emergency_status_t expected[2] = {TIMEOUT, COMPLETED};
+    for (int k = 0; k < 2; ++k) {
+        test_emergency_t *t = &emergencies[k];
+        if (!t->done) {
+            printf("FAIL: %s (id %d) non terminata entro %lld s simulati\n",
+                   t->e->emergency.type.emergency_desc, t->e->id, TEST_HORIZON_MS / 1000);
+            failures++;
+        } else if (t->final_status != expected[k]) {
+            printf("FAIL: %s (id %d) terminata in stato %s invece di %s\n",
+                   t->e->emergency.type.emergency_desc, t->e->id,
+                   emergency_status_str(t->final_status), emergency_status_str(expected[k]));
+            failures++;
+        }
+    }
+    if (!failures)
+        printf("OK: prenotazioni senza cicli, %s in %s e %s in %s\n",
+               emergencies[0].e->emergency.type.emergency_desc, emergency_status_str(expected[0]),
+               emergencies[1].e->emergency.type.emergency_desc, emergency_status_str(expected[1]));
+
+    // I job delle emergenze rimaste appese sono ancora in coda: il motore li scarta
+    event_engine_stop();
+    for (int k = 0; k < 2; ++k)
+        free_emergency_instance(emergencies[k].e);
+    for (int i = 0; i < rdata.num_twins; ++i)
+        mtx_destroy(&twin_locks[i]);
+    free(twin_locks);
+    reach_index_free();
+    free_emergency_types(&edata);
+    free_rescuers_data(&rdata);
+    close_log();
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
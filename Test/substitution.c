@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include "scall.h"
+#include "logger.h"
+#include "env.h"
+#include "rescuers.h"
+#include "emergency_types.h"
+#include "emergency.h"
+#include "worker_thread.h"
+#include "reach.h"
+#include "fleet.h"
+#include "simclock.h"
+#include "scratch.h"
+
+// Test di regressione dei tipi sostitutivi (Polizia|Carabinieri+3 in
+// emergency_types.conf): Sommossa (priorità 1, deadline 30s) chiede un
+// Polizia, sostituibile da un Carabinieri con 3s di penalità sull'arrivo.
+// La flotta (substitution_rescuers.conf, velocità 1) ha una zona per caso:
+//  - nessun Polizia arriva entro la deadline: va il Carabinieri
+//  - il Carabinieri arriva 3s prima del Polizia: vince il Polizia (a pari
+//    arrivo con la penalità il tipo richiesto precede il sostituto)
+//  - il Carabinieri arriva 4s prima: la penalità non basta, va il Carabinieri
+// I Carabinieri precedono i Polizia nel file, per cui la precedenza a pari
+// arrivo non dipende dall'ordine dei twin.
+// Uso: substitution (dalla directory Test/, con le sue configurazioni di prova)
+
+// Caso di prova: luogo dell'emergenza e base del twin atteso
+typedef struct {
+    const char *name;
+    int x;
+    int y;
+    const char *type;
+    int base_x;
+    int base_y;
+} test_case_t;
+
+
+// Funzione che restituisce il twin del tipo indicato con la base in (x, y)
+static rescuer_digital_twin_t *find_twin(rescuer_data_t *rdata, const char *type, int x, int y) {
+    for (int i = 0; i < rdata->num_twins; ++i) {
+        rescuer_digital_twin_t *t = &rdata->twins[i];
+        if (strcmp(t->rescuer->rescuer_type_name, type) == 0 && t->rescuer->x == x && t->rescuer->y == y)
+            return t;
+    }
+    fprintf(stderr, "Twin %s con base (%d,%d) assente in substitution_rescuers.conf\n", type, x, y);
+    exit(EXIT_FAILURE);
+}
+
+// Funzione che crea una Sommossa nel luogo del caso e verifica il twin assegnato.
+// Restituisce 1 se l'esito non è quello atteso.
+static int run_case(const test_case_t *c, int id, emergency_data_t *edata, rescuer_data_t *rdata,
+                    mtx_t *twin_locks) {
+    rescuer_digital_twin_t *expected = find_twin(rdata, c->type, c->base_x, c->base_y);
+    emergency_request_withID_t req = {.id = id};
+    emergency_withID_t *e;
+    SNCALL(e, malloc(sizeof(emergency_withID_t)), "malloc test emergency");
+    snprintf(req.req.emergency_name, sizeof(req.req.emergency_name), "Sommossa");
+    req.req.x = c->x;
+    req.req.y = c->y;
+    req.req.timestamp = sim_now();
+    if (create_emergency_instance(e, &req, edata->types, edata->num_types) != 0) {
+        fprintf(stderr, "Creazione dell'emergenza Sommossa fallita\n");
+        exit(EXIT_FAILURE);
+    }
+
+    int failed = 0;
+    rescuer_digital_twin_t *assigned[1] = {NULL};
+    scratch_reset();
+    int reachable = check_reachability(e, rdata);
+    scratch_reset();
+    if (!reachable) {
+        printf("FAIL: %s: emergenza giudicata irraggiungibile\n", c->name);
+        failed = 1;
+    } else if (assign_rescuers_to_emergency(e, rdata, assigned, twin_locks) != 1) {
+        printf("FAIL: %s: assegnazione fallita\n", c->name);
+        failed = 1;
+    } else if (assigned[0] != expected) {
+        printf("FAIL: %s: assegnato %s %d con base (%d,%d) invece di %s %d\n", c->name,
+               assigned[0]->rescuer->rescuer_type_name, assigned[0]->id,
+               assigned[0]->rescuer->x, assigned[0]->rescuer->y, c->type, expected->id);
+        failed = 1;
+    }
+    free_emergency_instance(e);
+    return failed;
+}
+
+int main(void) {
+    env_config_t env = {.height = 400, .width = 400};
+    rescuer_data_t rdata;
+    emergency_data_t edata;
+
+    sim_clock_init(SIM_CLOCK_MANUAL, 1.0);
+    sim_clock_set(1000);
+    init_log();
+    log_set_level(LOG_LEVEL_ERROR);
+    if (parse_rescuers("substitution_rescuers.conf", &rdata) != 0 ||
+        parse_emergency_types("emergency_types.conf", &rdata, &edata) != 0) {
+        fprintf(stderr, "Configurazioni di prova non valide (eseguire dalla directory Test/)\n");
+        return EXIT_FAILURE;
+    }
+    log_declare_fleet(&rdata);
+    fleet_attach(&rdata);
+    reach_index_init(&rdata, &env);
+    mtx_t *twin_locks;
+    SNCALL(twin_locks, malloc(sizeof(mtx_t) * rdata.num_twins), "malloc twin locks");
+    for (int i = 0; i < rdata.num_twins; ++i)
+        MCALL_INIT(&twin_locks[i], mtx_plain, "errore in init twin lock");
+
+    // Arrivi: Polizia a 200s e 300s, Carabinieri a 20s
+    // Polizia a 10s, Carabinieri a 7s (+3 di penalità: pari)
+    // Polizia a 10s, Carabinieri a 6s (+3 di penalità: 9s)
+    const test_case_t cases[] = {
+        {"nessun Polizia in tempo", 100, 100, "Carabinieri", 100, 120},
+        {"Carabinieri 3s prima", 200, 10, "Polizia", 200, 0},
+        {"Carabinieri 4s prima", 300, 10, "Carabinieri", 300, 16},
+    };
+    int num_cases = sizeof(cases) / sizeof(cases[0]);
+    int failures = 0;
+    for (int k = 0; k < num_cases; ++k)
+        failures += run_case(&cases[k], k + 1, &edata, &rdata, twin_locks);
+    if (!failures)
+        printf("OK: Carabinieri senza Polizia in tempo, Polizia preferito fino a 3s di svantaggio\n");
+
+    for (int i = 0; i < rdata.num_twins; ++i)
+        mtx_destroy(&twin_locks[i]);
+    free(twin_locks);
+    reach_index_free();
+    free_emergency_types(&edata);
+    free_rescuers_data(&rdata);
+    close_log();
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,300 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "livestate.h"
+
+// Visualizzatore dello stato corrente del server, letto dalla memoria
+// condivisa pubblicata con state_shm (livestate.h). Legge gli slot con il
+// protocollo del seqlock, senza prendere alcun lock del server: anche con
+// aggiornamenti molto frequenti non rallenta il dispatch.
+// Uso: ems-top [-e env.conf] [-i ms] [-n volte] [-l righe] [-t] [nome]
+//   nome: memoria condivisa (default: state_shm di env.conf)
+//   -i: intervallo di aggiornamento in ms (default 500)
+//   -n: numero di aggiornamenti, poi termina (default 0: fino alla fine del server)
+//   -l: righe massime delle tabelle (default 20)
+//   -t: elenca anche i twin non IDLE
+
+#define TOP_NAME_SIZE 128
+#define TOP_LINE_SIZE 256
+#define TOP_STATUSES 4
+
+static const char *twin_status_names[TOP_STATUSES] = {"IDLE", "EN_ROUTE_TO_SCENE", "ON_SCENE", "RETURNING_TO_BASE"};
+static const char *emergency_status_names[] = {"WAITING", "ASSIGNED", "IN_PROGRESS", "PAUSED",
+                                               "COMPLETED", "CANCELED", "TIMEOUT"};
+
+// Copie coerenti degli slot, senza il contatore del seqlock
+typedef struct {
+    int id;
+    int type_id;
+    int x, y;
+    int status;
+    int emergency_id;
+    long long status_since;
+} twin_view_t;
+
+typedef struct {
+    int id;
+    int priority;
+    int status;
+    int x, y;
+    int assigned;
+    int required;
+    long long time;
+    char name[LIVESTATE_NAME_SIZE];
+} emergency_view_t;
+
+// Letture ripetute perché lo slot era in scrittura (indice della contesa con il server)
+static unsigned long retries = 0;
+
+// Funzione che legge un twin: ripete la copia finché seq è pari e invariato
+static void read_twin(const livestate_twin_t *slot, twin_view_t *out) {
+    for (;;) {
+        unsigned s1 = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        if (!(s1 & 1)) {
+            out->type_id = slot->type_id;
+            out->x = slot->x;
+            out->y = slot->y;
+            out->status = slot->status;
+            out->emergency_id = slot->emergency_id;
+            out->status_since = slot->status_since;
+            atomic_thread_fence(memory_order_acquire);
+            if (atomic_load_explicit(&slot->seq, memory_order_relaxed) == s1)
+                return;
+        }
+        retries++;
+    }
+}
+
+// Funzione che legge un'emergenza; restituisce 0 se lo slot è libero
+static int read_emergency(const livestate_emergency_t *slot, emergency_view_t *out) {
+    for (;;) {
+        unsigned s1 = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        if (!(s1 & 1)) {
+            out->id = atomic_load_explicit(&slot->id, memory_order_relaxed);
+            out->priority = slot->priority;
+            out->status = slot->status;
+            out->x = slot->x;
+            out->y = slot->y;
+            out->assigned = slot->assigned;
+            out->required = slot->required;
+            out->time = slot->time;
+            memcpy(out->name, slot->name, LIVESTATE_NAME_SIZE);
+            atomic_thread_fence(memory_order_acquire);
+            if (atomic_load_explicit(&slot->seq, memory_order_relaxed) == s1) {
+                out->name[LIVESTATE_NAME_SIZE - 1] = '\0';
+                return out->id != 0;
+            }
+        }
+        retries++;
+    }
+}
+
+// Ordine della tabella: priorità decrescente, poi richieste più vecchie
+static int cmp_emergency_view(const void *a, const void *b) {
+    const emergency_view_t *x = a, *y = b;
+    if (x->priority != y->priority) return y->priority - x->priority;
+    if (x->time != y->time) return x->time < y->time ? -1 : 1;
+    return x->id - y->id;
+}
+
+// Funzione che ricava il nome della memoria condivisa dalla chiave state_shm di env.conf
+static int env_state_shm(const char *path, char *name, size_t size) {
+    FILE *f = fopen(path, "r");
+    if (!f) return -1;
+    char line[TOP_LINE_SIZE];
+    int found = -1;
+    while (fgets(line, sizeof(line), f)) {
+        char value[TOP_NAME_SIZE];
+        if (sscanf(line, "state_shm=%127s", value) == 1) {
+            snprintf(name, size, "%s", value);
+            found = 0;
+        }
+    }
+    fclose(f);
+    return found;
+}
+
+// Funzione che stampa un aggiornamento della vista
+static void top_print(const livestate_region_t *r, const char *name, int max_rows, int list_twins,
+                      twin_view_t *twins, emergency_view_t *ems, double rate, int clear) {
+    long long now = atomic_load_explicit(&r->now, memory_order_relaxed);
+
+    // Flotta: una lettura coerente per twin, poi il conteggio per nome di tipo
+    // e stato (rescuers.conf può dichiarare lo stesso tipo con più basi)
+    static int counts[MAX_TYPES][TOP_STATUSES];
+    static int group[MAX_TYPES];
+    memset(counts, 0, sizeof(counts));
+    for (int t = 0; t < r->num_types; ++t) {
+        group[t] = t;
+        for (int g = 0; g < t; ++g) {
+            if (strncmp(r->type_names[g], r->type_names[t], LIVESTATE_NAME_SIZE) == 0) {
+                group[t] = g;
+                break;
+            }
+        }
+    }
+    for (int i = 0; i < r->num_twins; ++i) {
+        read_twin(&r->twins[i], &twins[i]);
+        twins[i].id = i + 1;
+        if (twins[i].type_id >= 0 && twins[i].type_id < r->num_types &&
+            twins[i].status >= 0 && twins[i].status < TOP_STATUSES)
+            counts[group[twins[i].type_id]][twins[i].status]++;
+    }
+    int num_ems = 0;
+    int by_status[TIMEOUT + 1] = {0};
+    for (int i = 0; i < LIVESTATE_EMERGENCIES; ++i) {
+        if (!read_emergency(&r->emergencies[i], &ems[num_ems])) continue;
+        if (ems[num_ems].status >= 0 && ems[num_ems].status <= TIMEOUT) by_status[ems[num_ems].status]++;
+        num_ems++;
+    }
+    qsort(ems, num_ems, sizeof(emergency_view_t), cmp_emergency_view);
+
+    // Istante virtuale dell'ultimo aggiornamento (con l'orologio scalato non coincide con l'ora reale)
+    char clock[32];
+    time_t t_now = (time_t)now;
+    struct tm tm_now;
+    if (localtime_r(&t_now, &tm_now)) strftime(clock, sizeof(clock), "%Y-%m-%d %H:%M:%S", &tm_now);
+    else snprintf(clock, sizeof(clock), "%lld", now);
+
+    if (clear) printf("\033[H\033[J");
+    printf("ems-top /%s  pid %d  %s  griglia %dx%d  aggiornamenti %lu (%.0f/s)  letture ripetute %lu\n",
+           name, r->pid, clock, r->height, r->width,
+           atomic_load_explicit(&r->updates, memory_order_relaxed), rate, retries);
+
+    printf("\n%-20s %6s %6s %10s %9s %8s\n", "tipo", "twin", "IDLE", "EN_ROUTE", "ON_SCENE", "RETURN");
+    for (int t = 0; t < r->num_types; ++t) {
+        if (group[t] != t) continue;
+        int total = counts[t][0] + counts[t][1] + counts[t][2] + counts[t][3];
+        printf("%-20.20s %6d %6d %10d %9d %8d\n", r->type_names[t], total,
+               counts[t][IDLE], counts[t][EN_ROUTE_TO_SCENE], counts[t][ON_SCENE], counts[t][RETURNING_TO_BASE]);
+    }
+
+    printf("\nEmergenze: %d (WAITING %d, ASSIGNED %d, IN_PROGRESS %d, PAUSED %d), fuori tabella %lu\n",
+           num_ems, by_status[WAITING], by_status[ASSIGNED], by_status[IN_PROGRESS], by_status[PAUSED],
+           atomic_load_explicit(&r->overflow, memory_order_relaxed));
+    if (num_ems > 0)
+        printf("%8s %-22s %3s %-12s %11s %7s %8s\n", "id", "tipo", "pr", "stato", "posizione", "twin", "eta'(s)");
+    for (int i = 0; i < num_ems && i < max_rows; ++i) {
+        const emergency_view_t *e = &ems[i];
+        char pos[32], twin[32];
+        snprintf(pos, sizeof(pos), "(%d,%d)", e->x, e->y);
+        snprintf(twin, sizeof(twin), "%d/%d", e->assigned, e->required);
+        printf("%8d %-22.22s %3d %-12s %11s %7s %8lld\n", e->id, e->name, e->priority,
+               e->status >= 0 && e->status <= TIMEOUT ? emergency_status_names[e->status] : "?",
+               pos, twin, now - e->time);
+    }
+    if (num_ems > max_rows) printf("%8s ... altre %d\n", "", num_ems - max_rows);
+
+    if (list_twins) {
+        printf("\n%6s %-20s %-18s %11s %10s %8s\n", "twin", "tipo", "stato", "posizione", "emergenza", "da (s)");
+        int rows = 0, busy = 0;
+        for (int i = 0; i < r->num_twins; ++i) {
+            const twin_view_t *t = &twins[i];
+            if (t->status == IDLE) continue;
+            if (rows++ >= max_rows) { busy++; continue; }
+            char pos[32];
+            snprintf(pos, sizeof(pos), "(%d,%d)", t->x, t->y);
+            printf("%6d %-20.20s %-18s %11s %10d %8lld\n", t->id,
+                   t->type_id >= 0 && t->type_id < r->num_types ? r->type_names[t->type_id] : "?",
+                   t->status >= 0 && t->status < TOP_STATUSES ? twin_status_names[t->status] : "?",
+                   pos, t->emergency_id, now - t->status_since);
+        }
+        if (busy > 0) printf("%6s ... altri %d\n", "", busy);
+    }
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+    const char *env_path = "../env.conf";
+    int interval_ms = 500, iterations = 0, max_rows = 20, list_twins = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "e:i:n:l:t")) != -1) {
+        switch (opt) {
+            case 'e': env_path = optarg; break;
+            case 'i': interval_ms = atoi(optarg); break;
+            case 'n': iterations = atoi(optarg); break;
+            case 'l': max_rows = atoi(optarg); break;
+            case 't': list_twins = 1; break;
+            default:
+                fprintf(stderr, "Uso: %s [-e env.conf] [-i ms] [-n volte] [-l righe] [-t] [nome]\n", argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+    if (interval_ms <= 0) interval_ms = 500;
+    if (max_rows <= 0) max_rows = 20;
+
+    char name[TOP_NAME_SIZE];
+    if (optind < argc) {
+        snprintf(name, sizeof(name), "%s", argv[optind]);
+    } else if (env_state_shm(env_path, name, sizeof(name)) != 0) {
+        fprintf(stderr, "Nessuna chiave state_shm in %s: indicare il nome della memoria condivisa\n", env_path);
+        exit(EXIT_FAILURE);
+    }
+    char path[TOP_NAME_SIZE + 1];
+    snprintf(path, sizeof(path), "/%s", name);
+
+    // Mappatura in sola lettura: il visualizzatore non può alterare lo stato del server
+    int fd = shm_open(path, O_RDONLY, 0);
+    if (fd == -1) {
+        fprintf(stderr, "%s: %s (il server è avviato con state_shm=%s?)\n", path, strerror(errno), name);
+        exit(EXIT_FAILURE);
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size != sizeof(livestate_region_t)) {
+        fprintf(stderr, "%s: dimensione inattesa (server compilato con limiti diversi?)\n", path);
+        exit(EXIT_FAILURE);
+    }
+    const livestate_region_t *r = mmap(NULL, sizeof(livestate_region_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (r == MAP_FAILED) {
+        perror("mmap");
+        exit(EXIT_FAILURE);
+    }
+    if (r->magic != LIVESTATE_MAGIC || r->version != LIVESTATE_VERSION || r->size != sizeof(livestate_region_t)) {
+        fprintf(stderr, "%s: formato non riconosciuto o server in avvio\n", path);
+        exit(EXIT_FAILURE);
+    }
+    atomic_thread_fence(memory_order_acquire);
+
+    twin_view_t *twins = malloc(sizeof(twin_view_t) * (r->num_twins > 0 ? r->num_twins : 1));
+    emergency_view_t *ems = malloc(sizeof(emergency_view_t) * LIVESTATE_EMERGENCIES);
+    if (!twins || !ems) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    int clear = isatty(STDOUT_FILENO);
+    unsigned long last_updates = atomic_load_explicit(&r->updates, memory_order_relaxed);
+    struct timespec last, ts;
+    clock_gettime(CLOCK_MONOTONIC, &last);
+    double rate = 0;
+
+    for (int n = 0; iterations == 0 || n < iterations; ++n) {
+        top_print(r, name, max_rows, list_twins, twins, ems, rate, clear);
+        // Il server rimuove la regione all'uscita: la mappatura resta valida,
+        // la fine si riconosce dal pid
+        if (kill(r->pid, 0) == -1 && errno == ESRCH) {
+            printf("Server terminato.\n");
+            break;
+        }
+        if (iterations != 0 && n + 1 == iterations) break;
+        nanosleep(&(struct timespec){.tv_sec = interval_ms / 1000, .tv_nsec = (interval_ms % 1000) * 1000000L}, NULL);
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        double elapsed = (ts.tv_sec - last.tv_sec) + (ts.tv_nsec - last.tv_nsec) / 1e9;
+        unsigned long updates = atomic_load_explicit(&r->updates, memory_order_relaxed);
+        rate = elapsed > 0 ? (updates - last_updates) / elapsed : 0;
+        last_updates = updates;
+        last = ts;
+    }
+    free(twins);
+    free(ems);
+    munmap((void *)r, sizeof(livestate_region_t));
+    return 0;
+}
@@ -0,0 +1,80 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "logfmt.h"
+
+// Decoder del log binario (emergency.evlog, logfmt.h): stampa su stdout gli
+// eventi nel formato testuale di emergency.log.
+// Uso: log_decode [-s] [file]   (-s: statistiche per codice su stderr)
+
+static log_names_t names;
+
+int main(int argc, char *argv[]) {
+    int stats = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "s")) != -1) {
+        switch (opt) {
+            case 's': stats = 1; break;
+            default:
+                fprintf(stderr, "Uso: %s [-s] [file]\n", argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+    const char *path = optind < argc ? argv[optind] : "emergency.evlog";
+    FILE *in = fopen(path, "rb");
+    if (!in) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+
+    log_names_init(&names);
+    unsigned long counts[LOG_EV_COUNT] = {0};
+    unsigned long records = 0, sessions = 0;
+    unsigned long long bin_bytes = 0, text_bytes = 0;
+    log_bin_header_t h;
+    unsigned char payload[LOG_BIN_PAYLOAD_MAX];
+    char line[LOG_LINE_MAX];
+
+    while (fread(&h, sizeof(h), 1, in) == 1) {
+        if (h.payload_len > sizeof(payload) || fread(payload, 1, h.payload_len, in) != h.payload_len) {
+            fprintf(stderr, "Record %lu troncato o non valido\n", records);
+            exit(EXIT_FAILURE);
+        }
+        // Ogni sessione inizia con il magic: verifica formato e versione
+        if (h.code == LOG_EV_SESSION) {
+            uint32_t version;
+            memcpy(&version, payload + 8, sizeof(version));
+            if (h.payload_len < 20 || memcmp(payload, LOG_BIN_MAGIC, 8) != 0 || version != LOG_BIN_VERSION) {
+                fprintf(stderr, "Sessione %lu: formato non riconosciuto\n", sessions);
+                exit(EXIT_FAILURE);
+            }
+            sessions++;
+        } else if (sessions == 0) {
+            fprintf(stderr, "%s non inizia con una sessione del log binario\n", path);
+            exit(EXIT_FAILURE);
+        }
+        int len = log_render(&names, &h, payload, line, sizeof(line));
+        if (len < 0) {
+            fprintf(stderr, "Record %lu: codice %u sconosciuto\n", records, h.code);
+            continue;
+        }
+        fwrite(line, 1, len, stdout);
+        records++;
+        counts[h.code]++;
+        bin_bytes += sizeof(h) + h.payload_len;
+        text_bytes += len;
+    }
+    fclose(in);
+
+    if (stats) {
+        fprintf(stderr, "%lu record in %lu sessioni: %llu byte binari, %llu byte di testo (%.1fx)\n",
+                records, sessions, bin_bytes, text_bytes, bin_bytes ? (double)text_bytes / bin_bytes : 0.0);
+        for (int c = 0; c < LOG_EV_COUNT; ++c)
+            if (counts[c])
+                fprintf(stderr, "  %-26s %lu\n", log_code_name(c), counts[c]);
+    }
+    log_names_free(&names);
+    return 0;
+}
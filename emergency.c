@@ -7,8 +7,8 @@
 #include "scall.h"
 #include "emergency.h"
 #include "env.h"
+#include "simclock.h"
 
-#define MSG_SIZE 512
 
 // Funzione che estrae una richiesta di emergenza da una stringa
 // msg: stringa ricevuta dalla coda di messaggi (es. "Incendio 100 200 1715153512")
@@ -16,14 +16,13 @@
 // Ritorna 0 in caso di successo, -1 in caso di errore di formato
 int parse_MQrequest(const char *msg, emergency_request_withID_t *req) {
     if (!msg || !req) {
-        log_event("N/A", "MESSAGE_QUEUE", "Messaggio nullo o struttura req nulla");
+        LOG_TEXT(LOG_LEVEL_ERROR, LOG_CAT_QUEUE, "N/A", "MESSAGE_QUEUE",
+                 "Messaggio nullo o struttura req nulla");
         return -1;
     }
 
     // Log della ricezione
-    char log_msg[MSG_SIZE];
-    snprintf(log_msg, sizeof(log_msg), "Ricevuto messaggio MQ: %s", msg);
-    log_event_id(req->id, "MESSAGE_QUEUE", log_msg);
+    LOGF_ID(LOG_LEVEL_DEBUG, LOG_CAT_QUEUE, req->id, "MESSAGE_QUEUE", "Ricevuto messaggio MQ: %s", msg);
 
     // Variabili temporanee
     char name[NAME_SIZE];
@@ -32,8 +31,8 @@ int parse_MQrequest(const char *msg, emergency_request_withID_t *req) {
 
     // Parsing del messaggio
     if (sscanf(msg, "%63s %d %d %ld", name, &x, &y, &timestamp) != 4) {
-        snprintf(log_msg, sizeof(log_msg), "Formato messaggio non valido: %s", msg);
-        log_event_id(req->id, "MESSAGE_QUEUE", log_msg);
+        LOGF_ID(LOG_LEVEL_ERROR, LOG_CAT_QUEUE, req->id, "MESSAGE_QUEUE",
+                "Formato messaggio non valido: %s", msg);
         return -1;
     }
 
@@ -41,12 +40,11 @@ int parse_MQrequest(const char *msg, emergency_request_withID_t *req) {
     strcpy(req->req.emergency_name, name);
     req->req.x = x;
     req->req.y = y;
-    req->req.timestamp = timestamp;
+    // Il client invia tempi reali: li riporta sull'orologio virtuale
+    req->req.timestamp = sim_from_wall(timestamp);
 
-    snprintf(log_msg, sizeof(log_msg),
-             "ID %d: Estratti -> tipo: %s, coordinate: (%d,%d), timestamp: %ld",
-             req->id, req->req.emergency_name, x, y, timestamp);
-    log_event_id(req->id, "MESSAGE_QUEUE", log_msg);
+    LOGF_ID(LOG_LEVEL_DEBUG, LOG_CAT_QUEUE, req->id, "MESSAGE_QUEUE",
+            "ID %d: Estratti -> tipo: %s, coordinate: (%d,%d), timestamp: %ld", req->id, req->req.emergency_name, x, y, timestamp);
 
     return 0;
 }
@@ -61,10 +59,9 @@ int validate_MQrequest(const emergency_request_withID_t *req,
                        emergency_type_t *types,
                        int num_types,
                        const env_config_t *env) {
-    char msg[MSG_SIZE];
-
     if (!req || !types || !env) {
-        log_event("N/A", "MESSAGE_QUEUE", "Parametri nulli in validate_MQrequest");
+        LOG_TEXT(LOG_LEVEL_ERROR, LOG_CAT_QUEUE, "N/A", "MESSAGE_QUEUE",
+                 "Parametri nulli in validate_MQrequest");
         return -1;
     }
 
@@ -79,29 +76,28 @@ int validate_MQrequest(const emergency_request_withID_t *req,
         }
     }
     if (!found) {
-        snprintf(msg, sizeof(msg), "Tipo emergenza sconosciuto: %s", r->emergency_name);
-        log_event_id(req->id, "MESSAGE_QUEUE", msg);
+        LOGF_ID(LOG_LEVEL_ERROR, LOG_CAT_QUEUE, req->id, "MESSAGE_QUEUE",
+                "Tipo emergenza sconosciuto: %s", r->emergency_name);
         return -1;
     }
 
     // Controllo coordinate
     if (r->x < 0 || r->x > env->height || r->y < 0 || r->y > env->width) {
-        snprintf(msg, sizeof(msg), "Coordinate fuori dai limiti: (%d,%d)", r->x, r->y);
-        log_event_id(req->id, "MESSAGE_QUEUE", msg);
+        LOGF_ID(LOG_LEVEL_ERROR, LOG_CAT_QUEUE, req->id, "MESSAGE_QUEUE",
+                "Coordinate fuori dai limiti: (%d,%d)", r->x, r->y);
         return -1;
     }
 
     // Controllo timestamp
-    time_t now = time(NULL);
+    time_t now = sim_now();
     if (r->timestamp > now) {
-        snprintf(msg, sizeof(msg), "Timestamp futuro non valido: %ld (ora: %ld)", r->timestamp, now);
-        log_event_id(req->id, "MESSAGE_QUEUE", msg);
+        LOGF_ID(LOG_LEVEL_ERROR, LOG_CAT_QUEUE, req->id, "MESSAGE_QUEUE",
+                "Timestamp futuro non valido: %ld (ora: %ld)", r->timestamp, now);
         return -1;
     }
 
     // Validazione completata con successo
-    snprintf(msg, sizeof(msg), "Richiesta validata con successo");
-    log_event_id(req->id, "MESSAGE_QUEUE", msg);
+    LOGF_ID(LOG_LEVEL_DEBUG, LOG_CAT_QUEUE, req->id, "MESSAGE_QUEUE", "Richiesta validata con successo");
 
     return 0;
 }
@@ -121,7 +117,8 @@ int create_emergency_instance(emergency_withID_t *instance,
                                 
     // Controlla validità dei parametri                           
     if (!instance || !req || !types || num_types <= 0) {
-        log_event("N/A", "MESSAGE_QUEUE", "Parametri nulli in create_emergency_instance");
+        LOG_TEXT(LOG_LEVEL_ERROR, LOG_CAT_QUEUE, "N/A", "MESSAGE_QUEUE",
+                 "Parametri nulli in create_emergency_instance");
         return -1;
     }
 
@@ -137,18 +134,21 @@ int create_emergency_instance(emergency_withID_t *instance,
     }
     // Se il tipo non viene trovato, logga errore e termina
     if (!matched_type) {
-        log_event_id(req->id, "MESSAGE_QUEUE", "Tipo emergenza non trovato");
+        LOG_TEXT_ID(LOG_LEVEL_ERROR, LOG_CAT_QUEUE, req->id, "MESSAGE_QUEUE", "Tipo emergenza non trovato");
         return -1;
     }
 
     // Copia del tipo nella nuova istanza
     emergency_type_t *copied_type = &instance->emergency.type;
     copied_type->priority = matched_type->priority;
+    copied_type->preempt_max = matched_type->preempt_max;
+    copied_type->partial = matched_type->partial;
 
     // Copia dinamica della descrizione dell'emergenza
     copied_type->emergency_desc = strdup(matched_type->emergency_desc);
     if (!copied_type->emergency_desc) {
-        log_event_id(req->id, "MESSAGE_QUEUE", "malloc fallita per emergency_desc");
+        LOG_TEXT_ID(LOG_LEVEL_ERROR, LOG_CAT_QUEUE, req->id, "MESSAGE_QUEUE",
+                    "malloc fallita per emergency_desc");
         return -1;
     }
     // Alloca spazio per l'array dei soccorritori richiesti
@@ -156,14 +156,13 @@ int create_emergency_instance(emergency_withID_t *instance,
     copied_type->rescuers = malloc(sizeof(rescuer_request_t) * copied_type->rescuers_req_number);
     if (!copied_type->rescuers) {
         free(copied_type->emergency_desc);
-        log_event_id(req->id, "ERROR", "malloc fallita per rescuers");
+        LOG_TEXT_ID(LOG_LEVEL_ERROR, LOG_CAT_QUEUE, req->id, "ERROR", "malloc fallita per rescuers");
         return -1;
     }
     // Copia le informazioni per ciascun tipo di soccorritore richiesto
+    // (compresi gli eventuali sostituti)
     for (int i = 0; i < copied_type->rescuers_req_number; ++i) {
-        copied_type->rescuers[i].required_count = matched_type->rescuers[i].required_count;
-        copied_type->rescuers[i].time_to_manage = matched_type->rescuers[i].time_to_manage;
-        copied_type->rescuers[i].type = matched_type->rescuers[i].type;
+        copied_type->rescuers[i] = matched_type->rescuers[i];
     }
 
     // Inizializza gli altri campi della struttura emergency
@@ -174,13 +173,17 @@ int create_emergency_instance(emergency_withID_t *instance,
     instance->emergency.status = WAITING;
     instance->emergency.rescuer_count = 0;
     instance->emergency.rescuers_dt = NULL;
+    instance->emergency.rescuers_req = NULL;
+    instance->stage = -1;
+    instance->stage_ns = 0;
+    instance->live_slot = -1;
 
     // Logga la creazione dell'emergenza
-    char msg[MSG_SIZE];
-    snprintf(msg, sizeof(msg),
-             "Creato oggetto emergency con tipo='%s', coord=(%d,%d), tempo=%ld",
-             r->emergency_name, r->x, r->y, r->timestamp);
-    log_event_id(req->id, "MESSAGE_QUEUE", msg);
+    LOGF_ID(LOG_LEVEL_DEBUG, LOG_CAT_QUEUE, req->id, "MESSAGE_QUEUE",
+            "Creato oggetto emergency con tipo='%s', coord=(%d,%d), tempo=%ld", r->emergency_name, r->x, r->y, r->timestamp);
+    // Evento di arrivo: origine dei tempi di risposta (Load/ ne ricava i percentili per priorità)
+    LOG_STRUCT(LOG_LEVEL_STATE, LOG_CAT_EMERGENCY, LOG_EV_EM_RECEIVED, req->id, 0,
+               copied_type->priority, (int)(sim_now() - r->timestamp));
 
     return 0;
 }
@@ -229,6 +232,7 @@ void free_emergency_instance(emergency_withID_t *e) {
     if (e->emergency.rescuers_dt) {
         free(e->emergency.rescuers_dt);
     }
+    free(e->emergency.rescuers_req);
 
     // Libera l'array dei requisiti di soccorritori
     if (e->emergency.type.rescuers) {
@@ -38,11 +38,15 @@ typedef struct {
     time_t time;
     int rescuer_count;
     rescuer_digital_twin_t* rescuers_dt;
+    int* rescuers_req; // per ogni twin assegnato, indice della richiesta che copre
 } emergency_t;
 
 typedef struct {
     int id; // ID univoco dell'istanza di emergenza
     emergency_t emergency;
+    int stage;          // ultima fase misurata (metric_stage_t, metrics.h), -1 se non misurata
+    long long stage_ns; // istante (ns monotoni) in cui è stata raggiunta
+    int live_slot;      // slot nello stato condiviso (livestate.h), -1 se non pubblicata
 } emergency_withID_t;
 
 int parse_MQrequest(const char *msg, emergency_request_withID_t *req);
@@ -3,10 +3,16 @@
 
 #include "rescuers.h" 
 
+// Numero massimo di tipi sostitutivi per una richiesta (es. Polizia|Carabinieri:5,5)
+#define MAX_SUBSTITUTES 4
+
 typedef struct {
     rescuer_type_t *type;   
     int required_count;    
     int time_to_manage;   
+    rescuer_type_t *substitutes[MAX_SUBSTITUTES]; // tipi sostitutivi, in ordine di preferenza
+    int penalties[MAX_SUBSTITUTES];               // penalità (secondi) sull'arrivo stimato del sostituto
+    int substitutes_count;
 } rescuer_request_t;
 
 typedef struct {
@@ -14,6 +20,8 @@ typedef struct {
     char *emergency_desc;             
     rescuer_request_t *rescuers;      
     int rescuers_req_number;        
+    short preempt_max;                // priorità massima sottraibile (-1: nessuna preemption)
+    short partial;                    // 1: assegnazione parziale, i posti mancanti si riempiono man mano
 } emergency_type_t;
 
 typedef struct {
@@ -24,5 +32,6 @@ typedef struct {
 int parse_emergency_types(const char *filename, const rescuer_data_t *rescuer_data, emergency_data_t *emergency_data);
 void free_emergency_types(emergency_data_t *data);
 void print_emergency_types(const emergency_data_t *data);
+int rescuer_request_match(const rescuer_request_t *req, const rescuer_type_t *type);
 
 #endif 
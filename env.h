@@ -5,6 +5,18 @@ typedef struct {
     char* queue_name;
     int height;
     int width;
+    int clock_mode;      // sim_clock_mode_t (simclock.h)
+    double clock_scale;  // fattore di accelerazione per scaled
+    char* trace_path;    // file del trace binario delle richieste (NULL: nessuna cattura)
+    int log_overflow;    // log_overflow_t (logger.h): politica con il buffer di log pieno
+    int log_format;      // log_format_t (logger.h): testo (emergency.log) o binario (emergency.evlog)
+    int log_level;       // log_level_t (logger.h): livello minimo degli eventi registrati
+    unsigned log_categories; // maschera LOG_CAT_* (logger.h) delle categorie registrate
+    int log_sync;        // log_sync_t (logger.h): politica di durabilità del log
+    int log_sync_ms;     // intervallo della sync periodica (ms)
+    int log_segment_mb;  // dimensione dei segmenti di log in MB (0: nessuna rotazione)
+    char* metrics_socket; // socket Unix su cui esporre le metriche (NULL: nessuno)
+    char* state_shm;      // memoria condivisa con lo stato corrente (livestate.h, NULL: nessuna)
 } env_config_t;
 
 int parse_env(const char *filename, env_config_t *config);
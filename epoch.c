@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <threads.h>
+#include "scall.h"
+#include "epoch.h"
+
+// Record per-thread di un lettore: state vale 0 se il thread è fuori dalla
+// sezione critica, altrimenti (epoca << 1) | 1
+typedef struct epoch_record {
+    atomic_ulong state;
+    atomic_int in_use;
+    struct epoch_record *next;
+} epoch_record_t;
+
+// Puntatore ritirato in attesa che trascorra il periodo di grazia
+typedef struct retired {
+    void *ptr;
+    unsigned long epoch;
+    struct retired *next;
+} retired_t;
+
+// Epoca globale, avanzata dagli scrittori in epoch_reclaim()
+static atomic_ulong global_epoch = 1;
+// Lista (solo inserimento in testa) dei record dei lettori, mai liberati prima di epoch_shutdown()
+static _Atomic(epoch_record_t *) records = NULL;
+// Lista dei puntatori ritirati, protetta da retire_mutex
+static retired_t *limbo = NULL;
+static mtx_t retire_mutex;
+// Chiave TSS per il record del thread corrente (rilasciato alla terminazione del thread)
+static tss_t record_key;
+static once_flag epoch_once = ONCE_FLAG_INIT;
+
+
+// Distruttore TSS: rende il record riutilizzabile da un nuovo thread
+static void epoch_record_release(void *arg) {
+    epoch_record_t *rec = arg;
+    atomic_store(&rec->state, 0);
+    atomic_store(&rec->in_use, 0);
+}
+
+// Inizializzazione una tantum del modulo
+static void epoch_init(void) {
+    MCALL_INIT(&retire_mutex, mtx_plain, "errore in init retire_mutex");
+    if (tss_create(&record_key, epoch_record_release) != thrd_success) {
+        perror("errore in tss_create epoch");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Funzione che restituisce il record del thread corrente, riusando un record
+// libero se disponibile o allocandone uno nuovo
+static epoch_record_t *epoch_get_record(void) {
+    call_once(&epoch_once, epoch_init);
+    epoch_record_t *rec = tss_get(record_key);
+    if (rec) return rec;
+
+    // Prova a riutilizzare un record lasciato da un thread terminato
+    for (rec = atomic_load(&records); rec; rec = rec->next) {
+        int expected = 0;
+        if (atomic_compare_exchange_strong(&rec->in_use, &expected, 1)) break;
+    }
+    // Nessun record libero: ne alloca uno nuovo e lo inserisce in testa
+    if (!rec) {
+        SNCALL(rec, malloc(sizeof(epoch_record_t)), "errore in malloc epoch_record");
+        atomic_init(&rec->state, 0);
+        atomic_init(&rec->in_use, 1);
+        rec->next = atomic_load(&records);
+        while (!atomic_compare_exchange_weak(&records, &rec->next, rec))
+            ;
+    }
+    tss_set(record_key, rec);
+    return rec;
+}
+
+// Funzione che segna l'ingresso del thread in una sezione critica di lettura
+// I puntatori letti da strutture protette restano validi fino a epoch_exit()
+void epoch_enter(void) {
+    epoch_record_t *rec = epoch_get_record();
+    atomic_store(&rec->state, (atomic_load(&global_epoch) << 1) | 1);
+}
+
+// Funzione che segna l'uscita dalla sezione critica di lettura
+void epoch_exit(void) {
+    epoch_record_t *rec = tss_get(record_key);
+    if (rec) atomic_store_explicit(&rec->state, 0, memory_order_release);
+}
+
+// Funzione che ritira un puntatore già rimosso dalla struttura condivisa
+// La memoria verrà liberata da epoch_reclaim() dopo il periodo di grazia
+void epoch_retire(void *ptr) {
+    if (!ptr) return;
+    call_once(&epoch_once, epoch_init);
+    retired_t *r;
+    SNCALL(r, malloc(sizeof(retired_t)), "errore in malloc retired");
+    r->ptr = ptr;
+    r->epoch = atomic_load(&global_epoch);
+    MCALL_LOCK(&retire_mutex, "errore in lock retire_mutex");
+    r->next = limbo;
+    limbo = r;
+    MCALL_UNLOCK(&retire_mutex, "errore in unlock retire_mutex");
+}
+
+// Funzione che prova ad avanzare l'epoca globale e libera i puntatori
+// ritirati da almeno due epoche
+void epoch_reclaim(void) {
+    call_once(&epoch_once, epoch_init);
+    MCALL_LOCK(&retire_mutex, "errore in lock retire_mutex");
+
+    // L'epoca avanza solo se tutti i lettori attivi l'hanno già osservata
+    unsigned long epoch = atomic_load(&global_epoch);
+    int can_advance = 1;
+    for (epoch_record_t *rec = atomic_load(&records); rec; rec = rec->next) {
+        unsigned long state = atomic_load(&rec->state);
+        if ((state & 1) && (state >> 1) != epoch) {
+            can_advance = 0;
+            break;
+        }
+    }
+    if (can_advance) {
+        atomic_compare_exchange_strong(&global_epoch, &epoch, epoch + 1);
+        epoch++;
+    }
+
+    // Libera tutto ciò che è stato ritirato almeno due epoche fa
+    retired_t **pp = &limbo;
+    while (*pp) {
+        retired_t *r = *pp;
+        if (r->epoch + 2 <= epoch) {
+            *pp = r->next;
+            free(r->ptr);
+            free(r);
+        } else {
+            pp = &r->next;
+        }
+    }
+    MCALL_UNLOCK(&retire_mutex, "errore in unlock retire_mutex");
+}
+
+// Funzione che libera tutta la memoria ritirata, indipendentemente dall'epoca
+// Da chiamare solo a terminazione, quando nessun lettore è più attivo
+void epoch_shutdown(void) {
+    call_once(&epoch_once, epoch_init);
+    MCALL_LOCK(&retire_mutex, "errore in lock retire_mutex");
+    while (limbo) {
+        retired_t *r = limbo;
+        limbo = r->next;
+        free(r->ptr);
+        free(r);
+    }
+    MCALL_UNLOCK(&retire_mutex, "errore in unlock retire_mutex");
+}
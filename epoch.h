@@ -0,0 +1,15 @@
+#ifndef EPOCH_H
+#define EPOCH_H
+
+// Reclamation basata su epoche (EBR): i lettori annunciano l'epoca in cui
+// entrano in sezione critica, gli scrittori ritirano i puntatori non più
+// pubblicati e la memoria viene liberata solo dopo due avanzamenti di epoca,
+// quando nessun lettore può più possederne un riferimento.
+
+void epoch_enter(void);
+void epoch_exit(void);
+void epoch_retire(void *ptr);
+void epoch_reclaim(void);
+void epoch_shutdown(void);
+
+#endif
@@ -0,0 +1,405 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <time.h>
+#include <threads.h>
+#include <stdatomic.h>
+#include "scall.h"
+#include "event.h"
+#include "simclock.h"
+#include "lockprof.h"
+
+// Capacità iniziale delle code degli eventi e della tabella dei gettoni (raddoppiano quando sono piene)
+#define EVENT_QUEUE_INIT_CAPACITY 256
+
+typedef struct {
+    long long at;       // istante (ms) in cui l'evento scade
+    unsigned long seq;  // ordine di inserimento, per la stabilità a parità di istante
+    event_fn fn;
+    void *arg;
+    int token;          // gettone di cancellazione (EVENT_NO_TOKEN se nessuno)
+    unsigned long gen;  // generazione del gettone alla programmazione
+} event_t;
+
+// Coda con priorità (min-heap)
+typedef struct {
+    event_t *items;
+    int size;
+    int capacity;
+} event_heap_t;
+
+// Gettone di cancellazione: annullarlo ne incrementa la generazione, e gli
+// eventi programmati con una generazione precedente vengono scartati quando
+// arrivano in cima alla coda (cancellazione pigra, senza scandire la coda)
+typedef struct {
+    unsigned long gen;
+    int live;       // eventi in coda con la generazione attuale
+    int next_free;  // prossimo gettone libero (-1 se ultimo), valido se libero
+} event_token_slot_t;
+
+// Code degli eventi, protette da queue_mutex: i tentativi periodici (polling)
+// stanno in una coda separata, così il prossimo evento che non sia di polling
+// è sempre in cima a timers
+static event_heap_t timers = {0};
+static event_heap_t polls = {0};
+static unsigned long next_seq = 0;
+static mtx_t queue_mutex;
+static cnd_t queue_cond;
+static thrd_t engine_thread;
+static int running = 0;
+static int threaded = 0;  // 0 se gli eventi sono eseguiti dal chiamante (event_run_due)
+// Tabella dei gettoni, protetta da queue_mutex
+static event_token_slot_t *tokens = NULL;
+static int token_count = 0;
+static int token_capacity = 0;
+static int token_free = -1;
+// Statistiche
+static unsigned long dispatched = 0;
+static unsigned long discarded = 0;
+static int max_queue_size = 0;
+// Eventi in coda (entrambe le code) leggibili senza lock (metriche)
+static atomic_int queue_depth = 0;
+static unsigned long warps = 0;
+// Lavoro in corso fuori dal motore (event_hold): in modalità AFAP l'orologio
+// salta al prossimo evento solo quando è 0 e nessuna callback è in esecuzione
+static int in_flight = 0;
+
+
+// Funzione che confronta due eventi: 1 se a scade prima di b
+static int event_before(const event_t *a, const event_t *b) {
+    return a->at < b->at || (a->at == b->at && a->seq < b->seq);
+}
+
+// Funzione che riporta in cima all'heap l'evento in posizione i
+static void heap_sift_up(event_heap_t *h, int i) {
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (!event_before(&h->items[i], &h->items[parent])) break;
+        event_t tmp = h->items[i];
+        h->items[i] = h->items[parent];
+        h->items[parent] = tmp;
+        i = parent;
+    }
+}
+
+// Funzione che fa scendere nell'heap l'evento in posizione i
+static void heap_sift_down(event_heap_t *h, int i) {
+    while (1) {
+        int smallest = i;
+        int left = 2 * i + 1;
+        int right = 2 * i + 2;
+        if (left < h->size && event_before(&h->items[left], &h->items[smallest])) smallest = left;
+        if (right < h->size && event_before(&h->items[right], &h->items[smallest])) smallest = right;
+        if (smallest == i) break;
+        event_t tmp = h->items[i];
+        h->items[i] = h->items[smallest];
+        h->items[smallest] = tmp;
+        i = smallest;
+    }
+}
+
+// Funzione che inserisce un evento nell'heap, raddoppiandone la capacità se pieno
+static void heap_push(event_heap_t *h, const event_t *ev) {
+    if (h->size == h->capacity) {
+        int capacity = h->capacity ? h->capacity * 2 : EVENT_QUEUE_INIT_CAPACITY;
+        event_t *grown = realloc(h->items, sizeof(event_t) * capacity);
+        if (!grown) {
+            perror("realloc event queue");
+            exit(EXIT_FAILURE);
+        }
+        h->items = grown;
+        h->capacity = capacity;
+    }
+    h->items[h->size] = *ev;
+    heap_sift_up(h, h->size++);
+}
+
+// Funzione che estrae dall'heap l'evento in cima
+static event_t heap_pop(event_heap_t *h) {
+    event_t ev = h->items[0];
+    h->items[0] = h->items[--h->size];
+    heap_sift_down(h, 0);
+    return ev;
+}
+
+// Funzione che aggiorna la copia del numero di eventi in coda
+static void queue_depth_update(void) {
+    int size = timers.size + polls.size;
+    atomic_store_explicit(&queue_depth, size, memory_order_relaxed);
+    if (size > max_queue_size) max_queue_size = size;
+}
+
+// Funzione che scarta gli eventi annullati in cima all'heap.
+// Da chiamare con queue_mutex acquisito.
+static void heap_drop_cancelled(event_heap_t *h) {
+    while (h->size > 0 && h->items[0].token != EVENT_NO_TOKEN &&
+           h->items[0].gen != tokens[h->items[0].token].gen) {
+        heap_pop(h);
+        discarded++;
+    }
+    queue_depth_update();
+}
+
+// Funzione che restituisce la coda con il primo evento in scadenza (a parità
+// di istante il primo inserito), NULL se entrambe sono vuote.
+// Da chiamare con queue_mutex acquisito.
+static event_heap_t *queue_first(void) {
+    heap_drop_cancelled(&timers);
+    if (polls.size == 0) return timers.size > 0 ? &timers : NULL;
+    if (timers.size == 0) return &polls;
+    return event_before(&timers.items[0], &polls.items[0]) ? &timers : &polls;
+}
+
+// Funzione che estrae il primo evento dalla coda h, aggiornando il gettone.
+// Da chiamare con queue_mutex acquisito.
+static event_t queue_pop(event_heap_t *h) {
+    event_t ev = heap_pop(h);
+    if (ev.token != EVENT_NO_TOKEN)
+        tokens[ev.token].live--;
+    queue_depth_update();
+    dispatched++;
+    return ev;
+}
+
+// Funzione che restituisce l'istante del primo evento in coda che non sia di
+// polling (LLONG_MAX se non ce ne sono). Da chiamare con queue_mutex acquisito.
+static long long next_activity_at(void) {
+    heap_drop_cancelled(&timers);
+    return timers.size > 0 ? timers.items[0].at : LLONG_MAX;
+}
+
+// Thread del motore: attende il primo evento in scadenza e lo esegue
+// fuori dal lock, così le callback possono programmare nuovi eventi
+static int event_engine_loop(void *arg) {
+    (void)arg;
+    LOCKPROF_LOCK(&queue_mutex, LOCK_CLASS_EVENT, 0, "errore in lock event queue");
+    while (running) {
+        event_heap_t *first = queue_first();
+        if (!first) {
+            LOCKPROF_RELEASED(LOCK_CLASS_EVENT, 0);
+            cnd_wait(&queue_cond, &queue_mutex);
+            LOCKPROF_ACQUIRED(LOCK_CLASS_EVENT, 0);
+            continue;
+        }
+        long long now = sim_now_ms();
+        if (first->items[0].at > now) {
+            if (sim_clock_mode() != SIM_CLOCK_AFAP) {
+                // Attende la scadenza del primo evento (o l'inserimento di uno precedente)
+                struct timespec until;
+                sim_wall_deadline(first->items[0].at, &until);
+                LOCKPROF_RELEASED(LOCK_CLASS_EVENT, 0);
+                cnd_timedwait(&queue_cond, &queue_mutex, &until);
+                LOCKPROF_ACQUIRED(LOCK_CLASS_EVENT, 0);
+                continue;
+            }
+            // AFAP: nessun evento scaduto e nessuna callback in esecuzione. Se non
+            // c'è lavoro in corso fuori dal motore, il sistema è inattivo e
+            // l'orologio salta al prossimo evento che non sia di polling (o al
+            // prossimo tentativo se non ce ne sono); i tentativi scaduti nel
+            // frattempo vengono eseguiti subito dopo il salto
+            if (in_flight > 0) {
+                LOCKPROF_RELEASED(LOCK_CLASS_EVENT, 0);
+                cnd_wait(&queue_cond, &queue_mutex);
+                LOCKPROF_ACQUIRED(LOCK_CLASS_EVENT, 0);
+                continue;
+            }
+            long long target = next_activity_at();
+            sim_warp_to(target != LLONG_MAX ? target : first->items[0].at);
+            warps++;
+            continue;
+        }
+        event_t ev = queue_pop(first);
+        LOCKPROF_UNLOCK(&queue_mutex, LOCK_CLASS_EVENT, 0, "errore in unlock event queue");
+        ev.fn(ev.arg);
+        LOCKPROF_LOCK(&queue_mutex, LOCK_CLASS_EVENT, 0, "errore in lock event queue");
+    }
+    LOCKPROF_UNLOCK(&queue_mutex, LOCK_CLASS_EVENT, 0, "errore in unlock event queue");
+    return 0;
+}
+
+// Funzione che inizializza la coda del motore senza avviarne il thread:
+// gli eventi vengono eseguiti dal chiamante con event_run_due
+void event_engine_start_manual(void) {
+    MCALL_INIT(&queue_mutex, mtx_plain, "errore in init event queue mutex");
+    if (cnd_init(&queue_cond) != thrd_success) {
+        perror("errore in init event queue cond");
+        exit(EXIT_FAILURE);
+    }
+    SNCALL(timers.items, malloc(sizeof(event_t) * EVENT_QUEUE_INIT_CAPACITY), "malloc event queue");
+    timers.capacity = EVENT_QUEUE_INIT_CAPACITY;
+    SNCALL(polls.items, malloc(sizeof(event_t) * EVENT_QUEUE_INIT_CAPACITY), "malloc event queue");
+    polls.capacity = EVENT_QUEUE_INIT_CAPACITY;
+    running = 1;
+}
+
+// Funzione che avvia il thread del motore a eventi
+void event_engine_start(void) {
+    event_engine_start_manual();
+    threaded = 1;
+    if (thrd_create(&engine_thread, event_engine_loop, NULL) != thrd_success) {
+        perror("errore in creazione thread del motore a eventi");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Funzione che ferma il motore a eventi: gli eventi ancora in coda vengono scartati
+void event_engine_stop(void) {
+    LOCKPROF_LOCK(&queue_mutex, LOCK_CLASS_EVENT, 0, "errore in lock event queue");
+    running = 0;
+    cnd_signal(&queue_cond);
+    LOCKPROF_UNLOCK(&queue_mutex, LOCK_CLASS_EVENT, 0, "errore in unlock event queue");
+    if (threaded)
+        thrd_join(engine_thread, NULL);
+    threaded = 0;
+    free(timers.items);
+    free(polls.items);
+    timers = polls = (event_heap_t){0};
+    free(tokens);
+    tokens = NULL;
+    token_count = token_capacity = 0;
+    token_free = -1;
+    in_flight = 0;
+    atomic_store_explicit(&queue_depth, 0, memory_order_relaxed);
+    cnd_destroy(&queue_cond);
+    mtx_destroy(&queue_mutex);
+}
+
+// Funzione che inserisce un evento nella coda
+static void event_push(long long at_ms, event_fn fn, void *arg, int poll, int token) {
+    LOCKPROF_LOCK(&queue_mutex, LOCK_CLASS_EVENT, 0, "errore in lock event queue");
+    event_t ev = {.at = at_ms, .seq = next_seq++, .fn = fn, .arg = arg, .token = token, .gen = 0};
+    if (token != EVENT_NO_TOKEN) {
+        ev.gen = tokens[token].gen;
+        tokens[token].live++;
+    }
+    event_heap_t *h = poll ? &polls : &timers;
+    heap_push(h, &ev);
+    queue_depth_update();
+    // Risveglia il motore solo se il nuovo evento è il primo in scadenza
+    if (queue_first() == h && h->items[0].seq == ev.seq)
+        cnd_signal(&queue_cond);
+    LOCKPROF_UNLOCK(&queue_mutex, LOCK_CLASS_EVENT, 0, "errore in unlock event queue");
+}
+
+// Funzione che programma l'esecuzione di fn(arg) all'istante at_ms
+// (un istante già passato la esegue appena possibile)
+void event_schedule(long long at_ms, event_fn fn, void *arg) {
+    event_push(at_ms, fn, arg, 0, EVENT_NO_TOKEN);
+}
+
+// Funzione che programma un tentativo periodico (polling): come event_schedule,
+// ma in modalità AFAP non impedisce all'orologio di saltare al prossimo evento
+void event_schedule_poll(long long at_ms, event_fn fn, void *arg) {
+    event_push(at_ms, fn, arg, 1, EVENT_NO_TOKEN);
+}
+
+// Funzione che programma fn(arg) all'istante at_ms legandolo al gettone token:
+// l'evento non viene eseguito se nel frattempo il gettone è stato annullato
+void event_schedule_token(long long at_ms, event_fn fn, void *arg, int token) {
+    event_push(at_ms, fn, arg, 0, token);
+}
+
+// Funzione che crea un gettone di cancellazione per gli eventi di un job,
+// riusando quelli liberati
+int event_token_new(void) {
+    LOCKPROF_LOCK(&queue_mutex, LOCK_CLASS_EVENT, 0, "errore in lock event queue");
+    int token = token_free;
+    if (token >= 0) {
+        token_free = tokens[token].next_free;
+    } else {
+        if (token_count == token_capacity) {
+            int capacity = token_capacity ? token_capacity * 2 : EVENT_QUEUE_INIT_CAPACITY;
+            event_token_slot_t *grown = realloc(tokens, sizeof(event_token_slot_t) * capacity);
+            if (!grown) {
+                perror("realloc event tokens");
+                exit(EXIT_FAILURE);
+            }
+            tokens = grown;
+            token_capacity = capacity;
+        }
+        token = token_count++;
+        tokens[token].gen = 0;
+    }
+    tokens[token].live = 0;
+    LOCKPROF_UNLOCK(&queue_mutex, LOCK_CLASS_EVENT, 0, "errore in unlock event queue");
+    return token;
+}
+
+// Funzione che annulla gli eventi in coda programmati con il gettone
+// (ad esempio i timer di un job terminato), in tempo costante: restano in
+// coda e vengono scartati quando arrivano in cima.
+// Restituisce il numero di eventi annullati.
+int event_cancel(int token) {
+    LOCKPROF_LOCK(&queue_mutex, LOCK_CLASS_EVENT, 0, "errore in lock event queue");
+    int removed = tokens[token].live;
+    tokens[token].live = 0;
+    tokens[token].gen++;
+    LOCKPROF_UNLOCK(&queue_mutex, LOCK_CLASS_EVENT, 0, "errore in unlock event queue");
+    return removed;
+}
+
+// Funzione che libera il gettone, annullando gli eventi ancora legati ad esso
+void event_token_free(int token) {
+    LOCKPROF_LOCK(&queue_mutex, LOCK_CLASS_EVENT, 0, "errore in lock event queue");
+    tokens[token].gen++;
+    tokens[token].live = 0;
+    tokens[token].next_free = token_free;
+    token_free = token;
+    LOCKPROF_UNLOCK(&queue_mutex, LOCK_CLASS_EVENT, 0, "errore in unlock event queue");
+}
+
+// Funzione che segnala l'inizio di un lavoro fuori dal motore che programmerà
+// eventi (ad esempio un messaggio ricevuto da trasformare in task): fino a
+// event_release l'orologio AFAP non salta in avanti
+void event_hold(void) {
+    LOCKPROF_LOCK(&queue_mutex, LOCK_CLASS_EVENT, 0, "errore in lock event queue");
+    in_flight++;
+    LOCKPROF_UNLOCK(&queue_mutex, LOCK_CLASS_EVENT, 0, "errore in unlock event queue");
+}
+
+// Funzione che segnala la fine di un lavoro iniziato con event_hold
+void event_release(void) {
+    LOCKPROF_LOCK(&queue_mutex, LOCK_CLASS_EVENT, 0, "errore in lock event queue");
+    if (--in_flight == 0)
+        cnd_signal(&queue_cond);
+    LOCKPROF_UNLOCK(&queue_mutex, LOCK_CLASS_EVENT, 0, "errore in unlock event queue");
+}
+
+// Funzione che restituisce l'istante del prossimo evento in coda (LLONG_MAX se vuota)
+long long event_next_at(void) {
+    LOCKPROF_LOCK(&queue_mutex, LOCK_CLASS_EVENT, 0, "errore in lock event queue");
+    event_heap_t *first = queue_first();
+    long long at = first ? first->items[0].at : LLONG_MAX;
+    LOCKPROF_UNLOCK(&queue_mutex, LOCK_CLASS_EVENT, 0, "errore in unlock event queue");
+    return at;
+}
+
+// Funzione che esegue nel thread chiamante tutti gli eventi scaduti entro now_ms,
+// compresi quelli programmati dalle callback stesse. Restituisce il numero di eventi eseguiti.
+int event_run_due(long long now_ms) {
+    int count = 0;
+    LOCKPROF_LOCK(&queue_mutex, LOCK_CLASS_EVENT, 0, "errore in lock event queue");
+    event_heap_t *first;
+    while ((first = queue_first()) && first->items[0].at <= now_ms) {
+        event_t ev = queue_pop(first);
+        count++;
+        LOCKPROF_UNLOCK(&queue_mutex, LOCK_CLASS_EVENT, 0, "errore in unlock event queue");
+        ev.fn(ev.arg);
+        LOCKPROF_LOCK(&queue_mutex, LOCK_CLASS_EVENT, 0, "errore in lock event queue");
+    }
+    LOCKPROF_UNLOCK(&queue_mutex, LOCK_CLASS_EVENT, 0, "errore in unlock event queue");
+    return count;
+}
+
+// Funzione che restituisce il numero di eventi in coda, senza prendere il lock
+int event_queue_depth(void) {
+    return atomic_load_explicit(&queue_depth, memory_order_relaxed);
+}
+
+// Funzione che stampa le statistiche del motore a eventi
+void print_event_engine_stats(void) {
+    printf("Motore a eventi: %lu eventi eseguiti, %lu annullati, coda massima %d eventi\n",
+           dispatched, discarded, max_queue_size);
+    if (sim_clock_mode() == SIM_CLOCK_AFAP)
+        printf("Orologio AFAP: %lu salti, %lld ms virtuali saltati\n", warps, sim_warped_ms());
+}
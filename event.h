@@ -0,0 +1,34 @@
+#ifndef EVENT_H
+#define EVENT_H
+
+// Motore a eventi discreti: un unico thread estrae dalla coda con priorità
+// (min-heap ordinato per istante) gli eventi scaduti ed esegue le relative
+// callback, in ordine di istante e, a parità, di inserimento.
+// Sostituisce i thread dedicati ai singoli twin e alle emergenze: le callback
+// non devono bloccarsi, ma programmare un nuovo evento per il passo successivo.
+// Gli istanti sono in millisecondi del tempo virtuale (simclock.h).
+// Gli eventi di un job sono legati ad un gettone (event_token_new): annullarlo
+// scarta in tempo costante tutti quelli ancora in coda.
+
+typedef void (*event_fn)(void *arg);
+
+// Gettone di un evento non annullabile
+#define EVENT_NO_TOKEN -1
+
+void event_engine_start(void);
+void event_engine_start_manual(void);
+void event_engine_stop(void);
+void event_schedule(long long at_ms, event_fn fn, void *arg);
+void event_schedule_poll(long long at_ms, event_fn fn, void *arg);
+void event_schedule_token(long long at_ms, event_fn fn, void *arg, int token);
+int event_token_new(void);
+int event_cancel(int token);
+void event_token_free(int token);
+void event_hold(void);
+void event_release(void);
+long long event_next_at(void);
+int event_queue_depth(void);
+int event_run_due(long long now_ms);
+void print_event_engine_stats(void);
+
+#endif
@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <threads.h>
+#include <time.h>
+#include "scall.h"
+#include "fleet.h"
+#include "reach.h"
+#include "livestate.h"
+#include "simclock.h"
+
+// Journal circolare degli spostamenti dei twin: la generazione g è salvata
+// nello slot g % FLEET_JOURNAL_SIZE. Permette a chi mantiene stato derivato
+// dalle posizioni (es. gli intent) di applicare solo le differenze.
+static struct {
+    unsigned long generation;
+    int twin_id;
+} journal[FLEET_JOURNAL_SIZE];
+static atomic_ulong current_generation = 0;
+static mtx_t journal_mutex;
+static once_flag journal_once = ONCE_FLAG_INIT;
+
+// Vista colonnare della flotta, aggiornata ad ogni transizione
+static twin_columns_t *columns = NULL;
+
+static void fleet_init(void) {
+    MCALL_INIT(&journal_mutex, mtx_plain, "errore in init journal_mutex");
+}
+
+// Funzione che collega la vista colonnare della flotta (vedi twin_columns_t),
+// da chiamare prima di avviare i worker
+void fleet_attach(rescuer_data_t *rdata) {
+    columns = &rdata->cols;
+}
+
+// Funzione che applica una transizione di stato ad un twin
+// Ogni cambio di posizione viene registrato nel journal e incrementa la generazione
+// twin: twin da aggiornare
+// status: nuovo stato
+// x, y: nuova posizione
+void fleet_update_twin(rescuer_digital_twin_t *twin, rescuer_status_t status, int x, int y) {
+    int old_x = twin->x, old_y = twin->y;
+    rescuer_status_t old_status = twin->status;
+    int moved = old_x != x || old_y != y;
+    twin->x = x;
+    twin->y = y;
+    if (twin->status != status) twin->status_since = sim_now();
+    twin->status = status;
+    if (columns) {
+        columns->x[twin->id - 1] = x;
+        columns->y[twin->id - 1] = y;
+        columns->status[twin->id - 1] = (unsigned char)status;
+    }
+    // Mantiene aggiornato l'indice di raggiungibilità (posizione e stato IDLE)
+    reach_index_update(twin, old_x, old_y, old_status);
+    // e lo stato condiviso letto dagli strumenti di monitoraggio
+    livestate_twin(twin);
+    // Gli intent dipendono solo dalla posizione: le transizioni che non
+    // spostano il twin non generano modifiche
+    if (!moved) return;
+
+    call_once(&journal_once, fleet_init);
+    MCALL_LOCK(&journal_mutex, "errore in lock journal_mutex");
+    unsigned long gen = atomic_load(&current_generation) + 1;
+    journal[gen % FLEET_JOURNAL_SIZE].generation = gen;
+    journal[gen % FLEET_JOURNAL_SIZE].twin_id = twin->id;
+    atomic_store(&current_generation, gen);
+    MCALL_UNLOCK(&journal_mutex, "errore in unlock journal_mutex");
+}
+
+// Funzione che calcola la posizione attuale di un twin all'istante now.
+// Per un twin in rientro interpola il percorso dalla posizione di partenza
+// (x, y) verso la base del suo tipo, prima lungo x e poi lungo y;
+// negli altri stati la posizione è quella registrata.
+void fleet_twin_position(const rescuer_digital_twin_t *twin, time_t now, int *x, int *y) {
+    *x = twin->x;
+    *y = twin->y;
+    if (twin->status != RETURNING_TO_BASE || now <= twin->status_since) return;
+
+    long travelled = (long)(now - twin->status_since) * twin->rescuer->speed;
+    int dx = twin->rescuer->x - twin->x;
+    int dy = twin->rescuer->y - twin->y;
+    // Tratto lungo x
+    long step = labs(dx) < travelled ? labs(dx) : travelled;
+    *x += dx < 0 ? -(int)step : (int)step;
+    travelled -= step;
+    // Tratto lungo y
+    step = labs(dy) < travelled ? labs(dy) : travelled;
+    *y += dy < 0 ? -(int)step : (int)step;
+}
+
+// Funzione che restituisce la generazione corrente della flotta (senza lock)
+unsigned long fleet_generation(void) {
+    return atomic_load(&current_generation);
+}
+
+// Funzione che estrae gli ID dei twin spostati dopo la generazione since
+// twin_ids: buffer di output (può contenere duplicati)
+// max_ids: dimensione del buffer
+// generation: in output, la generazione a cui si riferisce l'elenco
+// Ritorna il numero di ID scritti, -1 se le modifiche non sono più nel journal
+// o non entrano nel buffer (il chiamante deve ricostruire lo stato da zero)
+int fleet_changes_since(unsigned long since, int *twin_ids, int max_ids, unsigned long *generation) {
+    call_once(&journal_once, fleet_init);
+    MCALL_LOCK(&journal_mutex, "errore in lock journal_mutex");
+    unsigned long gen = atomic_load(&current_generation);
+    if (gen - since > FLEET_JOURNAL_SIZE || gen - since > (unsigned long)max_ids) {
+        MCALL_UNLOCK(&journal_mutex, "errore in unlock journal_mutex");
+        return -1;
+    }
+    int count = 0;
+    for (unsigned long g = since + 1; g <= gen; ++g) {
+        twin_ids[count++] = journal[g % FLEET_JOURNAL_SIZE].twin_id;
+    }
+    MCALL_UNLOCK(&journal_mutex, "errore in unlock journal_mutex");
+    *generation = gen;
+    return count;
+}
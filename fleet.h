@@ -0,0 +1,17 @@
+#ifndef FLEET_H
+#define FLEET_H
+
+#include <time.h>
+#include "rescuers.h"
+
+// Numero di modifiche conservate nel journal della flotta; chi è rimasto
+// indietro di più modifiche deve ricostruire da zero il proprio stato
+#define FLEET_JOURNAL_SIZE 1024
+
+void fleet_attach(rescuer_data_t *rdata);
+void fleet_update_twin(rescuer_digital_twin_t *twin, rescuer_status_t status, int x, int y);
+void fleet_twin_position(const rescuer_digital_twin_t *twin, time_t now, int *x, int *y);
+unsigned long fleet_generation(void);
+int fleet_changes_since(unsigned long since, int *twin_ids, int max_ids, unsigned long *generation);
+
+#endif
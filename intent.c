@@ -1,41 +1,149 @@
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
+#include "scall.h"
 #include "intent.h"
+#include "lockprof.h"
+#include "epoch.h"
+#include "fleet.h"
 #include "rescuers.h"
 #include "logger.h"
+#include "simclock.h"
+#include "travel.h"
 #include "worker_thread.h"
 
 
+// Funzione hash per l'ID di emergenza (hashing moltiplicativo di Knuth)
+// Ritorna l'indice dello slot iniziale in una tabella di capacità potenza di 2
+static int intent_hash(int id, int capacity) {
+    return (int)(((unsigned int)id * 2654435761u) & (unsigned int)(capacity - 1));
+}
+
+// Funzione che alloca uno snapshot vuoto con la capacità data
+// Ritorna NULL se l'allocazione fallisce
+static intent_snapshot_t *snapshot_alloc(int capacity) {
+    intent_snapshot_t *snap = calloc(1, sizeof(intent_snapshot_t) + sizeof(intent_t *) * capacity);
+    if (snap) snap->capacity = capacity;
+    return snap;
+}
+
+// Funzione che cerca lo slot occupato dall'intent con l'ID dato
+// Ritorna l'indice dello slot, -1 se l'intent non è presente
+static int snapshot_find(const intent_snapshot_t *snap, int emergency_id) {
+    int mask = snap->capacity - 1;
+    for (int i = intent_hash(emergency_id, snap->capacity); snap->items[i]; i = (i + 1) & mask) {
+        if (snap->items[i]->id == emergency_id) return i;
+    }
+    return -1;
+}
+
+// Funzione che inserisce un intent senza controlli di capacità
+// Lo snapshot deve essere privato dello scrittore e avere almeno uno slot libero
+static void snapshot_insert(intent_snapshot_t *snap, intent_t *intent) {
+    int i = intent_hash(intent->id, snap->capacity);
+    while (snap->items[i]) i = (i + 1) & (snap->capacity - 1);
+    snap->items[i] = intent;
+    snap->size++;
+}
+
+// Funzione che rimuove l'intent nello slot dato con cancellazione a
+// backward shift, così la tabella non accumula tombstone
+static void snapshot_remove(intent_snapshot_t *snap, int hole) {
+    int mask = snap->capacity - 1;
+    snap->items[hole] = NULL;
+    snap->size--;
+    // Sposta indietro gli elementi successivi della stessa catena di probing
+    for (int i = (hole + 1) & mask; snap->items[i]; i = (i + 1) & mask) {
+        int home = intent_hash(snap->items[i]->id, snap->capacity);
+        // L'elemento può riempire il buco solo se il buco si trova
+        // (ciclicamente) tra il suo slot iniziale e la posizione attuale
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            snap->items[hole] = snap->items[i];
+            snap->items[i] = NULL;
+            hole = i;
+        }
+    }
+}
+
+// Funzione che crea una copia privata dello snapshot con la capacità data
+// (uguale o maggiore di quella attuale), su cui lo scrittore applica le modifiche
+// Ritorna NULL se l'allocazione fallisce
+static intent_snapshot_t *snapshot_copy(const intent_snapshot_t *old, int capacity) {
+    intent_snapshot_t *snap = snapshot_alloc(capacity);
+    if (!snap) return NULL;
+    if (capacity == old->capacity) {
+        // Stessa capacità: gli slot restano validi, basta copiarli
+        memcpy(snap->items, old->items, sizeof(intent_t *) * capacity);
+        snap->size = old->size;
+    } else {
+        // Capacità diversa: reinserisce tutti gli intent
+        for (int i = 0; i < old->capacity; ++i) {
+            if (old->items[i]) snapshot_insert(snap, old->items[i]);
+        }
+    }
+    return snap;
+}
+
+// Funzione che acquisisce il mutex degli scrittori aggiornando le statistiche di contesa
+static void intent_writer_lock(intent_table_t *table) {
+    if (mtx_trylock(&table->mutex) != thrd_success) {
+        atomic_fetch_add_explicit(&table->contended_writes, 1, memory_order_relaxed);
+        LOCKPROF_LOCK(&table->mutex, LOCK_CLASS_INTENT, 0, "errore in lock intent table");
+    } else {
+        LOCKPROF_ACQUIRED(LOCK_CLASS_INTENT, 0);
+    }
+    atomic_fetch_add_explicit(&table->writes, 1, memory_order_relaxed);
+}
+
+// Funzione che pubblica un nuovo snapshot e ritira il vecchio (e l'eventuale
+// intent sostituito o rimosso); la memoria è liberata dopo il periodo di grazia
+// Deve essere chiamata con il mutex degli scrittori acquisito
+static void intent_publish(intent_table_t *table, intent_snapshot_t *snap,
+                           intent_snapshot_t *old, intent_t *retired) {
+    atomic_store(&table->snapshot, snap);
+    epoch_retire(old);
+    epoch_retire(retired);
+    epoch_reclaim();
+}
+
 // Funzione che inizializza la tabella degli intenti
 void init_intent_table(intent_table_t *table) {
-    // Inizializza la dimensione a 0 (nessun intent presente)
-    table->size = 0;
-    // Inizializza il mutex associato alla tabella
-    mtx_init(&table->mutex, mtx_plain);
-    // Imposta tutti gli slot della tabella a NULL
-    for (int i = 0; i < MAX_INTENT_ENTRIES; ++i) {
-        table->items[i] = NULL;
-    }
+    intent_snapshot_t *snap;
+    // Alloca lo snapshot iniziale, con tutti gli slot a NULL
+    SNCALL(snap, snapshot_alloc(INTENT_TABLE_INIT_CAPACITY), "errore in calloc intent table");
+    atomic_init(&table->snapshot, snap);
+    atomic_init(&table->writes, 0);
+    atomic_init(&table->contended_writes, 0);
+    // Inizializza il mutex che serializza gli scrittori
+    MCALL_INIT(&table->mutex, mtx_plain, "errore in init intent table mutex");
 }
 
 // Funzione che registra un nuovo intento nella intent table
 // table: puntatore alla tabella degli intent
 // intent: puntatore all'intent da aggiungere
-// Ritorna 0 se l'aggiunta ha successo, -1 in caso di errore o tabella piena
+// Ritorna 0 se l'aggiunta ha successo, -1 se l'ID è già registrato.
+// Come per unregister_intent, la memoria esaurita per il nuovo snapshot è un
+// errore fatale: una tabella non aggiornabile lascerebbe intent orfani
 int register_intent(intent_table_t *table, intent_t *intent) {
     if (!intent || !table) return -1;
-    // Acquisisce il lock per accedere in mutua esclusione alla tabella
-    mtx_lock(&table->mutex);
-    // Verifica se c'è spazio nella tabella
-    if (table->size >= MAX_INTENT_ENTRIES) {
-        mtx_unlock(&table->mutex);
+    // Acquisisce il lock per serializzare gli scrittori
+    intent_writer_lock(table);
+    intent_snapshot_t *old = atomic_load(&table->snapshot);
+    // Un'emergenza può avere un solo intent registrato
+    if (snapshot_find(old, intent->id) != -1) {
+        LOCKPROF_UNLOCK(&table->mutex, LOCK_CLASS_INTENT, 0, "errore in unlock intent table");
         return -1;
     }
-    // Inserisce l'intento nella prima posizione libera e incrementa la dimensione
-    table->items[table->size++] = intent;
+    // Mantiene il fattore di carico sotto il 75%, la tabella cresce se necessario
+    int capacity = old->capacity;
+    if ((old->size + 1) * 4 > capacity * 3) capacity *= 2;
+    intent_snapshot_t *snap;
+    SNCALL(snap, snapshot_copy(old, capacity), "errore in calloc intent table");
+    snapshot_insert(snap, intent);
+    intent_publish(table, snap, old, NULL);
     // Rilascia il lock
-    mtx_unlock(&table->mutex);
+    LOCKPROF_UNLOCK(&table->mutex, LOCK_CLASS_INTENT, 0, "errore in unlock intent table");
     return 0;
 }
 
@@ -43,45 +151,148 @@ int register_intent(intent_table_t *table, intent_t *intent) {
 // table: puntatore alla tabella degli intent
 // new_intent: nuovo intent con lo stesso ID di uno già presente
 // Ritorna 0 se l'aggiornamento ha successo, -1 se l'intent non viene trovato
+// (memoria esaurita: errore fatale, come in register_intent)
 int update_intent(intent_table_t *table, intent_t *new_intent) {
     if (!table || !new_intent) return -1;
-    // Acquisisce il lock per accesso esclusivo alla tabella
-    mtx_lock(&table->mutex);
-    // Cerca un intent con lo stesso ID
-    for (int i = 0; i < table->size; ++i) {
-        if (table->items[i] && table->items[i]->id == new_intent->id) {
-            // Sostituisce il vecchio intent con quello nuovo
-            free(table->items[i]); // Libera memoria del vecchio intent
-            table->items[i] = new_intent; // Assegna il nuovo intent
-            mtx_unlock(&table->mutex);
-            return 0;
+    // Acquisisce il lock per serializzare gli scrittori
+    intent_writer_lock(table);
+    intent_snapshot_t *old = atomic_load(&table->snapshot);
+    // Cerca l'intent con lo stesso ID
+    int slot = snapshot_find(old, new_intent->id);
+    if (slot == -1) {
+        LOCKPROF_UNLOCK(&table->mutex, LOCK_CLASS_INTENT, 0, "errore in unlock intent table");
+        return -1;
+    }
+    intent_snapshot_t *snap;
+    SNCALL(snap, snapshot_copy(old, old->capacity), "errore in calloc intent table");
+    // Sostituisce il vecchio intent con quello nuovo, il vecchio viene ritirato
+    snap->items[slot] = new_intent;
+    intent_publish(table, snap, old, old->items[slot]);
+    LOCKPROF_UNLOCK(&table->mutex, LOCK_CLASS_INTENT, 0, "errore in unlock intent table");
+    return 0;
+}
+
+// Funzione che calcola la deadline di un'emergenza in base alla priorità
+static time_t intent_deadline(const emergency_withID_t *e) {
+    int priority = e->emergency.type.priority;
+    return e->emergency.time +
+        (priority == 1 ? TIMEOUT_PRIORITY_1 :
+         priority == 2 ? TIMEOUT_PRIORITY_2 : TIMEOUT_MAX);
+}
+
+// Funzione che segna i tipi di soccorritore richiesti dall'emergenza
+// (direttamente o come sostituti): required[k] = 1 se il tipo k serve
+static void intent_required_types(const emergency_withID_t *e, const rescuer_data_t *rdata,
+                                  unsigned char *required) {
+    for (int k = 0; k < rdata->num_types; ++k) {
+        required[k] = 0;
+        for (int j = 0; j < e->emergency.type.rescuers_req_number && !required[k]; ++j)
+            required[k] = rescuer_request_match(&e->emergency.type.rescuers[j], rdata->types[k]) >= 0;
+    }
+}
+
+// Funzione che aggiunge all'intent il twin di indice i, raggiungibile in travel_time secondi
+// Aggiorna valid_until: l'istante oltre il quale il twin non sarà più raggiungibile
+static void intent_add_twin(intent_t *intent, int i, int travel_time, time_t deadline) {
+    if (intent->twin_count < MAX_TWINS) {
+        intent->twin_ids[intent->twin_count++] = i + 1;
+        if (deadline - travel_time < intent->valid_until) {
+            intent->valid_until = deadline - travel_time;
         }
     }
-    // Intent con quell'ID non trovato
-    mtx_unlock(&table->mutex);
-    return -1; 
+}
+
+// Funzione che aggiunge il twin di indice i all'intent se può arrivare entro la deadline
+// (legge solo la vista colonnare della flotta)
+static void intent_add_if_reachable(intent_t *intent, const emergency_withID_t *e,
+                                    const twin_columns_t *cols, int i, time_t now, time_t deadline) {
+    int dist = abs(cols->x[i] - e->emergency.x) + abs(cols->y[i] - e->emergency.y);
+    int travel_time = (dist + cols->speed[i] - 1) / cols->speed[i];
+
+    if (now + travel_time <= deadline)
+        intent_add_twin(intent, i, travel_time, deadline);
+}
+
+// Funzione che verifica se l'intent contiene già il twin
+static int intent_contains(const intent_t *intent, int twin_id) {
+    for (int i = 0; i < intent->twin_count; ++i) {
+        if (intent->twin_ids[i] == twin_id) return 1;
+    }
+    return 0;
+}
+
+// Funzione che deriva un nuovo intent da quello precedente applicando solo le
+// differenze: i twin spostati dopo old->generation vengono rivalutati, gli altri
+// vengono solo filtrati in base al tempo residuo
+// Ritorna il nuovo intent, NULL se il journal della flotta non copre più le
+// modifiche (serve una ricostruzione completa) o in caso di errore
+static intent_t *intent_apply_delta(const intent_t *old, const emergency_withID_t *e,
+                                    const rescuer_data_t *rdata) {
+    int changed[FLEET_JOURNAL_SIZE];
+    unsigned long generation;
+    int changed_count = fleet_changes_since(old->generation, changed, FLEET_JOURNAL_SIZE, &generation);
+    if (changed_count < 0) return NULL;
+
+    intent_t *intent = malloc(sizeof(intent_t));
+    if (!intent) return NULL;
+    time_t deadline = intent_deadline(e);
+    time_t now = sim_now();
+    intent->id = old->id;
+    intent->priority = old->priority;
+    intent->timestamp = old->timestamp;
+    intent->generation = generation;
+    intent->valid_until = deadline;
+    intent->twin_count = 0;
+
+    // Twin non spostati: restano se ancora raggiungibili
+    for (int i = 0; i < old->twin_count; ++i) {
+        int moved = 0;
+        for (int k = 0; k < changed_count && !moved; ++k) {
+            moved = changed[k] == old->twin_ids[i];
+        }
+        if (!moved) {
+            intent_add_if_reachable(intent, e, &rdata->cols, old->twin_ids[i] - 1, now, deadline);
+        }
+    }
+    // Twin spostati: rivalutati come in una ricostruzione completa
+    unsigned char required[MAX_TYPES];
+    intent_required_types(e, rdata, required);
+    for (int k = 0; k < changed_count; ++k) {
+        int t = changed[k] - 1;
+        if (required[rdata->cols.type_id[t]] && !intent_contains(intent, changed[k])) {
+            intent_add_if_reachable(intent, e, &rdata->cols, t, now, deadline);
+        }
+    }
+    return intent;
 }
 
 // Funzione per registrare o aggiornare un intent nella intent table
+// Alla prima chiamata costruisce l'intent da zero, in seguito applica solo le
+// modifiche della flotta successive all'intent corrente
 // table: puntatore alla tabella degli intenti
 // e: emergenza da cui creare l'intent
 // rdata: dati dei soccorritori disponibili
-// first_time: 1 se si tratta di una nuova registrazione, 0 se è un aggiornamento
+// current: intent attualmente registrato per l'emergenza (NULL se nessuno),
+//          aggiornato in output con quello nuovo
 // Ritorna 0 in caso di successo, -1 in caso di errore
-int refresh_intent(intent_table_t *table, emergency_withID_t *e, rescuer_data_t *rdata, int first_time) {
-    // Crea un nuovo intento basato sull'emergenza corrente
-    intent_t *intent = create_intent_from_emergency(e, rdata);
+int refresh_intent(intent_table_t *table, emergency_withID_t *e, rescuer_data_t *rdata, intent_t **current) {
+    intent_t *old = *current;
+    // Prova ad applicare le differenze, altrimenti ricostruisce l'intent
+    intent_t *intent = old ? intent_apply_delta(old, e, rdata) : NULL;
     if (!intent) {
-        log_event_id(e->id, "INTENT", "Creazione intent fallita.");
+        intent = create_intent_from_emergency(e, rdata);
+    }
+    if (!intent) {
+        LOG_TEXT_ID(LOG_LEVEL_ERROR, LOG_CAT_DISPATCH, e->id, "INTENT", "Creazione intent fallita.");
         return -1;
     }
 
     int res;
-    if (first_time) {
+    if (!old) {
         // Prima registrazione dell'intent
         res = register_intent(table, intent);
         if (res != 0) {
-            log_event_id(e->id, "INTENT", "Registrazione intent fallita.");
+            LOG_TEXT_ID(LOG_LEVEL_ERROR, LOG_CAT_DISPATCH, e->id, "INTENT", "Registrazione intent fallita.");
             free(intent);
             return -1;
         }
@@ -89,11 +300,12 @@ int refresh_intent(intent_table_t *table, emergency_withID_t *e, rescuer_data_t
         // Aggiornamento dell'intent esistente
         res = update_intent(table, intent);
         if (res != 0) {
-            log_event_id(e->id, "INTENT", "Aggiornamento intent fallito.");
+            LOG_TEXT_ID(LOG_LEVEL_ERROR, LOG_CAT_DISPATCH, e->id, "INTENT", "Aggiornamento intent fallito.");
             free(intent);
             return -1;
         }
     }
+    *current = intent;
     return 0;
 }
 
@@ -101,22 +313,21 @@ int refresh_intent(intent_table_t *table, emergency_withID_t *e, rescuer_data_t
 // Funzione che rimuove un intento dalla intent table dato l'ID dell'emergenza
 // table: puntatore alla tabella degli intent
 // emergency_id: ID dell'emergenza da disregistrare
+// La memoria esaurita per il nuovo snapshot è un errore fatale (vedi register_intent)
 void unregister_intent(intent_table_t *table, int emergency_id) {
-    mtx_lock(&table->mutex);
+    intent_writer_lock(table);
+    intent_snapshot_t *old = atomic_load(&table->snapshot);
     // Cerca l'intent con l'ID specificato
-    for (int i = 0; i < table->size; ++i) {
-        if (table->items[i] && table->items[i]->id == emergency_id) {
-            // Libera la memoria dell'intento (allocato da funzione 
-            // create_intent_from_emergency)
-            free(table->items[i]);
-            // Riempie il buco spostando l'ultimo elemento in questa posizione
-            table->items[i] = table->items[table->size - 1];
-            table->items[table->size - 1] = NULL;
-            table->size--;
-            break;
-        }
+    int slot = snapshot_find(old, emergency_id);
+    if (slot != -1) {
+        intent_snapshot_t *snap;
+        SNCALL(snap, snapshot_copy(old, old->capacity), "errore in calloc intent table");
+        snapshot_remove(snap, slot);
+        // L'intento (allocato da create_intent_from_emergency) viene ritirato
+        // e liberato quando nessun lettore può più accedervi
+        intent_publish(table, snap, old, old->items[slot]);
     }
-    mtx_unlock(&table->mutex);
+    LOCKPROF_UNLOCK(&table->mutex, LOCK_CLASS_INTENT, 0, "errore in unlock intent table");
 }
 
 
@@ -137,31 +348,28 @@ int has_conflict(intent_t *a, intent_t *b) {
 
 
 // Funzione che verifica se un'emergenza può procedere con l'assegnazione delle risorse
+// Non acquisisce lock: legge lo snapshot corrente sotto protezione di epoca
 // table: puntatore alla intent table
 // emergency_id: ID dell'emergenza da valutare
 // Ritorna 1 se può procedere, 0 se deve aspettare per conflitti o priorità inferiori
 int can_proceed(intent_table_t *table, int emergency_id) {
     int res = 1;
-    intent_t *candidate = NULL;
-    
-    mtx_lock(&table->mutex);
+
+    epoch_enter();
+    intent_snapshot_t *snap = atomic_load(&table->snapshot);
 
     // Trova l'intent corrispondente all'ID dell'emergenza
-    for (int i = 0; i < table->size; ++i) {
-        if (table->items[i] && table->items[i]->id == emergency_id) {
-            candidate = table->items[i];
-            break;
-        }
-    }
+    int slot = snapshot_find(snap, emergency_id);
     // Se l'intent non esiste, non può procedere
-    if (!candidate) {
-        mtx_unlock(&table->mutex);
+    if (slot == -1) {
+        epoch_exit();
         return 0;
     }
+    intent_t *candidate = snap->items[slot];
 
     // Controlla se ci sono conflitti con altri intent
-    for (int i = 0; i < table->size; ++i) {
-        intent_t *other = table->items[i];
+    for (int i = 0; i < snap->capacity; ++i) {
+        intent_t *other = snap->items[i];
         if (!other || other->id == candidate->id) continue;
 
         // Se c'è conflitto tra twin_ids
@@ -184,7 +392,7 @@ int can_proceed(intent_table_t *table, int emergency_id) {
         }
     }
 
-    mtx_unlock(&table->mutex);
+    epoch_exit();
     return res;
 }
 
@@ -200,40 +408,37 @@ intent_t *create_intent_from_emergency(const emergency_withID_t *e, const rescue
     intent_t *intent = malloc(sizeof(intent_t));
     if (!intent) return NULL;
 
-    // Inizializza i campi principali dell'intent
+    // Calcola la deadline in base alla priorità dell'emergenza
+    time_t deadline = intent_deadline(e);
+
+    // Inizializza i campi principali dell'intent; la generazione va letta
+    // prima della scansione, così uno spostamento concorrente non viene perso
     intent->id = e->id;
     intent->priority = e->emergency.type.priority;
     intent->timestamp = e->emergency.time;
+    intent->generation = fleet_generation();
+    intent->valid_until = deadline;
     intent->twin_count = 0;
 
-    // Calcola la deadline in base alla priorità dell'emergenza
-    time_t deadline = e->emergency.time +
-        (intent->priority == 1 ? TIMEOUT_PRIORITY_1 :
-         intent->priority == 2 ? TIMEOUT_PRIORITY_2 : TIMEOUT_MAX);
-
-    time_t now = time(NULL);  
-
-    // Scorre tutti i rescuers digital twins
-    for (int i = 0; i < rdata->num_twins; ++i) {
-        rescuer_digital_twin_t *t = &rdata->twins[i];
-
-        // Considera solo i rescuers del tipo richiesto dall'emergenza
-        int tipo_richiesto = 0;
-        for (int j = 0; j < e->emergency.type.rescuers_req_number; ++j) {
-            const char *richiesto = e->emergency.type.rescuers[j].type->rescuer_type_name;
-            if (strcmp(t->rescuer->rescuer_type_name, richiesto) == 0) {
-                tipo_richiesto = 1;
-                break;
-            }
-        }
-        if (!tipo_richiesto) continue;
-
-        // Verifica se il rescuer può arrivare entro la deadline
-        int dist = abs(t->x - e->emergency.x) + abs(t->y - e->emergency.y);
-        int travel_time = (dist + t->rescuer->speed - 1) / t->rescuer->speed;
-
-        if (now + travel_time <= deadline && intent->twin_count < MAX_TWINS) {
-            intent->twin_ids[intent->twin_count++] = t->id;
+    time_t now = sim_now();  
+
+    // Scorre tutti i rescuers digital twins (vista colonnare)
+    unsigned char required[MAX_TYPES];
+    intent_required_types(e, rdata, required);
+    int times[TRAVEL_BLOCK];
+    unsigned char reachable[TRAVEL_BLOCK];
+    long budget = (long)(deadline - now);
+    if (budget > INT_MAX) budget = INT_MAX;
+    if (budget < -1) budget = -1;
+    for (int start = 0; start < rdata->num_twins; start += TRAVEL_BLOCK) {
+        int end = start + TRAVEL_BLOCK < rdata->num_twins ? start + TRAVEL_BLOCK : rdata->num_twins;
+        // Tempi di arrivo e maschera della deadline per l'intero blocco
+        travel_times(&rdata->cols, start, end, e->emergency.x, e->emergency.y, (int)budget,
+                     times, reachable);
+        for (int i = start; i < end; ++i) {
+            // Considera solo i rescuers del tipo richiesto che arrivano entro la deadline
+            if (reachable[i - start] && required[rdata->cols.type_id[i]])
+                intent_add_twin(intent, i, times[i - start], deadline);
         }
     }
 
@@ -242,20 +447,36 @@ intent_t *create_intent_from_emergency(const emergency_withID_t *e, const rescue
 
 
 
+// Funzione che stampa le statistiche di contesa della tabella degli intent
+// I lettori non acquisiscono lock, quindi la contesa riguarda solo gli scrittori
+void print_intent_table_stats(intent_table_t *table) {
+    if (!table) return;
+    unsigned long writes = atomic_load(&table->writes);
+    unsigned long contended = atomic_load(&table->contended_writes);
+    char msg[128];
+    snprintf(msg, sizeof(msg), "Scritture intent table: %lu, in contesa: %lu (%.1f%%)",
+             writes, contended, writes ? 100.0 * contended / writes : 0.0);
+    printf("%s\n", msg);
+    LOG_TEXT(LOG_LEVEL_INFO, LOG_CAT_DISPATCH, "intent.c", "INTENT", msg);
+}
+
 // Funzione che libera tutta la memoria associata alla tabella degli intent
+// Da chiamare quando nessun thread accede più alla tabella
 void free_intent_table(intent_table_t *table) {
     if (!table) return;
 
-    // Blocca l'accesso concorrente alla tabella
-    mtx_lock(&table->mutex);
-
-    for (int i = 0; i < table->size; ++i) {
-        if (table->items[i]) {
-            free(table->items[i]);
-            table->items[i] = NULL;
+    // Blocca l'accesso concorrente degli scrittori
+    LOCKPROF_LOCK(&table->mutex, LOCK_CLASS_INTENT, 0, "errore in lock intent table");
+    intent_snapshot_t *snap = atomic_load(&table->snapshot);
+    for (int i = 0; i < snap->capacity; ++i) {
+        if (snap->items[i]) {
+            free(snap->items[i]);
         }
     }
-    table->size = 0;
-    mtx_unlock(&table->mutex);
+    free(snap);
+    atomic_store(&table->snapshot, NULL);
+    // Libera snapshot e intent ancora in attesa del periodo di grazia
+    epoch_shutdown();
+    LOCKPROF_UNLOCK(&table->mutex, LOCK_CLASS_INTENT, 0, "errore in unlock intent table");
     mtx_destroy(&table->mutex);
 }
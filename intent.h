@@ -3,33 +3,54 @@
 
 #include <time.h>
 #include <threads.h>
+#include <stdatomic.h>
 #include "rescuers.h"
 #include "emergency.h"
 
-#define MAX_INTENT_ENTRIES 128
+// Capacità iniziale della tabella hash (deve essere una potenza di 2)
+#define INTENT_TABLE_INIT_CAPACITY 64
 #define WINDOW_PERIOD_SEC 5
 
 typedef struct {
     int id;
     int priority;
     time_t timestamp;
+    // Generazione della flotta su cui è stato calcolato l'intent (vedi fleet.h)
+    unsigned long generation;
+    // Istante oltre il quale almeno un twin dell'intent non è più raggiungibile
+    time_t valid_until;
     int twin_ids[MAX_TWINS];
     int twin_count;
 } intent_t;
 
+// Versione immutabile della tabella hash ad indirizzamento aperto (linear
+// probing) indicizzata per ID di emergenza; cresce raddoppiando quando
+// supera il 75% di carico
 typedef struct {
-    intent_t *items[MAX_INTENT_ENTRIES];
+    int capacity;
     int size;
+    intent_t *items[];
+} intent_snapshot_t;
+
+// Tabella degli intent read-mostly: i lettori (can_proceed) accedono senza lock
+// allo snapshot corrente sotto protezione di epoca, gli scrittori si serializzano
+// sul mutex, pubblicano una nuova versione e ritirano quella vecchia (vedi epoch.h)
+typedef struct {
+    _Atomic(intent_snapshot_t *) snapshot;
     mtx_t mutex;
+    // Statistiche di contesa degli scrittori (i lettori non toccano dati condivisi)
+    atomic_ulong writes;
+    atomic_ulong contended_writes;
 } intent_table_t;
 
 void init_intent_table(intent_table_t *table);
 int register_intent(intent_table_t *table, intent_t *intent);
 int update_intent(intent_table_t *table, intent_t *new_intent);
-int refresh_intent(intent_table_t *table, emergency_withID_t *e, rescuer_data_t *rdata, int first_time);
+int refresh_intent(intent_table_t *table, emergency_withID_t *e, rescuer_data_t *rdata, intent_t **current);
 void unregister_intent(intent_table_t *table, int emergency_id);
 int can_proceed(intent_table_t *table, int emergency_id);
 intent_t *create_intent_from_emergency(const emergency_withID_t *e, const rescuer_data_t *rdata);
+void print_intent_table_stats(intent_table_t *table);
 void free_intent_table(intent_table_t *table);
 
 #endif
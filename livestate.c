@@ -0,0 +1,167 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <threads.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "scall.h"
+#include "livestate.h"
+#include "simclock.h"
+
+#define LIVESTATE_PATH_SIZE 128
+
+// Regione pubblicata (NULL se state_shm non è configurato: ogni
+// aggiornamento si riduce al controllo di questo puntatore)
+static livestate_region_t *region = NULL;
+static char region_name[LIVESTATE_PATH_SIZE];
+// Flotta di cui si pubblica lo stato, per l'indice di tipo dei twin
+static const rescuer_data_t *fleet = NULL;
+
+// Funzione che apre la scrittura di uno slot: porta seq a un valore dispari.
+// Due scrittori dello stesso slot (es. il dispatcher e un job della stessa
+// emergenza) si alternano; le scritture durano poche istruzioni
+static unsigned livestate_write_begin(atomic_uint *seq) {
+    for (;;) {
+        unsigned s = atomic_load_explicit(seq, memory_order_relaxed);
+        if (!(s & 1) && atomic_compare_exchange_weak_explicit(seq, &s, s + 1,
+                                                              memory_order_acquire, memory_order_relaxed)) {
+            // I campi scritti dopo non possono precedere il seq dispari
+            atomic_thread_fence(memory_order_release);
+            return s + 1;
+        }
+        if (s & 1) thrd_yield();
+    }
+}
+
+// Funzione che chiude la scrittura: seq torna pari e rende visibili i campi
+static void livestate_write_end(atomic_uint *seq, unsigned s) {
+    atomic_store_explicit(seq, s + 1, memory_order_release);
+    atomic_store_explicit(&region->now, (long long)sim_now(), memory_order_relaxed);
+    atomic_fetch_add_explicit(&region->updates, 1, memory_order_relaxed);
+}
+
+// Funzione che crea la regione condivisa name (senza '/', come queue in env.conf)
+// e vi pubblica la flotta iniziale. Se la regione non si può creare il server
+// prosegue senza pubblicare lo stato
+void livestate_start(const char *name, const rescuer_data_t *rdata, const env_config_t *config) {
+    if (!name) return;
+    snprintf(region_name, sizeof(region_name), "/%s", name);
+    int fd = shm_open(region_name, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (fd == -1) {
+        perror("errore in shm_open stato condiviso");
+        return;
+    }
+    if (ftruncate(fd, sizeof(livestate_region_t)) == -1) {
+        perror("errore in ftruncate stato condiviso");
+        close(fd);
+        shm_unlink(region_name);
+        return;
+    }
+    void *addr = mmap(NULL, sizeof(livestate_region_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        perror("errore in mmap stato condiviso");
+        shm_unlink(region_name);
+        return;
+    }
+    livestate_region_t *r = addr;
+    // La regione appena creata è azzerata: seq pari e slot delle emergenze liberi
+    r->version = LIVESTATE_VERSION;
+    r->size = sizeof(livestate_region_t);
+    r->pid = (int)getpid();
+    r->height = config->height;
+    r->width = config->width;
+    r->num_types = rdata->num_types < MAX_TYPES ? rdata->num_types : MAX_TYPES;
+    r->num_twins = rdata->num_twins < MAX_TWINS ? rdata->num_twins : MAX_TWINS;
+    for (int i = 0; i < r->num_types; ++i)
+        snprintf(r->type_names[i], LIVESTATE_NAME_SIZE, "%s", rdata->types[i]->rescuer_type_name);
+    fleet = rdata;
+    region = r;
+    for (int i = 0; i < r->num_twins; ++i)
+        livestate_twin(&rdata->twins[i]);
+    // Il lettore considera valida la regione solo dopo il magic
+    atomic_thread_fence(memory_order_release);
+    r->magic = LIVESTATE_MAGIC;
+}
+
+// Funzione che pubblica lo stato di un twin (chiamata da fleet_update_twin,
+// dopo che il twin ha ricevuto posizione, stato ed emergenza)
+void livestate_twin(const rescuer_digital_twin_t *twin) {
+    if (!region || twin->id < 1 || twin->id > region->num_twins) return;
+    livestate_twin_t *slot = &region->twins[twin->id - 1];
+    unsigned s = livestate_write_begin(&slot->seq);
+    slot->type_id = fleet->cols.type_id[twin->id - 1];
+    slot->x = twin->x;
+    slot->y = twin->y;
+    slot->status = twin->status;
+    slot->emergency_id = twin->emergency_id;
+    slot->status_since = (long long)twin->status_since;
+    livestate_write_end(&slot->seq, s);
+}
+
+// Funzione che cerca uno slot libero per l'emergenza, a partire da id modulo
+// la dimensione della tabella. Restituisce -1 se la tabella è piena
+static int livestate_claim(int id) {
+    for (int i = 0; i < LIVESTATE_EMERGENCIES; ++i) {
+        int slot = (id + i) % LIVESTATE_EMERGENCIES;
+        int expected = 0;
+        if (atomic_compare_exchange_strong(&region->emergencies[slot].id, &expected, id))
+            return slot;
+    }
+    return -1;
+}
+
+// Funzione che pubblica lo stato di un'emergenza in attesa o in corso; alla
+// prima chiamata le assegna uno slot, che conserva fino a livestate_remove
+void livestate_emergency(emergency_withID_t *e) {
+    if (!region || e->live_slot == LIVESTATE_NO_SLOT) return;
+    if (e->live_slot < 0) {
+        e->live_slot = livestate_claim(e->id);
+        if (e->live_slot < 0) {
+            e->live_slot = LIVESTATE_NO_SLOT;
+            atomic_fetch_add_explicit(&region->overflow, 1, memory_order_relaxed);
+            return;
+        }
+        atomic_fetch_add_explicit(&region->active, 1, memory_order_relaxed);
+    }
+    const emergency_t *em = &e->emergency;
+    int required = 0;
+    for (int i = 0; i < em->type.rescuers_req_number; ++i)
+        required += em->type.rescuers[i].required_count;
+
+    livestate_emergency_t *slot = &region->emergencies[e->live_slot];
+    unsigned s = livestate_write_begin(&slot->seq);
+    slot->priority = em->type.priority;
+    slot->status = em->status;
+    slot->x = em->x;
+    slot->y = em->y;
+    slot->assigned = em->rescuer_count;
+    slot->required = required;
+    slot->time = (long long)em->time;
+    snprintf(slot->name, LIVESTATE_NAME_SIZE, "%s", em->type.emergency_desc);
+    livestate_write_end(&slot->seq, s);
+}
+
+// Funzione che toglie un'emergenza conclusa (completata o in TIMEOUT) dalla tabella
+void livestate_remove(emergency_withID_t *e) {
+    if (!region || e->live_slot < 0) return;
+    livestate_emergency_t *slot = &region->emergencies[e->live_slot];
+    unsigned s = livestate_write_begin(&slot->seq);
+    atomic_store_explicit(&slot->id, 0, memory_order_relaxed);
+    livestate_write_end(&slot->seq, s);
+    atomic_fetch_sub_explicit(&region->active, 1, memory_order_relaxed);
+    e->live_slot = -1;
+}
+
+// Funzione che rimuove la regione condivisa (i lettori già collegati
+// conservano la mappatura e vedono il server terminato tramite il pid)
+void livestate_stop(void) {
+    if (!region) return;
+    livestate_region_t *r = region;
+    region = NULL;
+    munmap(r, sizeof(livestate_region_t));
+    shm_unlink(region_name);
+}
@@ -0,0 +1,76 @@
+#ifndef LIVESTATE_H
+#define LIVESTATE_H
+
+#include <stdatomic.h>
+#include "rescuers.h"
+#include "emergency.h"
+#include "env.h"
+
+// Stato corrente del server pubblicato in memoria condivisa (shm_open del nome
+// indicato da state_shm in env.conf), in sola lettura per gli strumenti di
+// monitoraggio come Tools/ems-top. Ogni twin e ogni emergenza ha il suo slot
+// protetto da un seqlock: lo scrittore rende dispari il contatore seq, aggiorna
+// i campi e lo rende di nuovo pari; il lettore copia lo slot e ricomincia se
+// seq era dispari o è cambiato nel frattempo. I lettori non prendono alcun
+// lock del server e non possono rallentare il dispatch.
+// La regione ha dimensione fissa, per cui lettore e server vanno compilati con
+// gli stessi MAX_TWINS, MAX_TYPES e LIVESTATE_EMERGENCIES (controllati via size).
+
+#define LIVESTATE_MAGIC 0x454d5354u  // "EMST"
+#define LIVESTATE_VERSION 1
+#define LIVESTATE_NAME_SIZE 32
+// Emergenze in attesa o in corso pubblicabili contemporaneamente
+#ifndef LIVESTATE_EMERGENCIES
+#define LIVESTATE_EMERGENCIES 4096
+#endif
+// Valore di emergency_withID_t.live_slot per un'emergenza rimasta fuori dalla tabella piena
+#define LIVESTATE_NO_SLOT -2
+
+typedef struct {
+    atomic_uint seq;
+    int type_id;             // indice in type_names
+    int x;
+    int y;
+    int status;              // rescuer_status_t
+    int emergency_id;        // emergenza assegnata (0 se nessuna)
+    long long status_since;  // istante virtuale dell'ultimo cambio di stato
+} livestate_twin_t;
+
+typedef struct {
+    atomic_uint seq;
+    atomic_int id;           // 0: slot libero
+    int priority;
+    int status;              // emergency_status_t
+    int x;
+    int y;
+    int assigned;            // twin assegnati
+    int required;            // twin richiesti dal tipo
+    long long time;          // istante virtuale della richiesta
+    char name[LIVESTATE_NAME_SIZE];
+} livestate_emergency_t;
+
+typedef struct {
+    unsigned magic;
+    unsigned version;
+    unsigned long size;      // sizeof(livestate_region_t) del server
+    int pid;
+    int height;
+    int width;
+    int num_types;
+    int num_twins;
+    atomic_llong now;        // istante virtuale dell'ultimo aggiornamento
+    atomic_ulong updates;    // aggiornamenti pubblicati
+    atomic_int active;       // emergenze presenti nella tabella
+    atomic_ulong overflow;   // emergenze non pubblicate per tabella piena
+    char type_names[MAX_TYPES][LIVESTATE_NAME_SIZE];
+    livestate_twin_t twins[MAX_TWINS];              // indice = id - 1
+    livestate_emergency_t emergencies[LIVESTATE_EMERGENCIES];
+} livestate_region_t;
+
+void livestate_start(const char *name, const rescuer_data_t *rdata, const env_config_t *config);
+void livestate_twin(const rescuer_digital_twin_t *twin);
+void livestate_emergency(emergency_withID_t *e);
+void livestate_remove(emergency_withID_t *e);
+void livestate_stop(void);
+
+#endif
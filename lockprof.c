@@ -0,0 +1,150 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "lockprof.h"
+
+#if LOCK_PROFILE
+#include <stdatomic.h>
+#include "rescuers.h"
+#include "metrics.h"
+
+// Twin più contesi riportati nel rapporto
+#define LOCKPROF_TOP_TWINS 10
+
+// Statistiche di una classe di lock
+typedef struct {
+    atomic_ulong acquisitions;
+    atomic_ulong contended;      // acquisizioni che hanno dovuto attendere
+    atomic_ulong trylock_failed;
+    metric_histogram_t wait;     // attesa per l'acquisizione (0 se libero)
+    metric_histogram_t hold;     // tempo di possesso
+} lock_stats_t;
+
+static const char *class_names[LOCK_CLASSES] = {"twin_locks", "intent table", "log_mutex", "coda eventi"};
+static lock_stats_t stats[LOCK_CLASSES];
+// Istante di acquisizione del lock posseduto: scritto e letto solo da chi lo
+// possiede, il passaggio tra possessori è ordinato dal mutex stesso
+static long long held_since[LOCK_CLASSES];
+static long long twin_held_since[MAX_TWINS + 1];
+// Attese e trylock falliti per id di twin
+static atomic_uint twin_contention[MAX_TWINS + 1];
+
+
+// Funzione che restituisce la cella dell'istante di acquisizione di un lock
+static long long *held_slot(lock_class_t cls, int id) {
+    if (cls == LOCK_CLASS_TWIN && id >= 1 && id <= MAX_TWINS)
+        return &twin_held_since[id];
+    return &held_since[cls];
+}
+
+// Funzione che registra un'acquisizione con il suo tempo di attesa
+static void lockprof_record(lock_class_t cls, int id, long long wait_ns, long long now) {
+    lock_stats_t *s = &stats[cls];
+    atomic_fetch_add_explicit(&s->acquisitions, 1, memory_order_relaxed);
+    metric_record(&s->wait, wait_ns);
+    *held_slot(cls, id) = now;
+}
+
+// Funzione che conta un episodio di contesa sul twin id
+static void twin_contended(lock_class_t cls, int id) {
+    if (cls == LOCK_CLASS_TWIN && id >= 1 && id <= MAX_TWINS)
+        atomic_fetch_add_explicit(&twin_contention[id], 1, memory_order_relaxed);
+}
+
+// Funzione che acquisisce il mutex misurando l'attesa: prima un trylock, e
+// solo se il mutex è occupato un'acquisizione bloccante cronometrata
+void lockprof_lock(mtx_t *mutex, lock_class_t cls, int id, const char *errmsg) {
+    if (mtx_trylock(mutex) == thrd_success) {
+        lockprof_record(cls, id, 0, metrics_now_ns());
+        return;
+    }
+    long long start = metrics_now_ns();
+    if (mtx_lock(mutex) != thrd_success) {
+        perror(errmsg);
+        exit(EXIT_FAILURE);
+    }
+    long long now = metrics_now_ns();
+    atomic_fetch_add_explicit(&stats[cls].contended, 1, memory_order_relaxed);
+    twin_contended(cls, id);
+    lockprof_record(cls, id, now - start, now);
+}
+
+// Funzione che tenta l'acquisizione del mutex senza attendere
+// Ritorna il risultato di mtx_trylock
+int lockprof_trylock(mtx_t *mutex, lock_class_t cls, int id) {
+    int rc = mtx_trylock(mutex);
+    if (rc == thrd_success) {
+        lockprof_record(cls, id, 0, metrics_now_ns());
+    } else {
+        atomic_fetch_add_explicit(&stats[cls].trylock_failed, 1, memory_order_relaxed);
+        twin_contended(cls, id);
+    }
+    return rc;
+}
+
+// Funzione che registra un'acquisizione avvenuta fuori dal wrapper
+// (risveglio da cnd_wait, trylock riuscito del chiamante)
+void lockprof_acquired(lock_class_t cls, int id) {
+    lockprof_record(cls, id, 0, metrics_now_ns());
+}
+
+// Funzione che registra il tempo di possesso al rilascio del mutex
+void lockprof_released(lock_class_t cls, int id) {
+    metric_record(&stats[cls].hold, metrics_now_ns() - *held_slot(cls, id));
+}
+
+// Funzione che scrive su fd il rapporto di contesa dei lock
+void lockprof_dump(int fd) {
+    dprintf(fd, "===== Contesa dei lock =====\n");
+    dprintf(fd, "%-14s %12s %12s %15s %9s\n", "classe", "acquisizioni", "in attesa", "trylock falliti", "contesa");
+    for (int c = 0; c < LOCK_CLASSES; ++c) {
+        unsigned long acq = atomic_load_explicit(&stats[c].acquisitions, memory_order_relaxed);
+        unsigned long cont = atomic_load_explicit(&stats[c].contended, memory_order_relaxed);
+        unsigned long fail = atomic_load_explicit(&stats[c].trylock_failed, memory_order_relaxed);
+        dprintf(fd, "%-14s %12lu %12lu %15lu %8.1f%%\n", class_names[c], acq, cont, fail,
+                acq + fail ? 100.0 * (cont + fail) / (acq + fail) : 0.0);
+    }
+    metric_print_header(fd, "attesa");
+    for (int c = 0; c < LOCK_CLASSES; ++c)
+        metric_print_row(fd, class_names[c], &stats[c].wait);
+    metric_print_header(fd, "possesso");
+    for (int c = 0; c < LOCK_CLASSES; ++c)
+        metric_print_row(fd, class_names[c], &stats[c].hold);
+
+    // Selezione dei twin più contesi (LOCKPROF_TOP_TWINS passate sull'array)
+    int top[LOCKPROF_TOP_TWINS];
+    unsigned top_count[LOCKPROF_TOP_TWINS];
+    int found = 0;
+    for (int k = 0; k < LOCKPROF_TOP_TWINS; ++k) {
+        int best = 0;
+        unsigned best_count = 0;
+        for (int id = 1; id <= MAX_TWINS; ++id) {
+            unsigned n = atomic_load_explicit(&twin_contention[id], memory_order_relaxed);
+            int taken = 0;
+            for (int j = 0; j < found && !taken; ++j)
+                taken = top[j] == id;
+            if (!taken && n > best_count) {
+                best = id;
+                best_count = n;
+            }
+        }
+        if (best == 0) break;
+        top[found] = best;
+        top_count[found++] = best_count;
+    }
+    dprintf(fd, "Twin più contesi:");
+    if (found == 0) dprintf(fd, " nessuno");
+    for (int k = 0; k < found; ++k)
+        dprintf(fd, " %d(%u)", top[k], top_count[k]);
+    dprintf(fd, "\n");
+}
+
+#else
+
+// Profilo dei lock non compilato: nessun rapporto
+void lockprof_dump(int fd) {
+    (void)fd;
+}
+
+#endif
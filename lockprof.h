@@ -0,0 +1,52 @@
+#ifndef LOCKPROF_H
+#define LOCKPROF_H
+
+#include <threads.h>
+#include "scall.h"
+
+// Profilo di contesa dei mutex condivisi, attivato a tempo di compilazione
+// (make clean && make LOCK_PROFILE=1). Per ogni classe di lock registra le
+// acquisizioni, quelle che hanno dovuto attendere, i trylock falliti e gli
+// istogrammi del tempo di attesa e di possesso; per i twin anche gli id più
+// contesi. Il rapporto è incluso in quello delle metriche (SIGUSR1, socket,
+// fine esecuzione). Senza LOCK_PROFILE le macro si riducono alle chiamate
+// MCALL_* / mtx_trylock originali.
+#ifndef LOCK_PROFILE
+#define LOCK_PROFILE 0
+#endif
+
+typedef enum {
+    LOCK_CLASS_TWIN,    // twin_locks[id - 1], id = id del twin
+    LOCK_CLASS_INTENT,  // intent_table_t.mutex (scrittori)
+    LOCK_CLASS_LOG,     // log_mutex del thread scrittore
+    LOCK_CLASS_EVENT,   // mutex della coda del motore a eventi
+    LOCK_CLASSES
+} lock_class_t;
+
+#if LOCK_PROFILE
+void lockprof_lock(mtx_t *mutex, lock_class_t cls, int id, const char *errmsg);
+int lockprof_trylock(mtx_t *mutex, lock_class_t cls, int id);
+void lockprof_acquired(lock_class_t cls, int id);
+void lockprof_released(lock_class_t cls, int id);
+
+#define LOCKPROF_LOCK(mutex_ptr, cls, id, errmsg) lockprof_lock((mutex_ptr), (cls), (id), (errmsg))
+#define LOCKPROF_TRYLOCK(mutex_ptr, cls, id) lockprof_trylock((mutex_ptr), (cls), (id))
+#define LOCKPROF_UNLOCK(mutex_ptr, cls, id, errmsg) \
+    do { \
+        lockprof_released((cls), (id)); \
+        MCALL_UNLOCK((mutex_ptr), errmsg); \
+    } while (0)
+// Attorno a cnd_wait/cnd_timedwait: il mutex è rilasciato durante l'attesa
+#define LOCKPROF_ACQUIRED(cls, id) lockprof_acquired((cls), (id))
+#define LOCKPROF_RELEASED(cls, id) lockprof_released((cls), (id))
+#else
+#define LOCKPROF_LOCK(mutex_ptr, cls, id, errmsg) MCALL_LOCK((mutex_ptr), errmsg)
+#define LOCKPROF_TRYLOCK(mutex_ptr, cls, id) mtx_trylock((mutex_ptr))
+#define LOCKPROF_UNLOCK(mutex_ptr, cls, id, errmsg) MCALL_UNLOCK((mutex_ptr), errmsg)
+#define LOCKPROF_ACQUIRED(cls, id) ((void)0)
+#define LOCKPROF_RELEASED(cls, id) ((void)0)
+#endif
+
+void lockprof_dump(int fd);
+
+#endif
@@ -0,0 +1,233 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "logfmt.h"
+
+// Nomi dei codici evento, per le statistiche del decoder
+static const char *code_names[LOG_EV_COUNT] = {
+    "SESSION", "TEXT", "RESCUER_TYPE", "FLEET",
+    "EM_ASSIGNED", "EM_PARTIAL", "EM_ASSIGNMENT", "EM_ON_SCENE", "EM_IN_PROGRESS",
+    "EM_PAUSED", "EM_COMPLETED", "EM_WAITING",
+    "TW_RESERVED", "TW_ASSIGNED", "TW_TAKEN_OVER", "TW_RESERVATION_CANCELLED",
+    "TW_ON_SCENE", "TW_RETURNING", "TW_RETURNING_PAUSED", "TW_IDLE", "TW_IDLE_PAUSED",
+    "EM_RECEIVED", "EM_TIMEOUT_REACH", "EM_TIMEOUT_DEADLINE"
+};
+
+// Numero di argomenti int32 nel payload dei codici con argomenti
+static const unsigned char code_args[LOG_EV_COUNT] = {
+    [LOG_EV_EM_PARTIAL] = 2, [LOG_EV_EM_ON_SCENE] = 2,
+    [LOG_EV_EM_PAUSED] = 1, [LOG_EV_TW_RESERVED] = 1,
+    [LOG_EV_EM_RECEIVED] = 2, [LOG_EV_EM_TIMEOUT_REACH] = 2
+};
+
+// Funzione che restituisce il numero di argomenti int32 di un codice evento
+int log_code_args(int code) {
+    return code >= 0 && code < LOG_EV_COUNT ? code_args[code] : 0;
+}
+
+// Funzione che restituisce il nome di un codice evento
+const char *log_code_name(int code) {
+    return code >= 0 && code < LOG_EV_COUNT ? code_names[code] : "UNKNOWN";
+}
+
+// Funzione che inizializza la tabella dei nomi (nessun tipo né twin dichiarato)
+void log_names_init(log_names_t *names) {
+    names->time_base = 0;
+    for (int i = 0; i < MAX_TYPES; ++i)
+        names->type_names[i] = NULL;
+    for (int i = 0; i <= MAX_TWINS; ++i)
+        names->twin_type[i] = -1;
+}
+
+// Funzione che libera i nomi dichiarati e riporta la tabella allo stato iniziale
+void log_names_free(log_names_t *names) {
+    for (int i = 0; i < MAX_TYPES; ++i)
+        free(names->type_names[i]);
+    log_names_init(names);
+}
+
+// Funzione che restituisce il nome del tipo del twin id ("?" se non dichiarato)
+static const char *twin_type_name(const log_names_t *names, int id) {
+    if (id < 1 || id > MAX_TWINS || names->twin_type[id] < 0)
+        return "?";
+    const char *name = names->type_names[names->twin_type[id]];
+    return name ? name : "?";
+}
+
+// Funzione che legge l'argomento int32 in posizione i del payload (0 se assente)
+static int payload_arg(const log_bin_header_t *h, const unsigned char *payload, int i) {
+    int32_t v = 0;
+    if ((size_t)(i + 1) * sizeof(int32_t) <= h->payload_len)
+        memcpy(&v, payload + i * sizeof(int32_t), sizeof(int32_t));
+    return v;
+}
+
+// Funzione che registra un record di dichiarazione nella tabella dei nomi
+static void log_declare(log_names_t *names, const log_bin_header_t *h, const unsigned char *payload) {
+    if (h->code == LOG_EV_RESCUER_TYPE) {
+        if (h->twin_id < 0 || h->twin_id >= MAX_TYPES) return;
+        char *name = malloc(h->payload_len + 1);
+        if (!name) return;
+        memcpy(name, payload, h->payload_len);
+        name[h->payload_len] = '\0';
+        free(names->type_names[h->twin_id]);
+        names->type_names[h->twin_id] = name;
+    } else if (h->code == LOG_EV_FLEET) {
+        int count = h->payload_len / sizeof(uint16_t);
+        for (int i = 0; i < count; ++i) {
+            uint16_t type;
+            memcpy(&type, payload + i * sizeof(uint16_t), sizeof(type));
+            int id = h->twin_id + i;
+            if (id >= 1 && id <= MAX_TWINS && type < MAX_TYPES)
+                names->twin_type[id] = type;
+        }
+    } else if (h->code == LOG_EV_SESSION) {
+        // Nuova sessione: i nomi dichiarati in precedenza non valgono più
+        log_names_free(names);
+        int64_t base;
+        if (h->payload_len >= 20) {
+            memcpy(&base, payload + 12, sizeof(base));
+            names->time_base = base;
+        }
+    }
+}
+
+// Funzione che compone il messaggio {Tipo id,id}{Tipo2 id} di un'assegnazione,
+// raggruppando i twin per nome del tipo nell'ordine di prima comparsa
+static int render_assignment(const log_names_t *names, const log_bin_header_t *h,
+                             const unsigned char *payload, char *out, size_t size) {
+    int count = h->payload_len / sizeof(int32_t);
+    size_t len = 0;
+    for (int i = 0; i < count && len < size; ++i) {
+        const char *type = twin_type_name(names, payload_arg(h, payload, i));
+        // Il gruppo è già stato scritto da un twin precedente dello stesso tipo
+        int seen = 0;
+        for (int k = 0; k < i && !seen; ++k)
+            seen = strcmp(twin_type_name(names, payload_arg(h, payload, k)), type) == 0;
+        if (seen) continue;
+        len += snprintf(out + len, size - len, "{%s ", type);
+        int first = 1;
+        for (int k = i; k < count && len < size; ++k) {
+            int id = payload_arg(h, payload, k);
+            if (strcmp(twin_type_name(names, id), type) != 0) continue;
+            len += snprintf(out + len, size - len, first ? "%d" : ",%d", id);
+            first = 0;
+        }
+        if (len < size)
+            len += snprintf(out + len, size - len, "}");
+    }
+    return len < size ? (int)len : (int)size - 1;
+}
+
+// Funzione che rende un record nel formato testuale di emergency.log
+// ("[tempo] [origine] [tipo] messaggio\n"), aggiornando la tabella dei nomi
+// con i record di dichiarazione.
+// Restituisce la lunghezza della riga scritta in out, 0 se il record non
+// produce testo, -1 se il codice è sconosciuto.
+int log_render(log_names_t *names, const log_bin_header_t *h, const unsigned char *payload,
+               char *out, size_t size) {
+    char id[96] = "N/A";
+    char msg[LOG_LINE_MAX];
+    const char *event_type = "UNKNOWN";
+    long long time = names->time_base + h->time;
+    int em = h->emergency_id;
+    int a0 = payload_arg(h, payload, 0);
+    int a1 = payload_arg(h, payload, 1);
+
+    if ((h->code >= LOG_EV_EM_ASSIGNED && h->code <= LOG_EV_EM_WAITING) || h->code >= LOG_EV_EM_RECEIVED) {
+        snprintf(id, sizeof(id), "Emergenza %d", em);
+        event_type = "EMERGENCY_STATUS";
+    } else if (h->code >= LOG_EV_TW_RESERVED && h->code <= LOG_EV_TW_IDLE_PAUSED) {
+        snprintf(id, sizeof(id), "%s %d", twin_type_name(names, h->twin_id), h->twin_id);
+        event_type = "RESCUER_STATUS";
+    }
+
+    switch (h->code) {
+        case LOG_EV_SESSION:
+        case LOG_EV_RESCUER_TYPE:
+        case LOG_EV_FLEET:
+            log_declare(names, h, payload);
+            return 0;
+        case LOG_EV_TEXT: {
+            if (h->payload_len < 4) return -1;
+            int id_len = payload[0];
+            int type_len = payload[1];
+            uint16_t msg_len;
+            memcpy(&msg_len, payload + 2, sizeof(msg_len));
+            if (4 + id_len + type_len + msg_len > h->payload_len) return -1;
+            const char *text = (const char *)payload + 4;
+            int len = snprintf(out, size, "[%lld] [%.*s] [%.*s] %.*s\n", time,
+                               id_len, text, type_len, text + id_len, msg_len, text + id_len + type_len);
+            return len < (int)size ? len : (int)size - 1;
+        }
+        case LOG_EV_EM_ASSIGNED:
+            snprintf(msg, sizeof(msg), "Stato cambiato a ASSIGNED");
+            break;
+        case LOG_EV_EM_PARTIAL:
+            snprintf(msg, sizeof(msg), "Assegnazione parziale: %d/%d soccorritori", a0, a1);
+            break;
+        case LOG_EV_EM_ASSIGNMENT:
+            event_type = "ASSIGNMENT";
+            render_assignment(names, h, payload, msg, sizeof(msg));
+            break;
+        case LOG_EV_EM_ON_SCENE:
+            snprintf(msg, sizeof(msg), "Soccorritori sul posto: %d/%d", a0, a1);
+            break;
+        case LOG_EV_EM_IN_PROGRESS:
+            snprintf(msg, sizeof(msg), "Stato cambiato a IN_PROGRESS");
+            break;
+        case LOG_EV_EM_PAUSED:
+            snprintf(msg, sizeof(msg), "Stato cambiato a PAUSED, lavoro gia' svolto: %d secondi", a0);
+            break;
+        case LOG_EV_EM_COMPLETED:
+            snprintf(msg, sizeof(msg), "Stato cambiato a COMPLETED");
+            break;
+        case LOG_EV_EM_WAITING:
+            snprintf(msg, sizeof(msg), "Stato cambiato a WAITING, in attesa di ripresa");
+            break;
+        case LOG_EV_TW_RESERVED:
+            snprintf(msg, sizeof(msg), "Prenotato dall'emergenza %d, libero tra circa %d secondi", em, a0);
+            break;
+        case LOG_EV_TW_ASSIGNED:
+            snprintf(msg, sizeof(msg), "Assegnato all'emergenza %d, stato EN_ROUTE_TO_SCENE", em);
+            break;
+        case LOG_EV_TW_TAKEN_OVER:
+            snprintf(msg, sizeof(msg), "Preso in carico dall'emergenza %d, stato EN_ROUTE_TO_SCENE", em);
+            break;
+        case LOG_EV_TW_RESERVATION_CANCELLED:
+            snprintf(msg, sizeof(msg), "Prenotazione annullata, emergenza %d sospesa", em);
+            break;
+        case LOG_EV_TW_ON_SCENE:
+            snprintf(msg, sizeof(msg), "Stato cambiato a ON_SCENE per emergenza %d", em);
+            break;
+        case LOG_EV_TW_RETURNING:
+            snprintf(msg, sizeof(msg), "Stato cambiato a RETURNING_TO_BASE per emergenza %d", em);
+            break;
+        case LOG_EV_TW_RETURNING_PAUSED:
+            snprintf(msg, sizeof(msg), "Stato cambiato a RETURNING_TO_BASE, emergenza %d sospesa", em);
+            break;
+        case LOG_EV_TW_IDLE:
+            snprintf(msg, sizeof(msg), "Stato cambiato a IDLE dopo completamento emergenza %d", em);
+            break;
+        case LOG_EV_TW_IDLE_PAUSED:
+            snprintf(msg, sizeof(msg), "Stato cambiato a IDLE dopo sospensione emergenza %d", em);
+            break;
+        case LOG_EV_EM_RECEIVED:
+            snprintf(msg, sizeof(msg), "Ricevuta con priorita' %d, richiesta inviata %d secondi prima", a0, a1);
+            break;
+        case LOG_EV_EM_TIMEOUT_REACH: {
+            const char *type = h->twin_id >= 0 && h->twin_id < MAX_TYPES ? names->type_names[h->twin_id] : NULL;
+            snprintf(msg, sizeof(msg),
+                     "Timeout per distanza, richiesto '%s': %d disponibili entro il limite, trovati %d nella zona",
+                     type ? type : "?", a0, a1);
+            break;
+        }
+        case LOG_EV_EM_TIMEOUT_DEADLINE:
+            snprintf(msg, sizeof(msg), "Timeout per carenza, scaduto tempo massimo disponibile");
+            break;
+        default:
+            return -1;
+    }
+    int len = snprintf(out, size, "[%lld] [%s] [%s] %s\n", time, id, event_type, msg);
+    return len < (int)size ? len : (int)size - 1;
+}
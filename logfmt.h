@@ -0,0 +1,84 @@
+#ifndef LOGFMT_H
+#define LOGFMT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "rescuers.h"
+
+// Formato strutturato degli eventi di log, condiviso dal logger e dal
+// decoder offline (Tools/log_decode). Ogni record è un'intestazione fissa
+// di 24 byte seguita da payload_len byte di payload tipizzato secondo il
+// codice (interi little-endian nativi):
+//   LOG_EV_SESSION        magic "EMSEVLOG" | uint32 versione | int64 tempo base (s)
+//                         (primo record di ogni avvio)
+//   LOG_EV_TEXT           uint8 lung. id | uint8 lung. tipo | uint16 lung. messaggio | byte
+//   LOG_EV_RESCUER_TYPE   twin_id = indice del tipo | byte del nome
+//   LOG_EV_FLEET          twin_id = primo id | uint16 indice del tipo per ogni twin successivo
+//   LOG_EV_EM_ASSIGNMENT  int32 id dei twin assegnati
+//   altri codici          argomenti int32 (vedi log_render in logfmt.c)
+// I record di dichiarazione (tipi e flotta) non producono testo: servono a
+// ricostruire le etichette "Tipo id" dei twin.
+#define LOG_BIN_MAGIC "EMSEVLOG"
+#define LOG_BIN_VERSION 1
+// Twin dichiarati in un singolo record LOG_EV_FLEET
+#define LOG_FLEET_CHUNK 512
+#define LOG_BIN_PAYLOAD_MAX 1024
+// Lunghezza massima di una riga di testo resa da un record
+#define LOG_LINE_MAX 2048
+
+typedef enum {
+    LOG_EV_SESSION,
+    LOG_EV_TEXT,
+    LOG_EV_RESCUER_TYPE,
+    LOG_EV_FLEET,
+    // Emergenza (emergency_id)
+    LOG_EV_EM_ASSIGNED,
+    LOG_EV_EM_PARTIAL,        // assegnati, posti totali
+    LOG_EV_EM_ASSIGNMENT,
+    LOG_EV_EM_ON_SCENE,       // arrivati, attesi
+    LOG_EV_EM_IN_PROGRESS,
+    LOG_EV_EM_PAUSED,         // secondi di lavoro già svolti
+    LOG_EV_EM_COMPLETED,
+    LOG_EV_EM_WAITING,
+    // Twin (twin_id) al servizio dell'emergenza emergency_id
+    LOG_EV_TW_RESERVED,       // secondi alla fine del lavoro corrente
+    LOG_EV_TW_ASSIGNED,
+    LOG_EV_TW_TAKEN_OVER,
+    LOG_EV_TW_RESERVATION_CANCELLED,
+    LOG_EV_TW_ON_SCENE,
+    LOG_EV_TW_RETURNING,
+    LOG_EV_TW_RETURNING_PAUSED,
+    LOG_EV_TW_IDLE,
+    LOG_EV_TW_IDLE_PAUSED,
+    // Emergenza (emergency_id), codici aggiunti in coda per non cambiare i precedenti
+    LOG_EV_EM_RECEIVED,       // priorità, età della richiesta (s)
+    LOG_EV_EM_TIMEOUT_REACH,  // posti richiesti, twin raggiungibili; twin_id = indice del tipo
+    LOG_EV_EM_TIMEOUT_DEADLINE,
+    LOG_EV_COUNT
+} log_code_t;
+
+// Intestazione fissa di un record (24 byte, nessun padding implicito)
+typedef struct {
+    uint64_t mono_ns;      // istante monotono (CLOCK_MONOTONIC) in nanosecondi
+    int32_t time;          // secondi del tempo virtuale dal tempo base della sessione
+    uint16_t code;         // log_code_t
+    uint16_t payload_len;
+    int32_t emergency_id;  // 0 se non riferito ad un'emergenza
+    int32_t twin_id;       // 0 se non riferito ad un twin
+} log_bin_header_t;
+
+// Stato di resa: tempo base della sessione e nomi dichiarati nel log, per le etichette dei twin
+typedef struct {
+    long long time_base;
+    char *type_names[MAX_TYPES];
+    int twin_type[MAX_TWINS + 1]; // indice del tipo per id di twin (-1 se non dichiarato)
+} log_names_t;
+
+void log_names_init(log_names_t *names);
+void log_names_free(log_names_t *names);
+int log_render(log_names_t *names, const log_bin_header_t *h, const unsigned char *payload,
+               char *out, size_t size);
+const char *log_code_name(int code);
+int log_code_args(int code);
+
+#endif
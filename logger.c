@@ -1,102 +1,798 @@
-#define _POSIX_C_SOURCE 200809L
-#include <stdio.h>      
-#include <stdlib.h>     
-#include <string.h>     
-#include <unistd.h>     
-#include <fcntl.h>     
-#include <errno.h>     
-#include <time.h> 
+#define _GNU_SOURCE // fallocate
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
 #include <threads.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
 #include "logger.h"
+#include "logfmt.h"
 #include "scall.h"
+#include "simclock.h"
+#include "lockprof.h"
 
 #define FILE_NAME "emergency.log"
+#define BIN_FILE_NAME "emergency.evlog"
 
-// File descriptor 
+// Record per ring buffer di ciascun thread (potenza di 2)
+#define LOG_RING_SIZE 1024
+#define LOG_ID_SIZE 64
+#define LOG_TYPE_SIZE 32
+#define LOG_MSG_SIZE 512
+// Record raccolti in una singola writev (un iovec per record, sotto IOV_MAX)
+#define LOG_BATCH 256
+// Intervallo (ms reali) tra due risvegli dello scrittore
+#define LOG_FLUSH_INTERVAL_MS 5
+// Nome di un segmento ruotato (es. emergency.log.3)
+#define LOG_PATH_SIZE 64
+
+// Record di log nel formato strutturato (logfmt.h): il produttore copia solo
+// intestazione e argomenti, la resa in testo è lasciata allo scrittore.
+// Intestazione e payload sono contigui e vengono scritti così come sono nel log binario.
+typedef struct {
+    unsigned long seq;  // ordine di emissione globale
+    log_bin_header_t h;
+    unsigned char payload[LOG_BIN_PAYLOAD_MAX];
+} log_record_t;
+_Static_assert(offsetof(log_record_t, payload) == offsetof(log_record_t, h) + sizeof(log_bin_header_t),
+               "payload non contiguo all'intestazione");
+
+// Ring buffer di un thread: un solo produttore (il thread proprietario)
+// avanza head, solo lo scrittore avanza tail
+typedef struct log_ring {
+    _Atomic size_t head;
+    _Atomic size_t tail;
+    atomic_int in_use;
+    size_t cursor; // prossimo record da raccogliere (solo scrittore)
+    size_t limit;  // record pubblicati all'inizio della raccolta (solo scrittore)
+    size_t commit; // record pubblicati alla prima fotografia della raccolta (solo scrittore)
+    struct log_ring *next;
+    log_record_t records[LOG_RING_SIZE];
+} log_ring_t;
+
+// File descriptor (emergency.log, oppure emergency.evlog nel formato binario)
 static int log_fd = -1;
-// Mutex per scrivere su file log
+// Formato richiesto e formato in uso dallo scrittore
+static atomic_int requested_format = LOG_FORMAT_TEXT;
+static int current_format = LOG_FORMAT_TEXT;
+// Politica di durabilità (log_set_durability) e richiesta di sync di un evento critico
+static atomic_int sync_policy = LOG_SYNC_PERIODIC;
+static atomic_int sync_interval_ms = 100;
+static atomic_int sync_requested = 0;
+// Group commit: lo scrittore incrementa drain_gen all'inizio di ogni raccolta e,
+// appena la prima fotografia dei ring è scritta e sincronizzata, porta
+// durable_gen allo stesso valore (con commit_cond): i record pubblicati prima
+// dell'inizio della raccolta g sono su disco quando durable_gen >= g
+static atomic_ulong drain_gen = 0;
+static atomic_ulong durable_gen = 0;
+// Dimensione dei segmenti (0: nessuna rotazione), applicata dallo scrittore
+static _Atomic size_t segment_limit = 0;
+static size_t segment_applied = 0;
+static size_t segment_bytes = 0;    // byte nel segmento corrente
+static int next_segment = 0;        // suffisso del prossimo segmento ruotato (0: da cercare)
+static unsigned long unsynced = 0;  // record scritti dall'ultima sincronizzazione
+static struct timespec last_sync;
+// Nomi dichiarati (tipi e twin) e tempo base, usati dallo scrittore per rendere il testo
+static log_names_t names;
+// Tempo virtuale (s) all'avvio del logger: i record ne riportano la distanza
+static time_t time_base;
+// Lista (solo inserimento in testa) dei ring buffer, liberati in close_log()
+static _Atomic(log_ring_t *) rings = NULL;
+// Chiave TSS per il ring del thread corrente (rilasciato alla terminazione del thread)
+static tss_t ring_key;
+static atomic_ulong next_seq = 0;
+static atomic_int overflow_policy = LOG_OVERFLOW_BLOCK;
+// Filtro runtime consultato da LOG_ENABLED (logger.h) prima di formattare
+atomic_int log_runtime_level = LOG_MIN_LEVEL;
+atomic_uint log_runtime_categories = LOG_CAT_ALL;
+// Thread scrittore: attende su log_cond (con log_mutex) tra una raccolta e l'altra
+static thrd_t writer_thread;
 static mtx_t log_mutex;
+static cnd_t log_cond;
+static cnd_t commit_cond;
+static atomic_int writer_running = 0;
+static atomic_int stopping = 0;
+// Statistiche
+static atomic_ulong dropped = 0;
+static atomic_ulong blocked = 0;
+static atomic_ulong commit_waits = 0;
+static unsigned long written = 0;
+static unsigned long writes = 0;
+static unsigned long fsyncs = 0;
+static unsigned long rotations = 0;
+static unsigned long long bytes = 0;
+
+
+// Distruttore TSS: rende il ring riutilizzabile da un nuovo thread
+// (i record ancora in coda vengono scritti normalmente)
+static void log_ring_release(void *arg) {
+    log_ring_t *ring = arg;
+    atomic_store(&ring->in_use, 0);
+}
+
+// Funzione che restituisce il ring del thread corrente, riusando un ring
+// libero se disponibile o allocandone uno nuovo
+static log_ring_t *log_get_ring(void) {
+    log_ring_t *ring = tss_get(ring_key);
+    if (ring) return ring;
+
+    // Prova a riutilizzare il ring lasciato da un thread terminato
+    for (ring = atomic_load(&rings); ring; ring = ring->next) {
+        int expected = 0;
+        if (atomic_compare_exchange_strong(&ring->in_use, &expected, 1)) break;
+    }
+    // Nessun ring libero: ne alloca uno nuovo e lo inserisce in testa
+    if (!ring) {
+        SNCALL(ring, malloc(sizeof(log_ring_t)), "errore in malloc log ring");
+        atomic_init(&ring->head, 0);
+        atomic_init(&ring->tail, 0);
+        atomic_init(&ring->in_use, 1);
+        ring->next = atomic_load(&rings);
+        while (!atomic_compare_exchange_weak(&rings, &ring->next, ring))
+            ;
+    }
+    tss_set(ring_key, ring);
+    return ring;
+}
+
+// Funzione che scrive tutti i byte descritti da iov, riprendendo dopo scritture parziali
+static void log_write_all(int fd, struct iovec *iov, int iovcnt) {
+    while (iovcnt > 0) {
+        ssize_t n = writev(fd, iov, iovcnt);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("errore in writev emergency.log");
+            return;
+        }
+        // Salta gli iovec già scritti e accorcia quello scritto a metà
+        while (iovcnt > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+}
+
+// Funzione che restituisce i millisecondi trascorsi da since (CLOCK_MONOTONIC)
+static long log_elapsed_ms(const struct timespec *since) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - since->tv_sec) * 1000L + (now.tv_nsec - since->tv_nsec) / 1000000L;
+}
+
+// Funzione che porta su disco i record scritti (fdatasync: i metadati del
+// file non servono a rileggere il log). Eseguita solo dal thread scrittore.
+static void log_sync(void) {
+    fdatasync(log_fd);
+    fsyncs++;
+    unsynced = 0;
+    clock_gettime(CLOCK_MONOTONIC, &last_sync);
+}
+
+// Funzione che preassegna al file i blocchi di un intero segmento senza
+// cambiarne la dimensione, così le scritture in append non allocano extent
+static void log_preallocate(int fd) {
+    size_t limit = atomic_load(&segment_limit);
+    if (limit > 0 && fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, limit) == -1 && errno != EOPNOTSUPP)
+        perror("errore in fallocate log");
+}
+
+// Funzione che apre (in append) il file di log corrente e ne registra la dimensione
+static int log_open(const char *path) {
+    int fd;
+    SCALL(fd, open(path, O_CREAT | O_WRONLY | O_APPEND, 0644), "errore in open file di log");
+    struct stat st;
+    segment_bytes = fstat(fd, &st) == 0 ? (size_t)st.st_size : 0;
+    log_preallocate(fd);
+    return fd;
+}
+
+// Funzione che scrive l'inizio di un file binario: il record di sessione e le
+// dichiarazioni di tipi e twin già note, così ogni segmento è leggibile da solo
+static void log_write_preamble(int fd) {
+    struct {
+        log_bin_header_t h;
+        unsigned char payload[LOG_BIN_PAYLOAD_MAX];
+    } rec = {0};
+    struct timespec mono;
+    clock_gettime(CLOCK_MONOTONIC, &mono);
+    rec.h.mono_ns = (uint64_t)mono.tv_sec * 1000000000ULL + mono.tv_nsec;
+
+    // Sessione: magic | versione | tempo base
+    rec.h.code = LOG_EV_SESSION;
+    rec.h.payload_len = 20;
+    uint32_t version = LOG_BIN_VERSION;
+    int64_t base = time_base;
+    memcpy(rec.payload, LOG_BIN_MAGIC, 8);
+    memcpy(rec.payload + 8, &version, sizeof(version));
+    memcpy(rec.payload + 12, &base, sizeof(base));
+    struct iovec iov = {.iov_base = &rec, .iov_len = sizeof(log_bin_header_t) + rec.h.payload_len};
+    log_write_all(fd, &iov, 1);
+    segment_bytes += iov.iov_len;
+
+    // Nomi dei tipi
+    rec.h.code = LOG_EV_RESCUER_TYPE;
+    for (int k = 0; k < MAX_TYPES; ++k) {
+        if (!names.type_names[k]) continue;
+        rec.h.twin_id = k;
+        rec.h.payload_len = strnlen(names.type_names[k], LOG_ID_SIZE);
+        memcpy(rec.payload, names.type_names[k], rec.h.payload_len);
+        iov = (struct iovec){.iov_base = &rec, .iov_len = sizeof(log_bin_header_t) + rec.h.payload_len};
+        log_write_all(fd, &iov, 1);
+        segment_bytes += iov.iov_len;
+    }
+
+    // Tipo di ogni twin dichiarato, a blocchi di id consecutivi
+    int last = 0;
+    for (int id = 1; id <= MAX_TWINS; ++id)
+        if (names.twin_type[id] >= 0) last = id;
+    rec.h.code = LOG_EV_FLEET;
+    for (int start = 1; start <= last; start += LOG_FLEET_CHUNK) {
+        int count = last - start + 1 < LOG_FLEET_CHUNK ? last - start + 1 : LOG_FLEET_CHUNK;
+        rec.h.twin_id = start;
+        for (int i = 0; i < count; ++i) {
+            uint16_t type = (uint16_t)names.twin_type[start + i]; // -1: non dichiarato, ignorato dal decoder
+            memcpy(rec.payload + i * sizeof(uint16_t), &type, sizeof(type));
+        }
+        rec.h.payload_len = count * sizeof(uint16_t);
+        iov = (struct iovec){.iov_base = &rec, .iov_len = sizeof(log_bin_header_t) + rec.h.payload_len};
+        log_write_all(fd, &iov, 1);
+        segment_bytes += iov.iov_len;
+    }
+}
+
+// Funzione che chiude il segmento corrente quando raggiunge la dimensione
+// massima: lo rinomina con il primo suffisso numerico libero (emergency.log.N)
+// e riapre un file nuovo, preallocato. Eseguita solo dal thread scrittore.
+static void log_rotate(void) {
+    size_t limit = atomic_load(&segment_limit);
+    if (limit == 0 || segment_bytes < limit)
+        return;
+    const char *path = current_format == LOG_FORMAT_BINARY ? BIN_FILE_NAME : FILE_NAME;
+    char rotated[LOG_PATH_SIZE];
+    if (next_segment == 0) next_segment = 1;
+    do {
+        snprintf(rotated, sizeof(rotated), "%s.%d", path, next_segment++);
+    } while (access(rotated, F_OK) == 0);
+
+    log_sync();
+    close(log_fd);
+    if (rename(path, rotated) == -1)
+        perror("errore in rename segmento di log");
+    log_fd = log_open(path);
+    if (current_format == LOG_FORMAT_BINARY)
+        log_write_preamble(log_fd);
+    rotations++;
+}
+
+// Funzione che applica le impostazioni richieste dopo l'avvio: il formato
+// (log_set_format: il binario scrive su emergency.evlog, che inizia ad ogni
+// avvio con un record di sessione) e la dimensione dei segmenti, da
+// preallocare sul file corrente. Eseguita solo dal thread scrittore, prima di
+// raccogliere i record.
+static void log_apply_settings(void) {
+    size_t limit = atomic_load(&segment_limit);
+    if (limit != segment_applied) {
+        segment_applied = limit;
+        log_preallocate(log_fd);
+    }
+    int format = atomic_load(&requested_format);
+    if (format == current_format || format != LOG_FORMAT_BINARY)
+        return;
+    int fd = log_open(BIN_FILE_NAME);
+    log_write_preamble(fd);
+    log_sync();
+    close(log_fd);
+    log_fd = fd;
+    current_format = format;
+}
+
+// Funzione che registra nel log i cambi di livello (log_set_level o SIGUSR2),
+// indipendentemente dal filtro. Eseguita solo dal thread scrittore.
+static void log_announce_level(void) {
+    static int announced = LOG_MIN_LEVEL;
+    int level = atomic_load_explicit(&log_runtime_level, memory_order_relaxed);
+    if (level == announced)
+        return;
+    announced = level;
+    log_eventf("logger.c", "LOG_LEVEL", "Livello di log cambiato a %s", log_level_name(level));
+}
+
+// Funzione che rende durable_gen pari a gen e sveglia i produttori in attesa
+// del group commit. Eseguita solo dal thread scrittore.
+static void log_commit(unsigned long gen) {
+    LOCKPROF_LOCK(&log_mutex, LOCK_CLASS_LOG, 0, "errore in lock log_mutex");
+    atomic_store(&durable_gen, gen);
+    cnd_broadcast(&commit_cond);
+    LOCKPROF_UNLOCK(&log_mutex, LOCK_CLASS_LOG, 0, "errore in unlock log_mutex");
+}
+
+// Funzione che indica se i record della prima fotografia sono stati tutti
+// raccolti: first è la testa della lista dei ring in quel momento
+static int log_first_snapshot_drained(log_ring_t *first) {
+    for (log_ring_t *ring = first; ring; ring = ring->next)
+        if (ring->cursor < ring->commit)
+            return 0;
+    return 1;
+}
+
+// Funzione che svuota i ring buffer: raccoglie i record pubblicati in ordine
+// di emissione (fusione per numero di sequenza) e li scrive a blocchi con writev.
+// Eseguita solo dal thread scrittore.
+static void log_drain(void) {
+    static char lines[LOG_BATCH][LOG_LINE_MAX];
+    static struct iovec iov[LOG_BATCH];
+    static char scratch_line[LOG_LINE_MAX];
+
+    log_apply_settings();
+    log_announce_level();
+    // Un evento critico pubblicato prima di questo punto è nella raccolta che segue
+    int urgent = atomic_exchange(&sync_requested, 0);
+    int policy = atomic_load(&sync_policy);
+    unsigned long gen = atomic_fetch_add(&drain_gen, 1) + 1;
+    atomic_thread_fence(memory_order_seq_cst);
+    // Group commit: i produttori in attesa di gen hanno il record nella prima
+    // fotografia, e proseguono appena questa è raccolta e su disco
+    log_ring_t *first = NULL;
+    int committed = policy != LOG_SYNC_GROUP;
+    while (1) {
+        // Fotografia dei record pubblicati in ciascun ring
+        int first_snapshot = first == NULL;
+        if (first_snapshot)
+            first = atomic_load(&rings);
+        for (log_ring_t *ring = first_snapshot ? first : atomic_load(&rings); ring; ring = ring->next) {
+            ring->cursor = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+            ring->limit = atomic_load_explicit(&ring->head, memory_order_acquire);
+            if (first_snapshot)
+                ring->commit = ring->limit;
+        }
+        int count = 0, iovcnt = 0;
+        while (count < LOG_BATCH) {
+            // Sceglie il record con sequenza minima tra le teste dei ring
+            log_ring_t *best = NULL;
+            unsigned long best_seq = 0;
+            for (log_ring_t *ring = atomic_load(&rings); ring; ring = ring->next) {
+                if (ring->cursor == ring->limit) continue;
+                unsigned long seq = ring->records[ring->cursor % LOG_RING_SIZE].seq;
+                if (!best || seq < best_seq) {
+                    best = ring;
+                    best_seq = seq;
+                }
+            }
+            if (!best) break;
+            log_record_t *rec = &best->records[best->cursor++ % LOG_RING_SIZE];
+            count++;
+            if (current_format == LOG_FORMAT_BINARY) {
+                // Il record va su file così com'è; le dichiarazioni aggiornano
+                // anche la tabella dei nomi, riscritta all'inizio di ogni segmento
+                if (rec->h.code == LOG_EV_RESCUER_TYPE || rec->h.code == LOG_EV_FLEET)
+                    log_render(&names, &rec->h, rec->payload, scratch_line, LOG_LINE_MAX);
+                iov[iovcnt++] = (struct iovec){.iov_base = &rec->h,
+                                               .iov_len = sizeof(log_bin_header_t) + rec->h.payload_len};
+                continue;
+            }
+            // Testo: le dichiarazioni aggiornano solo la tabella dei nomi
+            int len = log_render(&names, &rec->h, rec->payload, lines[iovcnt], LOG_LINE_MAX);
+            if (len > 0) {
+                iov[iovcnt] = (struct iovec){.iov_base = lines[iovcnt], .iov_len = len};
+                iovcnt++;
+            }
+        }
+        if (count == 0) break;
+
+        size_t batch_bytes = 0;
+        for (int i = 0; i < iovcnt; ++i)
+            batch_bytes += iov[i].iov_len;
+        bytes += batch_bytes;
+        segment_bytes += batch_bytes;
+        if (iovcnt > 0) {
+            log_write_all(log_fd, iov, iovcnt);
+            writes++;
+        }
+        written += count;
+        // Solo ora i posti raccolti tornano disponibili ai produttori
+        for (log_ring_t *ring = atomic_load(&rings); ring; ring = ring->next)
+            atomic_store_explicit(&ring->tail, ring->cursor, memory_order_release);
+
+        // Group commit: una sola fdatasync per tutti i record della raccolta,
+        // di qualunque thread produttore
+        unsynced += count;
+        if (policy == LOG_SYNC_GROUP)
+            log_sync();
+        if (!committed && log_first_snapshot_drained(first)) {
+            log_commit(gen);
+            committed = 1;
+        }
+        log_rotate();
+    }
+
+    // Sync periodica, anche per gli eventi non critici della politica critical;
+    // un evento critico porta subito su disco tutto ciò che lo precede
+    if (unsynced > 0 &&
+        ((policy == LOG_SYNC_CRITICAL && urgent) ||
+         ((policy == LOG_SYNC_PERIODIC || policy == LOG_SYNC_CRITICAL) &&
+          log_elapsed_ms(&last_sync) >= atomic_load(&sync_interval_ms))))
+        log_sync();
+
+    // Raccolta senza record: quelli precedenti sono già su disco
+    if (!committed)
+        log_commit(gen);
+}
+
+// Thread scrittore: svuota periodicamente i ring buffer, e un'ultima volta alla chiusura
+static int log_writer(void *arg) {
+    (void)arg;
+    LOCKPROF_LOCK(&log_mutex, LOCK_CLASS_LOG, 0, "errore in lock log_mutex");
+    while (!atomic_load(&stopping)) {
+        LOCKPROF_UNLOCK(&log_mutex, LOCK_CLASS_LOG, 0, "errore in unlock log_mutex");
+        log_drain();
+        LOCKPROF_LOCK(&log_mutex, LOCK_CLASS_LOG, 0, "errore in lock log_mutex");
+        if (atomic_load(&stopping)) break;
+        // Una sync richiesta durante la raccolta va eseguita senza attendere
+        if (atomic_load(&sync_requested)) continue;
+        struct timespec until;
+        timespec_get(&until, TIME_UTC);
+        until.tv_nsec += LOG_FLUSH_INTERVAL_MS * 1000000L;
+        if (until.tv_nsec >= 1000000000L) {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000L;
+        }
+        LOCKPROF_RELEASED(LOCK_CLASS_LOG, 0);
+        cnd_timedwait(&log_cond, &log_mutex, &until);
+        LOCKPROF_ACQUIRED(LOCK_CLASS_LOG, 0);
+    }
+    LOCKPROF_UNLOCK(&log_mutex, LOCK_CLASS_LOG, 0, "errore in unlock log_mutex");
+    log_drain();
+    if (atomic_load(&sync_policy) != LOG_SYNC_NONE)
+        log_sync();
+    return 0;
+}
+
+// Funzione che, all'uscita del processo, scrive i record ancora in coda
+static void log_at_exit(void) {
+    if (atomic_load(&writer_running) && !thrd_equal(thrd_current(), writer_thread))
+        close_log();
+}
 
 // Funzione che inizializza il sistema di logging
-// Apre il file di log e inizializza il mutex per l'accesso concorrente
+// Apre il file di log e avvia il thread scrittore
 void init_log(void) {
     // Apre il file di log (in modalità append, crea se non esiste)
-    SCALL(log_fd, open(FILE_NAME, O_CREAT | O_WRONLY | O_APPEND, 0644), "errore in open emergency.log");
+    log_fd = log_open(FILE_NAME);
+    clock_gettime(CLOCK_MONOTONIC, &last_sync);
 
-    // Scrive un messaggio di avvio nel log 
-    dprintf(log_fd, "[%ld] [logger.c] [FILE_PARSING] Inizializzazione sistema di logging\n", time(NULL));
+    log_names_init(&names);
+    time_base = sim_now();
+    names.time_base = time_base;
+    if (tss_create(&ring_key, log_ring_release) != thrd_success) {
+        perror("errore in tss_create log");
+        exit(EXIT_FAILURE);
+    }
+    MCALL_INIT(&log_mutex, mtx_plain, "errore in init log_mutex");
+    if (cnd_init(&log_cond) != thrd_success || cnd_init(&commit_cond) != thrd_success) {
+        perror("errore in init log_cond");
+        exit(EXIT_FAILURE);
+    }
+    atomic_store(&stopping, 0);
+    atomic_store(&writer_running, 1);
+    if (thrd_create(&writer_thread, log_writer, NULL) != thrd_success) {
+        perror("errore in creazione thread scrittore del log");
+        exit(EXIT_FAILURE);
+    }
+    // Anche le uscite per errore dopo questo punto non perdono i record in coda
+    static int registered = 0;
+    if (!registered) {
+        atexit(log_at_exit);
+        registered = 1;
+    }
 
-    // Inizializza il mutex associato al log
-    if (mtx_init(&log_mutex, mtx_plain) != thrd_success) { 
-            perror("errore in init log_mutex"); 
-            exit(EXIT_FAILURE); 
-    } 
+    // Scrive un messaggio di avvio nel log
+    LOG_TEXT(LOG_LEVEL_INFO, LOG_CAT_PARSING, "logger.c", "FILE_PARSING", "Inizializzazione sistema di logging");
 }
 
+// Funzione che imposta la politica da seguire quando il ring di un thread è pieno
+void log_set_overflow(log_overflow_t policy) {
+    atomic_store(&overflow_policy, policy);
+}
 
-// Funzione che scrive un evento nel file di log in modo thread-safe
-// id: identificatore dell'origine dell'evento (ID emergenza)
-// event_type: tipo dell'evento (es. "INTENT", "ASSIGNMENT")
-// message: messaggio descrittivo dell'evento
-void log_event(const char *id, const char *event_type, const char *message) {
+// Funzione che imposta la politica di durabilità del log e l'intervallo (ms)
+// della sync periodica
+void log_set_durability(log_sync_t policy, int interval_ms) {
+    atomic_store(&sync_policy, policy);
+    atomic_store(&sync_interval_ms, interval_ms > 0 ? interval_ms : 1);
+}
+
+// Funzione che imposta la dimensione massima di un segmento di log (0: nessuna rotazione)
+void log_set_segment_size(size_t bytes) {
+    atomic_store(&segment_limit, bytes);
+}
+
+// Funzione che imposta il livello minimo degli eventi registrati (mai sotto LOG_MIN_LEVEL)
+void log_set_level(log_level_t level) {
+    atomic_store(&log_runtime_level, level < LOG_MIN_LEVEL ? LOG_MIN_LEVEL : (int)level);
+}
+
+// Funzione che imposta le categorie registrate (maschera LOG_CAT_*)
+void log_set_categories(unsigned categories) {
+    atomic_store(&log_runtime_categories, categories);
+}
+
+// Funzione che passa al livello successivo, ricominciando dal più dettagliato
+// dopo LOG_LEVEL_ERROR. Async-signal-safe (solo operazioni atomiche lock-free):
+// è chiamata dal gestore di SIGUSR2.
+void log_cycle_level(void) {
+    int level = atomic_load(&log_runtime_level);
+    atomic_store(&log_runtime_level, level >= LOG_LEVEL_ERROR ? LOG_MIN_LEVEL : level + 1);
+}
+
+// Funzione che restituisce il nome di un livello di log (come in env.conf)
+const char *log_level_name(int level) {
+    switch (level) {
+        case LOG_LEVEL_DEBUG: return "debug";
+        case LOG_LEVEL_INFO: return "info";
+        case LOG_LEVEL_STATE: return "state";
+        case LOG_LEVEL_ERROR: return "error";
+        default: return "unknown";
+    }
+}
+
+// Funzione che indica se il thread corrente è lo scrittore (che non può
+// attendere sé stesso quando il proprio ring è pieno)
+static int log_in_writer(void) {
+    return thrd_equal(thrd_current(), writer_thread);
+}
+
+// Funzione che riserva il prossimo posto nel ring del thread corrente e ne
+// compila l'intestazione. Restituisce NULL se il record va scartato (logger non
+// attivo o ring pieno con la politica drop); altrimenti il record va pubblicato
+// con log_publish dopo averne scritto il payload.
+static log_record_t *log_reserve(log_ring_t **ring_out, int code, int emergency_id, int twin_id) {
+    // Ottiene il tempo corrente
+    time_t now = sim_now();
+    struct timespec mono;
+    clock_gettime(CLOCK_MONOTONIC, &mono);
+
+    // Logger non attivo (prima di init_log o dopo close_log): il record va perso.
+    // Fa eccezione lo scrittore, che registra i propri eventi anche nell'ultima raccolta
+    if (!atomic_load_explicit(&writer_running, memory_order_relaxed) && !log_in_writer()) {
+        atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+        return NULL;
+    }
+    log_ring_t *ring = log_get_ring();
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+    // Ring pieno: scarta il record o attende che lo scrittore liberi spazio
+    int waited = 0;
+    while (head - atomic_load_explicit(&ring->tail, memory_order_acquire) >= LOG_RING_SIZE) {
+        if (atomic_load_explicit(&overflow_policy, memory_order_relaxed) == LOG_OVERFLOW_DROP ||
+            !atomic_load_explicit(&writer_running, memory_order_relaxed) || log_in_writer()) {
+            atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+            return NULL;
+        }
+        if (!waited) {
+            atomic_fetch_add_explicit(&blocked, 1, memory_order_relaxed);
+            waited = 1;
+        }
+        cnd_signal(&log_cond);
+        thrd_sleep(&(struct timespec){.tv_nsec = 100000}, NULL);
+    }
+
+    log_record_t *rec = &ring->records[head % LOG_RING_SIZE];
+    rec->seq = atomic_fetch_add_explicit(&next_seq, 1, memory_order_relaxed);
+    rec->h = (log_bin_header_t){
+        .mono_ns = (uint64_t)mono.tv_sec * 1000000000ULL + mono.tv_nsec,
+        .time = (int32_t)(now - time_base),
+        .code = code,
+        .emergency_id = emergency_id,
+        .twin_id = twin_id
+    };
+    *ring_out = ring;
+    return rec;
+}
+
+// Funzione che attende che il record appena pubblicato sia su disco (group
+// commit): la fdatasync resta dello scrittore, ed è una sola per tutti i
+// produttori in attesa nella stessa raccolta
+static void log_commit_wait(void) {
+    // Il record pubblicato è visibile a tutte le raccolte iniziate dopo la
+    // lettura di drain_gen (barriera in coppia con quella di log_drain)
+    atomic_thread_fence(memory_order_seq_cst);
+    unsigned long target = atomic_load(&drain_gen) + 1;
+    atomic_fetch_add_explicit(&commit_waits, 1, memory_order_relaxed);
+    LOCKPROF_LOCK(&log_mutex, LOCK_CLASS_LOG, 0, "errore in lock log_mutex");
+    atomic_store(&sync_requested, 1);
+    cnd_signal(&log_cond);
+    while (atomic_load(&durable_gen) < target && atomic_load(&writer_running))
+        cnd_wait(&commit_cond, &log_mutex);
+    LOCKPROF_UNLOCK(&log_mutex, LOCK_CLASS_LOG, 0, "errore in unlock log_mutex");
+}
+
+// Funzione che pubblica allo scrittore il record riservato per ultimo.
+// Un evento critico (assegnazione, TIMEOUT, COMPLETED) con la politica
+// critical sveglia subito lo scrittore, che lo porta su disco senza che il
+// produttore attenda; con la politica group il produttore attende la
+// fdatasync comune della raccolta (log_commit_wait).
+static void log_publish(log_ring_t *ring, int critical) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    if (!critical)
+        return;
+    int policy = atomic_load_explicit(&sync_policy, memory_order_relaxed);
+    if (policy == LOG_SYNC_GROUP && !log_in_writer()) {
+        log_commit_wait();
+    } else if (policy == LOG_SYNC_CRITICAL) {
+        atomic_store(&sync_requested, 1);
+        cnd_signal(&log_cond);
+    }
+}
+
+// Funzione che copia al più max byte di una stringa e ne restituisce la lunghezza copiata
+static size_t log_copy(unsigned char *dst, const char *src, size_t max) {
+    size_t len = strnlen(src, max);
+    memcpy(dst, src, len);
+    return len;
+}
+
+// Funzione che accoda un evento testuale per il file di log, senza lock né system call
+// Il messaggio è formattato con ap direttamente nel record, oppure copiato
+// da message se ap è NULL.
+static void log_text(const char *id, const char *event_type, const char *message,
+                     const char *format, va_list *ap) {
 
     // Controlla che i parametri non siano nulli, assegna valori di default se necessario
     if (!id) id = "N/A";
     if (!event_type) event_type = "UNKNOWN";
     if (!message) message = "(null)";
 
-    // Ottiene il tempo corrente
-    time_t now = time(NULL);
+    log_ring_t *ring;
+    log_record_t *rec = log_reserve(&ring, LOG_EV_TEXT, 0, 0);
+    if (!rec) return;
 
-    // Contatore statico per evitare troppi fsync(), che ridurrebbero le prestazioni
-    static int counter = 0;
+    // Payload: lunghezze di origine, tipo e messaggio seguite dai byte
+    unsigned char *p = rec->payload + 4;
+    size_t id_len = log_copy(p, id, LOG_ID_SIZE);
+    size_t type_len = log_copy(p + id_len, event_type, LOG_TYPE_SIZE);
+    uint16_t msg_len;
+    if (ap) {
+        int n = vsnprintf((char *)p + id_len + type_len, LOG_MSG_SIZE + 1, format, *ap);
+        msg_len = n < 0 ? 0 : n > LOG_MSG_SIZE ? LOG_MSG_SIZE : n;
+    } else {
+        msg_len = log_copy(p + id_len + type_len, message, LOG_MSG_SIZE);
+    }
+    rec->payload[0] = id_len;
+    rec->payload[1] = type_len;
+    memcpy(rec->payload + 2, &msg_len, sizeof(msg_len));
+    rec->h.payload_len = 4 + id_len + type_len + msg_len;
+    // Gli eventi critici (assegnazione, TIMEOUT, COMPLETED) sono tutti strutturati
+    log_publish(ring, 0);
+}
 
-    // Acquisisce il mutex per accesso concorrente al file di log
-    if (mtx_lock(&log_mutex) != thrd_success) {
-            perror("errore in lock log_mutex"); 
-            exit(EXIT_FAILURE);
-    } 
+// Funzione che accoda un evento testuale con messaggio già composto
+// id: identificatore dell'origine dell'evento (ID emergenza)
+// event_type: tipo dell'evento (es. "INTENT", "ASSIGNMENT")
+// message: messaggio descrittivo dell'evento
+void log_event(const char *id, const char *event_type, const char *message) {
+    log_text(id, event_type, message, NULL, NULL);
+}
 
-    // Scrive l'evento nel file di log
-    dprintf(log_fd, "[%ld] [%s] [%s] %s\n", now, id, event_type, message);
+// Funzione che accoda un evento testuale formattato in stile printf
+// (usata dalle macro LOGF, dopo il controllo del filtro)
+void log_eventf(const char *id, const char *event_type, const char *format, ...) {
+    va_list ap;
+    va_start(ap, format);
+    log_text(id, event_type, "", format, &ap);
+    va_end(ap);
+}
 
-    // Effettua flush su disco ogni 10 scritture per ottimizzare le prestazioni
-    counter++;
-    if (counter >= 10) {
-        fsync(log_fd);
-        counter = 0;
+// Funzione che accoda un evento formattato riferito all'emergenza id
+void log_eventf_id(int id, const char *event_type, const char *format, ...) {
+    char id_str[32];
+    snprintf(id_str, sizeof(id_str), "Emergenza %d", id);
+    va_list ap;
+    va_start(ap, format);
+    log_text(id_str, event_type, "", format, &ap);
+    va_end(ap);
+}
+
+// Funzione che accoda un evento strutturato con i suoi argomenti int32
+// (quanti previsti dal codice, vedi logfmt.h): nessuna formattazione nel chiamante
+void log_struct(log_code_t code, int emergency_id, int twin_id, int arg0, int arg1) {
+    log_ring_t *ring;
+    log_record_t *rec = log_reserve(&ring, code, emergency_id, twin_id);
+    if (!rec) return;
+    int32_t args[2] = {arg0, arg1};
+    int nargs = log_code_args(code);
+    memcpy(rec->payload, args, nargs * sizeof(int32_t));
+    rec->h.payload_len = nargs * sizeof(int32_t);
+    // Eventi critici: i TIMEOUT (per causa) e COMPLETED
+    int critical = code == LOG_EV_EM_COMPLETED || code == LOG_EV_EM_TIMEOUT_REACH ||
+                   code == LOG_EV_EM_TIMEOUT_DEADLINE;
+    log_publish(ring, critical);
+}
+
+// Funzione che accoda l'assegnazione dei twin ad un'emergenza (id dei twin,
+// raggruppati per tipo solo quando il record viene reso in testo)
+void log_assignment(int emergency_id, rescuer_digital_twin_t **twins, int count) {
+    log_ring_t *ring;
+    log_record_t *rec = log_reserve(&ring, LOG_EV_EM_ASSIGNMENT, emergency_id, 0);
+    if (!rec) return;
+    int max = LOG_BIN_PAYLOAD_MAX / sizeof(int32_t);
+    if (count > max) count = max;
+    for (int i = 0; i < count; ++i) {
+        int32_t id = twins[i]->id;
+        memcpy(rec->payload + i * sizeof(int32_t), &id, sizeof(id));
+    }
+    rec->h.payload_len = count * sizeof(int32_t);
+    log_publish(ring, 1);
+}
+
+// Funzione che dichiara nel log i tipi di soccorritori e il tipo di ogni twin,
+// da cui lo scrittore e il decoder ricavano le etichette "Tipo id"
+void log_declare_fleet(const rescuer_data_t *rdata) {
+    log_ring_t *ring;
+    for (int k = 0; k < rdata->num_types; ++k) {
+        log_record_t *rec = log_reserve(&ring, LOG_EV_RESCUER_TYPE, 0, k);
+        if (!rec) continue;
+        rec->h.payload_len = log_copy(rec->payload, rdata->types[k]->rescuer_type_name, LOG_ID_SIZE);
+        log_publish(ring, 0);
+    }
+    // Tipi dei twin a blocchi di id consecutivi (twins[i].id = i + 1)
+    for (int start = 0; start < rdata->num_twins; start += LOG_FLEET_CHUNK) {
+        int count = rdata->num_twins - start < LOG_FLEET_CHUNK ? rdata->num_twins - start : LOG_FLEET_CHUNK;
+        log_record_t *rec = log_reserve(&ring, LOG_EV_FLEET, 0, start + 1);
+        if (!rec) continue;
+        for (int i = 0; i < count; ++i) {
+            uint16_t type = rdata->cols.type_id[start + i];
+            memcpy(rec->payload + i * sizeof(uint16_t), &type, sizeof(type));
+        }
+        rec->h.payload_len = count * sizeof(uint16_t);
+        log_publish(ring, 0);
     }
+}
 
-    // Rilascia il mutex
-    if (mtx_unlock(&log_mutex) != thrd_success) { 
-            perror("errore in unlock log_mutex"); 
-            exit(EXIT_FAILURE); 
-    } 
+// Funzione che sceglie il formato del log (testo su emergency.log o binario
+// su emergency.evlog); lo scrittore lo applica dalla raccolta successiva
+void log_set_format(log_format_t format) {
+    atomic_store(&requested_format, format);
 }
 
 
-// Funzione che chiude in sicurezza il file di log e distrugge il mutex
+// Funzione che chiude in sicurezza il file di log: ferma lo scrittore dopo
+// che ha scritto tutti i record in coda, poi chiude il file
 void close_log(void) {
-    // Chiude il file descriptor in sezione critica per evitare
-    // condizioni di race con log_event()
-    if (mtx_lock(&log_mutex) != thrd_success) {
-            perror("errore in lock log_mutex"); 
-            exit(EXIT_FAILURE);
-    }
+    if (!atomic_exchange(&writer_running, 0))
+        return;
+
+    // Lo scrittore svuota i ring un'ultima volta prima di terminare
+    LOCKPROF_LOCK(&log_mutex, LOCK_CLASS_LOG, 0, "errore in lock log_mutex");
+    atomic_store(&stopping, 1);
+    cnd_signal(&log_cond);
+    LOCKPROF_UNLOCK(&log_mutex, LOCK_CLASS_LOG, 0, "errore in unlock log_mutex");
+    thrd_join(writer_thread, NULL);
 
     // Se il file è stato aperto correttamente, lo si chiude
     if (log_fd != -1) {
         close(log_fd);
+        log_fd = -1;
     }
 
-    // Rilascia il lock prima di distruggere il mutex
-    if (mtx_unlock(&log_mutex) != thrd_success) { 
-            perror("errore in unlock log_mutex"); 
-            exit(EXIT_FAILURE); 
-    } 
-
-    // Distrugge il mutex
+    // Distrugge mutex e condition variable. I ring restano allocati: un thread
+    // ancora attivo potrebbe conservarne il riferimento nella chiave TSS
+    cnd_destroy(&log_cond);
+    cnd_destroy(&commit_cond);
     mtx_destroy(&log_mutex);
+    log_names_free(&names);
 }
 
 // Funzione di supporto che formatta l'ID di emergenza e invoca log_event()
@@ -107,4 +803,14 @@ void log_event_id(int id, const char *event_type, const char *message) {
     char id_str[32];
     snprintf(id_str, sizeof(id_str), "Emergenza %d", id);
     log_event(id_str, event_type, message);
-}
\ No newline at end of file
+}
+
+// Funzione che stampa le statistiche del logger
+void print_log_stats(void) {
+    static const char *policies[] = {"none", "periodic", "group", "critical"};
+    printf("Logger (%s): %lu record scritti (%llu byte) in %lu writev, %lu fdatasync (%s), %lu segmenti ruotati, "
+           "%lu scartati, %lu attese per buffer pieno, %lu attese di commit\n",
+           current_format == LOG_FORMAT_BINARY ? "binario" : "testo", written, bytes, writes, fsyncs,
+           policies[atomic_load(&sync_policy)], rotations, atomic_load(&dropped), atomic_load(&blocked),
+           atomic_load(&commit_waits));
+}
@@ -2,10 +2,108 @@
 #define LOGGER_H
 
 #include <time.h>
+#include <stdatomic.h>
+#include "rescuers.h"
+#include "logfmt.h"
+
+// Logging asincrono: ogni thread produttore accoda i record in un proprio
+// ring buffer senza lock, un thread scrittore li raccoglie in ordine di
+// emissione e li scrive su emergency.log con writev, sincronizzandolo su disco
+// secondo la politica di durabilità e ruotandolo in segmenti di dimensione fissa.
+// I record sono strutturati (logfmt.h): lo scrittore li rende nel formato
+// testuale, oppure li scrive così come sono nel formato binario.
+
+// Politica quando il ring buffer di un thread è pieno
+typedef enum {
+    LOG_OVERFLOW_BLOCK, // il produttore attende che lo scrittore liberi spazio
+    LOG_OVERFLOW_DROP   // il record viene scartato (e contato)
+} log_overflow_t;
+
+// Formato del file di log
+typedef enum {
+    LOG_FORMAT_TEXT,   // emergency.log
+    LOG_FORMAT_BINARY  // emergency.evlog, da leggere con Tools/log_decode
+} log_format_t;
+
+// Politica di durabilità di emergency.log: le sync sono eseguite sempre dal
+// thread scrittore, mai dai produttori
+typedef enum {
+    LOG_SYNC_NONE,     // nessuna sync esplicita, se non alla chiusura
+    LOG_SYNC_PERIODIC, // fdatasync al più ogni log_sync_ms
+    LOG_SYNC_GROUP,    // group commit: una fdatasync per ogni raccolta, comune a tutti i record
+                       // raccolti; chi scrive ASSIGNMENT, TIMEOUT e COMPLETED attende che sia su disco
+    LOG_SYNC_CRITICAL  // ASSIGNMENT, TIMEOUT e COMPLETED subito su disco senza attesa, il resto come periodic
+} log_sync_t;
+
+// Livelli di log, dal più dettagliato al più importante
+typedef enum {
+    LOG_LEVEL_DEBUG, // passi intermedi: righe dei file di configurazione, passi della coda di messaggi
+    LOG_LEVEL_INFO,  // avvio, configurazione e riepiloghi
+    LOG_LEVEL_STATE, // transizioni di stato di emergenze e soccorritori
+    LOG_LEVEL_ERROR  // errori e richieste scartate
+} log_level_t;
+
+// Categorie di log (maschera di bit), per tipo di evento
+#define LOG_CAT_PARSING   (1u << 0) // FILE_PARSING
+#define LOG_CAT_QUEUE     (1u << 1) // MESSAGE_QUEUE
+#define LOG_CAT_EMERGENCY (1u << 2) // EMERGENCY_STATUS, ASSIGNMENT, TIMEOUT
+#define LOG_CAT_RESCUER   (1u << 3) // RESCUER_STATUS, SUBSTITUTION, PREEMPTION
+#define LOG_CAT_DISPATCH  (1u << 4) // INTENT, REACH_INDEX
+#define LOG_CAT_SYSTEM    (1u << 5) // CLOCK, TRACE, logger
+#define LOG_CAT_ALL       0x3fu
+
+// Livello minimo compilato: i punti di log sotto questa soglia diventano
+// codice morto e vengono eliminati dal compilatore (make LOG_MIN_LEVEL=LOG_LEVEL_STATE)
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+// Filtro a tempo di esecuzione (log_set_level, log_set_categories, SIGUSR2)
+extern atomic_int log_runtime_level;
+extern atomic_uint log_runtime_categories;
+
+// Vero se un evento di quel livello e categoria va registrato. Gli errori
+// passano il filtro per categoria.
+#define LOG_ENABLED(level, cat) \
+    ((level) >= LOG_MIN_LEVEL && \
+     (int)(level) >= atomic_load_explicit(&log_runtime_level, memory_order_relaxed) && \
+     ((level) >= LOG_LEVEL_ERROR || \
+      (atomic_load_explicit(&log_runtime_categories, memory_order_relaxed) & (cat))))
+
+// Front end del logger: il filtro viene controllato prima di formattare il
+// messaggio, per cui un evento filtrato non costa che un confronto
+#define LOG_TEXT(level, cat, id, type, message) \
+    do { if (LOG_ENABLED(level, cat)) log_event(id, type, message); } while (0)
+#define LOG_TEXT_ID(level, cat, em_id, type, message) \
+    do { if (LOG_ENABLED(level, cat)) log_event_id(em_id, type, message); } while (0)
+#define LOGF(level, cat, id, type, ...) \
+    do { if (LOG_ENABLED(level, cat)) log_eventf(id, type, __VA_ARGS__); } while (0)
+#define LOGF_ID(level, cat, em_id, type, ...) \
+    do { if (LOG_ENABLED(level, cat)) log_eventf_id(em_id, type, __VA_ARGS__); } while (0)
+#define LOG_STRUCT(level, cat, code, em_id, twin_id, arg0, arg1) \
+    do { if (LOG_ENABLED(level, cat)) log_struct(code, em_id, twin_id, arg0, arg1); } while (0)
+#define LOG_ASSIGNMENT(level, cat, em_id, twins, count) \
+    do { if (LOG_ENABLED(level, cat)) log_assignment(em_id, twins, count); } while (0)
 
 void init_log(void);
+void log_set_overflow(log_overflow_t policy);
+void log_set_format(log_format_t format);
+void log_set_durability(log_sync_t policy, int interval_ms);
+void log_set_segment_size(size_t bytes);
+void log_set_level(log_level_t level);
+void log_set_categories(unsigned categories);
+void log_cycle_level(void);
+const char *log_level_name(int level);
 void log_event(const char *id, const char *event_type, const char *message);
+void log_eventf(const char *id, const char *event_type, const char *format, ...)
+    __attribute__((format(printf, 3, 4)));
+void log_eventf_id(int id, const char *event_type, const char *format, ...)
+    __attribute__((format(printf, 3, 4)));
+void log_struct(log_code_t code, int emergency_id, int twin_id, int arg0, int arg1);
+void log_assignment(int emergency_id, rescuer_digital_twin_t **twins, int count);
+void log_declare_fleet(const rescuer_data_t *rdata);
 void close_log(void);
 void log_event_id(int id, const char *event_type, const char *message);
+void print_log_stats(void);
 
 #endif
@@ -21,6 +21,13 @@
 #include "emergency.h"
 #include "worker_thread.h"
 #include "intent.h"
+#include "reach.h"
+#include "fleet.h"
+#include "event.h"
+#include "simclock.h"
+#include "trace.h"
+#include "metrics.h"
+#include "livestate.h"
 
 
 #define MAX_MSG_SIZE 512
@@ -45,24 +52,92 @@ void sigint_handler(int signal_number) {
     write(STDOUT_FILENO, msg, sizeof(msg) - 1);
 }
 
+// Gestore del Segnale SIGUSR2
+// Passa al livello di log successivo; il thread scrittore registra il cambio.
+void sigusr2_handler(int signal_number) {
+    (void)signal_number;
+    log_cycle_level();
+}
+
+// Gestore del Segnale SIGUSR1
+// Chiede al thread delle metriche di stampare il rapporto su stdout.
+void sigusr1_handler(int signal_number) {
+    (void)signal_number;
+    metrics_request_dump();
+}
 
-int main()
+
+int main(int argc, char *argv[])
 {
+    // --- Opzioni: -r <trace> riproduce un trace invece di leggere la coda,
+    //     -o <file> sceglie il log delle decisioni del replay ---
+    const char *replay_path = NULL;
+    const char *decisions_path = "replay_decisions.log";
+    int opt;
+    while ((opt = getopt(argc, argv, "r:o:")) != -1) {
+        switch (opt) {
+            case 'r': replay_path = optarg; break;
+            case 'o': decisions_path = optarg; break;
+            default:
+                fprintf(stderr, "Uso: %s [-r trace [-o decisioni]]\n", argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+
     // --- Inizializza il sistema di logging ---
     init_log();
 
     // --- Parsing del file di configurazione env.conf ----
     env_config_t config;
-    log_event("main.c", "FILE_PARSING", "Avvio del parsing di env.conf");
+    LOG_TEXT(LOG_LEVEL_INFO, LOG_CAT_PARSING, "main.c", "FILE_PARSING", "Avvio del parsing di env.conf");
     if (parse_env("env.conf", &config) != 0) {
         printf("Errore durante il parsing di env.conf\n");
-        log_event("main.c", "FILE_PARSING", "Errore durante il parsing di env.conf");
+        LOG_TEXT(LOG_LEVEL_ERROR, LOG_CAT_PARSING, "main.c", "FILE_PARSING",
+                 "Errore durante il parsing di env.conf");
         // clean up and exit
         free_env_config(&config);
         close_log();
         exit(EXIT_FAILURE);
     }
     print_env(&config);
+    log_set_overflow(config.log_overflow);
+    log_set_format(config.log_format);
+    log_set_level(config.log_level);
+    log_set_categories(config.log_categories);
+    log_set_durability(config.log_sync, config.log_sync_ms);
+    log_set_segment_size((size_t)config.log_segment_mb * 1024 * 1024);
+
+    // --- SIGUSR2 cambia il livello di log a run-time (debug -> info -> state -> error -> debug) ---
+    struct sigaction sa_sigusr2;
+    memset(&sa_sigusr2, 0, sizeof(sa_sigusr2));
+    sa_sigusr2.sa_handler = sigusr2_handler;
+    sigemptyset(&sa_sigusr2.sa_mask);
+    sa_sigusr2.sa_flags = SA_RESTART; // il cambio di livello non deve interrompere le attese
+    if (sigaction(SIGUSR2, &sa_sigusr2, NULL) == -1)
+        perror("sigaction SIGUSR2 fallita");
+
+    // --- Metriche: SIGUSR1 stampa il rapporto, metrics_socket lo espone su socket Unix ---
+    metrics_start(config.metrics_socket);
+    struct sigaction sa_sigusr1;
+    memset(&sa_sigusr1, 0, sizeof(sa_sigusr1));
+    sa_sigusr1.sa_handler = sigusr1_handler;
+    sigemptyset(&sa_sigusr1.sa_mask);
+    sa_sigusr1.sa_flags = SA_RESTART;
+    if (sigaction(SIGUSR1, &sa_sigusr1, NULL) == -1)
+        perror("sigaction SIGUSR1 fallita");
+    // Un client delle metriche che chiude il socket prima della fine del
+    // rapporto non deve terminare il server: la scrittura fallisce con EPIPE
+    struct sigaction sa_sigpipe;
+    memset(&sa_sigpipe, 0, sizeof(sa_sigpipe));
+    sa_sigpipe.sa_handler = SIG_IGN;
+    sigemptyset(&sa_sigpipe.sa_mask);
+    if (sigaction(SIGPIPE, &sa_sigpipe, NULL) == -1)
+        perror("sigaction SIGPIPE fallita");
+
+    // --- Avvio dell'orologio virtuale (prima di qualsiasi timestamp) ---
+    // Il replay usa un orologio manuale, avanzato dallo scheduler deterministico
+    sim_clock_init(replay_path ? SIM_CLOCK_MANUAL : config.clock_mode, config.clock_scale);
+    LOG_TEXT(LOG_LEVEL_INFO, LOG_CAT_SYSTEM, "main.c", "CLOCK", sim_clock_mode_name(sim_clock_mode()));
 
     // --- Configura attributi della coda di messaggi ---
     struct mq_attr attr = {
@@ -71,26 +146,33 @@ int main()
         .mq_msgsize = MQ_MSG_SIZE,
         .mq_curmsgs = 0
     };
-    // Apre la coda di messaggi (non bloccante)
-    mqd_t mq = mq_open(config.queue_name, O_CREAT | O_RDONLY | O_NONBLOCK, 0666, &attr);
-    if (mq == -1) {
-        perror("mq_open");
-        exit(EXIT_FAILURE);
+    // Apre la coda di messaggi (non bloccante), non usata dal replay
+    mqd_t mq = (mqd_t)-1;
+    if (!replay_path) {
+        mq = mq_open(config.queue_name, O_CREAT | O_RDONLY | O_NONBLOCK, 0666, &attr);
+        if (mq == -1) {
+            perror("mq_open");
+            exit(EXIT_FAILURE);
+        }
+        LOG_TEXT(LOG_LEVEL_INFO, LOG_CAT_QUEUE, "main.c", "MESSAGE_QUEUE", "Coda di messaggi creata");
+        metrics_watch_queue(mq);
     }
-    log_event("main.c", "MESSAGE_QUEUE", "Coda di messaggi creata");
 
     // --- Parsing del file rescuers.conf ---
     rescuer_data_t rescuer_data;
-    log_event("main.c", "FILE_PARSING", "Avvio del parsing di rescuers.conf");
+    LOG_TEXT(LOG_LEVEL_INFO, LOG_CAT_PARSING, "main.c", "FILE_PARSING", "Avvio del parsing di rescuers.conf");
     if (parse_rescuers("rescuers.conf", &rescuer_data) != 0) {
         printf("Errore durante il parsing di rescuers.conf\n");
-        log_event("main.c", "FILE_PARSING", "Errore nel parsing di rescuers.conf");
+        LOG_TEXT(LOG_LEVEL_ERROR, LOG_CAT_PARSING, "main.c", "FILE_PARSING",
+                 "Errore nel parsing di rescuers.conf");
         // clean up and exit
         free_env_config(&config);
         close_log();
         exit(EXIT_FAILURE);
     }
     print_rescuer_data(&rescuer_data);
+    // Tipi e twin dichiarati nel log, per le etichette degli eventi strutturati
+    log_declare_fleet(&rescuer_data);
 
     // --- Inizializza array di mutex per gestire accesso concorrente ai digital twin ---
     mtx_t twin_locks[MAX_TWINS];
@@ -100,10 +182,12 @@ int main()
 
     // --- Parsing del file emergency_types.conf ---
     emergency_data_t emergency_data;
-    log_event("main.c", "FILE_PARSING", "Avvio del parsing di emergency_types.conf");
+    LOG_TEXT(LOG_LEVEL_INFO, LOG_CAT_PARSING, "main.c", "FILE_PARSING",
+             "Avvio del parsing di emergency_types.conf");
     if (parse_emergency_types("emergency_types.conf", &rescuer_data, &emergency_data) != 0) {
         printf("Errore durante il parsing di emergency_types.conf\n");
-        log_event("main.c", "FILE_PARSING", "Errore nel parsing di emergency_types.conf");
+        LOG_TEXT(LOG_LEVEL_ERROR, LOG_CAT_PARSING, "main.c", "FILE_PARSING",
+                 "Errore nel parsing di emergency_types.conf");
         // clean up and exit
         free_env_config(&config);
         free_rescuers_data(&rescuer_data);
@@ -112,6 +196,51 @@ int main()
     }
     print_emergency_types(&emergency_data);
 
+    // --- Replay: riporta la flotta allo stato registrato nel trace ---
+    trace_t trace;
+    if (replay_path && trace_load(replay_path, &rescuer_data, &emergency_data, &trace) != 0) {
+        free_env_config(&config);
+        free_rescuers_data(&rescuer_data);
+        free_emergency_types(&emergency_data);
+        close_log();
+        exit(EXIT_FAILURE);
+    }
+
+    // --- Collega la vista colonnare della flotta, aggiornata ad ogni transizione ---
+    fleet_attach(&rescuer_data);
+
+    // --- Costruisce l'indice di raggiungibilità (se fallisce si usa la scansione completa) ---
+    reach_index_init(&rescuer_data, &config);
+
+    // --- Pubblica lo stato corrente in memoria condivisa, se richiesto (letto da Tools/ems-top) ---
+    livestate_start(config.state_shm, &rescuer_data, &config);
+
+    // --- Replay deterministico a thread singolo: nessuna coda né worker thread ---
+    if (replay_path) {
+        event_engine_start_manual();
+        int rc = trace_replay(&trace, decisions_path, &rescuer_data, &emergency_data, &config, twin_locks);
+        event_engine_stop();
+        livestate_stop();
+        print_event_engine_stats();
+        metrics_stop();
+        metrics_dump(STDOUT_FILENO);
+        free_trace(&trace);
+        free_env_config(&config);
+        free_rescuers_data(&rescuer_data);
+        free_emergency_types(&emergency_data);
+        reach_index_free();
+        for (int i = 0; i < MAX_TWINS; i++)
+        {
+            mtx_destroy(&twin_locks[i]);
+        }
+        close_log();
+        print_log_stats();
+        exit(rc == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    // --- Avvia il motore a eventi che simula i twin in attività ---
+    event_engine_start();
+
     // --- Configurazione del gestore per SIGINT (Ctrl+C) ---
     struct sigaction sa_sigint;
     memset(&sa_sigint, 0, sizeof(sa_sigint)); // Azzera la struttura
@@ -126,6 +255,7 @@ int main()
         printf("Esecuzione cleanup.\n");
         mq_close(mq);
         mq_unlink(config.queue_name);
+        livestate_stop();
         free_env_config(&config);
         free_rescuers_data(&rescuer_data);
         free_emergency_types(&emergency_data);
@@ -139,6 +269,10 @@ int main()
     }
     printf("Gestore SIGINT installato. Inizio ciclo principale...\n");
 
+    // --- Avvia la cattura del trace, se richiesta in env.conf ---
+    if (config.trace_path)
+        trace_open(config.trace_path, &rescuer_data, &emergency_data);
+
     // --- Inizializza tabella degli intenti e id generator ---
     static int emergency_id = 1;
     intent_table_t itable;
@@ -146,7 +280,7 @@ int main()
     // Buffer per ricezione messaggi
     char buffer[MAX_MSG_SIZE];
 
-    // --- Ciclo principale: ricezione messaggi e creazione worker thread ---
+    // --- Ciclo principale: ricezione messaggi e avvio dei task delle emergenze ---
     while(terminate_request==0) {
     
         ssize_t bytes_read = mq_receive(mq, buffer, MQ_MSG_SIZE, NULL);
@@ -162,12 +296,19 @@ int main()
                 continue;
             }
         }
+        // Messaggio in lavorazione: in modalità AFAP l'orologio non avanza
+        // finché il suo task non è programmato (o il messaggio scartato)
+        event_hold();
+        long long received_ns = metrics_now_ns();
+        metrics_count(COUNTER_RECEIVED);
 
         // Alloca richiesta ed emergenza
         emergency_request_withID_t *req = malloc(sizeof(emergency_request_withID_t));
         emergency_withID_t *inst = malloc(sizeof(emergency_withID_t));
         if (!req || !inst) {
-            log_event("main.c", "ALLOC_ERROR", "malloc fallita per request o instanza");
+            LOG_TEXT(LOG_LEVEL_ERROR, LOG_CAT_QUEUE, "main.c", "ALLOC_ERROR",
+                     "malloc fallita per request o instanza");
+            event_release();
             continue;
         }
 
@@ -178,55 +319,50 @@ int main()
             validate_MQrequest(req, emergency_data.types, emergency_data.num_types, &config) != 0 ||
             create_emergency_instance(inst, req, emergency_data.types, emergency_data.num_types) != 0) {
 
-            log_event("main.c", "PARSING/VALIDATION_ERROR", buffer);
+            LOG_TEXT(LOG_LEVEL_ERROR, LOG_CAT_QUEUE, "main.c", "PARSING/VALIDATION_ERROR", buffer);
+            metrics_count(COUNTER_REJECTED);
             free(req);
             free(inst);
+            event_release();
             continue;
         }
 
+        metrics_admit(inst, received_ns);
+        trace_record_request(req);
         free(req);
         print_emergency_instance(inst);
 
-        // Alloca argomenti e crea un worker thread per gestire l'emergenza
-        worker_args_t *args = malloc(sizeof(worker_args_t));
-        if (!args)
-        {
-            log_event("main.c", "ALLOC_ERROR", "malloc fallita per worker args");
-            free_emergency_instance(inst);
-            continue;
-        }
-        args->emergency = inst;
-        args->itable = &itable;
-        args->rdata = &rescuer_data;
-        args->twin_locks = twin_locks;
-
-        thrd_t t;
-        if (thrd_create(&t, worker_thread, args) != thrd_success) {
-            log_event("main.c", "THREAD_ERROR", "Creazione thread fallita");
-            free_emergency_instance(inst);
-            free(args);
-            continue;
-        }
-
-        // Detach del thread per evitare memory leak
-        thrd_detach(t);
+        // Affida l'emergenza al suo task, eseguito dal motore a eventi
+        dispatch_submit(inst, &rescuer_data, &itable, twin_locks);
+        event_release();
     }
 
     // Cleanup al termine del ciclo (SIGINT ricevuto)
     printf("Flag di terminazione rilevato.\n");
     printf("Esecuzione cleanup prima della terminazione.\n");
     // Clean
+    metrics_watch_queue((mqd_t)-1);
     mq_close(mq);
     mq_unlink(config.queue_name);
+    trace_close();
+    // Ferma il motore a eventi prima di liberare i twin che simula
+    event_engine_stop();
+    livestate_stop();
     free_env_config(&config);
     free_rescuers_data(&rescuer_data);
     free_emergency_types(&emergency_data);
+    print_intent_table_stats(&itable);
+    print_event_engine_stats();
+    metrics_stop();
+    metrics_dump(STDOUT_FILENO);
     free_intent_table(&itable);
+    reach_index_free();
     for (int i = 0; i < MAX_TWINS; i++)
     {
         mtx_destroy(&twin_locks[i]);
     }
     close_log();
+    print_log_stats();
     printf("Cleanup completato. Uscita.\n");
 
     exit(EXIT_SUCCESS); // Termina il programma con successo
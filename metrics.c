@@ -0,0 +1,270 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <threads.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "metrics.h"
+#include "event.h"
+#include "lockprof.h"
+#include "scall.h"
+
+static const char *stage_names[METRIC_STAGES] = {
+    "ricezione->validata", "->intent registrato", "->can_proceed", "->twin assegnati",
+    "->sul posto", "->completata"
+};
+static const char *counter_names[COUNTER_COUNT] = {
+    "messaggi ricevuti", "richieste scartate", "attese per can_proceed", "assegnazioni fallite",
+    "trylock falliti", "timeout per distanza", "timeout per carenza", "sospensioni per preemption",
+    "emergenze completate"
+};
+
+static metric_histogram_t histograms[METRIC_STAGES];
+static atomic_ulong counters[COUNTER_COUNT];
+static atomic_long active_emergencies = 0;
+static mqd_t watched_queue = (mqd_t)-1;
+// Thread che serve il socket e le richieste di stampa (SIGUSR1, tramite pipe)
+static thrd_t metrics_thread;
+static int wake_pipe[2] = {-1, -1};
+static int listen_fd = -1;
+static char *socket_path = NULL;
+static atomic_int metrics_running = 0;
+
+
+// Funzione che restituisce l'istante corrente (CLOCK_MONOTONIC) in nanosecondi
+long long metrics_now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+// Funzione che restituisce il bucket di un valore: i primi METRIC_SUB valori
+// hanno un bucket ciascuno, poi ogni potenza di 2 è divisa in METRIC_SUB parti
+static int metric_bucket(unsigned long long v) {
+    if (v < METRIC_SUB)
+        return (int)v;
+    int msb = 63 - __builtin_clzll(v);
+    int shift = msb - METRIC_SUB_BITS;
+    return (shift + 1) * METRIC_SUB + (int)((v >> shift) & (METRIC_SUB - 1));
+}
+
+// Funzione che restituisce il limite inferiore dei valori di un bucket
+static unsigned long long metric_bucket_value(int b) {
+    if (b < METRIC_SUB)
+        return b;
+    int shift = b / METRIC_SUB - 1;
+    return (unsigned long long)(METRIC_SUB + b % METRIC_SUB) << shift;
+}
+
+// Funzione che registra un valore (ns) in un istogramma
+void metric_record(metric_histogram_t *h, long long ns) {
+    if (ns < 0) ns = 0;
+    atomic_fetch_add_explicit(&h->buckets[metric_bucket(ns)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->sum, ns, memory_order_relaxed);
+    long long max = atomic_load_explicit(&h->max, memory_order_relaxed);
+    while (ns > max && !atomic_compare_exchange_weak_explicit(&h->max, &max, ns,
+                                                              memory_order_relaxed, memory_order_relaxed))
+        ;
+}
+
+// Funzione che registra la validazione di una nuova emergenza e avvia la
+// misura delle sue fasi. received_ns: istante di ricezione dalla coda
+void metrics_admit(emergency_withID_t *e, long long received_ns) {
+    long long now = metrics_now_ns();
+    metric_record(&histograms[METRIC_VALIDATED], now - received_ns);
+    e->stage = METRIC_VALIDATED;
+    e->stage_ns = now;
+}
+
+// Funzione che registra il raggiungimento di una fase: il tempo dalla fase
+// precedente, solo la prima volta (i nuovi tentativi dopo una sospensione non contano)
+void metrics_stage(emergency_withID_t *e, metric_stage_t stage) {
+    if (e->stage < 0 || (int)stage <= e->stage)
+        return;
+    long long now = metrics_now_ns();
+    metric_record(&histograms[stage], now - e->stage_ns);
+    e->stage = stage;
+    e->stage_ns = now;
+}
+
+// Funzione che incrementa un contatore
+void metrics_count(metric_counter_t counter) {
+    atomic_fetch_add_explicit(&counters[counter], 1, memory_order_relaxed);
+}
+
+// Funzione che aggiorna il numero di emergenze in gestione
+void metrics_active(int delta) {
+    atomic_fetch_add_explicit(&active_emergencies, delta, memory_order_relaxed);
+}
+
+// Funzione che indica la coda di messaggi di cui riportare la profondità
+void metrics_watch_queue(mqd_t mq) {
+    watched_queue = mq;
+}
+
+// Funzione che scrive una durata in ns con l'unità più leggibile
+static void metric_format(char *out, size_t size, unsigned long long ns) {
+    if (ns < 1000ULL) snprintf(out, size, "%lluns", ns);
+    else if (ns < 1000000ULL) snprintf(out, size, "%.1fus", ns / 1e3);
+    else if (ns < 1000000000ULL) snprintf(out, size, "%.1fms", ns / 1e6);
+    else snprintf(out, size, "%.2fs", ns / 1e9);
+}
+
+// Funzione che restituisce il valore al percentile p (0-100) di un istogramma
+static unsigned long long metric_percentile(metric_histogram_t *h, unsigned long total, double p) {
+    unsigned long rank = (unsigned long)(p / 100.0 * total);
+    if (rank >= total) rank = total - 1;
+    unsigned long seen = 0;
+    for (int b = 0; b < METRIC_BUCKETS; ++b) {
+        seen += atomic_load_explicit(&h->buckets[b], memory_order_relaxed);
+        if (seen > rank)
+            return metric_bucket_value(b);
+    }
+    return atomic_load_explicit(&h->max, memory_order_relaxed);
+}
+
+// Funzione che scrive l'intestazione delle colonne di una tabella di istogrammi
+void metric_print_header(int fd, const char *title) {
+    dprintf(fd, "%-22s %8s %9s %9s %9s %9s %9s %9s\n", title, "n", "media", "p50", "p90", "p99", "p99.9", "max");
+}
+
+// Funzione che scrive la riga di un istogramma: conteggio, media, percentili e massimo
+void metric_print_row(int fd, const char *name, metric_histogram_t *h) {
+    static const double pct[] = {50, 90, 99, 99.9};
+    unsigned long total = atomic_load_explicit(&h->count, memory_order_relaxed);
+    char cols[6][16] = {"-", "-", "-", "-", "-", "-"};
+    if (total > 0) {
+        metric_format(cols[0], sizeof(cols[0]), atomic_load_explicit(&h->sum, memory_order_relaxed) / total);
+        for (int k = 0; k < 4; ++k)
+            metric_format(cols[k + 1], sizeof(cols[k + 1]), metric_percentile(h, total, pct[k]));
+        metric_format(cols[5], sizeof(cols[5]), atomic_load_explicit(&h->max, memory_order_relaxed));
+    }
+    dprintf(fd, "%-22s %8lu %9s %9s %9s %9s %9s %9s\n", name, total,
+            cols[0], cols[1], cols[2], cols[3], cols[4], cols[5]);
+}
+
+// Funzione che scrive su fd il rapporto testuale delle metriche
+void metrics_dump(int fd) {
+    // Le stampe con printf ancora nel buffer di stdout devono precedere il rapporto
+    if (fd == STDOUT_FILENO)
+        fflush(stdout);
+    dprintf(fd, "===== Metriche =====\n");
+    metric_print_header(fd, "fase");
+    for (int s = 0; s < METRIC_STAGES; ++s)
+        metric_print_row(fd, stage_names[s], &histograms[s]);
+    for (int c = 0; c < COUNTER_COUNT; ++c)
+        dprintf(fd, "%-28s %lu\n", counter_names[c], atomic_load_explicit(&counters[c], memory_order_relaxed));
+    long mq_depth = -1;
+    struct mq_attr attr;
+    if (watched_queue != (mqd_t)-1 && mq_getattr(watched_queue, &attr) == 0)
+        mq_depth = attr.mq_curmsgs;
+    dprintf(fd, "%-28s %ld\n", "emergenze in gestione", atomic_load(&active_emergencies));
+    dprintf(fd, "%-28s %d\n", "eventi in coda", event_queue_depth());
+    if (mq_depth >= 0)
+        dprintf(fd, "%-28s %ld\n", "messaggi nella coda MQ", mq_depth);
+    lockprof_dump(fd);
+}
+
+// Funzione che chiede al thread delle metriche di stampare il rapporto su
+// stdout. Async-signal-safe (solo write): è chiamata dal gestore di SIGUSR1.
+void metrics_request_dump(void) {
+    int saved = errno;
+    if (wake_pipe[1] != -1) {
+        char c = 'd';
+        ssize_t n = write(wake_pipe[1], &c, 1);
+        (void)n;
+    }
+    errno = saved;
+}
+
+// Thread delle metriche: stampa il rapporto quando riceve una richiesta sulla
+// pipe e lo invia ad ogni client che si connette al socket
+static int metrics_loop(void *arg) {
+    (void)arg;
+    struct pollfd fds[2] = {{.fd = wake_pipe[0], .events = POLLIN}, {.fd = listen_fd, .events = POLLIN}};
+    int nfds = listen_fd != -1 ? 2 : 1;
+    while (atomic_load(&metrics_running)) {
+        if (poll(fds, nfds, -1) == -1) {
+            if (errno == EINTR) continue;
+            perror("errore in poll metriche");
+            break;
+        }
+        if (fds[0].revents & POLLIN) {
+            char buf[16];
+            ssize_t n = read(wake_pipe[0], buf, sizeof(buf));
+            for (ssize_t i = 0; i < n; ++i)
+                if (buf[i] == 'd') metrics_dump(STDOUT_FILENO);
+        }
+        if (nfds == 2 && (fds[1].revents & POLLIN)) {
+            int client = accept(listen_fd, NULL, NULL);
+            if (client == -1) continue;
+            // Un client già disconnesso fa fallire le scritture con EPIPE
+            // (SIGPIPE è ignorato dal server): il rapporto va semplicemente perso
+            metrics_dump(client);
+            close(client);
+        }
+    }
+    return 0;
+}
+
+// Funzione che avvia il thread delle metriche e, se socket_path non è NULL,
+// il socket Unix su cui le espone
+void metrics_start(const char *path) {
+    int rc;
+    SCALL(rc, pipe(wake_pipe), "errore in pipe metriche");
+    // Pipe non bloccante: il gestore di SIGUSR1 non deve mai attendere in write
+    // (con la pipe piena una stampa è già in sospeso)
+    for (int k = 0; k < 2; ++k)
+        SCALL(rc, fcntl(wake_pipe[k], F_SETFL, fcntl(wake_pipe[k], F_GETFL) | O_NONBLOCK),
+              "errore in fcntl pipe metriche");
+    if (path) {
+        struct sockaddr_un addr = {.sun_family = AF_UNIX};
+        if (strlen(path) >= sizeof(addr.sun_path)) {
+            fprintf(stderr, "Percorso del socket delle metriche troppo lungo: %s\n", path);
+        } else {
+            strcpy(addr.sun_path, path);
+            SCALL(listen_fd, socket(AF_UNIX, SOCK_STREAM, 0), "errore in socket metriche");
+            unlink(path);
+            if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 || listen(listen_fd, 4) == -1) {
+                perror("errore in bind/listen socket metriche");
+                close(listen_fd);
+                listen_fd = -1;
+            } else {
+                SNCALL(socket_path, strdup(path), "errore in strdup socket metriche");
+            }
+        }
+    }
+    atomic_store(&metrics_running, 1);
+    if (thrd_create(&metrics_thread, metrics_loop, NULL) != thrd_success) {
+        perror("errore in creazione thread metriche");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Funzione che ferma il thread delle metriche e rimuove il socket
+void metrics_stop(void) {
+    if (!atomic_exchange(&metrics_running, 0))
+        return;
+    char c = 'q';
+    ssize_t n = write(wake_pipe[1], &c, 1);
+    (void)n;
+    thrd_join(metrics_thread, NULL);
+    close(wake_pipe[0]);
+    close(wake_pipe[1]);
+    wake_pipe[0] = wake_pipe[1] = -1;
+    if (listen_fd != -1) {
+        close(listen_fd);
+        listen_fd = -1;
+        unlink(socket_path);
+    }
+    free(socket_path);
+    socket_path = NULL;
+}
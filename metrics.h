@@ -0,0 +1,69 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <mqueue.h>
+#include <stdatomic.h>
+#include "emergency.h"
+
+// Metriche del ciclo di vita delle emergenze: istogrammi di latenza per fase
+// (bucket log-lineari in stile HDR, 16 sotto-bucket per potenza di 2, errore
+// relativo < 7%), contatori e profondità delle code. La registrazione costa
+// una lettura di CLOCK_MONOTONIC e qualche incremento atomico rilassato.
+// Le metriche si leggono con SIGUSR1 (stampa su stdout) o connettendosi al
+// socket Unix indicato da metrics_socket in env.conf (es. nc -U /tmp/ems.sock).
+
+// Sotto-bucket per potenza di 2 (2^METRIC_SUB_BITS)
+#define METRIC_SUB_BITS 4
+#define METRIC_SUB (1 << METRIC_SUB_BITS)
+// Bucket di un istogramma: valori fino a 2^63 ns
+#define METRIC_BUCKETS ((64 - METRIC_SUB_BITS + 1) * METRIC_SUB)
+
+// Istogramma di latenza (ns): contatori per bucket, somma e massimo.
+// Usato anche dal profilo dei lock (lockprof.h)
+typedef struct {
+    atomic_ulong buckets[METRIC_BUCKETS];
+    atomic_ulong count;
+    atomic_ullong sum;
+    atomic_llong max;
+} metric_histogram_t;
+
+// Fasi misurate: ciascuna è il tempo trascorso dalla fase precedente, e
+// viene registrata solo la prima volta che l'emergenza la raggiunge
+typedef enum {
+    METRIC_VALIDATED,  // ricezione dalla coda -> richiesta validata
+    METRIC_INTENT,     // -> intent registrato
+    METRIC_PROCEED,    // -> primo can_proceed riuscito
+    METRIC_CLAIM,      // -> twin assegnati (lock presi)
+    METRIC_ON_SCENE,   // -> tutti i twin sul posto (IN_PROGRESS)
+    METRIC_COMPLETED,  // -> COMPLETED
+    METRIC_STAGES
+} metric_stage_t;
+
+typedef enum {
+    COUNTER_RECEIVED,          // messaggi ricevuti
+    COUNTER_REJECTED,          // richieste scartate (formato o validazione)
+    COUNTER_RETRY_PROCEED,     // tentativi rimandati da can_proceed
+    COUNTER_RETRY_CLAIM,       // tentativi di assegnazione falliti
+    COUNTER_TRYLOCK_FAILED,    // mtx_trylock falliti sui twin
+    COUNTER_TIMEOUT_REACH,     // TIMEOUT per distanza (check_reachability)
+    COUNTER_TIMEOUT_DEADLINE,  // TIMEOUT per carenza (check_deadline)
+    COUNTER_PAUSED,            // emergenze sospese per preemption
+    COUNTER_COMPLETED,
+    COUNTER_COUNT
+} metric_counter_t;
+
+long long metrics_now_ns(void);
+void metric_record(metric_histogram_t *h, long long ns);
+void metric_print_header(int fd, const char *title);
+void metric_print_row(int fd, const char *name, metric_histogram_t *h);
+void metrics_admit(emergency_withID_t *e, long long received_ns);
+void metrics_stage(emergency_withID_t *e, metric_stage_t stage);
+void metrics_count(metric_counter_t counter);
+void metrics_active(int delta);
+void metrics_watch_queue(mqd_t mq);
+void metrics_start(const char *socket_path);
+void metrics_request_dump(void);
+void metrics_dump(int fd);
+void metrics_stop(void);
+
+#endif
@@ -13,7 +13,28 @@
 #define MAX_REQ_PER_EMERGENCY 16
 #define NAME_SIZE 64
 #define RESCUER_LENGTH 256
-#define MSG_SIZE 256
+
+// Funzione che cerca un tipo di rescuer per nome.
+// Restituisce il puntatore al tipo, NULL se non esiste.
+static rescuer_type_t *find_rescuer_type(const rescuer_data_t *rescuer_data, const char *name) {
+    for (int i = 0; i < rescuer_data->num_types; i++) {
+        if (strcmp(rescuer_data->types[i]->rescuer_type_name, name) == 0)
+            return rescuer_data->types[i];
+    }
+    return NULL;
+}
+
+// Funzione che verifica se un tipo di rescuer soddisfa una richiesta, direttamente
+// o come sostituto. Restituisce la penalità (0 per il tipo principale), -1 se non la soddisfa.
+int rescuer_request_match(const rescuer_request_t *req, const rescuer_type_t *type) {
+    if (strcmp(req->type->rescuer_type_name, type->rescuer_type_name) == 0)
+        return 0;
+    for (int i = 0; i < req->substitutes_count; ++i) {
+        if (strcmp(req->substitutes[i]->rescuer_type_name, type->rescuer_type_name) == 0)
+            return req->penalties[i];
+    }
+    return -1;
+}
 
 // Funzione che parse il file emergency_types.conf.
 int parse_emergency_types(const char *filename, const rescuer_data_t *rescuer_data, emergency_data_t *emergency_data) {
@@ -31,7 +52,8 @@ int parse_emergency_types(const char *filename, const rescuer_data_t *rescuer_da
         exit(EXIT_FAILURE);
     }
 
-    log_event("parse_emergency_types.c", "FILE_PARSING", "Apertura del file emergency_types.conf");
+    LOG_TEXT(LOG_LEVEL_DEBUG, LOG_CAT_PARSING, "parse_emergency_types.c", "FILE_PARSING",
+             "Apertura del file emergency_types.conf");
 
     // Alloca il vettore dei tipi di emergenza
     emergency_type_t *types;
@@ -41,7 +63,6 @@ int parse_emergency_types(const char *filename, const rescuer_data_t *rescuer_da
     char *line = NULL;
     size_t len = 0;
     int riga = 1;
-    char msg[MSG_SIZE];
 
     // Ciclo di lettura riga per riga
     while (getline(&line, &len, file) != -1 && count < MAX_EMERGENCIES) {
@@ -59,6 +80,8 @@ int parse_emergency_types(const char *filename, const rescuer_data_t *rescuer_da
             etype_temp.priority = priority;
             SNCALL(etype_temp.emergency_desc, strdup(name), "strdup emergency_desc");
             etype_temp.rescuers_req_number = 0;
+            etype_temp.preempt_max = -1;
+            etype_temp.partial = 0;
             SNCALL(etype_temp.rescuers, malloc(sizeof(rescuer_request_t) * MAX_REQ_PER_EMERGENCY), "malloc rescuers");
 
             // Copia sicura della parte rescuer per strtok
@@ -71,18 +94,28 @@ int parse_emergency_types(const char *filename, const rescuer_data_t *rescuer_da
             while (entry && etype_temp.rescuers_req_number < MAX_REQ_PER_EMERGENCY) {
                 char rescuer_name[NAME_SIZE];
                 int quantity, duration;
+                short preempt_max;
+                char keyword[NAME_SIZE];
 
-                // Parsea ogni voce: nome:q,d
-                if (sscanf(entry, "%63[^:]:%d,%d", rescuer_name, &quantity, &duration) == 3) {
-                    rescuer_type_t *matched = NULL;
-
-                    // Cerca corrispondenza tra i tipi di rescuer disponibili
-                    for (int i = 0; i < rescuer_data->num_types; i++) {
-                        if (strcmp(rescuer_data->types[i]->rescuer_type_name, rescuer_name) == 0) {
-                            matched = rescuer_data->types[i];
-                            break;
-                        }
+                // Voce opzionale preempt=p: può sottrarre twin ad emergenze con priorità <= p
+                if (sscanf(entry, " preempt=%hd", &preempt_max) == 1) {
+                    if (preempt_max >= 0 && preempt_max < priority) {
+                        etype_temp.preempt_max = preempt_max;
+                    } else {
+                        LOGF(LOG_LEVEL_ERROR, LOG_CAT_PARSING, "emergency_types.conf", "FILE_PARSING",
+                             "Riga %d: regola di preemption non valida: %s", riga, entry);
                     }
+                }
+                // Voce opzionale partial: invia subito i twin disponibili e
+                // completa l'assegnazione man mano che altri si liberano
+                else if (sscanf(entry, " %63s", keyword) == 1 && strcmp(keyword, "partial") == 0) {
+                    etype_temp.partial = 1;
+                }
+                // Parsea ogni voce: nome:q,d oppure nome|sostituto[+penalità]|...:q,d
+                else if (sscanf(entry, "%63[^:]:%d,%d", rescuer_name, &quantity, &duration) == 3) {
+                    char *save = NULL;
+                    char *alt = strtok_r(rescuer_name, "|", &save);
+                    rescuer_type_t *matched = alt ? find_rescuer_type(rescuer_data, alt) : NULL;
 
                     // Se trovato, inserisce nella lista dei rescuer richiesti
                     if (matched) {
@@ -90,9 +123,26 @@ int parse_emergency_types(const char *filename, const rescuer_data_t *rescuer_da
                         req->type = matched;
                         req->required_count = quantity;
                         req->time_to_manage = duration;
+                        req->substitutes_count = 0;
+
+                        // Tipi sostitutivi opzionali, in ordine di preferenza
+                        while ((alt = strtok_r(NULL, "|", &save)) != NULL) {
+                            char alt_name[NAME_SIZE];
+                            int penalty = 0;
+                            if (sscanf(alt, "%63[^+]+%d", alt_name, &penalty) < 1) continue;
+                            rescuer_type_t *substitute = find_rescuer_type(rescuer_data, alt_name);
+                            if (!substitute || penalty < 0 || req->substitutes_count >= MAX_SUBSTITUTES) {
+                                LOGF(LOG_LEVEL_ERROR, LOG_CAT_PARSING, "emergency_types.conf", "FILE_PARSING",
+                                     "Riga %d: sostituto non valido: %s", riga, alt);
+                                continue;
+                            }
+                            req->substitutes[req->substitutes_count] = substitute;
+                            req->penalties[req->substitutes_count] = penalty;
+                            req->substitutes_count++;
+                        }
                     } else {
-                        snprintf(msg, MSG_SIZE, "Riga %d: Tipo rescuer sconosciuto: %s", riga, rescuer_name);
-                        log_event("emergency_types.conf", "FILE_PARSING", msg);
+                        LOGF(LOG_LEVEL_ERROR, LOG_CAT_PARSING, "emergency_types.conf", "FILE_PARSING",
+                             "Riga %d: Tipo rescuer sconosciuto: %s", riga, rescuer_name);
                     }
                 }
 
@@ -102,31 +152,33 @@ int parse_emergency_types(const char *filename, const rescuer_data_t *rescuer_da
             // Se almeno un rescuer valido è stato trovato, memorizza il tipo
             if (etype_temp.rescuers_req_number > 0) {
                 types[count++] = etype_temp;
-                snprintf(msg, MSG_SIZE, "Riga %d: %s", riga, line);
-                log_event("emergency_types.conf", "FILE_PARSING", msg);
+                LOGF(LOG_LEVEL_DEBUG, LOG_CAT_PARSING, "emergency_types.conf", "FILE_PARSING",
+                     "Riga %d: %s", riga, line);
             } else {
                 // Altrimenti, ignora e libera la memoria allocata
                 free(etype_temp.emergency_desc);
                 free(etype_temp.rescuers);
-                snprintf(msg, MSG_SIZE, "Riga %d ignorata: nessun rescuer valido", riga);
-                log_event("emergency_types.conf", "FILE_PARSING", msg);
+                LOGF(LOG_LEVEL_ERROR, LOG_CAT_PARSING, "emergency_types.conf", "FILE_PARSING",
+                     "Riga %d ignorata: nessun rescuer valido", riga);
             }
 
         } else {
             // Riga malformata (non riconosciuta da sscanf)
-            snprintf(msg, MSG_SIZE, "Riga %d ignorata: %s", riga, line);
-            log_event("emergency_types.conf", "FILE_PARSING", msg);
+            LOGF(LOG_LEVEL_ERROR, LOG_CAT_PARSING, "emergency_types.conf", "FILE_PARSING",
+                 "Riga %d ignorata: %s", riga, line);
         }
 
         riga++;
     }
 
-    log_event("parse_emergency_types.c", "FILE_PARSING", "Parsing completato con successo");
+    LOG_TEXT(LOG_LEVEL_INFO, LOG_CAT_PARSING, "parse_emergency_types.c", "FILE_PARSING",
+             "Parsing completato con successo");
 
     // Libera buffer getline e chiude il file
     if (line) free(line);
     fclose(file);
-    log_event("parse_emergency_types.c", "FILE_PARSING", "Chiusura del file emergency_types.conf");
+    LOG_TEXT(LOG_LEVEL_DEBUG, LOG_CAT_PARSING, "parse_emergency_types.c", "FILE_PARSING",
+             "Chiusura del file emergency_types.conf");
 
     // Scrive i dati raccolti nella struttura di output
     emergency_data->types = types;
@@ -174,6 +226,10 @@ void print_emergency_types(const emergency_data_t *data) {
 
         printf("Emergenza Tipo %d: %s\n", i + 1, etype->emergency_desc);
         printf("  Priorità: %d\n", etype->priority);
+        if (etype->preempt_max >= 0)
+            printf("  Preemption: emergenze con priorità <= %d\n", etype->preempt_max);
+        if (etype->partial)
+            printf("  Assegnazione parziale consentita\n");
         printf("  Richieste di soccorritori:\n");
 
         for (int j = 0; j < etype->rescuers_req_number; ++j) {
@@ -182,6 +238,9 @@ void print_emergency_types(const emergency_data_t *data) {
                    req->type->rescuer_type_name,
                    req->required_count,
                    req->time_to_manage);
+            for (int k = 0; k < req->substitutes_count; ++k)
+                printf("      sostituibile con %s (penalità %d secondi)\n",
+                       req->substitutes[k]->rescuer_type_name, req->penalties[k]);
         }
         printf("\n");
     }
@@ -7,24 +7,37 @@
 #include "env.h"
 #include "scall.h"
 #include "logger.h" 
+#include "simclock.h"
 
 #define BUF_SIZE 512
-#define MESSAGE_SIZE 256
 #define KEY_SIZE 64
 #define VALUE_SIZE 64
 #define CODA_SIZE 128
 
 // Funzione che legge il file env.conf e popola la struttura env_config_t.
-// Supporta tre chiavi: queue, width, height. Ignora chiavi sconosciute o righe malformate.
+// Supporta le chiavi queue, width, height, clock, clock_scale, trace, log_overflow, log_format,
+// log_level, log_categories, log_sync, log_sync_ms, log_segment_mb, metrics_socket e state_shm.
+// Ignora i commenti (righe che iniziano con '#'), le chiavi sconosciute e le righe malformate.
 // In caso di errore fatale (open, malloc, strdup), il programma termina con exit.
 int parse_env(const char *filename, env_config_t *config) {
 
-    // Buffer per messaggi di log
-    char msg[MESSAGE_SIZE];
+    // Valori di default delle chiavi opzionali
+    config->clock_mode = SIM_CLOCK_REALTIME;
+    config->clock_scale = 1.0;
+    config->trace_path = NULL;
+    config->log_overflow = LOG_OVERFLOW_BLOCK;
+    config->log_format = LOG_FORMAT_TEXT;
+    config->log_level = LOG_LEVEL_DEBUG;
+    config->log_categories = LOG_CAT_ALL;
+    config->log_sync = LOG_SYNC_PERIODIC;
+    config->log_sync_ms = 100;
+    config->log_segment_mb = 0;
+    config->metrics_socket = NULL;
+    config->state_shm = NULL;
 
     // Apertura del file
     int fd;
-    log_event("parse_env.c", "FILE_PARSING", "Apertura del file env.conf");
+    LOG_TEXT(LOG_LEVEL_DEBUG, LOG_CAT_PARSING, "parse_env.c", "FILE_PARSING", "Apertura del file env.conf");
     SCALL(fd, open(filename, O_RDONLY), "errore in open env.conf");
 
     // Allocazione di un buffer per il contenuto del file
@@ -37,13 +50,19 @@ int parse_env(const char *filename, env_config_t *config) {
 
     // Chiusura del file
     close(fd);
-    log_event("parse_env.c", "FILE_PARSING", "Chiusura del file env.conf");
+    LOG_TEXT(LOG_LEVEL_DEBUG, LOG_CAT_PARSING, "parse_env.c", "FILE_PARSING", "Chiusura del file env.conf");
 
     // Parsing riga per riga del contenuto letto
     char *line = strtok(buf, "\n");
     int riga = 1;
     while (line != NULL) {
         char key[KEY_SIZE], value[VALUE_SIZE];
+        // Le righe che iniziano con '#' sono commenti (es. chiavi opzionali disattivate)
+        if (line[0] == '#') {
+            line = strtok(NULL, "\n");
+            riga++;
+            continue;
+        }
         // Estrae coppie chiave=valore: legge fino al carattere '='
         if (sscanf(line, "%63[^=]=%63s", key, value) == 2) {
              // Chiave: queue = nome della coda POSIX
@@ -51,11 +70,12 @@ int parse_env(const char *filename, env_config_t *config) {
                 char buff[CODA_SIZE];
                 snprintf(buff, sizeof(buff), "/%s", value);
                 config->queue_name = strdup(buff);
-                snprintf(msg, sizeof(msg), "Riga %d: %s=%s", riga, key, value);
-                log_event("env.conf", "FILE_PARSING", msg);
+                LOGF(LOG_LEVEL_DEBUG, LOG_CAT_PARSING, "env.conf", "FILE_PARSING",
+                     "Riga %d: %s=%s", riga, key, value);
                 if (!config->queue_name) {
                     perror("strdup queue_name");
-                    log_event("parse_env.c", "FILE_PARSING", "Parsing errore dovuto al strdup");
+                    LOG_TEXT(LOG_LEVEL_ERROR, LOG_CAT_PARSING, "parse_env.c", "FILE_PARSING",
+                             "Parsing errore dovuto al strdup");
                     // Liberazione del buffer prima di uscire
                     free(buf);
                     exit(EXIT_FAILURE);
@@ -66,18 +86,167 @@ int parse_env(const char *filename, env_config_t *config) {
             else if (strcmp(key, "width") == 0) {
                 config->width = atoi(value);
                 
-                snprintf(msg, sizeof(msg), "Riga %d: %s=%s", riga, key, value); 
-                log_event("env.conf", "FILE_PARSING", msg); 
+                LOGF(LOG_LEVEL_DEBUG, LOG_CAT_PARSING, "env.conf", "FILE_PARSING",
+                     "Riga %d: %s=%s", riga, key, value); 
             } 
 
             // Chiave: height = altezza della griglia
             else if (strcmp(key, "height") == 0) {
                 config->height = atoi(value);
 
-                snprintf(msg, sizeof(msg), "Riga %d: %s=%s", riga, key, value); 
-                log_event("env.conf", "FILE_PARSING", msg); 
+                LOGF(LOG_LEVEL_DEBUG, LOG_CAT_PARSING, "env.conf", "FILE_PARSING",
+                     "Riga %d: %s=%s", riga, key, value); 
             } 
 
+            // Chiave: clock = modalità dell'orologio (realtime, scaled, afap)
+            else if (strcmp(key, "clock") == 0) {
+                if (strcmp(value, "realtime") == 0) config->clock_mode = SIM_CLOCK_REALTIME;
+                else if (strcmp(value, "scaled") == 0) config->clock_mode = SIM_CLOCK_SCALED;
+                else if (strcmp(value, "afap") == 0) config->clock_mode = SIM_CLOCK_AFAP;
+                else dprintf(STDERR_FILENO, "Modalità clock sconosciuta in env.conf: %s\n", value);
+
+                LOGF(LOG_LEVEL_DEBUG, LOG_CAT_PARSING, "env.conf", "FILE_PARSING",
+                     "Riga %d: %s=%s", riga, key, value);
+            }
+
+            // Chiave: clock_scale = secondi virtuali per ogni secondo reale
+            else if (strcmp(key, "clock_scale") == 0) {
+                config->clock_scale = atof(value);
+                if (config->clock_scale <= 0) {
+                    dprintf(STDERR_FILENO, "clock_scale non valido in env.conf: %s\n", value);
+                    config->clock_scale = 1.0;
+                }
+
+                LOGF(LOG_LEVEL_DEBUG, LOG_CAT_PARSING, "env.conf", "FILE_PARSING",
+                     "Riga %d: %s=%s", riga, key, value);
+            }
+
+            // Chiave: trace = file in cui registrare le richieste accettate (vedi trace.h)
+            else if (strcmp(key, "trace") == 0) {
+                free(config->trace_path);
+                config->trace_path = strdup(value);
+                if (!config->trace_path) {
+                    perror("strdup trace_path");
+                    free(buf);
+                    exit(EXIT_FAILURE);
+                }
+
+                LOGF(LOG_LEVEL_DEBUG, LOG_CAT_PARSING, "env.conf", "FILE_PARSING",
+                     "Riga %d: %s=%s", riga, key, value);
+            }
+
+            // Chiave: log_overflow = comportamento con il buffer di log pieno (block, drop)
+            else if (strcmp(key, "log_overflow") == 0) {
+                if (strcmp(value, "block") == 0) config->log_overflow = LOG_OVERFLOW_BLOCK;
+                else if (strcmp(value, "drop") == 0) config->log_overflow = LOG_OVERFLOW_DROP;
+                else dprintf(STDERR_FILENO, "Politica log_overflow sconosciuta in env.conf: %s\n", value);
+
+                LOGF(LOG_LEVEL_DEBUG, LOG_CAT_PARSING, "env.conf", "FILE_PARSING",
+                     "Riga %d: %s=%s", riga, key, value);
+            }
+
+            // Chiave: log_format = formato del log (text, binary)
+            else if (strcmp(key, "log_format") == 0) {
+                if (strcmp(value, "text") == 0) config->log_format = LOG_FORMAT_TEXT;
+                else if (strcmp(value, "binary") == 0) config->log_format = LOG_FORMAT_BINARY;
+                else dprintf(STDERR_FILENO, "Formato log_format sconosciuto in env.conf: %s\n", value);
+
+                LOGF(LOG_LEVEL_DEBUG, LOG_CAT_PARSING, "env.conf", "FILE_PARSING",
+                     "Riga %d: %s=%s", riga, key, value);
+            }
+
+            // Chiave: log_level = livello minimo registrato (debug, info, state, error)
+            else if (strcmp(key, "log_level") == 0) {
+                int level = -1;
+                for (int l = LOG_LEVEL_DEBUG; l <= LOG_LEVEL_ERROR; ++l)
+                    if (strcmp(value, log_level_name(l)) == 0) level = l;
+                if (level >= 0) config->log_level = level;
+                else dprintf(STDERR_FILENO, "Livello log_level sconosciuto in env.conf: %s\n", value);
+
+                LOGF(LOG_LEVEL_DEBUG, LOG_CAT_PARSING, "env.conf", "FILE_PARSING", "Riga %d: %s=%s", riga, key, value);
+            }
+
+            // Chiave: log_categories = categorie registrate, separate da virgole
+            // (parsing, queue, emergency, rescuer, dispatch, system, oppure all)
+            else if (strcmp(key, "log_categories") == 0) {
+                static const char *cat_names[] = {"parsing", "queue", "emergency", "rescuer", "dispatch", "system"};
+                unsigned mask = 0;
+                char *save = NULL;
+                for (char *name = strtok_r(value, ",", &save); name; name = strtok_r(NULL, ",", &save)) {
+                    int found = strcmp(name, "all") == 0;
+                    if (found) mask = LOG_CAT_ALL;
+                    for (int c = 0; c < (int)(sizeof(cat_names) / sizeof(cat_names[0])) && !found; ++c) {
+                        if (strcmp(name, cat_names[c]) == 0) {
+                            mask |= 1u << c;
+                            found = 1;
+                        }
+                    }
+                    if (!found) dprintf(STDERR_FILENO, "Categoria di log sconosciuta in env.conf: %s\n", name);
+                }
+                config->log_categories = mask;
+
+                LOGF(LOG_LEVEL_DEBUG, LOG_CAT_PARSING, "env.conf", "FILE_PARSING", "Riga %d: %s=0x%02x", riga, key, mask);
+            }
+
+            // Chiave: log_sync = durabilità del log (none, periodic, group, critical)
+            else if (strcmp(key, "log_sync") == 0) {
+                if (strcmp(value, "none") == 0) config->log_sync = LOG_SYNC_NONE;
+                else if (strcmp(value, "periodic") == 0) config->log_sync = LOG_SYNC_PERIODIC;
+                else if (strcmp(value, "group") == 0) config->log_sync = LOG_SYNC_GROUP;
+                else if (strcmp(value, "critical") == 0) config->log_sync = LOG_SYNC_CRITICAL;
+                else dprintf(STDERR_FILENO, "Politica log_sync sconosciuta in env.conf: %s\n", value);
+
+                LOGF(LOG_LEVEL_DEBUG, LOG_CAT_PARSING, "env.conf", "FILE_PARSING", "Riga %d: %s=%s", riga, key, value);
+            }
+
+            // Chiave: log_sync_ms = intervallo della sync periodica, in millisecondi
+            else if (strcmp(key, "log_sync_ms") == 0) {
+                config->log_sync_ms = atoi(value);
+                if (config->log_sync_ms <= 0) {
+                    dprintf(STDERR_FILENO, "log_sync_ms non valido in env.conf: %s\n", value);
+                    config->log_sync_ms = 100;
+                }
+
+                LOGF(LOG_LEVEL_DEBUG, LOG_CAT_PARSING, "env.conf", "FILE_PARSING", "Riga %d: %s=%s", riga, key, value);
+            }
+
+            // Chiave: log_segment_mb = dimensione dei segmenti di log, preallocati (0: nessuna rotazione)
+            else if (strcmp(key, "log_segment_mb") == 0) {
+                config->log_segment_mb = atoi(value);
+                if (config->log_segment_mb < 0) {
+                    dprintf(STDERR_FILENO, "log_segment_mb non valido in env.conf: %s\n", value);
+                    config->log_segment_mb = 0;
+                }
+
+                LOGF(LOG_LEVEL_DEBUG, LOG_CAT_PARSING, "env.conf", "FILE_PARSING", "Riga %d: %s=%s", riga, key, value);
+            }
+
+            // Chiave: metrics_socket = socket Unix su cui esporre le metriche (vedi metrics.h)
+            else if (strcmp(key, "metrics_socket") == 0) {
+                free(config->metrics_socket);
+                config->metrics_socket = strdup(value);
+                if (!config->metrics_socket) {
+                    perror("strdup metrics_socket");
+                    free(buf);
+                    exit(EXIT_FAILURE);
+                }
+
+                LOGF(LOG_LEVEL_DEBUG, LOG_CAT_PARSING, "env.conf", "FILE_PARSING", "Riga %d: %s=%s", riga, key, value);
+            }
+
+            // Chiave: state_shm = nome della memoria condivisa con lo stato corrente (vedi livestate.h)
+            else if (strcmp(key, "state_shm") == 0) {
+                free(config->state_shm);
+                config->state_shm = strdup(value);
+                if (!config->state_shm) {
+                    perror("strdup state_shm");
+                    free(buf);
+                    exit(EXIT_FAILURE);
+                }
+
+                LOGF(LOG_LEVEL_DEBUG, LOG_CAT_PARSING, "env.conf", "FILE_PARSING", "Riga %d: %s=%s", riga, key, value);
+            }
+
             // Chiave non riconosciuta
             else {
                 dprintf(STDERR_FILENO, "Chiave sconosciuta in env.conf: %s\n", key);
@@ -85,8 +254,8 @@ int parse_env(const char *filename, env_config_t *config) {
         }
         // Riga malformata (senza '=' o incompleta)
         else{
-            snprintf(msg, sizeof(msg), "Riga %d ignorata: %s", riga, line);
-            log_event("env.conf", "FILE_PARSING", msg);
+            LOGF(LOG_LEVEL_ERROR, LOG_CAT_PARSING, "env.conf", "FILE_PARSING",
+                 "Riga %d ignorata: %s", riga, line);
         }
         // Passa alla riga successiva
         line = strtok(NULL, "\n");
@@ -96,7 +265,8 @@ int parse_env(const char *filename, env_config_t *config) {
     // liberazione del buffer dopo il parsing
     free(buf);
     // completamento del parsing
-    log_event("parse_env.c", "FILE_PARSING", "Parsing completato con successo");
+    LOG_TEXT(LOG_LEVEL_INFO, LOG_CAT_PARSING, "parse_env.c", "FILE_PARSING",
+             "Parsing completato con successo");
     return 0;
 }
 
@@ -107,6 +277,9 @@ void free_env_config(env_config_t *config) {
     if (config->queue_name != NULL) {
         free(config->queue_name);
     }
+    free(config->trace_path);
+    free(config->metrics_socket);
+    free(config->state_shm);
 }
 
 
@@ -119,4 +292,15 @@ void print_env(const env_config_t *config) {
     printf("===== Configurazione Ambiente =====\n");
     printf("Nome coda messaggi: %s\n", config->queue_name);
     printf("Dimensioni griglia: %d x %d\n", config->height, config->width);
+    printf("Orologio: %s (scala %.2f)\n", sim_clock_mode_name(config->clock_mode), config->clock_scale);
+    printf("Buffer di log pieno: %s\n", config->log_overflow == LOG_OVERFLOW_DROP ? "drop" : "block");
+    printf("Formato del log: %s\n", config->log_format == LOG_FORMAT_BINARY ? "binary (emergency.evlog)" : "text");
+    printf("Livello del log: %s (compilato da %s), categorie 0x%02x\n", log_level_name(config->log_level),
+           log_level_name(LOG_MIN_LEVEL), config->log_categories);
+    static const char *sync_names[] = {"none", "periodic", "group", "critical"};
+    printf("Durabilita' del log: %s (%d ms), segmenti: ", sync_names[config->log_sync], config->log_sync_ms);
+    if (config->log_segment_mb > 0) printf("%d MB\n", config->log_segment_mb);
+    else printf("nessuna rotazione\n");
+    printf("Socket delle metriche: %s\n", config->metrics_socket ? config->metrics_socket : "nessuno (solo SIGUSR1)");
+    printf("Stato condiviso: %s\n", config->state_shm ? config->state_shm : "nessuno");
 }
\ No newline at end of file
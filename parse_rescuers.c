@@ -4,25 +4,25 @@
 #include <string.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <time.h>
 #include "rescuers.h"
 #include "scall.h"
 #include "logger.h"
+#include "simclock.h"
 
 #define BUFFER_SIZE 65536
 #define NAME_SIZE 64
-#define MESSAGE_SIZE 256
 
 // Funzione che parse il file rescuers.conf e popola la struttura rescuer_data_t
 int parse_rescuers(const char *filename, rescuer_data_t *data) {
 
     // ID progressivo globale per assegnare univocamente i twin
     int global_twin_id =1;
-    // Buffer per i messaggi di log
-    char msg[MESSAGE_SIZE];
 
     // Apertura del file con SC open
     int fd;
-    log_event("parse_rescuers.c", "FILE_PARSING", "Apertura del file rescuers.conf");
+    LOG_TEXT(LOG_LEVEL_DEBUG, LOG_CAT_PARSING, "parse_rescuers.c", "FILE_PARSING",
+             "Apertura del file rescuers.conf");
     SCALL(fd, open(filename, O_RDONLY), "errore in open rescuers.conf");
 
     // Lettura del file in buffer 
@@ -40,7 +40,8 @@ int parse_rescuers(const char *filename, rescuer_data_t *data) {
     }
     buf[bytes_read] = '\0';
     close(fd);
-    log_event("parse_rescuers.c", "FILE_PARSING", "Chiusura del file rescuers.conf");
+    LOG_TEXT(LOG_LEVEL_DEBUG, LOG_CAT_PARSING, "parse_rescuers.c", "FILE_PARSING",
+             "Chiusura del file rescuers.conf");
 
     // Alloca spazio per tipi e twins
     data->types = NULL;
@@ -73,14 +74,14 @@ int parse_rescuers(const char *filename, rescuer_data_t *data) {
             data->types[data->num_types++] = type;
 
             // Log riga valida
-            snprintf(msg, sizeof(msg), "Riga %d: rescuer_nome=%s, quantita'=%d, velocita'=%d, base=(%d,%d)",
-                     riga, name, count, speed, x, y);
-            log_event("rescuers.conf", "FILE_PARSING", msg);
+            LOGF(LOG_LEVEL_DEBUG, LOG_CAT_PARSING, "rescuers.conf", "FILE_PARSING",
+                 "Riga %d: rescuer_nome=%s, quantita'=%d, velocita'=%d, base=(%d,%d)", riga, name, count, speed, x, y);
 
             // Crea gemelli digitali
             for (int i = 0; i < count; ++i) {
                 if (data->num_twins >= MAX_TWINS) {
-                    log_event("rescuers.conf", "FILE_PARSING", "Limite gemelli digitali superato");
+                    LOG_TEXT(LOG_LEVEL_ERROR, LOG_CAT_PARSING, "rescuers.conf", "FILE_PARSING",
+                             "Limite gemelli digitali superato");
                     free(buf);
                     exit(EXIT_FAILURE);
                 }
@@ -91,24 +92,63 @@ int parse_rescuers(const char *filename, rescuer_data_t *data) {
                 twin->y = y;
                 twin->rescuer = type;
                 twin->status = IDLE;
+                twin->emergency_id = 0;
+                twin->emergency_priority = -1;
+                twin->assignment = 0;
+                twin->status_since = sim_now();
+                twin->free_at = 0;
+                twin->working = 0;
+                twin->free_x = x;
+                twin->free_y = y;
+                twin->reserved_by = 0;
+                twin->job = NULL;
+                twin->reserved_job = NULL;
 
             }
 
         } else {
             // Riga malformata
-            snprintf(msg, sizeof(msg), "Riga %d ignorata: %s", riga, line);
-            log_event("rescuers.conf", "FILE_PARSING", msg);
+            LOGF(LOG_LEVEL_ERROR, LOG_CAT_PARSING, "rescuers.conf", "FILE_PARSING",
+                 "Riga %d ignorata: %s", riga, line);
         }
 
         riga++;
         line = strtok(NULL, "\n");
     }
 
+    // Costruisce la vista colonnare dei twin
+    build_twin_columns(data);
+
     // Fine parsing
-    log_event("parse_rescuers.c", "FILE_PARSING", "Parsing completato con successo");
+    LOG_TEXT(LOG_LEVEL_INFO, LOG_CAT_PARSING, "parse_rescuers.c", "FILE_PARSING",
+             "Parsing completato con successo");
     return 0;
 }
 
+// Funzione che costruisce la vista colonnare dei twin (vedi twin_columns_t)
+// copiando posizione, tipo, velocità e stato di ciascun twin
+void build_twin_columns(rescuer_data_t *data) {
+    twin_columns_t *cols = &data->cols;
+    size_t n = data->num_twins > 0 ? (size_t)data->num_twins : 1;
+    SNCALL(cols->x, malloc(sizeof(int) * n), "errore in malloc colonne twin");
+    SNCALL(cols->y, malloc(sizeof(int) * n), "errore in malloc colonne twin");
+    SNCALL(cols->type_id, malloc(sizeof(int) * n), "errore in malloc colonne twin");
+    SNCALL(cols->speed, malloc(sizeof(int) * n), "errore in malloc colonne twin");
+    SNCALL(cols->inv_speed, malloc(sizeof(float) * n), "errore in malloc colonne twin");
+    SNCALL(cols->status, malloc(n), "errore in malloc colonne twin");
+    for (int i = 0; i < data->num_twins; ++i) {
+        const rescuer_digital_twin_t *twin = &data->twins[i];
+        int type = 0;
+        while (type < data->num_types && data->types[type] != twin->rescuer) type++;
+        cols->x[i] = twin->x;
+        cols->y[i] = twin->y;
+        cols->type_id[i] = type;
+        cols->speed[i] = twin->rescuer->speed;
+        cols->inv_speed[i] = twin->rescuer->speed > 0 ? 1.0f / twin->rescuer->speed : 0.0f;
+        cols->status[i] = (unsigned char)twin->status;
+    }
+}
+
 // Funzione che libera la memoria dinamicamente allocata per i dati dei soccorritori.
 void free_rescuers_data(rescuer_data_t *data) {
     if(data!=NULL){
@@ -120,6 +160,13 @@ void free_rescuers_data(rescuer_data_t *data) {
     // Libera array dei tipi e dei twin
     free(data->types);
     free(data->twins);
+    // Libera la vista colonnare
+    free(data->cols.x);
+    free(data->cols.y);
+    free(data->cols.type_id);
+    free(data->cols.speed);
+    free(data->cols.inv_speed);
+    free(data->cols.status);
 
     }
 }
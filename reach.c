@@ -0,0 +1,236 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <threads.h>
+#include "scall.h"
+#include "logger.h"
+#include "reach.h"
+
+// Gruppo di twin con lo stesso nome di tipo e la stessa velocità:
+// condividono il raggio raggiungibile in un dato intervallo di tempo
+typedef struct {
+    const char *type_name;
+    int speed;
+    // seqlock: dispari durante una scrittura, i lettori riprovano se cambia
+    atomic_uint seq;
+    // Alberi di Fenwick (1-based, U x V) di tutti i twin e dei soli twin IDLE
+    atomic_int *all;
+    atomic_int *idle;
+    // Numero di twin non IDLE: in rientro o impegnati, possono comunque essere
+    // assegnati da una posizione diversa da quella indicizzata
+    atomic_int busy;
+} reach_group_t;
+
+static reach_group_t *groups = NULL;
+static int group_count = 0;
+// Limiti delle coordinate ruotate: u in [u_min, u_min+U), v in [v_min, v_min+V)
+static int u_min, v_min, U, V;
+// 0 se l'indice non è disponibile (non inizializzato o twin fuori griglia)
+static atomic_int index_valid = 0;
+// Serializza gli scrittori (gli spostamenti dei twin sono rari rispetto alle query)
+static mtx_t index_mutex;
+
+
+// Funzione che aggiunge delta alla cella (u, v) dell'albero di Fenwick
+// Deve essere chiamata con index_mutex acquisito
+static void fenwick_add(atomic_int *tree, int u, int v, int delta) {
+    for (int i = u; i <= U; i += i & -i) {
+        for (int j = v; j <= V; j += j & -j) {
+            atomic_int *cell = &tree[(size_t)(i - 1) * V + (j - 1)];
+            atomic_store_explicit(cell, atomic_load_explicit(cell, memory_order_relaxed) + delta,
+                                  memory_order_relaxed);
+        }
+    }
+}
+
+// Funzione che calcola la somma del rettangolo [1..u] x [1..v]
+static long fenwick_prefix(atomic_int *tree, int u, int v) {
+    long sum = 0;
+    for (int i = u; i > 0; i -= i & -i) {
+        for (int j = v; j > 0; j -= j & -j) {
+            sum += atomic_load_explicit(&tree[(size_t)(i - 1) * V + (j - 1)], memory_order_relaxed);
+        }
+    }
+    return sum;
+}
+
+// Funzione che conta i punti nel rettangolo [u1..u2] x [v1..v2] (1-based, già limitati)
+static long fenwick_rect(atomic_int *tree, int u1, int v1, int u2, int v2) {
+    return fenwick_prefix(tree, u2, v2) - fenwick_prefix(tree, u1 - 1, v2)
+         - fenwick_prefix(tree, u2, v1 - 1) + fenwick_prefix(tree, u1 - 1, v1 - 1);
+}
+
+// Funzione che cerca il gruppo di un tipo/velocità, -1 se assente
+static int reach_group_find(const char *type_name, int speed) {
+    for (int g = 0; g < group_count; ++g) {
+        if (groups[g].speed == speed && strcmp(groups[g].type_name, type_name) == 0) return g;
+    }
+    return -1;
+}
+
+// Funzione che converte (x, y) in coordinate ruotate 1-based
+// Ritorna 0 se il punto è fuori dalla griglia dell'indice
+static int reach_to_grid(int x, int y, int *u, int *v) {
+    *u = x + y - u_min + 1;
+    *v = x - y - v_min + 1;
+    return *u >= 1 && *u <= U && *v >= 1 && *v <= V;
+}
+
+// Funzione che applica delta alla posizione (x, y) del twin nei suoi alberi
+static int reach_apply(reach_group_t *grp, int x, int y, rescuer_status_t status, int delta) {
+    int u, v;
+    if (!reach_to_grid(x, y, &u, &v)) return -1;
+    fenwick_add(grp->all, u, v, delta);
+    if (status == IDLE) fenwick_add(grp->idle, u, v, delta);
+    return 0;
+}
+
+
+// Funzione che costruisce l'indice a partire dalla flotta iniziale
+// La griglia copre l'ambiente (emergenze) e tutte le basi dei soccorritori
+// Ritorna 0 in caso di successo, -1 in caso di errore (l'indice resta disabilitato)
+int reach_index_init(const rescuer_data_t *rdata, const env_config_t *env) {
+    if (!rdata || !env) return -1;
+
+    // Limiti cartesiani: ambiente [0..height] x [0..width] più le basi
+    int x_min = 0, x_max = env->height, y_min = 0, y_max = env->width;
+    for (int i = 0; i < rdata->num_types; ++i) {
+        const rescuer_type_t *t = rdata->types[i];
+        if (t->x < x_min) x_min = t->x;
+        if (t->x > x_max) x_max = t->x;
+        if (t->y < y_min) y_min = t->y;
+        if (t->y > y_max) y_max = t->y;
+    }
+    u_min = x_min + y_min;
+    v_min = x_min - y_max;
+    U = x_max + y_max - u_min + 1;
+    V = x_max - y_min - v_min + 1;
+
+    MCALL_INIT(&index_mutex, mtx_plain, "errore in init reach index mutex");
+    SNCALL(groups, calloc(rdata->num_types, sizeof(reach_group_t)), "errore in calloc reach groups");
+    group_count = 0;
+
+    // Un gruppo per ogni coppia distinta (nome tipo, velocità)
+    for (int i = 0; i < rdata->num_types; ++i) {
+        const rescuer_type_t *t = rdata->types[i];
+        if (t->speed <= 0 || reach_group_find(t->rescuer_type_name, t->speed) != -1) continue;
+        reach_group_t *grp = &groups[group_count++];
+        grp->type_name = t->rescuer_type_name;
+        grp->speed = t->speed;
+        atomic_init(&grp->seq, 0);
+        atomic_init(&grp->busy, 0);
+        SNCALL(grp->all, calloc((size_t)U * V, sizeof(atomic_int)), "errore in calloc reach grid");
+        SNCALL(grp->idle, calloc((size_t)U * V, sizeof(atomic_int)), "errore in calloc reach grid");
+    }
+
+    // Inserisce la posizione iniziale di ogni twin
+    for (int i = 0; i < rdata->num_twins; ++i) {
+        const rescuer_digital_twin_t *tw = &rdata->twins[i];
+        int g = reach_group_find(tw->rescuer->rescuer_type_name, tw->rescuer->speed);
+        if (g == -1 || reach_apply(&groups[g], tw->x, tw->y, tw->status, 1) != 0) {
+            LOG_TEXT(LOG_LEVEL_INFO, LOG_CAT_DISPATCH, "reach.c", "REACH_INDEX",
+                     "Twin non indicizzabile, indice disabilitato");
+            return -1;
+        }
+    }
+
+    LOGF(LOG_LEVEL_INFO, LOG_CAT_DISPATCH, "reach.c", "REACH_INDEX",
+         "Indice di raggiungibilita' creato: %d gruppi, griglia %dx%d", group_count, U, V);
+    atomic_store(&index_valid, 1);
+    return 0;
+}
+
+// Funzione che aggiorna l'indice dopo una transizione di stato di un twin
+// twin: twin già aggiornato con la nuova posizione e il nuovo stato
+// old_x, old_y, old_status: posizione e stato precedenti
+void reach_index_update(const rescuer_digital_twin_t *twin, int old_x, int old_y, rescuer_status_t old_status) {
+    if (!atomic_load(&index_valid)) return;
+    int g = reach_group_find(twin->rescuer->rescuer_type_name, twin->rescuer->speed);
+    if (g == -1) return;
+    reach_group_t *grp = &groups[g];
+    // Conteggio dei twin non IDLE
+    if (twin->status != IDLE && old_status == IDLE)
+        atomic_fetch_add(&grp->busy, 1);
+    else if (twin->status == IDLE && old_status != IDLE)
+        atomic_fetch_sub(&grp->busy, 1);
+    // Nessun cambiamento rilevante per gli alberi
+    if (twin->x == old_x && twin->y == old_y && (twin->status == IDLE) == (old_status == IDLE)) return;
+
+    MCALL_LOCK(&index_mutex, "errore in lock reach index mutex");
+    unsigned int seq = atomic_load_explicit(&grp->seq, memory_order_relaxed);
+    atomic_store_explicit(&grp->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    if (reach_apply(grp, twin->x, twin->y, twin->status, 1) != 0 ||
+        reach_apply(grp, old_x, old_y, old_status, -1) != 0) {
+        // Posizione fuori griglia: le query tornano alla scansione completa
+        atomic_store(&index_valid, 0);
+        LOG_TEXT(LOG_LEVEL_INFO, LOG_CAT_DISPATCH, "reach.c", "REACH_INDEX",
+                 "Twin fuori dalla griglia, indice disabilitato");
+    }
+    atomic_store_explicit(&grp->seq, seq + 2, memory_order_release);
+    MCALL_UNLOCK(&index_mutex, "errore in unlock reach index mutex");
+}
+
+// Funzione che conta i twin del tipo dato che possono raggiungere (x, y)
+// entro time_budget secondi, cioè con ceil(dist / speed) <= time_budget
+// only_idle: se 1 conta solo i twin IDLE
+// Ritorna il numero di twin, -1 se l'indice non è disponibile
+int reach_index_count(const char *type_name, int x, int y, long time_budget, int only_idle) {
+    if (!atomic_load(&index_valid)) return -1;
+    if (time_budget < 0) return 0;
+
+    int u, v;
+    reach_to_grid(x, y, &u, &v);
+    long total = 0;
+    for (int g = 0; g < group_count; ++g) {
+        reach_group_t *grp = &groups[g];
+        if (strcmp(grp->type_name, type_name) != 0) continue;
+
+        // Raggio in distanza di Manhattan, limitato alla dimensione della griglia
+        long r = (time_budget > (long)(U + V) ? (long)(U + V) : time_budget) * grp->speed;
+        if (r > U + V) r = U + V;
+        int u1 = u - r < 1 ? 1 : (int)(u - r), u2 = u + r > U ? U : (int)(u + r);
+        int v1 = v - r < 1 ? 1 : (int)(v - r), v2 = v + r > V ? V : (int)(v + r);
+        if (u1 > u2 || v1 > v2) continue;
+
+        atomic_int *tree = only_idle ? grp->idle : grp->all;
+        unsigned int seq;
+        long count;
+        do {
+            // Attende la fine di un'eventuale scrittura in corso
+            while ((seq = atomic_load_explicit(&grp->seq, memory_order_acquire)) & 1)
+                thrd_yield();
+            count = fenwick_rect(tree, u1, v1, u2, v2);
+            atomic_thread_fence(memory_order_acquire);
+        } while (atomic_load_explicit(&grp->seq, memory_order_relaxed) != seq);
+        total += count;
+    }
+    return (int)total;
+}
+
+// Funzione che restituisce il numero di twin del tipo dato non IDLE
+// (in rientro o impegnati: possono essere assegnati o prenotati da
+// una posizione diversa da quella indicizzata)
+int reach_index_busy(const char *type_name) {
+    int total = 0;
+    for (int g = 0; g < group_count; ++g) {
+        if (strcmp(groups[g].type_name, type_name) == 0)
+            total += atomic_load(&groups[g].busy);
+    }
+    return total;
+}
+
+// Funzione che libera la memoria dell'indice
+void reach_index_free(void) {
+    if (!groups) return;
+    atomic_store(&index_valid, 0);
+    for (int g = 0; g < group_count; ++g) {
+        free(groups[g].all);
+        free(groups[g].idle);
+    }
+    free(groups);
+    groups = NULL;
+    group_count = 0;
+    mtx_destroy(&index_mutex);
+}
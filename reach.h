@@ -0,0 +1,18 @@
+#ifndef REACH_H
+#define REACH_H
+
+#include "rescuers.h"
+#include "env.h"
+
+// Indice di raggiungibilità: per ogni coppia (tipo di soccorritore, velocità)
+// mantiene un albero di Fenwick 2D sulle coordinate ruotate u=x+y, v=x-y,
+// dove il rombo di Manhattan |dx|+|dy| <= r diventa un quadrato.
+// Contare i twin entro una distanza costa quindi O(log^2) invece di una scansione.
+
+int reach_index_init(const rescuer_data_t *rdata, const env_config_t *env);
+void reach_index_update(const rescuer_digital_twin_t *twin, int old_x, int old_y, rescuer_status_t old_status);
+int reach_index_count(const char *type_name, int x, int y, long time_budget, int only_idle);
+int reach_index_busy(const char *type_name);
+void reach_index_free(void);
+
+#endif
@@ -1,8 +1,16 @@
 #ifndef RESCUER_H
 #define RESCUER_H
 
+#include <time.h>
+
+// Limiti della flotta, ridefinibili a tempo di compilazione (es. il benchmark
+// Bench/ usa -DMAX_TWINS=1048576 -DMAX_TYPES=1024)
+#ifndef MAX_TYPES
 #define MAX_TYPES 512
+#endif
+#ifndef MAX_TWINS
 #define MAX_TWINS 2048
+#endif
 
 typedef enum {
     IDLE,            
@@ -24,18 +32,45 @@ typedef struct {
     int y;
     rescuer_type_t *rescuer;  
     rescuer_status_t status;    
+    int emergency_id;          // emergenza a cui è assegnato (0 se IDLE o in rientro)
+    short emergency_priority;  // priorità dell'emergenza assegnata
+    unsigned int assignment;   // numero di assegnazioni ricevute, identifica il task titolare
+    time_t status_since;       // istante dell'ultimo cambio di stato
+    time_t free_at;            // istante di fine dell'intervento in corso (valido se working)
+    short working;             // 1 durante l'intervento sul posto, fissato all'inizio del lavoro
+    int free_x;                // posizione a fine lavoro (valida se working)
+    int free_y;
+    int reserved_by;           // emergenza che ha prenotato il twin a fine lavoro (0 se nessuna)
+    struct twin_job *job;          // job che gestisce il twin (vedi worker_thread.h)
+    struct twin_job *reserved_job; // job in attesa della prenotazione
 } rescuer_digital_twin_t;
 
+// Vista colonnare della flotta, allineata a twins[] (indice = id - 1):
+// le scansioni leggono solo questi array densi invece di seguire
+// twin->rescuer; il twin completo resta per i log e per le prenotazioni.
+// Aggiornata insieme al twin da fleet_update_twin.
+typedef struct {
+    int *x;
+    int *y;
+    int *type_id;          // indice del tipo in types[]
+    int *speed;            // velocità del tipo, copiata dalla tabella dei tipi
+    float *inv_speed;      // 1 / speed, per il kernel dei tempi di arrivo (travel.h)
+    unsigned char *status; // rescuer_status_t
+} twin_columns_t;
+
 typedef struct {
     rescuer_type_t **types; 
     int num_types;
 
     rescuer_digital_twin_t *twins; 
     int num_twins;
+
+    twin_columns_t cols;
 } rescuer_data_t;
 
 int parse_rescuers(const char *filename, rescuer_data_t *data);
 void free_rescuers_data(rescuer_data_t *data);
+void build_twin_columns(rescuer_data_t *data);
 const char* twin_status_to_string(rescuer_status_t status);
 void print_rescuer_data(rescuer_data_t *data);
 
@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <threads.h>
+#include "scall.h"
+#include "scratch.h"
+
+// Dimensione minima di un blocco dell'arena
+#define SCRATCH_MIN_CHUNK (64 * 1024)
+// Allineamento delle allocazioni
+#define SCRATCH_ALIGN _Alignof(max_align_t)
+
+// Blocco dell'arena: i dati seguono l'intestazione
+typedef struct scratch_chunk {
+    struct scratch_chunk *next;
+    size_t size;
+    size_t used;
+    max_align_t data[];
+} scratch_chunk_t;
+
+// Arena del thread: lista di blocchi, il primo è quello in uso
+typedef struct {
+    scratch_chunk_t *head;
+    size_t capacity; // somma delle dimensioni dei blocchi
+} scratch_arena_t;
+
+// Chiave TSS per l'arena del thread corrente (liberata alla terminazione del thread)
+static tss_t arena_key;
+static once_flag scratch_once = ONCE_FLAG_INIT;
+
+
+// Funzione che libera tutti i blocchi di un'arena
+static void scratch_free_chunks(scratch_arena_t *arena) {
+    scratch_chunk_t *c = arena->head;
+    while (c) {
+        scratch_chunk_t *next = c->next;
+        free(c);
+        c = next;
+    }
+    arena->head = NULL;
+    arena->capacity = 0;
+}
+
+// Distruttore TSS: libera l'arena del thread che termina
+static void scratch_release(void *arg) {
+    scratch_arena_t *arena = arg;
+    scratch_free_chunks(arena);
+    free(arena);
+}
+
+// Inizializzazione una tantum del modulo
+static void scratch_init(void) {
+    if (tss_create(&arena_key, scratch_release) != thrd_success) {
+        perror("errore in tss_create scratch");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Funzione che restituisce l'arena del thread corrente, creandola se manca
+static scratch_arena_t *scratch_get_arena(void) {
+    call_once(&scratch_once, scratch_init);
+    scratch_arena_t *arena = tss_get(arena_key);
+    if (arena) return arena;
+    SNCALL(arena, calloc(1, sizeof(scratch_arena_t)), "errore in calloc scratch arena");
+    tss_set(arena_key, arena);
+    return arena;
+}
+
+// Funzione che aggiunge in testa all'arena un blocco di almeno size byte
+static scratch_chunk_t *scratch_grow(scratch_arena_t *arena, size_t size) {
+    size_t chunk_size = arena->capacity > SCRATCH_MIN_CHUNK ? arena->capacity : SCRATCH_MIN_CHUNK;
+    if (chunk_size < size) chunk_size = size;
+    scratch_chunk_t *c;
+    SNCALL(c, malloc(sizeof(scratch_chunk_t) + chunk_size), "errore in malloc scratch chunk");
+    c->next = arena->head;
+    c->size = chunk_size;
+    c->used = 0;
+    arena->head = c;
+    arena->capacity += chunk_size;
+    return c;
+}
+
+// Funzione che alloca size byte dall'arena del thread corrente.
+// La memoria è valida fino al prossimo scratch_reset() dello stesso thread
+// e non va liberata con free.
+void *scratch_alloc(size_t size) {
+    scratch_arena_t *arena = scratch_get_arena();
+    size = (size + SCRATCH_ALIGN - 1) & ~(size_t)(SCRATCH_ALIGN - 1);
+    scratch_chunk_t *c = arena->head;
+    if (!c || c->size - c->used < size)
+        c = scratch_grow(arena, size);
+    void *ptr = (char *)c->data + c->used;
+    c->used += size;
+    return ptr;
+}
+
+// Funzione che azzera l'arena del thread corrente. Se il passo precedente
+// ha richiesto più blocchi, li sostituisce con un unico blocco della stessa
+// capacità totale: a regime ogni passo usa un solo blocco senza malloc.
+void scratch_reset(void) {
+    scratch_arena_t *arena = scratch_get_arena();
+    if (arena->head && arena->head->next) {
+        size_t capacity = arena->capacity;
+        scratch_free_chunks(arena);
+        scratch_grow(arena, capacity);
+    } else if (arena->head) {
+        arena->head->used = 0;
+    }
+}
+
+// Funzione che restituisce la capacità (byte) dell'arena del thread corrente
+size_t scratch_capacity(void) {
+    scratch_arena_t *arena = scratch_get_arena();
+    return arena->capacity;
+}
@@ -0,0 +1,16 @@
+#ifndef SCRATCH_H
+#define SCRATCH_H
+
+#include <stddef.h>
+
+// Arena di memoria temporanea per thread: le strutture di lavoro di un
+// tentativo di assegnazione (candidati, penalità, richiesta coperta da ogni twin) vengono
+// prese dall'arena invece che dallo stack, dimensionate sul numero effettivo
+// di twin e di tipi. L'arena si azzera all'inizio di ogni passo del dispatcher
+// (scratch_reset) e la memoria resta al thread per i passi successivi.
+
+void *scratch_alloc(size_t size);
+void scratch_reset(void);
+size_t scratch_capacity(void);
+
+#endif
@@ -0,0 +1,95 @@
+#include <stdatomic.h>
+#include "simclock.h"
+
+// Configurazione dell'orologio: scritta una sola volta da sim_clock_init
+// prima dell'avvio dei thread, poi solo letta
+static sim_clock_mode_t mode = SIM_CLOCK_REALTIME;
+static double scale = 1.0;
+static long long origin_ms = 0;   // istante reale (e virtuale) di avvio
+// Salto in avanti accumulato in modalità AFAP (l'unico modo in cui avanza)
+static atomic_llong warp_ms = 0;
+// Istante virtuale impostato a mano in modalità MANUAL
+static atomic_llong manual_ms = 0;
+
+
+// Funzione che restituisce l'istante reale in millisecondi
+static long long wall_now_ms(void) {
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+// Funzione che configura l'orologio virtuale (scale <= 0 vale 1; la scala
+// vale solo per SCALED)
+void sim_clock_init(sim_clock_mode_t m, double s) {
+    mode = m;
+    scale = (m != SIM_CLOCK_SCALED || s <= 0) ? 1.0 : s;
+    origin_ms = wall_now_ms();
+    atomic_store(&warp_ms, 0);
+    atomic_store(&manual_ms, origin_ms);
+}
+
+sim_clock_mode_t sim_clock_mode(void) {
+    return mode;
+}
+
+const char* sim_clock_mode_name(sim_clock_mode_t m) {
+    switch (m) {
+        case SIM_CLOCK_SCALED: return "scaled";
+        case SIM_CLOCK_AFAP: return "afap";
+        case SIM_CLOCK_MANUAL: return "manual";
+        default: return "realtime";
+    }
+}
+
+// Funzione che restituisce l'istante virtuale in millisecondi
+long long sim_now_ms(void) {
+    if (mode == SIM_CLOCK_MANUAL) return atomic_load(&manual_ms);
+    if (mode == SIM_CLOCK_AFAP) return origin_ms + atomic_load(&warp_ms);
+    long long wall = wall_now_ms();
+    if (mode == SIM_CLOCK_REALTIME) return wall;
+    return origin_ms + (long long)((wall - origin_ms) * scale);
+}
+
+// Funzione che restituisce l'istante virtuale in secondi (al posto di time(NULL))
+time_t sim_now(void) {
+    return (time_t)(sim_now_ms() / 1000);
+}
+
+// Funzione che converte un timestamp reale (ad esempio quello inviato dal
+// client) nel tempo virtuale, conservandone la distanza dall'istante attuale
+time_t sim_from_wall(time_t wall) {
+    if (mode == SIM_CLOCK_REALTIME) return wall;
+    return sim_now() - ((time_t)(wall_now_ms() / 1000) - wall);
+}
+
+// Funzione che calcola l'istante reale in cui l'orologio virtuale
+// raggiungerà at_ms (senza contare eventuali salti futuri)
+void sim_wall_deadline(long long at_ms, struct timespec *until) {
+    long long wall = at_ms;
+    if (mode != SIM_CLOCK_REALTIME) {
+        long long now = sim_now_ms();
+        wall = wall_now_ms() + (long long)((at_ms - now) / scale);
+    }
+    until->tv_sec = wall / 1000;
+    until->tv_nsec = (wall % 1000) * 1000000;
+}
+
+// Funzione che fa avanzare l'orologio virtuale fino ad at_ms (solo AFAP;
+// l'orologio non torna mai indietro)
+void sim_warp_to(long long at_ms) {
+    if (mode != SIM_CLOCK_AFAP) return;
+    long long delta = at_ms - sim_now_ms();
+    if (delta > 0) atomic_fetch_add(&warp_ms, delta);
+}
+
+// Funzione che imposta l'istante virtuale (solo MANUAL; l'orologio non torna mai indietro)
+void sim_clock_set(long long at_ms) {
+    if (mode == SIM_CLOCK_MANUAL && at_ms > atomic_load(&manual_ms))
+        atomic_store(&manual_ms, at_ms);
+}
+
+// Funzione che restituisce il tempo virtuale totale saltato in modalità AFAP
+long long sim_warped_ms(void) {
+    return atomic_load(&warp_ms);
+}
@@ -0,0 +1,33 @@
+#ifndef SIMCLOCK_H
+#define SIMCLOCK_H
+
+#include <time.h>
+
+// Orologio virtuale della simulazione. Tutti i tempi del sistema (scadenze,
+// viaggi, gestione, log) sono letti da qui invece che da time(NULL):
+//  - SIM_CLOCK_REALTIME: il tempo virtuale coincide con quello reale
+//  - SIM_CLOCK_SCALED:   il tempo virtuale scorre scale volte più veloce
+//  - SIM_CLOCK_AFAP:     il tempo virtuale è fermo mentre il sistema lavora e
+//                        avanza solo quando è inattivo, con il motore a eventi
+//                        che fa saltare l'orologio al prossimo evento (event.c):
+//                        le decisioni non dipendono dalla durata reale dei passi
+//  - SIM_CLOCK_MANUAL:   il tempo avanza solo con sim_clock_set (replay deterministico)
+typedef enum {
+    SIM_CLOCK_REALTIME,
+    SIM_CLOCK_SCALED,
+    SIM_CLOCK_AFAP,
+    SIM_CLOCK_MANUAL
+} sim_clock_mode_t;
+
+void sim_clock_init(sim_clock_mode_t mode, double scale);
+sim_clock_mode_t sim_clock_mode(void);
+const char* sim_clock_mode_name(sim_clock_mode_t mode);
+long long sim_now_ms(void);
+time_t sim_now(void);
+time_t sim_from_wall(time_t wall);
+void sim_wall_deadline(long long at_ms, struct timespec *until);
+void sim_warp_to(long long at_ms);
+void sim_clock_set(long long at_ms);
+long long sim_warped_ms(void);
+
+#endif
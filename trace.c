@@ -0,0 +1,455 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "scall.h"
+#include "logger.h"
+#include "trace.h"
+#include "worker_thread.h"
+#include "intent.h"
+#include "event.h"
+#include "simclock.h"
+#include "metrics.h"
+
+#define TRACE_BUF_SIZE 256
+#define TRACE_RECORD_SIZE (8 + 2 + 4 + 4 + 4)
+#define TRACE_NAME_MAX 255
+
+// Stato della cattura: scritto solo dal thread principale
+static int trace_fd = -1;
+static long long trace_start_ms = 0;
+static const emergency_data_t *trace_types = NULL;
+static unsigned long trace_records = 0;
+
+
+// Funzioni che serializzano un intero nel buffer, restituendo la posizione successiva
+static size_t put_u8(unsigned char *buf, size_t pos, uint8_t v) {
+    buf[pos] = v;
+    return pos + 1;
+}
+static size_t put_u16(unsigned char *buf, size_t pos, uint16_t v) {
+    memcpy(buf + pos, &v, sizeof(v));
+    return pos + sizeof(v);
+}
+static size_t put_u32(unsigned char *buf, size_t pos, uint32_t v) {
+    memcpy(buf + pos, &v, sizeof(v));
+    return pos + sizeof(v);
+}
+static size_t put_i64(unsigned char *buf, size_t pos, int64_t v) {
+    memcpy(buf + pos, &v, sizeof(v));
+    return pos + sizeof(v);
+}
+
+// Funzione che scrive tutto il buffer sul file del trace
+static void trace_write(const unsigned char *buf, size_t len) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t w;
+        SCALL(w, write(trace_fd, buf + done, len - done), "errore in write trace");
+        done += (size_t)w;
+    }
+}
+
+// Funzione che scrive un nome preceduto dalla sua lunghezza
+static void trace_write_name(const char *name) {
+    unsigned char buf[TRACE_NAME_MAX + 1];
+    size_t len = strlen(name);
+    if (len > TRACE_NAME_MAX) len = TRACE_NAME_MAX;
+    size_t pos = put_u8(buf, 0, (uint8_t)len);
+    memcpy(buf + pos, name, len);
+    trace_write(buf, pos + len);
+}
+
+// Funzione che apre il file del trace e registra la flotta iniziale
+void trace_open(const char *path, const rescuer_data_t *rdata, const emergency_data_t *edata) {
+    SCALL(trace_fd, open(path, O_CREAT | O_WRONLY | O_TRUNC, 0644), "errore in open trace");
+    trace_start_ms = sim_now_ms();
+    trace_types = edata;
+    trace_records = 0;
+
+    unsigned char buf[TRACE_BUF_SIZE];
+    memcpy(buf, TRACE_MAGIC, 8);
+    size_t pos = 8;
+    pos = put_u32(buf, pos, TRACE_VERSION);
+    pos = put_u32(buf, pos, (uint32_t)rdata->num_types);
+    pos = put_u32(buf, pos, (uint32_t)rdata->num_twins);
+    pos = put_u32(buf, pos, (uint32_t)edata->num_types);
+    trace_write(buf, pos);
+
+    for (int i = 0; i < rdata->num_types; ++i)
+        trace_write_name(rdata->types[i]->rescuer_type_name);
+    for (int i = 0; i < edata->num_types; ++i)
+        trace_write_name(edata->types[i].emergency_desc);
+
+    for (int i = 0; i < rdata->num_twins; ++i) {
+        const rescuer_digital_twin_t *t = &rdata->twins[i];
+        int type = 0;
+        while (type < rdata->num_types && rdata->types[type] != t->rescuer) type++;
+        pos = put_u16(buf, 0, (uint16_t)type);
+        pos = put_u32(buf, pos, (uint32_t)t->id);
+        pos = put_u32(buf, pos, (uint32_t)t->x);
+        pos = put_u32(buf, pos, (uint32_t)t->y);
+        trace_write(buf, pos);
+    }
+    LOG_TEXT(LOG_LEVEL_INFO, LOG_CAT_SYSTEM, "trace.c", "TRACE", "Cattura del trace avviata");
+}
+
+// Funzione che registra una richiesta accettata con il suo istante di arrivo
+void trace_record_request(const emergency_request_withID_t *req) {
+    if (trace_fd == -1) return;
+    int type = 0;
+    while (type < trace_types->num_types &&
+           strcmp(trace_types->types[type].emergency_desc, req->req.emergency_name) != 0)
+        type++;
+    if (type == trace_types->num_types) return;
+
+    unsigned char buf[TRACE_RECORD_SIZE];
+    size_t pos = put_i64(buf, 0, sim_now_ms() - trace_start_ms);
+    pos = put_u16(buf, pos, (uint16_t)type);
+    pos = put_u32(buf, pos, (uint32_t)req->req.x);
+    pos = put_u32(buf, pos, (uint32_t)req->req.y);
+    pos = put_u32(buf, pos, (uint32_t)(sim_now() - req->req.timestamp));
+    trace_write(buf, pos);
+    trace_records++;
+}
+
+// Funzione che chiude il file del trace
+void trace_close(void) {
+    if (trace_fd == -1) return;
+    close(trace_fd);
+    trace_fd = -1;
+    printf("Trace: %lu richieste registrate\n", trace_records);
+}
+
+
+// Cursore di lettura sul contenuto del trace caricato in memoria
+typedef struct {
+    const unsigned char *buf;
+    size_t len;
+    size_t pos;
+} trace_reader_t;
+
+// Funzione che legge n byte dal trace; restituisce -1 se il file è troncato
+static int get_bytes(trace_reader_t *r, void *out, size_t n) {
+    if (r->pos + n > r->len) return -1;
+    memcpy(out, r->buf + r->pos, n);
+    r->pos += n;
+    return 0;
+}
+
+// Funzione che legge un nome preceduto dalla lunghezza
+static int get_name(trace_reader_t *r, char *out) {
+    uint8_t len;
+    if (get_bytes(r, &len, 1) != 0 || get_bytes(r, out, len) != 0) return -1;
+    out[len] = '\0';
+    return 0;
+}
+
+// Funzione che carica il trace, verifica che tipi e flotta corrispondano ai
+// file di configurazione e riporta i twin nelle posizioni registrate.
+// Restituisce 0 in caso di successo, -1 se il trace non è valido.
+int trace_load(const char *path, rescuer_data_t *rdata, const emergency_data_t *edata, trace_t *trace) {
+    int fd;
+    SCALL(fd, open(path, O_RDONLY), "errore in open trace");
+    struct stat st;
+    int rc;
+    SCALL(rc, fstat(fd, &st), "errore in fstat trace");
+    unsigned char *buf;
+    SNCALL(buf, malloc(st.st_size > 0 ? (size_t)st.st_size : 1), "malloc trace");
+    size_t got = 0;
+    while (got < (size_t)st.st_size) {
+        ssize_t n;
+        SCALL(n, read(fd, buf + got, (size_t)st.st_size - got), "errore in read trace");
+        if (n == 0) break;
+        got += (size_t)n;
+    }
+    close(fd);
+
+    trace_reader_t r = {.buf = buf, .len = got, .pos = 0};
+    char magic[8];
+    uint32_t version, num_rtypes, num_twins, num_etypes;
+    if (get_bytes(&r, magic, 8) != 0 || memcmp(magic, TRACE_MAGIC, 8) != 0 ||
+        get_bytes(&r, &version, 4) != 0 || version != TRACE_VERSION ||
+        get_bytes(&r, &num_rtypes, 4) != 0 || get_bytes(&r, &num_twins, 4) != 0 ||
+        get_bytes(&r, &num_etypes, 4) != 0 || num_rtypes > MAX_TYPES ||
+        num_twins != (uint32_t)rdata->num_twins || num_etypes > MAX_TYPES) {
+        printf("Trace %s non valido o flotta diversa da rescuers.conf\n", path);
+        free(buf);
+        return -1;
+    }
+
+    // Tabelle dei nomi: indice nel trace -> tipo caricato dai file di configurazione
+    rescuer_type_t *rtypes[MAX_TYPES];
+    int etypes[MAX_TYPES];
+    char name[TRACE_NAME_MAX + 1];
+    for (uint32_t i = 0; i < num_rtypes; ++i) {
+        if (get_name(&r, name) != 0) goto truncated;
+        // Più righe di rescuers.conf possono avere lo stesso nome (basi diverse):
+        // i tipi si confrontano per posizione
+        rtypes[i] = (int)i < rdata->num_types ? rdata->types[i] : NULL;
+        if (!rtypes[i] || strcmp(rtypes[i]->rescuer_type_name, name) != 0) {
+            printf("Tipo di soccorritore %s del trace diverso da rescuers.conf\n", name);
+            free(buf);
+            return -1;
+        }
+    }
+    for (uint32_t i = 0; i < num_etypes; ++i) {
+        if (get_name(&r, name) != 0) goto truncated;
+        etypes[i] = -1;
+        for (int k = 0; k < edata->num_types; ++k)
+            if (strcmp(edata->types[k].emergency_desc, name) == 0) etypes[i] = k;
+        if (etypes[i] == -1) {
+            printf("Tipo di emergenza %s del trace assente in emergency_types.conf\n", name);
+            free(buf);
+            return -1;
+        }
+    }
+
+    // Flotta iniziale
+    for (uint32_t i = 0; i < num_twins; ++i) {
+        uint16_t type;
+        int32_t id, x, y;
+        if (get_bytes(&r, &type, 2) != 0 || get_bytes(&r, &id, 4) != 0 ||
+            get_bytes(&r, &x, 4) != 0 || get_bytes(&r, &y, 4) != 0 || type >= num_rtypes)
+            goto truncated;
+        rescuer_digital_twin_t *t = &rdata->twins[i];
+        if (t->id != id || t->rescuer != rtypes[type]) {
+            printf("Twin %d del trace diverso da rescuers.conf\n", id);
+            free(buf);
+            return -1;
+        }
+        t->x = t->free_x = rdata->cols.x[i] = x;
+        t->y = t->free_y = rdata->cols.y[i] = y;
+    }
+
+    // Richieste
+    size_t capacity = (r.len - r.pos) / TRACE_RECORD_SIZE;
+    SNCALL(trace->requests, malloc(sizeof(trace_request_t) * (capacity > 0 ? capacity : 1)), "malloc trace requests");
+    trace->num_requests = 0;
+    while (r.pos < r.len) {
+        int64_t at;
+        uint16_t type;
+        int32_t x, y, age;
+        if (get_bytes(&r, &at, 8) != 0 || get_bytes(&r, &type, 2) != 0 ||
+            get_bytes(&r, &x, 4) != 0 || get_bytes(&r, &y, 4) != 0 ||
+            get_bytes(&r, &age, 4) != 0 || type >= num_etypes) {
+            free(trace->requests);
+            goto truncated;
+        }
+        trace->requests[trace->num_requests++] = (trace_request_t){
+            .at_ms = at, .type_index = etypes[type], .x = x, .y = y, .age = age};
+    }
+    free(buf);
+    return 0;
+
+truncated:
+    printf("Trace %s troncato o corrotto\n", path);
+    free(buf);
+    return -1;
+}
+
+void free_trace(trace_t *trace) {
+    free(trace->requests);
+    trace->requests = NULL;
+    trace->num_requests = 0;
+}
+
+
+// Emergenza in corso durante il replay, con l'ultimo stato già scritto nel log delle decisioni
+typedef struct {
+    dispatch_ctx_t ctx;
+    emergency_status_t status;
+    int assigned;
+} replay_slot_t;
+
+// Funzione che scrive nel log delle decisioni le novità di un'emergenza:
+// twin assegnati (con * quelli prenotati) e cambi di stato.
+// Restituisce 1 se c'erano novità da scrivere.
+static int replay_observe(int fd, long long rel_ms, replay_slot_t *slot) {
+    emergency_withID_t *e = slot->ctx.e;
+    emergency_t *em = &e->emergency;
+    int changed = em->rescuer_count != slot->assigned || em->status != slot->status;
+    if (em->rescuer_count > slot->assigned) {
+        dprintf(fd, "+%lld E%d %s ASSIGN", rel_ms, e->id, em->type.emergency_desc);
+        for (int i = slot->assigned; i < em->rescuer_count; ++i)
+            dprintf(fd, " %s#%d%s", em->rescuers_dt[i].rescuer->rescuer_type_name,
+                    em->rescuers_dt[i].id, em->rescuers_dt[i].emergency_id != e->id ? "*" : "");
+        dprintf(fd, "\n");
+    }
+    slot->assigned = em->rescuer_count;
+    if (em->status != slot->status) {
+        dprintf(fd, "+%lld E%d %s %s\n", rel_ms, e->id, em->type.emergency_desc,
+                emergency_status_str(em->status));
+        slot->status = em->status;
+    }
+    return changed;
+}
+
+// Funzione che restituisce il primo istante (ms) successivo a now in cui
+// scade la deadline di un'emergenza in attesa di twin (LLONG_MAX se nessuna):
+// check_deadline la considera scaduta dal secondo successivo
+static long long replay_next_deadline(replay_slot_t **active, int num_active, long long now) {
+    long long next = LLONG_MAX;
+    for (int i = 0; i < num_active; ++i) {
+        const emergency_t *em = &active[i]->ctx.e->emergency;
+        if (active[i]->ctx.phase == DISPATCH_RUNNING || em->type.priority < 1) continue;
+        int limit = em->type.priority == 1 ? TIMEOUT_PRIORITY_1 : TIMEOUT_PRIORITY_2;
+        long long at = ((long long)em->time + limit + 1) * 1000;
+        if (at > now && at < next) next = at;
+    }
+    return next;
+}
+
+// Funzione che crea l'istanza di emergenza di una richiesta del trace.
+// Restituisce NULL se la richiesta non supera la validazione.
+static emergency_withID_t *replay_admit(const trace_request_t *rec, int id, emergency_data_t *edata,
+                                        const env_config_t *env) {
+    emergency_request_withID_t req;
+    req.id = id;
+    snprintf(req.req.emergency_name, sizeof(req.req.emergency_name), "%s",
+             edata->types[rec->type_index].emergency_desc);
+    req.req.x = rec->x;
+    req.req.y = rec->y;
+    req.req.timestamp = sim_now() - rec->age;
+
+    long long received_ns = metrics_now_ns();
+    metrics_count(COUNTER_RECEIVED);
+    emergency_withID_t *inst;
+    SNCALL(inst, malloc(sizeof(emergency_withID_t)), "malloc replay instance");
+    if (validate_MQrequest(&req, edata->types, edata->num_types, env) != 0 ||
+        create_emergency_instance(inst, &req, edata->types, edata->num_types) != 0) {
+        metrics_count(COUNTER_REJECTED);
+        free(inst);
+        return NULL;
+    }
+    metrics_admit(inst, received_ns);
+    return inst;
+}
+
+// Funzione che riproduce il trace con uno scheduler deterministico a thread singolo:
+// l'orologio virtuale (SIM_CLOCK_MANUAL) avanza al prossimo evento, arrivo o
+// tentativo; ad ogni istante si eseguono gli eventi dei job scaduti e poi un
+// passo del dispatcher per ogni emergenza, in ordine di arrivo. I tentativi
+// si ripetono ogni DISPATCH_RETRY_MS solo finché producono novità.
+// Il log delle decisioni non contiene tempi reali, quindi due replay dello
+// stesso trace producono file identici. Stampa le emergenze gestite al secondo.
+// Restituisce -1 se restano emergenze non concluse o lo scheduler si blocca.
+int trace_replay(const trace_t *trace, const char *decisions_path, rescuer_data_t *rdata,
+                 emergency_data_t *edata, const env_config_t *env, mtx_t *twin_locks) {
+    int fd;
+    SCALL(fd, open(decisions_path, O_CREAT | O_WRONLY | O_TRUNC, 0644), "errore in open log decisioni");
+
+    intent_table_t itable;
+    init_intent_table(&itable);
+    replay_slot_t **active;
+    SNCALL(active, malloc(sizeof(replay_slot_t *) * (trace->num_requests > 0 ? trace->num_requests : 1)),
+           "malloc replay slots");
+    int num_active = 0, next = 0, processed = 0, rejected = 0, stalled = 0;
+
+    struct timespec wall_start, wall_end;
+    timespec_get(&wall_start, TIME_UTC);
+    long long base = sim_now_ms();
+    long long now = base;
+
+    while (next < trace->num_requests || num_active > 0) {
+        sim_clock_set(now);
+        // Novità in questo istante (eventi, arrivi, decisioni): senza, i
+        // tentativi successivi darebbero lo stesso esito
+        int progress = event_run_due(now) > 0;
+        for (int i = 0; i < num_active; ++i)
+            progress |= replay_observe(fd, now - base, active[i]);
+
+        // Arrivi
+        while (next < trace->num_requests && base + trace->requests[next].at_ms <= now) {
+            int id = next + 1;
+            emergency_withID_t *e = replay_admit(&trace->requests[next], id, edata, env);
+            next++;
+            progress = 1;
+            if (!e) {
+                dprintf(fd, "+%lld E%d REJECTED\n", now - base, id);
+                rejected++;
+                continue;
+            }
+            replay_slot_t *slot;
+            SNCALL(slot, malloc(sizeof(replay_slot_t)), "malloc replay slot");
+            dispatch_init(&slot->ctx, e, rdata, &itable, twin_locks);
+            slot->status = e->emergency.status;
+            slot->assigned = 0;
+            active[num_active++] = slot;
+            dprintf(fd, "+%lld E%d %s ARRIVED (%d,%d) priority %d\n", now - base, id,
+                    e->emergency.type.emergency_desc, e->emergency.x, e->emergency.y,
+                    e->emergency.type.priority);
+        }
+
+        // Un passo del dispatcher per ogni emergenza, in ordine di arrivo
+        int retry = 0, kept = 0;
+        for (int i = 0; i < num_active; ++i) {
+            replay_slot_t *slot = active[i];
+            dispatch_result_t result;
+            do {
+                result = dispatch_step(&slot->ctx);
+                progress |= replay_observe(fd, now - base, slot);
+            } while (result == DISPATCH_AGAIN);
+            if (result == DISPATCH_DONE) {
+                progress = 1;
+                free_emergency_instance(slot->ctx.e);
+                free(slot);
+                processed++;
+                continue;
+            }
+            if (result == DISPATCH_RETRY) retry = 1;
+            active[kept++] = slot;
+        }
+        num_active = kept;
+
+        // Prossimo istante: eventi appena programmati vengono eseguiti subito
+        long long next_at = event_next_at();
+        if (next_at <= now) continue;
+        if (next < trace->num_requests && base + trace->requests[next].at_ms < next_at)
+            next_at = base + trace->requests[next].at_ms;
+        if (retry) {
+            // Tentativi senza novità: come l'orologio AFAP (event.c), il replay
+            // salta al prossimo evento o arrivo, ma non oltre la prima deadline
+            // di un'emergenza in attesa, così i TIMEOUT restano puntuali
+            long long retry_at = now + DISPATCH_RETRY_MS;
+            if (!progress) {
+                long long deadline = replay_next_deadline(active, num_active, now);
+                if (deadline < next_at) next_at = deadline;
+                if (next_at != LLONG_MAX) retry_at = next_at;
+            }
+            if (retry_at < next_at) next_at = retry_at;
+        }
+        if (next_at == LLONG_MAX) {
+            // Coda vuota dopo l'ultima emergenza: i twin sono tornati alla base
+            if (num_active == 0 && next == trace->num_requests)
+                break;
+            // Emergenze in attesa ma nessun evento né tentativo in programma:
+            // non dovrebbe accadere, il log delle decisioni è troncato
+            LOG_TEXT(LOG_LEVEL_ERROR, LOG_CAT_SYSTEM, "trace.c", "TRACE",
+                     "Replay bloccato: nessun evento in programma");
+            stalled = 1;
+            break;
+        }
+        now = next_at;
+    }
+
+    timespec_get(&wall_end, TIME_UTC);
+    double wall = (wall_end.tv_sec - wall_start.tv_sec) + (wall_end.tv_nsec - wall_start.tv_nsec) / 1e9;
+    printf("Replay: %d emergenze gestite, %d scartate, %.1f s simulati in %.3f s reali (%.0f emergenze/s)\n",
+           processed, rejected, (now - base) / 1000.0, wall, wall > 0 ? processed / wall : 0.0);
+    dprintf(fd, "+%lld END processed %d rejected %d\n", now - base, processed, rejected);
+
+    for (int i = 0; i < num_active; ++i) {
+        free_emergency_instance(active[i]->ctx.e);
+        free(active[i]);
+    }
+    free(active);
+    print_intent_table_stats(&itable);
+    free_intent_table(&itable);
+    close(fd);
+    return num_active == 0 && !stalled ? 0 : -1;
+}
@@ -0,0 +1,48 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <threads.h>
+#include "rescuers.h"
+#include "emergency_types.h"
+#include "emergency.h"
+#include "env.h"
+
+// Trace binario delle richieste accettate, per riprodurre le decisioni del
+// dispatcher. Formato (interi little-endian nativi, nessun padding):
+//   header:   "EMSTRACE" | uint32 versione | uint32 n. tipi soccorritori |
+//             uint32 n. twin | uint32 n. tipi emergenza
+//   tabelle:  nomi dei tipi soccorritori e dei tipi emergenza (uint8 lung. + byte)
+//   flotta:   per ogni twin uint16 tipo | int32 id | int32 x | int32 y
+//   richieste fino a fine file:
+//             int64 arrivo (ms dall'inizio) | uint16 tipo emergenza |
+//             int32 x | int32 y | int32 età del timestamp (s)
+#define TRACE_MAGIC "EMSTRACE"
+#define TRACE_VERSION 1
+
+// Richiesta registrata nel trace
+typedef struct {
+    long long at_ms;
+    int type_index; // indice nei tipi di emergenza caricati
+    int x;
+    int y;
+    int age;
+} trace_request_t;
+
+typedef struct {
+    trace_request_t *requests;
+    int num_requests;
+} trace_t;
+
+// Cattura (thread principale)
+void trace_open(const char *path, const rescuer_data_t *rdata, const emergency_data_t *edata);
+void trace_record_request(const emergency_request_withID_t *req);
+void trace_close(void);
+
+// Replay deterministico
+int trace_load(const char *path, rescuer_data_t *rdata, const emergency_data_t *edata, trace_t *trace);
+int trace_replay(const trace_t *trace, const char *decisions_path, rescuer_data_t *rdata,
+                 emergency_data_t *edata, const env_config_t *env, mtx_t *twin_locks);
+void free_trace(trace_t *trace);
+
+#endif
@@ -0,0 +1,149 @@
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <immintrin.h>
+#include "travel.h"
+
+typedef void (*travel_kernel_fn)(const twin_columns_t *, int, int, int, int, int, int *, unsigned char *);
+
+static travel_kernel_fn kernel = NULL;
+static const char *kernel_name = "scalar";
+static once_flag kernel_once = ONCE_FLAG_INIT;
+
+
+// Funzione che calcola il tempo di arrivo di un singolo twin (versione di riferimento)
+static inline int travel_time_one(const twin_columns_t *cols, int i, int x, int y) {
+    int dist = abs(cols->x[i] - x) + abs(cols->y[i] - y);
+    return (dist + cols->speed[i] - 1) / cols->speed[i];
+}
+
+// Versione scalare del kernel, usata anche per la coda dei blocchi vettoriali
+void travel_times_scalar(const twin_columns_t *cols, int begin, int end, int x, int y, int budget,
+                         int *times, unsigned char *reachable) {
+    for (int i = begin; i < end; ++i) {
+        int t = travel_time_one(cols, i, x, y);
+        times[i - begin] = t;
+        reachable[i - begin] = t <= budget;
+    }
+}
+
+// Versione AVX2: 8 twin per iterazione. Il quoziente stimato con il reciproco
+// in virgola mobile può differire di 1 da quello esatto: il resto intero lo corregge.
+__attribute__((target("avx2")))
+static void travel_times_avx2(const twin_columns_t *cols, int begin, int end, int x, int y, int budget,
+                              int *times, unsigned char *reachable) {
+    const __m256i vx = _mm256_set1_epi32(x);
+    const __m256i vy = _mm256_set1_epi32(y);
+    const __m256i vbudget = _mm256_set1_epi32(budget);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi32(1);
+    int i = begin;
+    for (; i + 8 <= end; i += 8) {
+        __m256i px = _mm256_loadu_si256((const __m256i *)(cols->x + i));
+        __m256i py = _mm256_loadu_si256((const __m256i *)(cols->y + i));
+        __m256i speed = _mm256_loadu_si256((const __m256i *)(cols->speed + i));
+        __m256 inv = _mm256_loadu_ps(cols->inv_speed + i);
+        __m256i dist = _mm256_add_epi32(_mm256_abs_epi32(_mm256_sub_epi32(px, vx)),
+                                        _mm256_abs_epi32(_mm256_sub_epi32(py, vy)));
+        // q ~ dist / speed, r = dist - q * speed
+        __m256i q = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_cvtepi32_ps(dist), inv));
+        __m256i r = _mm256_sub_epi32(dist, _mm256_mullo_epi32(q, speed));
+        // r < 0: q troppo grande di 1
+        __m256i neg = _mm256_cmpgt_epi32(zero, r);
+        q = _mm256_add_epi32(q, neg);
+        r = _mm256_add_epi32(r, _mm256_and_si256(neg, speed));
+        // r >= speed: q troppo piccolo di 1
+        __m256i over = _mm256_cmpgt_epi32(r, _mm256_sub_epi32(speed, one));
+        q = _mm256_sub_epi32(q, over);
+        r = _mm256_sub_epi32(r, _mm256_and_si256(over, speed));
+        // Arrotondamento per eccesso: +1 se resta qualcosa
+        __m256i t = _mm256_sub_epi32(q, _mm256_cmpgt_epi32(r, zero));
+        _mm256_storeu_si256((__m256i *)(times + i - begin), t);
+        // Maschera t <= budget, compressa a un byte per twin
+        int bits = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(t, vbudget)));
+        for (int k = 0; k < 8; ++k)
+            reachable[i - begin + k] = !((bits >> k) & 1);
+    }
+    travel_times_scalar(cols, i, end, x, y, budget, times + (i - begin), reachable + (i - begin));
+}
+
+// Versione AVX-512: 16 twin per iterazione, stessa correzione del quoziente con le maschere
+__attribute__((target("avx512f")))
+static void travel_times_avx512(const twin_columns_t *cols, int begin, int end, int x, int y, int budget,
+                                int *times, unsigned char *reachable) {
+    const __m512i vx = _mm512_set1_epi32(x);
+    const __m512i vy = _mm512_set1_epi32(y);
+    const __m512i vbudget = _mm512_set1_epi32(budget);
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i one = _mm512_set1_epi32(1);
+    int i = begin;
+    for (; i + 16 <= end; i += 16) {
+        __m512i px = _mm512_loadu_si512(cols->x + i);
+        __m512i py = _mm512_loadu_si512(cols->y + i);
+        __m512i speed = _mm512_loadu_si512(cols->speed + i);
+        __m512 inv = _mm512_loadu_ps(cols->inv_speed + i);
+        __m512i dist = _mm512_add_epi32(_mm512_abs_epi32(_mm512_sub_epi32(px, vx)),
+                                        _mm512_abs_epi32(_mm512_sub_epi32(py, vy)));
+        __m512i q = _mm512_cvttps_epi32(_mm512_mul_ps(_mm512_cvtepi32_ps(dist), inv));
+        __m512i r = _mm512_sub_epi32(dist, _mm512_mullo_epi32(q, speed));
+        __mmask16 neg = _mm512_cmplt_epi32_mask(r, zero);
+        q = _mm512_mask_sub_epi32(q, neg, q, one);
+        r = _mm512_mask_add_epi32(r, neg, r, speed);
+        __mmask16 over = _mm512_cmpge_epi32_mask(r, speed);
+        q = _mm512_mask_add_epi32(q, over, q, one);
+        r = _mm512_mask_sub_epi32(r, over, r, speed);
+        __m512i t = _mm512_mask_add_epi32(q, _mm512_cmpgt_epi32_mask(r, zero), q, one);
+        _mm512_storeu_si512(times + i - begin, t);
+        __mmask16 ok = _mm512_cmple_epi32_mask(t, vbudget);
+        for (int k = 0; k < 16; ++k)
+            reachable[i - begin + k] = (ok >> k) & 1;
+    }
+    travel_times_scalar(cols, i, end, x, y, budget, times + (i - begin), reachable + (i - begin));
+}
+
+// Funzione che sceglie una sola volta l'implementazione supportata dalla CPU
+static void travel_kernel_select(void) {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        kernel = travel_times_avx512;
+        kernel_name = "avx512";
+    } else if (__builtin_cpu_supports("avx2")) {
+        kernel = travel_times_avx2;
+        kernel_name = "avx2";
+    } else {
+        kernel = travel_times_scalar;
+        kernel_name = "scalar";
+    }
+}
+
+void travel_times(const twin_columns_t *cols, int begin, int end, int x, int y, int budget,
+                  int *times, unsigned char *reachable) {
+    call_once(&kernel_once, travel_kernel_select);
+    kernel(cols, begin, end, x, y, budget, times, reachable);
+}
+
+// Funzione che forza un'implementazione ("avx512", "avx2" o "scalar"), ad
+// esempio per confrontarle nel benchmark. Restituisce -1 se la CPU non la supporta.
+int travel_select_kernel(const char *name) {
+    call_once(&kernel_once, travel_kernel_select);
+    __builtin_cpu_init();
+    if (strcmp(name, "avx512") == 0 && __builtin_cpu_supports("avx512f")) {
+        kernel = travel_times_avx512;
+        kernel_name = "avx512";
+    } else if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+        kernel = travel_times_avx2;
+        kernel_name = "avx2";
+    } else if (strcmp(name, "scalar") == 0) {
+        kernel = travel_times_scalar;
+        kernel_name = "scalar";
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+// Funzione che restituisce il nome dell'implementazione in uso
+const char *travel_kernel_name(void) {
+    call_once(&kernel_once, travel_kernel_select);
+    return kernel_name;
+}
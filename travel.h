@@ -0,0 +1,22 @@
+#ifndef TRAVEL_H
+#define TRAVEL_H
+
+#include "rescuers.h"
+
+// Numero di twin elaborati per blocco dai chiamanti del kernel
+#define TRAVEL_BLOCK 256
+
+// Kernel a blocchi per i tempi di arrivo: per i twin [begin, end) della vista
+// colonnare calcola times[i - begin] = ceil((|x_i - x| + |y_i - y|) / speed_i)
+// e reachable[i - begin] = (times[i - begin] <= budget).
+// La divisione è sostituita dalla moltiplicazione per il reciproco della
+// velocità (inv_speed) con correzione intera, quindi il risultato è esatto.
+// L'implementazione (AVX-512, AVX2 o scalare) è scelta a runtime in base alla CPU.
+void travel_times(const twin_columns_t *cols, int begin, int end, int x, int y, int budget,
+                  int *times, unsigned char *reachable);
+void travel_times_scalar(const twin_columns_t *cols, int begin, int end, int x, int y, int budget,
+                         int *times, unsigned char *reachable);
+const char *travel_kernel_name(void);
+int travel_select_kernel(const char *name);
+
+#endif
@@ -15,12 +15,102 @@
 #include "emergency_types.h"
 #include "emergency.h"
 #include "worker_thread.h"
+#include "fleet.h"
+#include "reach.h"
+#include "event.h"
+#include "simclock.h"
+#include "travel.h"
+#include "scratch.h"
+#include "metrics.h"
+#include "lockprof.h"
+#include "livestate.h"
 
-#define MAX_MSG_SIZE 512
 #define NAME_SIZE 64
 
 
 
+// Funzione che converte la deadline nel tempo di viaggio massimo per il kernel
+static int travel_budget(time_t now, time_t deadline)
+{
+    long budget = (long)(deadline - now);
+    return budget > INT_MAX ? INT_MAX : budget < -1 ? -1 : (int)budget;
+}
+
+// Funzione che calcola per ogni tipo di soccorritore la penalità con cui
+// soddisfa la richiesta (-1 se non la soddisfa): le scansioni confrontano
+// così solo l'indice di tipo della vista colonnare
+static void request_type_penalties(const rescuer_request_t *req, const rescuer_data_t *rdata, int *penalties)
+{
+    for (int k = 0; k < rdata->num_types; ++k)
+        penalties[k] = rescuer_request_match(req, rdata->types[k]);
+}
+
+// Funzione che conta con una scansione completa i twin del tipo richiesto (o
+// di un suo sostituto) che possono arrivare entro la deadline (si ferma a required_count).
+// Usata quando l'indice di raggiungibilità non è disponibile.
+static int count_reachable_twins(emergency_t *em, rescuer_request_t *req, rescuer_data_t *rdata,
+                                 time_t now, time_t deadline)
+{
+    const twin_columns_t *cols = &rdata->cols;
+    int *penalties = scratch_alloc(sizeof(int) * rdata->num_types);
+    request_type_penalties(req, rdata, penalties);
+    int times[TRAVEL_BLOCK];
+    unsigned char reachable[TRAVEL_BLOCK];
+    int budget = travel_budget(now, deadline);
+    int reachable_count = 0;
+    for (int start = 0; start < rdata->num_twins; start += TRAVEL_BLOCK)
+    {
+        int end = start + TRAVEL_BLOCK < rdata->num_twins ? start + TRAVEL_BLOCK : rdata->num_twins;
+        // Tempi di arrivo e maschera della deadline per l'intero blocco
+        travel_times(cols, start, end, em->x, em->y, budget, times, reachable);
+        for (int j = start; j < end; ++j)
+        {
+            // Conta se è del tipo richiesto (o di un sostituto) e arriva entro la deadline
+            if (reachable[j - start] && penalties[cols->type_id[j]] >= 0)
+            {
+                reachable_count++;
+                if (reachable_count >= req->required_count)
+                    return reachable_count;
+            }
+        }
+    }
+    return reachable_count;
+}
+
+// Funzione che interroga l'indice di raggiungibilità per una richiesta,
+// sommando il tipo principale e i suoi sostituti.
+// Restituisce il numero di twin, -1 se l'indice non è disponibile.
+static int reach_count_request(const rescuer_request_t *req, int x, int y, long time_budget, int only_idle)
+{
+    int total = reach_index_count(req->type->rescuer_type_name, x, y, time_budget, only_idle);
+    for (int k = 0; k < req->substitutes_count && total >= 0; ++k) {
+        int count = reach_index_count(req->substitutes[k]->rescuer_type_name, x, y, time_budget, only_idle);
+        total = count < 0 ? -1 : total + count;
+    }
+    return total;
+}
+
+// Funzione che restituisce il numero di twin non IDLE del tipo richiesto e dei suoi sostituti
+static int reach_busy_request(const rescuer_request_t *req)
+{
+    int total = reach_index_busy(req->type->rescuer_type_name);
+    for (int k = 0; k < req->substitutes_count; ++k)
+        total += reach_index_busy(req->substitutes[k]->rescuer_type_name);
+    return total;
+}
+
+
+// Funzione che calcola il tempo massimo disponibile (deadline) in base alla
+// priorità: INT_MAX se l'emergenza non ne ha
+static time_t emergency_deadline(const emergency_t *em)
+{
+    if (em->type.priority == 1)
+        return em->time + TIMEOUT_PRIORITY_1;
+    if (em->type.priority == 2)
+        return em->time + TIMEOUT_PRIORITY_2;
+    return INT_MAX;
+}
+
 // Funzione che verifica se un'emergenza è raggiungibile entro i limiti di tempo definiti dalla priorità.
 // Per ogni tipo di soccorritore richiesto, controlla se esiste un numero sufficiente di gemelli digitali
 // che possono raggiungere la posizione dell'emergenza prima della scadenza (deadline).
@@ -31,50 +121,30 @@ int check_reachability(emergency_withID_t *e, rescuer_data_t *rdata)
     emergency_t *em = &e->emergency;
     emergency_type_t *etype = &em->type;
     // Calcola il tempo massimo disponibile in base alla priorità
-    time_t deadline;
-    if (etype->priority == 1) {
-        deadline = em->time + 30;
-    } else if (etype->priority == 2) {
-        deadline = em->time + 10;
-    } else {
-        deadline = INT_MAX;
-    }
+    time_t deadline = emergency_deadline(em);
 
-    time_t now = time(NULL);
+    time_t now = sim_now();
     // Per ogni tipo di soccorritore richiesto
     for (int i = 0; i < etype->rescuers_req_number; ++i)
     {
         rescuer_request_t *req = &etype->rescuers[i];
-        int reachable_count = 0;
-        // Conta quanti twins di quel tipo possono arrivare in tempo
-        for (int j = 0; j < rdata->num_twins; ++j)
-        {
-            rescuer_digital_twin_t *twin = &rdata->twins[j];
-            // Salta se non è del tipo richiesto
-            if (strcmp(twin->rescuer->rescuer_type_name, req->type->rescuer_type_name) != 0)
-                continue;
-            // Calcola il tempo di arrivo del twin
-            int dist = abs(twin->x - em->x) + abs(twin->y - em->y);
-            int tempo_arrivo = (dist + twin->rescuer->speed - 1) / twin->rescuer->speed;
-
-            // Se può arrivare entro la deadline, conta
-            if (now + tempo_arrivo <= deadline)
-            {
-                reachable_count++;
-                if (reachable_count >= req->required_count)
-                    break;
-            }
-        }
+        // Conta quanti twins di quel tipo (o sostituti) possono arrivare in tempo,
+        // tramite l'indice di raggiungibilità o, se non disponibile, con una scansione
+        int reachable_count = reach_count_request(req, em->x, em->y, (long)(deadline - now), 0);
+        if (reachable_count < 0)
+            reachable_count = count_reachable_twins(em, req, rdata, now, deadline);
 
         // Se non ci sono abbastanza twin raggiungibili per questo tipo -> TIMEOUT
         if (reachable_count < req->required_count)
         {
-            char msg[256];
-            snprintf(msg, sizeof(msg),
-                     "Timeout per distanza, richiesto '%s': %d disponibili entro il limite, trovati %d nella zona",
-                     req->type->rescuer_type_name, req->required_count, reachable_count);
             em->status = TIMEOUT;
-            log_event_id(e->id, "EMERGENCY_STATUS", msg);
+            metrics_count(COUNTER_TIMEOUT_REACH);
+            if (LOG_ENABLED(LOG_LEVEL_STATE, LOG_CAT_EMERGENCY)) {
+                // Il tipo si registra per indice, il nome è dichiarato nel log (log_declare_fleet)
+                int type = 0;
+                while (type < rdata->num_types && rdata->types[type] != req->type) type++;
+                log_struct(LOG_EV_EM_TIMEOUT_REACH, e->id, type, req->required_count, reachable_count);
+            }
             return 0; // Timeout per distanza
         }
     }
@@ -89,23 +159,12 @@ int check_reachability(emergency_withID_t *e, rescuer_data_t *rdata)
 int check_deadline(emergency_withID_t *e)
 {
     emergency_t *em = &e->emergency;
-    emergency_type_t *etype = &em->type;
 
-    time_t now = time(NULL);
-    // Calcola il tempo massimo disponibile in base alla priorità
-    time_t deadline;
-    if (etype->priority == 1) {
-        deadline = em->time + 30;
-    } else if (etype->priority == 2) {
-        deadline = em->time + 10;
-    } else {
-        deadline = INT_MAX;
-    }
-
-    if (now > deadline)
+    if (sim_now() > emergency_deadline(em))
     {
-        log_event_id(e->id, "EMERGENCY_STATUS", "Timeout per carenza, scaduto tempo massimo disponibile");
+        LOG_STRUCT(LOG_LEVEL_STATE, LOG_CAT_EMERGENCY, LOG_EV_EM_TIMEOUT_DEADLINE, e->id, 0, 0, 0);
         em->status = TIMEOUT;
+        metrics_count(COUNTER_TIMEOUT_DEADLINE);
         return 0;
     }
 
@@ -114,8 +173,95 @@ int check_deadline(emergency_withID_t *e)
 
 
 
+// Disponibilità di un twin per un'emergenza, in ordine di preferenza
+enum {
+    TWIN_UNAVAILABLE,  // non assegnabile
+    TWIN_FREE,         // IDLE o in rientro alla base: assegnabile subito
+    TWIN_RESERVABLE,   // impegnato: prenotabile per quando avrà finito
+    TWIN_PREEMPTABLE   // impegnato: sottraibile secondo la regola di preemption
+};
+
+// Funzione che classifica la disponibilità di un twin per l'emergenza e.
+// Un twin già prenotato (da qualsiasi emergenza) o già al lavoro per e
+// (assegnazione parziale) non è disponibile. Un twin impegnato è prenotabile
+// solo durante l'intervento sul posto: in viaggio o alla barriera la fine del
+// lavoro dipende dagli altri twin della sua emergenza, e due emergenze parziali
+// potrebbero prenotarsi a vicenda il twin in attesa, senza mai iniziare.
+static int twin_availability(const rescuer_digital_twin_t *t, const emergency_withID_t *e)
+{
+    const emergency_type_t *etype = &e->emergency.type;
+    if (t->reserved_by != 0 || t->emergency_id == e->id)
+        return TWIN_UNAVAILABLE;
+    if (t->status == IDLE || t->status == RETURNING_TO_BASE)
+        return TWIN_FREE;
+    if (etype->preempt_max >= 0 &&
+        t->emergency_priority <= etype->preempt_max &&
+        t->emergency_priority < etype->priority)
+        return TWIN_PREEMPTABLE;
+    if (!t->working)
+        return TWIN_UNAVAILABLE;
+    return TWIN_RESERVABLE;
+}
+
+// Funzione che stima i secondi necessari al twin per raggiungere (x, y) a partire da now:
+// dalla posizione attuale se libero, oppure dal luogo e dall'istante di fine lavoro
+// previsti se impegnato (prenotazione)
+// (posizione e velocità dei twin fermi lette dalla vista colonnare)
+static int twin_eta(const twin_columns_t *cols, const rescuer_digital_twin_t *t, int availability,
+                    int x, int y, time_t now)
+{
+    int j = t->id - 1;
+    int from_x, from_y;
+    int wait = 0;
+    if (availability == TWIN_RESERVABLE) {
+        from_x = t->free_x;
+        from_y = t->free_y;
+        wait = t->free_at > now ? (int)(t->free_at - now) : 0;
+    } else if (cols->status[j] == IDLE) {
+        from_x = cols->x[j];
+        from_y = cols->y[j];
+    } else {
+        fleet_twin_position(t, now, &from_x, &from_y);
+    }
+    int dist = abs(from_x - x) + abs(from_y - y);
+    return wait + (dist + cols->speed[j] - 1) / cols->speed[j];
+}
+
+
+
+static void twin_detach_job(rescuer_digital_twin_t *t);
+static void twin_job_step(void *arg);
+
+// Funzione che restituisce il numero totale di twin richiesti dall'emergenza
+static int emergency_slots(const emergency_t *em)
+{
+    int slots = 0;
+    for (int j = 0; j < em->type.rescuers_req_number; ++j)
+        slots += em->type.rescuers[j].required_count;
+    return slots;
+}
+
+// Funzione che conta i twin già assegnati all'emergenza per la richiesta req_index
+static int assigned_for_request(const emergency_t *em, int req_index)
+{
+    int count = 0;
+    for (int i = 0; i < em->rescuer_count; ++i) {
+        if (em->rescuers_req[i] == req_index)
+            count++;
+    }
+    return count;
+}
+
+
 // Funzione che assegna un numero sufficiente di gemelli digitali (twin) ad un'emergenza.
-// Restituisce 1 se l'assegnazione ha successo, 0 altrimenti.
+// I candidati sono ordinati per istante di arrivo stimato: oltre ai twin liberi
+// considera quelli impegnati che finiranno presto, prenotandoli per la fine del lavoro.
+// Se il tipo lo consente, può sottrarre twin ad emergenze di priorità inferiore.
+// Se il tipo consente l'assegnazione parziale, assegna subito i twin disponibili
+// anche se non bastano: le chiamate successive riempiono i posti ancora mancanti.
+// Un posto può essere coperto da un tipo sostitutivo, la cui penalità si somma
+// all'arrivo stimato nell'ordinamento dei candidati.
+// Restituisce il numero di twin assegnati, 0 se l'assegnazione fallisce.
 int assign_rescuers_to_emergency(emergency_withID_t *e,
                                  rescuer_data_t *rdata,
                                  rescuer_digital_twin_t **assigned_twins,
@@ -123,48 +269,80 @@ int assign_rescuers_to_emergency(emergency_withID_t *e,
     emergency_t *em = &e->emergency;
     emergency_type_t *etype = &em->type;
 
-    time_t now = time(NULL);
-    time_t deadline;
-    char msg[MAX_MSG_SIZE];
+    time_t now = sim_now();
+    time_t deadline = emergency_deadline(em);
     int total_assigned = 0;
+    // Strutture di lavoro dall'arena del thread, dimensionate su flotta e tipi effettivi
+    int *assigned_req = scratch_alloc(sizeof(int) * emergency_slots(em)); // richiesta coperta da ciascun twin selezionato
+    twin_candidate_t *candidates = scratch_alloc(sizeof(twin_candidate_t) * rdata->num_twins);
+    int *penalties = scratch_alloc(sizeof(int) * rdata->num_types);
 
-    // Calcola la deadline in base alla priorità
-    if (etype->priority == 1) {
-        deadline = em->time + TIMEOUT_PRIORITY_1;
-    } else if (etype->priority == 2) {
-        deadline = em->time + TIMEOUT_PRIORITY_2;
-    } else {
-        deadline = INT_MAX;
-    }
-
-    // Step 1: Selezione dei twin IDLE e raggiungibili, ordinati per distanza
+    // Step 1: Selezione dei twin raggiungibili, ordinati per istante di arrivo
     for (int i = 0; i < etype->rescuers_req_number; ++i){
         rescuer_request_t *req = &etype->rescuers[i];
-        twin_candidate_t candidates[MAX_TWINS];
+        // Posti ancora da coprire per questo tipo
+        int missing = req->required_count - assigned_for_request(em, i);
+        if (missing <= 0)
+            continue;
+        // Uscita anticipata: l'indice dice già che i twin IDLE raggiungibili, più
+        // tutti quelli non IDLE (ovunque si trovino), non bastano
+        int idle_reachable = reach_count_request(req, em->x, em->y, (long)(deadline - now), 1);
+        if (idle_reachable >= 0 && idle_reachable + reach_busy_request(req) < missing) {
+            if (!etype->partial)
+                return 0;
+        }
         int candidate_count = 0;
+        request_type_penalties(req, rdata, penalties);
+        int times[TRAVEL_BLOCK];
+        unsigned char reachable[TRAVEL_BLOCK];
+        int budget = travel_budget(now, deadline);
 
-        // Raccoglie tutti i twin candidati
+        // Raccoglie tutti i twin candidati: il filtro per tipo legge solo la vista colonnare
         for (int j = 0; j < rdata->num_twins; ++j){
+            // Tempi di arrivo dalla posizione registrata, un blocco alla volta
+            int block = j % TRAVEL_BLOCK;
+            if (block == 0) {
+                int end = j + TRAVEL_BLOCK < rdata->num_twins ? j + TRAVEL_BLOCK : rdata->num_twins;
+                travel_times(&rdata->cols, j, end, em->x, em->y, budget, times, reachable);
+            }
+            int penalty = penalties[rdata->cols.type_id[j]];
+            if (penalty < 0)
+                continue;
+            // Un twin fermo fuori tempo non può diventare candidato
+            if (!reachable[block] && rdata->cols.status[j] == IDLE)
+                continue;
             rescuer_digital_twin_t *twin = &rdata->twins[j];
-
-            if (twin->status != IDLE)
+            int availability = twin_availability(twin, e);
+            if (availability == TWIN_UNAVAILABLE)
                 continue;
-            if (strcmp(twin->rescuer->rescuer_type_name, req->type->rescuer_type_name) != 0)
+            // Salta i twin già selezionati per una richiesta precedente
+            int taken = 0;
+            for (int k = 0; k < total_assigned && !taken; ++k)
+                taken = assigned_twins[k] == twin;
+            if (taken)
                 continue;
-            // Calcola tempo stimato di arrivo
-            int dist = abs(twin->x - em->x) + abs(twin->y - em->y);
-            int travel_t = (dist + twin->rescuer->speed - 1) / twin->rescuer->speed;
+            // Calcola tempo stimato di arrivo (già noto dal kernel se il twin è fermo)
+            int travel_t = availability == TWIN_FREE && rdata->cols.status[j] == IDLE ?
+                           times[block] : twin_eta(&rdata->cols, twin, availability, em->x, em->y, now);
             if (now + travel_t > deadline)
                 continue;
-            // Salva come candidato
+            // Salva come candidato, con la penalità del sostituto nell'ordinamento
             candidates[candidate_count].twin = twin;
-            candidates[candidate_count].travel_time = travel_t;
+            candidates[candidate_count].travel_time = travel_t + penalty;
+            candidates[candidate_count].penalty = penalty;
+            candidates[candidate_count].preempt = availability == TWIN_PREEMPTABLE;
             candidate_count++;
         }
-        // Ordina i candidati per tempo di viaggio crescente
+        // Ordina i candidati: prima quelli liberi o prenotabili, poi quelli da
+        // sottrarre ad altre emergenze, a parità per istante di arrivo crescente
+        // e, a pari arrivo, il tipo richiesto prima dei sostituti
         for (int x = 0; x < candidate_count - 1; ++x) {
             for (int y = x + 1; y < candidate_count; ++y) {
-                if (candidates[y].travel_time < candidates[x].travel_time){
+                if (candidates[y].preempt < candidates[x].preempt ||
+                    (candidates[y].preempt == candidates[x].preempt &&
+                     (candidates[y].travel_time < candidates[x].travel_time ||
+                      (candidates[y].travel_time == candidates[x].travel_time &&
+                       candidates[y].penalty < candidates[x].penalty)))){
                     twin_candidate_t temp = candidates[x];
                     candidates[x] = candidates[y];
                     candidates[y] = temp;
@@ -172,14 +350,19 @@ int assign_rescuers_to_emergency(emergency_withID_t *e,
             }
         }
         // Verifica se ci sono abbastanza twin disponibili per questo tipo
-        if (candidate_count < req->required_count){
-            return 0; // Risorse insufficienti
+        if (candidate_count < missing){
+            if (!etype->partial)
+                return 0; // Risorse insufficienti
+            missing = candidate_count; // Assegnazione parziale
         }
         // Seleziona i primi N twin
-        for (int k = 0; k < req->required_count; ++k){
+        for (int k = 0; k < missing; ++k){
+            assigned_req[total_assigned] = i;
             assigned_twins[total_assigned++] = candidates[k].twin;
         }
     }
+    if (total_assigned == 0)
+        return 0;
 
 
     // Step 2: Ordina i twin per ID (evita deadlock nei lock multipli)
@@ -189,6 +372,9 @@ int assign_rescuers_to_emergency(emergency_withID_t *e,
                 rescuer_digital_twin_t *tmp = assigned_twins[i];
                 assigned_twins[i] = assigned_twins[j];
                 assigned_twins[j] = tmp;
+                int tmp_req = assigned_req[i];
+                assigned_req[i] = assigned_req[j];
+                assigned_req[j] = tmp_req;
             }
         }
     }
@@ -197,333 +383,811 @@ int assign_rescuers_to_emergency(emergency_withID_t *e,
     for (int i = 0; i < total_assigned; ++i) {
         rescuer_digital_twin_t *t = assigned_twins[i];
 
-        if (mtx_trylock(&twin_locks[assigned_twins[i]->id - 1]) != thrd_success) {
+        if (LOCKPROF_TRYLOCK(&twin_locks[assigned_twins[i]->id - 1], LOCK_CLASS_TWIN, assigned_twins[i]->id) != thrd_success) {
             // Fallimento: rilascio dei lock già acquisiti
+            metrics_count(COUNTER_TRYLOCK_FAILED);
             printf("Assegnazione fallitaTwin %d occupato\n", assigned_twins[i]->id);
             for (int j = i - 1; j >= 0; j--) {
-                mtx_unlock(&twin_locks[assigned_twins[j]->id - 1]);
+                LOCKPROF_UNLOCK(&twin_locks[assigned_twins[j]->id - 1], LOCK_CLASS_TWIN, assigned_twins[j]->id, "errore in unlock twin");
             }
             return 0;
         }
-        // Dopo aver preso il lock, ricontrolla che sia ancora IDLE
-        if (t->status != IDLE) {
-            printf("Twin %d non è più IDLE\n", t->id);
+        // Dopo aver preso il lock, ricontrolla che sia ancora assegnabile
+        if (twin_availability(t, e) == TWIN_UNAVAILABLE) {
+            printf("Twin %d non è più disponibile\n", t->id);
             for (int j = i; j >= 0; j--){
-                mtx_unlock(&twin_locks[assigned_twins[j]->id - 1]);
+                LOCKPROF_UNLOCK(&twin_locks[assigned_twins[j]->id - 1], LOCK_CLASS_TWIN, assigned_twins[j]->id, "errore in unlock twin");
             }
             return 0;
         }
     }
 
-    // Step 4: Tutti i lock acquisiti con successo: conferma assegnazione
-    em->rescuer_count = total_assigned;
-    em->status = ASSIGNED;
-    // Salva copia dei twin (deep copy)
-    em->rescuers_dt = malloc(sizeof(rescuer_digital_twin_t) * total_assigned);
-    if (!em->rescuers_dt){
-        log_event_id(e->id, "ERROR", "Errore in malloc per rescuers_dt");
-        // Rilascia i lock presi prima di uscire
-        for (int i = 0; i < total_assigned; ++i){
-            mtx_unlock(&twin_locks[assigned_twins[i]->id - 1]);
+    // Step 4: Tutti i lock acquisiti con successo: conferma assegnazione.
+    // Le copie dei twin occupano i posti successivi a quelli già assegnati
+    int slots = emergency_slots(em);
+    int offset = em->rescuer_count;
+    if (!em->rescuers_dt) {
+        // Salva copia dei twin (deep copy), con un posto per ogni twin richiesto
+        em->rescuers_dt = malloc(sizeof(rescuer_digital_twin_t) * slots);
+        em->rescuers_req = malloc(sizeof(int) * slots);
+        if (!em->rescuers_dt || !em->rescuers_req){
+            LOG_TEXT_ID(LOG_LEVEL_ERROR, LOG_CAT_EMERGENCY, e->id, "ERROR", "Errore in malloc per rescuers_dt");
+            free(em->rescuers_dt);
+            free(em->rescuers_req);
+            em->rescuers_dt = NULL;
+            em->rescuers_req = NULL;
+            // Rilascia i lock presi prima di uscire
+            for (int i = 0; i < total_assigned; ++i){
+                LOCKPROF_UNLOCK(&twin_locks[assigned_twins[i]->id - 1], LOCK_CLASS_TWIN, assigned_twins[i]->id, "errore in unlock twin");
+            }
+            return 0;
         }
-        return 0;
     }
-    for (int i = 0; i < total_assigned; ++i) {
-        em->rescuers_dt[i] = *(assigned_twins[i]); // deep copy
+    if (offset == 0) {
+        em->status = ASSIGNED;
+        // Log cambio di stato emergenza
+        LOG_STRUCT(LOG_LEVEL_STATE, LOG_CAT_EMERGENCY, LOG_EV_EM_ASSIGNED, e->id, 0, 0, 0);
     }
-    // Log cambio di stato emergenza
-    log_event_id(e->id, "EMERGENCY_STATUS", "Stato cambiato a ASSIGNED");
-
+    if (offset + total_assigned < slots)
+        LOG_STRUCT(LOG_LEVEL_STATE, LOG_CAT_EMERGENCY, LOG_EV_EM_PARTIAL, e->id, 0, offset + total_assigned, slots);
 
-    // Step 5: Raggruppamento per log e aggiornamento stato dei twin
-    group_t groups[MAX_TYPES];
-    int group_count = 0;
 
+    // Step 5: Aggiornamento stato dei twin
     for (int i = 0; i < total_assigned; ++i) {
         rescuer_digital_twin_t *twin = assigned_twins[i];
-        twin->status = EN_ROUTE_TO_SCENE;
-
-        // Log individuale del cambiamento di stato
-        char id_str[NAME_SIZE];
-        snprintf(id_str, sizeof(id_str), "%s %d", twin->rescuer->rescuer_type_name, twin->id);
-        snprintf(msg, sizeof(msg), "Assegnato all'emergenza %d, stato EN_ROUTE_TO_SCENE", e->id);
-        log_event(id_str, "RESCUER_STATUS", msg);
-        // Raggruppa per tipo
-        int found = 0;
-        for (int g = 0; g < group_count; ++g) {
-            if (strcmp(groups[g].type, twin->rescuer->rescuer_type_name) == 0) {
-                groups[g].ids[groups[g].count++] = twin->id;
-                found = 1;
-                break;
-            }
-        }
-        if (!found) {
-            strncpy(groups[group_count].type, twin->rescuer->rescuer_type_name, NAME_SIZE);
-            groups[group_count].ids[0] = twin->id;
-            groups[group_count].count = 1;
-            group_count++;
+        int availability = twin_availability(twin, e);
+        em->rescuers_req[offset + i] = assigned_req[i];
+        if (LOG_ENABLED(LOG_LEVEL_STATE, LOG_CAT_RESCUER) &&
+            strcmp(twin->rescuer->rescuer_type_name,
+                   etype->rescuers[assigned_req[i]].type->rescuer_type_name) != 0) {
+            char id_str[NAME_SIZE];
+            snprintf(id_str, sizeof(id_str), "%s %d", twin->rescuer->rescuer_type_name, twin->id);
+            log_eventf(id_str, "SUBSTITUTION", "Sostituisce %s per l'emergenza %d",
+                       etype->rescuers[assigned_req[i]].type->rescuer_type_name, e->id);
         }
-        // Rilascia lock dopo assegnazione
-        mtx_unlock(&twin_locks[twin->id - 1]);
-    }
-
-    // Step 6: Log assegnazione in formato {Tipo id,id}{Tipo2 id,id}
-    char summary[MAX_MSG_SIZE] = {0};
-    for (int g = 0; g < group_count; ++g) {
-        strncat(summary, "{", sizeof(summary) - strlen(summary) - 1);
-        strncat(summary, groups[g].type, sizeof(summary) - strlen(summary) - 1);
-        strncat(summary, " ", sizeof(summary) - strlen(summary) - 1);
-        for (int k = 0; k < groups[g].count; ++k) {
-            char buf[16];
-            snprintf(buf, sizeof(buf), "%d", groups[g].ids[k]);
-            strncat(summary, buf, sizeof(summary) - strlen(summary) - 1);
-            if (k < groups[g].count - 1) {
-                strncat(summary, ",", sizeof(summary) - strlen(summary) - 1);
+
+        if (availability == TWIN_RESERVABLE) {
+            // Twin impegnato: viene prenotato, il suo task lo prenderà in carico
+            // appena terminato il lavoro corrente
+            twin->reserved_by = e->id;
+            em->rescuers_dt[offset + i] = *twin; // deep copy
+            LOG_STRUCT(LOG_LEVEL_STATE, LOG_CAT_RESCUER, LOG_EV_TW_RESERVED, e->id, twin->id,
+                       (int)(twin->free_at > now ? twin->free_at - now : 0), 0);
+        } else {
+            // Twin sottratto ad un'emergenza di priorità inferiore: il suo task
+            // se ne accorge e sospende l'emergenza originale (stato PAUSED)
+            if (availability == TWIN_PREEMPTABLE && LOG_ENABLED(LOG_LEVEL_STATE, LOG_CAT_RESCUER)) {
+                char id_str[NAME_SIZE];
+                snprintf(id_str, sizeof(id_str), "%s %d", twin->rescuer->rescuer_type_name, twin->id);
+                log_eventf(id_str, "PREEMPTION", "Sottratto all'emergenza %d (priorita' %d) dall'emergenza %d (priorita' %d)",
+                           twin->emergency_id, twin->emergency_priority, e->id, etype->priority);
             }
+            // Twin in rientro: riparte dalla posizione raggiunta
+            int from_x, from_y;
+            fleet_twin_position(twin, now, &from_x, &from_y);
+            // Il job che lo gestiva (rientro o emergenza sottratta) si interrompe
+            twin_detach_job(twin);
+            twin->emergency_id = e->id;
+            twin->emergency_priority = etype->priority;
+            twin->reserved_by = 0;
+            twin->working = 0;
+            twin->assignment++;
+            fleet_update_twin(twin, EN_ROUTE_TO_SCENE, from_x, from_y);
+            em->rescuers_dt[offset + i] = *twin; // deep copy, con il numero di assegnazione aggiornato
+
+            // Log individuale del cambiamento di stato
+            LOG_STRUCT(LOG_LEVEL_STATE, LOG_CAT_RESCUER, LOG_EV_TW_ASSIGNED, e->id, twin->id, 0, 0);
         }
-        strncat(summary, "}", sizeof(summary) - strlen(summary) - 1);
+        // Rilascia lock dopo assegnazione
+        LOCKPROF_UNLOCK(&twin_locks[twin->id - 1], LOCK_CLASS_TWIN, twin->id, "errore in unlock twin");
     }
-    log_event_id(e->id, "ASSIGNMENT", summary);
-    return 1;
+    em->rescuer_count = offset + total_assigned;
+    livestate_emergency(e);
+
+    // Step 6: Log assegnazione, reso in testo come {Tipo id,id}{Tipo2 id,id}
+    LOG_ASSIGNMENT(LOG_LEVEL_STATE, LOG_CAT_EMERGENCY, e->id, assigned_twins, total_assigned);
+    return total_assigned;
 }
 
 
-// Funzione che simula l'intervento una volta assegnati i twin.
-// Crea un thread per ogni twin assegnato e un thread per l'emergenza stessa.
-// Utilizza una struttura di sincronizzazione condivisa per coordinare l'arrivo e il rientro dei twin.
-// Attende la fine di tutti i thread prima di terminare.
-void handle_emergency(emergency_withID_t *e,
-                      rescuer_digital_twin_t **assigned_twins) {
+// Funzione che programma un passo del job all'istante at (ms).
+// Deve essere chiamata con il mutex di sync acquisito.
+static void job_schedule_locked(twin_job_t *job, long long at) {
+    job->sync->pending++;
+    event_schedule_token(at, twin_job_step, job, job->token);
+}
 
-    // Numero totale di twin assegnati
-    int n = e->emergency.rescuer_count;
+// Funzione che programma un passo del job all'istante at (ms)
+static void job_schedule(twin_job_t *job, long long at) {
+    mtx_lock(&job->sync->mutex);
+    job_schedule_locked(job, at);
+    mtx_unlock(&job->sync->mutex);
+}
 
-     // Alloca e inizializza la struttura di sincronizzazione condivisa
-    emergency_sync_t *sync = malloc(sizeof(emergency_sync_t));
-    sync->arrived = 0; // Contatore dei twin arrivati sul luogo
-    sync->returned = 0; // Contatore dei twin tornati alla base
-    mtx_init(&sync->mutex, mtx_plain); // Mutex di protezione
-    cnd_init(&sync->all_arrived); // Condizione per l'arrivo
-    cnd_init(&sync->all_returned); // Condizione per il rientro
+// Funzione che risveglia tutti i job dell'emergenza (sospensione o timeout).
+// Deve essere chiamata con il mutex di sync acquisito.
+static void emergency_wake_jobs(emergency_sync_t *sync) {
+    for (int i = 0; i < sync->started; ++i)
+        job_schedule_locked(&sync->jobs[i], 0);
+}
 
-    // Crea un thread per ciascun twin assegnato
-    thrd_t twin_threads[n];
-    for (int i = 0; i < n; ++i) {
-        twin_arg_t *arg = malloc(sizeof(twin_arg_t));
-        arg->twin = assigned_twins[i]; // Puntatore al twin assegnato
-        arg->e = e; // Puntatore all’emergenza condivisa
-        arg->sync = sync; // Puntatore alla struttura di sincronizzazione
-        // Avvia il thread del twin
-        thrd_create(&twin_threads[i], run_twin_task, arg);
+// Funzione che toglie il twin al job che lo sta gestendo, risvegliandolo:
+// trovando il numero di assegnazione cambiato, il job si interrompe.
+// Deve essere chiamata con il lock del twin acquisito.
+static void twin_detach_job(rescuer_digital_twin_t *t) {
+    if (t->job) {
+        job_schedule(t->job, 0);
+        t->job = NULL;
     }
+}
 
-    // Crea e avvia un thread separato per la gestione dell’emergenza
-    em_arg_t *em_arg = malloc(sizeof(em_arg_t));
-    em_arg->e = e;
-    em_arg->sync = sync;
-    thrd_t e_thread;
-    thrd_create(&e_thread, run_emergency_task, em_arg);
+// Funzione che risveglia il job che ha prenotato il twin, se presente.
+// Deve essere chiamata con il lock del twin acquisito.
+static void twin_wake_reservation(rescuer_digital_twin_t *t) {
+    if (t->reserved_job)
+        job_schedule(t->reserved_job, 0);
+}
+
+
+// Funzione che sospende un'emergenza (stato PAUSED) salvando il lavoro residuo:
+// il tempo già trascorso sul posto viene scalato dai tempi di gestione richiesti.
+// Deve essere chiamata con il mutex di sync acquisito.
+static void pause_emergency(emergency_withID_t *e, emergency_sync_t *sync)
+{
+    emergency_t *em = &e->emergency;
+    int elapsed = sync->work_started ? (int)(sim_now() - sync->work_started) : 0;
+    for (int j = 0; j < em->type.rescuers_req_number; ++j) {
+        rescuer_request_t *req = &em->type.rescuers[j];
+        req->time_to_manage = req->time_to_manage > elapsed ? req->time_to_manage - elapsed : 0;
+    }
+    em->status = PAUSED;
+    LOG_STRUCT(LOG_LEVEL_STATE, LOG_CAT_EMERGENCY, LOG_EV_EM_PAUSED, e->id, 0, elapsed, 0);
+    livestate_emergency(e);
+    metrics_count(COUNTER_PAUSED);
+}
 
-    // Attende la terminazione di tutti i thread dei twin
-    for (int i = 0; i < n; ++i) {
-        thrd_join(twin_threads[i], NULL);
+// Funzione che imposta lo stato finale dell'emergenza, una sola volta:
+// COMPLETED se tutti i twin hanno finito di lavorare, altrimenti PAUSED
+// (un twin è stato sottratto). Con il timeout lo stato TIMEOUT è già
+// stato impostato da emergency_time_out.
+// Deve essere chiamata con il mutex di sync acquisito.
+static void emergency_finish(emergency_sync_t *sync) {
+    if (sync->finished)
+        return;
+    sync->finished = 1;
+    if (sync->timed_out)
+        return;
+    if (sync->returned >= sync->expected) {
+        sync->e->emergency.status = COMPLETED;
+        LOG_STRUCT(LOG_LEVEL_STATE, LOG_CAT_EMERGENCY, LOG_EV_EM_COMPLETED, sync->e->id, 0, 0, 0);
+        metrics_stage(sync->e, METRIC_COMPLETED);
+        metrics_count(COUNTER_COMPLETED);
+    } else {
+        pause_emergency(sync->e, sync);
     }
-    // Attende la terminazione del thread dell’emergenza
-    thrd_join(e_thread, NULL);
+}
+
+// Funzione che porta l'emergenza in TIMEOUT perché i posti non sono stati
+// coperti entro la deadline: i twin già assegnati rientrano.
+// Deve essere chiamata con il mutex di sync acquisito.
+static void emergency_time_out(emergency_sync_t *sync) {
+    if (sync->finished)
+        return;
+    sync->e->emergency.status = TIMEOUT;
+    LOG_STRUCT(LOG_LEVEL_STATE, LOG_CAT_EMERGENCY, LOG_EV_EM_TIMEOUT_DEADLINE, sync->e->id, 0, 0, 0);
+    metrics_count(COUNTER_TIMEOUT_DEADLINE);
+    sync->timed_out = 1;
+    sync->paused = 1;
+    emergency_finish(sync);
+    emergency_wake_jobs(sync);
 }
 
 
+// Funzione che verifica se il twin è ancora assegnato al job: un'emergenza di
+// priorità superiore può averlo sottratto, oppure, durante il rientro, può
+// essere stato riassegnato
+static int job_owned(twin_job_t *job) {
+    mtx_t *lock = &job->twin_locks[job->twin->id - 1];
+    LOCKPROF_LOCK(lock, LOCK_CLASS_TWIN, job->twin->id, "errore in lock twin");
+    int owned = job->twin->assignment == job->assignment;
+    LOCKPROF_UNLOCK(lock, LOCK_CLASS_TWIN, job->twin->id, "errore in unlock twin");
+    return owned;
+}
+
+// Funzione che verifica se l'emergenza del job è stata sospesa
+static int job_paused(twin_job_t *job) {
+    mtx_lock(&job->sync->mutex);
+    int paused = job->sync->paused;
+    mtx_unlock(&job->sync->mutex);
+    return paused;
+}
 
-// Simula il comportamento di un twin durante l'intervento.
-// Il twin si muove verso il luogo dell'emergenza, attende che tutti gli altri arrivano,
-// lavora per il tempo richiesto, ritorna alla base e ripristina lo stato IDLE.
-// Utilizza una struttura di sincronizzazione condivisa per coordinarsi con gli altri twin.
-int run_twin_task(void *arg) {
-    twin_arg_t *a = (twin_arg_t *)arg;
-    rescuer_digital_twin_t *t = a->twin;
-    emergency_t *em = &a->e->emergency;
-    emergency_sync_t *sync = a->sync;
+// Funzione che termina il job, annullando i suoi timer ancora in coda
+static void job_done(twin_job_t *job) {
+    job->state = JOB_DONE;
+    int removed = event_cancel(job->token);
+    mtx_lock(&job->sync->mutex);
+    job->sync->active--;
+    job->sync->pending -= removed;
+    mtx_unlock(&job->sync->mutex);
+}
 
-    char id_str[NAME_SIZE], msg[MAX_MSG_SIZE];
-    snprintf(id_str, sizeof(id_str), "%s %d", t->rescuer->rescuer_type_name, t->id);
+// Funzione che riporta il twin alla base del suo tipo (rescuers.conf).
+// Con lo stato RETURNING_TO_BASE il twin è già libero: può essere riassegnato
+// dalla posizione raggiunta, e in tal caso il rientro si interrompe.
+// completed: 1 se il twin ha terminato il lavoro (conta come rientrato per
+//            l'emergenza), 0 se rientra perché l'emergenza è stata sospesa
+// Restituisce 0, oppure -1 se il twin era già stato sottratto al job.
+static int job_return_to_base(twin_job_t *job, int completed) {
+    rescuer_digital_twin_t *t = job->twin;
+    emergency_sync_t *sync = job->sync;
+    mtx_t *lock = &job->twin_locks[t->id - 1];
+
+    LOCKPROF_LOCK(lock, LOCK_CLASS_TWIN, t->id, "errore in lock twin");
+    if (t->assignment != job->assignment) {
+        LOCKPROF_UNLOCK(lock, LOCK_CLASS_TWIN, t->id, "errore in unlock twin");
+        return -1;
+    }
+    int dist = abs(t->x - t->rescuer->x) + abs(t->y - t->rescuer->y);
+    int travel_t = (dist + t->rescuer->speed - 1) / t->rescuer->speed;
+    t->emergency_id = 0;
+    t->working = 0;
+    fleet_update_twin(t, RETURNING_TO_BASE, t->x, t->y);
+    // Il twin è libero: l'eventuale emergenza che lo ha prenotato può prenderlo in carico
+    twin_wake_reservation(t);
+    LOCKPROF_UNLOCK(lock, LOCK_CLASS_TWIN, t->id, "errore in unlock twin");
+    LOG_STRUCT(LOG_LEVEL_STATE, LOG_CAT_RESCUER, completed ? LOG_EV_TW_RETURNING : LOG_EV_TW_RETURNING_PAUSED,
+               job->e->id, t->id, 0, 0);
+
+    // Notifica il rientro: l'ultimo che finisce lavoro completa l'emergenza
+    job->completed = completed;
+    if (completed) {
+        mtx_lock(&sync->mutex);
+        sync->returned++;
+        if (sync->returned == sync->expected)
+            emergency_finish(sync);
+        mtx_unlock(&sync->mutex);
+    }
 
-    // Step 1: Simula lo spostamento verso il luogo dell'emergenza
-    int home_x = em->x;
-    int home_y = em->y;
+    // Simula il ritorno alla base
+    job->state = JOB_RETURNING;
+    job->due = sim_now_ms() + travel_t * 1000LL;
+    job_schedule(job, job->due);
+    return 0;
+}
+
+// Funzione che gestisce l'interruzione di un job.
+// Se il twin è stato sottratto, sospende l'emergenza e termina senza toccarlo
+// (ora appartiene ad un'altra emergenza). Altrimenti l'emergenza è stata
+// sospesa per un altro twin: questo rientra e torna disponibile.
+static void job_abort(twin_job_t *job) {
+    if (job_return_to_base(job, 0) == 0)
+        return;
+    // Sospende l'emergenza e risveglia gli altri job
+    mtx_lock(&job->sync->mutex);
+    job->sync->paused = 1;
+    emergency_finish(job->sync);
+    emergency_wake_jobs(job->sync);
+    mtx_unlock(&job->sync->mutex);
+    job_done(job);
+}
+
+// Funzione che avvia lo spostamento del twin verso il luogo dell'emergenza
+// (dalla posizione attuale: base, o punto raggiunto durante un rientro).
+// La fine del lavoro non è ancora prevedibile: dipende dall'arrivo degli
+// altri twin e viene pubblicata da job_at_barrier all'inizio dell'intervento.
+static void job_start_travel(twin_job_t *job) {
+    rescuer_digital_twin_t *t = job->twin;
+    emergency_t *em = &job->e->emergency;
+    mtx_t *lock = &job->twin_locks[t->id - 1];
+
+    LOCKPROF_LOCK(lock, LOCK_CLASS_TWIN, t->id, "errore in lock twin");
+    if (t->assignment != job->assignment) {
+        LOCKPROF_UNLOCK(lock, LOCK_CLASS_TWIN, t->id, "errore in unlock twin");
+        job_abort(job);
+        return;
+    }
+    t->job = job;
     int dist = abs(t->x - em->x) + abs(t->y - em->y);
     int travel_t = (dist + t->rescuer->speed - 1) / t->rescuer->speed;
-    sleep(travel_t); // tempo di viaggio simulato
+    LOCKPROF_UNLOCK(lock, LOCK_CLASS_TWIN, t->id, "errore in unlock twin");
+
+    job->state = JOB_EN_ROUTE;
+    job->due = sim_now_ms() + travel_t * 1000LL;
+    job_schedule(job, job->due);
+}
+
+// Passo di un job prenotato: se il twin ha terminato il lavoro per l'emergenza
+// precedente (stato IDLE o RETURNING_TO_BASE) lo prende in carico, altrimenti
+// si registra sul twin per essere risvegliato al rientro, con un timer alla
+// deadline dell'emergenza.
+// Se nel frattempo l'emergenza del job viene sospesa, annulla la prenotazione;
+// se la deadline scade prima che il twin si liberi, l'emergenza va in TIMEOUT.
+static void job_claim_reserved(twin_job_t *job) {
+    rescuer_digital_twin_t *t = job->twin;
+    mtx_t *lock = &job->twin_locks[t->id - 1];
+    time_t deadline = emergency_deadline(&job->e->emergency);
+    int expired = sim_now() > deadline;
+
+    int paused = job_paused(job);
+    LOCKPROF_LOCK(lock, LOCK_CLASS_TWIN, t->id, "errore in lock twin");
+    int busy = t->status != IDLE && t->status != RETURNING_TO_BASE;
+    if (paused || (busy && expired)) {
+        if (t->reserved_by == job->e->id)
+            t->reserved_by = 0;
+        if (t->reserved_job == job)
+            t->reserved_job = NULL;
+        LOCKPROF_UNLOCK(lock, LOCK_CLASS_TWIN, t->id, "errore in unlock twin");
+        LOG_STRUCT(LOG_LEVEL_STATE, LOG_CAT_RESCUER, LOG_EV_TW_RESERVATION_CANCELLED, job->e->id, t->id, 0, 0);
+        if (!paused) {
+            mtx_lock(&job->sync->mutex);
+            emergency_time_out(job->sync);
+            mtx_unlock(&job->sync->mutex);
+        }
+        job_done(job);
+        return;
+    }
+    if (busy) {
+        t->reserved_job = job;
+        LOCKPROF_UNLOCK(lock, LOCK_CLASS_TWIN, t->id, "errore in unlock twin");
+        // Un solo timer: la deadline non cambia
+        if (deadline != INT_MAX && job->due == 0) {
+            job->due = (deadline + 1) * 1000LL;
+            job_schedule(job, job->due);
+        }
+        return;
+    }
+    int from_x, from_y;
+    fleet_twin_position(t, sim_now(), &from_x, &from_y);
+    twin_detach_job(t);
+    t->emergency_id = job->e->id;
+    t->emergency_priority = job->e->emergency.type.priority;
+    t->reserved_by = 0;
+    t->reserved_job = NULL;
+    t->assignment++;
+    job->assignment = t->assignment;
+    fleet_update_twin(t, EN_ROUTE_TO_SCENE, from_x, from_y);
+    LOCKPROF_UNLOCK(lock, LOCK_CLASS_TWIN, t->id, "errore in unlock twin");
+    LOG_STRUCT(LOG_LEVEL_STATE, LOG_CAT_RESCUER, LOG_EV_TW_TAKEN_OVER, job->e->id, t->id, 0, 0);
+    job_start_travel(job);
+}
+
+// Passo di un job in viaggio: all'arrivo il twin passa ON_SCENE e si
+// registra sulla barriera; l'ultimo che arriva avvia l'intervento (IN_PROGRESS)
+static void job_en_route(twin_job_t *job) {
+    rescuer_digital_twin_t *t = job->twin;
+    emergency_sync_t *sync = job->sync;
+    mtx_t *lock = &job->twin_locks[t->id - 1];
+
+    if (!job_owned(job) || job_paused(job)) {
+        job_abort(job);
+        return;
+    }
+    if (sim_now_ms() < job->due)
+        return; // Risveglio anticipato senza interruzione
 
     // Aggiorna posizione e stato ON_SCENE
-    t->x = em->x;
-    t->y = em->y;
-    t->status = ON_SCENE;
-    snprintf(msg, sizeof(msg), "Stato cambiato a ON_SCENE per emergenza %d", a->e->id);
-    log_event(id_str, "RESCUER_STATUS", msg);
+    LOCKPROF_LOCK(lock, LOCK_CLASS_TWIN, t->id, "errore in lock twin");
+    if (t->assignment != job->assignment) {
+        LOCKPROF_UNLOCK(lock, LOCK_CLASS_TWIN, t->id, "errore in unlock twin");
+        job_abort(job);
+        return;
+    }
+    fleet_update_twin(t, ON_SCENE, job->e->emergency.x, job->e->emergency.y);
+    LOCKPROF_UNLOCK(lock, LOCK_CLASS_TWIN, t->id, "errore in unlock twin");
+    LOG_STRUCT(LOG_LEVEL_STATE, LOG_CAT_RESCUER, LOG_EV_TW_ON_SCENE, job->e->id, t->id, 0, 0);
 
-    // Notifica che è arrivato, attende che tutti arrivano
+    // Notifica l'arrivo (arrivi per posto con l'assegnazione parziale);
+    // l'ultimo che arriva porta l'emergenza IN_PROGRESS e risveglia tutti
+    job->state = JOB_AT_BARRIER;
     mtx_lock(&sync->mutex);
     sync->arrived++;
-    // L'ultimo che arriva risveglia tutti
-    if (sync->arrived == em->rescuer_count){
-        cnd_broadcast(&sync->all_arrived); 
-        mtx_unlock(&sync->mutex);
-    } else { // attende a meno che non sia l'ultimo
-        cnd_wait(&sync->all_arrived, &sync->mutex);
-        mtx_unlock(&sync->mutex);
+    if (sync->arrived < sync->expected && job->e->emergency.type.partial)
+        LOG_STRUCT(LOG_LEVEL_STATE, LOG_CAT_EMERGENCY, LOG_EV_EM_ON_SCENE, job->e->id, 0,
+                   sync->arrived, sync->expected);
+    if (sync->arrived == sync->expected && !sync->paused) {
+        job->e->emergency.status = IN_PROGRESS;
+        sync->work_started = sim_now();
+        LOG_STRUCT(LOG_LEVEL_STATE, LOG_CAT_EMERGENCY, LOG_EV_EM_IN_PROGRESS, job->e->id, 0, 0, 0);
+        livestate_emergency(job->e);
+        metrics_stage(job->e, METRIC_ON_SCENE);
+        emergency_wake_jobs(sync);
     }
+    mtx_unlock(&sync->mutex);
+}
 
-    // Step 2: Simula il tempo di intervento sul posto
-    int manage_time = 0;
-    for (int j = 0; j < em->type.rescuers_req_number; ++j) {
-        if (strcmp(em->type.rescuers[j].type->rescuer_type_name, t->rescuer->rescuer_type_name) == 0) {
-            manage_time = em->type.rescuers[j].time_to_manage;
-            break;
-        }
+// Passo di un job sul posto in attesa degli altri twin: quando sono
+// arrivati tutti inizia il tempo di intervento
+static void job_at_barrier(twin_job_t *job) {
+    rescuer_digital_twin_t *t = job->twin;
+    emergency_sync_t *sync = job->sync;
+    mtx_t *lock = &job->twin_locks[t->id - 1];
+    int manage_time = job->e->emergency.type.rescuers[job->req_index].time_to_manage;
+
+    if (!job_owned(job)) {
+        job_abort(job);
+        return;
+    }
+    mtx_lock(&sync->mutex);
+    int paused = sync->paused;
+    int all_arrived = sync->arrived >= sync->expected;
+    mtx_unlock(&sync->mutex);
+    if (paused) {
+        job_abort(job);
+        return;
     }
-    sleep(manage_time);
+    if (!all_arrived)
+        return;
+
+    // Simula il tempo di intervento sul posto: da qui la fine del lavoro è
+    // nota e il twin è prenotabile da altre emergenze
+    LOCKPROF_LOCK(lock, LOCK_CLASS_TWIN, t->id, "errore in lock twin");
+    if (t->assignment == job->assignment) {
+        t->free_at = sim_now() + manage_time;
+        t->free_x = t->x;
+        t->free_y = t->y;
+        t->working = 1;
+    }
+    LOCKPROF_UNLOCK(lock, LOCK_CLASS_TWIN, t->id, "errore in unlock twin");
+    job->state = JOB_ON_SCENE;
+    job->due = sim_now_ms() + manage_time * 1000LL;
+    job_schedule(job, job->due);
+}
 
-    // Step 3: Aggiorna stato: ritorno alla base
-    t->status = RETURNING_TO_BASE;
-    snprintf(msg, sizeof(msg), "Stato cambiato a RETURNING_TO_BASE per emergenza %d", a->e->id);
-    log_event(id_str, "RESCUER_STATUS", msg);
+// Passo di un job durante l'intervento: al termine il twin rientra alla base,
+// durante il rientro è già disponibile per altre emergenze
+static void job_on_scene(twin_job_t *job) {
+    if (!job_owned(job) || job_paused(job)) {
+        job_abort(job);
+        return;
+    }
+    if (sim_now_ms() < job->due)
+        return;
+    if (job_return_to_base(job, 1) != 0)
+        job_abort(job);
+}
+
+// Passo di un job in rientro: all'arrivo alla base il twin torna IDLE,
+// a meno che nel frattempo non sia stato riassegnato
+static void job_returning(twin_job_t *job) {
+    rescuer_digital_twin_t *t = job->twin;
+    mtx_t *lock = &job->twin_locks[t->id - 1];
+
+    if (sim_now_ms() < job->due && job_owned(job))
+        return;
+    LOCKPROF_LOCK(lock, LOCK_CLASS_TWIN, t->id, "errore in lock twin");
+    if (t->assignment != job->assignment) {
+        LOCKPROF_UNLOCK(lock, LOCK_CLASS_TWIN, t->id, "errore in unlock twin");
+        job_done(job);
+        return;
+    }
+    fleet_update_twin(t, IDLE, t->rescuer->x, t->rescuer->y);
+    t->job = NULL;
+    twin_wake_reservation(t);
+    LOCKPROF_UNLOCK(lock, LOCK_CLASS_TWIN, t->id, "errore in unlock twin");
+    LOG_STRUCT(LOG_LEVEL_STATE, LOG_CAT_RESCUER, job->completed ? LOG_EV_TW_IDLE : LOG_EV_TW_IDLE_PAUSED,
+               job->e->id, t->id, 0, 0);
+    job_done(job);
+}
 
-    // Notifica il rientro
+// Callback del motore a eventi: esegue il passo del job in base al suo stato.
+// Le transizioni di stato del twin avvengono sotto il suo lock: se il twin
+// viene sottratto da un'emergenza di priorità superiore (preemption) il job
+// viene risvegliato e si interrompe.
+static void twin_job_step(void *arg) {
+    twin_job_t *job = arg;
+    emergency_sync_t *sync = job->sync;
+
+    switch (job->state) {
+        case JOB_RESERVED:   job_claim_reserved(job); break;
+        case JOB_STARTING:   job_start_travel(job); break;
+        case JOB_EN_ROUTE:   job_en_route(job); break;
+        case JOB_AT_BARRIER: job_at_barrier(job); break;
+        case JOB_ON_SCENE:   job_on_scene(job); break;
+        case JOB_RETURNING:  job_returning(job); break;
+        case JOB_DONE:       break;
+    }
+
+    // Ultimo accesso al job: dopo lo sblocco emergency_end può liberarlo.
+    // Se l'emergenza è conclusa riprende il task sospeso in attesa dei job.
     mtx_lock(&sync->mutex);
-    sync->returned++;
-    // L'ultimo che finisce lavoro segnala il thread dell'emergenza
-    if (sync->returned == a->e->emergency.rescuer_count)
-        cnd_signal(&sync->all_returned);
+    sync->pending--;
+    void *waiter = NULL;
+    if (sync->finished && sync->active == 0 && sync->pending == 0) {
+        waiter = sync->waiter;
+        sync->waiter = NULL;
+    }
     mtx_unlock(&sync->mutex);
+    if (waiter)
+        event_schedule(0, dispatch_task, waiter);
+}
 
-    // Step 4: Simula il ritorno alla base
-    sleep(travel_t);
-
-    t->x = home_x;
-    t->y = home_y;
-    t->status = IDLE;
-    snprintf(msg, sizeof(msg), "Stato cambiato a IDLE dopo completamento emergenza %d", a->e->id);
-    log_event(id_str, "RESCUER_STATUS", msg);
 
-    // Libera argomenti allocati
-    free(a);
-    return 0;
+// Funzione che avvia un job per ciascun twin assegnato all'emergenza
+// a partire dal posto sync->started.
+static void start_twin_jobs(emergency_withID_t *e, emergency_sync_t *sync,
+                            rescuer_digital_twin_t **assigned_twins, mtx_t *twin_locks) {
+    mtx_lock(&sync->mutex);
+    for (int i = sync->started; i < e->emergency.rescuer_count; ++i) {
+        twin_job_t *job = &sync->jobs[i];
+        job->twin = assigned_twins[i]; // Puntatore al twin assegnato
+        job->e = e; // Puntatore all’emergenza condivisa
+        job->sync = sync; // Puntatore alla struttura di sincronizzazione
+        job->twin_locks = twin_locks; // Lock dei twin, per le transizioni di stato
+        job->assignment = e->emergency.rescuers_dt[i].assignment; // Assegnazione di cui è titolare
+        job->req_index = e->emergency.rescuers_req[i]; // Richiesta coperta dal twin
+        // Twin solo prenotato: viene preso in carico quando termina il lavoro precedente
+        job->state = e->emergency.rescuers_dt[i].emergency_id != e->id ? JOB_RESERVED : JOB_STARTING;
+        job->due = 0;
+        job->completed = 0;
+        job->token = event_token_new(); // Gettone dei suoi eventi, liberato da emergency_end
+        sync->active++;
+        sync->started++;
+        job_schedule_locked(job, 0);
+    }
+    mtx_unlock(&sync->mutex);
 }
 
 
+// Funzione che avvia l'intervento una volta assegnati i twin.
+// Ogni twin assegnato è gestito da un job, una macchina a stati eseguita dal
+// motore a eventi (vedi event.h): nessun thread dedicato per twin o per l'emergenza.
+// Utilizza una struttura di sincronizzazione condivisa per coordinare l'arrivo e il rientro dei twin.
+emergency_sync_t *emergency_begin(emergency_withID_t *e,
+                                  rescuer_digital_twin_t **assigned_twins,
+                                  mtx_t *twin_locks) {
 
-// Simula il comportamento di un'emergenza durante l'intervento.
-// Attende che tutti i twin arrivano sul luogo, poi passa lo stato a IN_PROGRESS.
-// Quando tutti i twin hanno finito di lavorare, aggiorna lo stato a COMPLETED.
-int run_emergency_task(void *arg)
-{
-    em_arg_t *a = (em_arg_t *)arg;
-    emergency_t *em = &a->e->emergency;
-    emergency_sync_t *sync = a->sync;
+    // Numero totale di twin richiesti
+    int slots = emergency_slots(&e->emergency);
+
+     // Alloca e inizializza la struttura di sincronizzazione condivisa
+    emergency_sync_t *sync = malloc(sizeof(emergency_sync_t));
+    twin_job_t *jobs = malloc(sizeof(twin_job_t) * slots);
+    if (!sync || !jobs) {
+        perror("malloc emergency sync");
+        exit(EXIT_FAILURE);
+    }
+    sync->e = e; // Emergenza gestita
+    sync->jobs = jobs; // Un job per ogni posto
+    sync->expected = slots; // Numero di twin attesi sul luogo
+    sync->arrived = 0; // Contatore dei twin arrivati sul luogo
+    sync->returned = 0; // Contatore dei twin tornati alla base
+    sync->paused = 0; // Diventa 1 se un twin viene sottratto
+    sync->timed_out = 0; // Diventa 1 se i posti non vengono coperti entro la deadline
+    sync->finished = 0; // Diventa 1 quando è impostato lo stato finale
+    sync->started = 0; // Job avviati
+    sync->active = 0; // Job non ancora terminati
+    sync->pending = 0; // Eventi dei job ancora in coda nel motore
+    sync->work_started = 0; // Istante di inizio del lavoro sul posto
+    sync->waiter = NULL; // Task da riprendere quando tutti i job sono terminati
+    mtx_init(&sync->mutex, mtx_plain); // Mutex di protezione
+
+    // Avvia un job per ciascun twin assegnato
+    start_twin_jobs(e, sync, assigned_twins, twin_locks);
+    return sync;
+}
 
-    // Attende che tutti i twin arrivano
+// Funzione che esegue un tentativo di assegnazione parziale dei posti mancanti.
+// Se la deadline scade prima, l'emergenza va in TIMEOUT e i twin rientrano.
+// Restituisce 1 se restano posti da riempire (riprovare dopo 5ms), 0 altrimenti.
+int emergency_fill_step(emergency_withID_t *e, emergency_sync_t *sync,
+                        rescuer_data_t *rdata,
+                        rescuer_digital_twin_t **assigned_twins,
+                        mtx_t *twin_locks) {
+    if (e->emergency.rescuer_count >= sync->expected)
+        return 0;
     mtx_lock(&sync->mutex);
-    while (sync->arrived < em->rescuer_count)
-        cnd_wait(&sync->all_arrived, &sync->mutex);
-    // Quando tutti i twin sono sul posto -> IN_PROGRESS
-    em->status = IN_PROGRESS;
-    log_event_id(a->e->id, "EMERGENCY_STATUS", "Stato cambiato a IN_PROGRESS");
+    int paused = sync->paused;
     mtx_unlock(&sync->mutex);
+    if (paused)
+        return 0;
+    if (sim_now() > emergency_deadline(&e->emergency)) {
+        // Posti non coperti in tempo: i twin già assegnati rientrano
+        mtx_lock(&sync->mutex);
+        emergency_time_out(sync);
+        mtx_unlock(&sync->mutex);
+        return 0;
+    }
+    if (assign_rescuers_to_emergency(e, rdata, assigned_twins + e->emergency.rescuer_count, twin_locks))
+        start_twin_jobs(e, sync, assigned_twins, twin_locks);
+    return e->emergency.rescuer_count < sync->expected;
+}
 
-    // Attende che tutti i twin finiscono di lavorare
+// Funzione che restituisce 1 se tutti i job sono terminati e nessun loro
+// evento è ancora in coda (la struttura di sincronizzazione può essere liberata)
+int emergency_settled(emergency_sync_t *sync) {
     mtx_lock(&sync->mutex);
-    while (sync->returned < em->rescuer_count)
-        cnd_wait(&sync->all_returned, &sync->mutex);
-    // Quando tutti hanno finito -> COMPLETED
-    em->status = COMPLETED;
-    em->rescuer_count = 0;
-    free(em->rescuers_dt);
-    em->rescuers_dt = NULL;
-    log_event_id(a->e->id, "EMERGENCY_STATUS", "Stato cambiato a COMPLETED");
+    int settled = sync->finished && sync->active == 0 && sync->pending == 0;
     mtx_unlock(&sync->mutex);
+    return settled;
+}
 
-    // Libera risorse di sincronizzazione
-    cnd_destroy(&sync->all_arrived);
-    cnd_destroy(&sync->all_returned);
+// Funzione che chiude l'intervento: libera la sincronizzazione e le copie dei twin.
+// Restituisce 1 se l'emergenza è terminata (COMPLETED o TIMEOUT), 0 se è stata sospesa
+// (PAUSED) perché un suo twin è stato sottratto da un'emergenza di priorità superiore.
+int emergency_end(emergency_withID_t *e, emergency_sync_t *sync) {
+    // Libera risorse di sincronizzazione (nessun job le usa più)
+    for (int i = 0; i < sync->started; ++i)
+        event_token_free(sync->jobs[i].token);
     mtx_destroy(&sync->mutex);
+    free(sync->jobs);
     free(sync);
-    free(a);
-    return 0;
+    // Libera le copie dei twin assegnati
+    e->emergency.rescuer_count = 0;
+    free(e->emergency.rescuers_dt);
+    e->emergency.rescuers_dt = NULL;
+    free(e->emergency.rescuers_req);
+    e->emergency.rescuers_req = NULL;
+
+    return e->emergency.status != PAUSED;
 }
 
+// Funzione che prepara il contesto del dispatcher per un'emergenza
+void dispatch_init(dispatch_ctx_t *ctx, emergency_withID_t *e, rescuer_data_t *rdata,
+                   intent_table_t *itable, mtx_t *twin_locks) {
+    ctx->e = e;
+    ctx->rdata = rdata;
+    ctx->itable = itable;
+    ctx->twin_locks = twin_locks;
+    ctx->intent = NULL; // Intent attualmente registrato (NULL prima della registrazione iniziale)
+    ctx->replace_intent_counter = 0; // Tentativi dall'ultimo refresh dell'intent
+    ctx->phase = DISPATCH_ASSIGNING;
+    ctx->sync = NULL;
+    ctx->assigned_twins = NULL; // Allocato alla prima assegnazione, un posto per twin richiesto
+    metrics_active(1);
+    livestate_emergency(e);
+}
 
+// Funzione che libera le risorse del contesto e segnala la fine dell'emergenza
+static dispatch_result_t dispatch_done(dispatch_ctx_t *ctx) {
+    free(ctx->assigned_twins);
+    ctx->assigned_twins = NULL;
+    metrics_active(-1);
+    livestate_remove(ctx->e);
+    return DISPATCH_DONE;
+}
 
-// Thread dedicato alla gestione di un'emergenza.
+// Funzione che esegue un passo del dispatcher di un'emergenza, senza mai
+// bloccarsi: l'esito indica al chiamante come proseguire (vedi dispatch_result_t).
+// Usata sia dal task dell'emergenza (dispatch_task) sia dal replay deterministico (trace.h).
 // Spiegato dettagliatamente in report sezione 2.2
-int worker_thread(void *arg) {
-    worker_args_t *args = (worker_args_t *)arg;
-    emergency_withID_t *e = args->emergency;
-    rescuer_data_t *rdata = args->rdata;
-    intent_table_t *itable = args->itable;
-    mtx_t *twin_locks = args->twin_locks;
-    // Contatore per refresh intent
-    int replace_intent_counter = 0;
-    // Flag per registrazione iniziale intent
-    int first_time = 1;
-
-    // Ciclo principale del worker
-    while (1) {
-
-        // Step 1: Controlla se ci sono abbastanza numero di twin 
-        // raggiungibili entro il tempo limite 
-        if (!check_reachability(e, rdata)){
-            free_emergency_instance(e);
-            free(args);
-            return 0;
-        }
+dispatch_result_t dispatch_step(dispatch_ctx_t *ctx) {
+    emergency_withID_t *e = ctx->e;
+    rescuer_data_t *rdata = ctx->rdata;
+    intent_table_t *itable = ctx->itable;
+    // Le strutture di lavoro del passo precedente non servono più
+    scratch_reset();
+
+    switch (ctx->phase) {
+        case DISPATCH_FILLING:
+            // Assegnazione parziale: riempie i posti mancanti
+            if (emergency_fill_step(e, ctx->sync, rdata, ctx->assigned_twins, ctx->twin_locks))
+                return DISPATCH_RETRY;
+            ctx->phase = DISPATCH_RUNNING;
+            // fallthrough
+        case DISPATCH_RUNNING:
+            if (!emergency_settled(ctx->sync))
+                return DISPATCH_WAIT;
+            int ended = emergency_end(e, ctx->sync);
+            ctx->sync = NULL;
+            if (ended)
+                return dispatch_done(ctx);
+            // Emergenza sospesa per preemption: torna in coda con il
+            // lavoro residuo e riprende dallo Step 1
+            e->emergency.status = WAITING;
+            LOG_STRUCT(LOG_LEVEL_STATE, LOG_CAT_EMERGENCY, LOG_EV_EM_WAITING, e->id, 0, 0, 0);
+            livestate_emergency(e);
+            ctx->replace_intent_counter = 0;
+            ctx->phase = DISPATCH_ASSIGNING;
+            return DISPATCH_AGAIN;
+        case DISPATCH_ASSIGNING:
+            break;
+    }
+
+    // Step 1: Controlla se ci sono abbastanza numero di twin 
+    // raggiungibili entro il tempo limite 
+    // (l'intent di un tentativo precedente va ritirato, altrimenti
+    // continuerebbe a bloccare le emergenze in conflitto)
+    if (!check_reachability(e, rdata)) {
+        unregister_intent(itable, e->id);
+        return dispatch_done(ctx);
+    }
 
-        // Step 2: Controlla se il tempo deadline e' scaduto 
-        if (!check_deadline(e)) {
+    // Step 2: Controlla se il tempo deadline e' scaduto 
+    if (!check_deadline(e)) {
+        unregister_intent(itable, e->id);
+        return dispatch_done(ctx);
+    }
+
+    // Step 3: Alla prima volta si registra un intent, dalla seconda
+    // in poi si aggiorna solo quando un twin esce dalla finestra di
+    // raggiungibilita' o la flotta si e' spostata (al piu' ogni
+    // INTENT_REFRESH_MIN_INTERVAL tentativi)
+    if (!ctx->intent || sim_now() > ctx->intent->valid_until ||
+        (ctx->replace_intent_counter >= INTENT_REFRESH_MIN_INTERVAL &&
+         fleet_generation() != ctx->intent->generation)) {
+        if (refresh_intent(itable, e, rdata, &ctx->intent) != 0) {
             unregister_intent(itable, e->id);
-            free_emergency_instance(e);
-            free(args);
-            return 0;
+            return dispatch_done(ctx);
         }
+        ctx->replace_intent_counter = 0;
+        metrics_stage(e, METRIC_INTENT);
+    }
 
-        // Step 3: Alla prima volta si registra un intent, dalla 
-        // seconda in poi si aggiorna l'intent ogni 1 secondo
-        if (first_time || replace_intent_counter >= INTENT_REFRESH_INTERVAL) {
-            if (refresh_intent(itable, e, rdata, first_time) != 0) {
-                unregister_intent(itable, e->id);
-                free_emergency_instance(e);
-                free(args);
-                return 0;
-            }
-            first_time = 0;
-            replace_intent_counter = 0;
-        }
+    // Step 4: Determina se l'emergenza corrente puo' entrare 
+    // nella fase di assegnazione, riprovare dopo 5ms altrimenti
+    if (!can_proceed(itable, e->id)) {
+        ctx->replace_intent_counter++;
+        metrics_count(COUNTER_RETRY_PROCEED);
+        return DISPATCH_RETRY;
+    }
+    metrics_stage(e, METRIC_PROCEED);
+
+    // Step 5: Tenta di assegnare le risorse, in caso fallito 
+    // riprovare dopo 5ms
+    if (!ctx->assigned_twins)
+        SNCALL(ctx->assigned_twins, malloc(sizeof(rescuer_digital_twin_t *) * emergency_slots(&e->emergency)),
+               "malloc assigned twins");
+    if (!assign_rescuers_to_emergency(e, rdata, ctx->assigned_twins, ctx->twin_locks)) {
+        ctx->replace_intent_counter++;
+        metrics_count(COUNTER_RETRY_CLAIM);
+        return DISPATCH_RETRY;
+    }
+    metrics_stage(e, METRIC_CLAIM);
+    // elimina l'intent se ha successo
+    unregister_intent(itable, e->id);
+    ctx->intent = NULL;
+    // Step 6: Modella il comportamento temporale dei twin 
+    // assegnati e dell'emergenza
+    ctx->sync = emergency_begin(e, ctx->assigned_twins, ctx->twin_locks);
+    if (e->emergency.rescuer_count < ctx->sync->expected) {
+        ctx->phase = DISPATCH_FILLING;
+        return DISPATCH_RETRY;
+    }
+    ctx->phase = DISPATCH_RUNNING;
+    return DISPATCH_WAIT;
+}
 
-        // Step 4: Determina se l'emergenza corrente puo' entrare 
-        // nella fase di assegnazione, riprovare dopo 5ms altrimenti
-        if (!can_proceed(itable, e->id)) {
-            thrd_sleep(&(struct timespec){.tv_sec = 0, .tv_nsec = 5 * 1000000}, NULL); // 5ms
-            replace_intent_counter++;
-            continue;
-        }
 
-        // Step 5: Tenta di assegnare le risorse, in caso fallito 
-        // riprovare dopo 5ms
-        rescuer_digital_twin_t *assigned_twins[MAX_TWINS];
-        if (assign_rescuers_to_emergency(e, rdata, assigned_twins, twin_locks)){
-            // elimina l'intent se ha successo
-            unregister_intent(itable, e->id);
-            // Step 6: Modella il comportamento temporale dei twin 
-            // assegnati e dell'emergenza
-            handle_emergency(e, assigned_twins);
-            free_emergency_instance(e);
-            free(args);
-            return 0;
-        }
-        else {
-            // Assegnazione fallita -> aspetta e riprova
-            thrd_sleep(&(struct timespec){.tv_sec = 0, .tv_nsec = 5 * 1000000}, NULL); // 5ms
-            replace_intent_counter++;
-            continue;
+// Task di un'emergenza, eseguito dal motore a eventi al posto di un thread
+// dedicato: esegue i passi del dispatcher e poi si sospende, riprogrammandosi
+// dopo DISPATCH_RETRY_MS per i tentativi o restando in attesa che l'ultimo job
+// lo riprenda (twin_job_step). Il contesto è tutto ciò che resta in memoria.
+void dispatch_task(void *arg) {
+    dispatch_ctx_t *ctx = arg;
+    dispatch_result_t result;
+    do {
+        result = dispatch_step(ctx);
+    } while (result == DISPATCH_AGAIN);
+
+    switch (result) {
+        case DISPATCH_RETRY:
+            event_schedule_poll(sim_now_ms() + DISPATCH_RETRY_MS, dispatch_task, ctx);
+            break;
+        case DISPATCH_WAIT: {
+            // Si registra come task da riprendere; se i job sono già terminati riparte subito
+            emergency_sync_t *sync = ctx->sync;
+            mtx_lock(&sync->mutex);
+            int settled = sync->finished && sync->active == 0 && sync->pending == 0;
+            if (!settled)
+                sync->waiter = ctx;
+            mtx_unlock(&sync->mutex);
+            if (settled)
+                event_schedule(0, dispatch_task, ctx);
+            break;
         }
+        default:
+            free_emergency_instance(ctx->e);
+            free(ctx);
+            break;
     }
 }
+
+// Funzione che prende in carico una nuova emergenza avviandone il task
+void dispatch_submit(emergency_withID_t *e, rescuer_data_t *rdata,
+                     intent_table_t *itable, mtx_t *twin_locks) {
+    dispatch_ctx_t *ctx;
+    SNCALL(ctx, malloc(sizeof(dispatch_ctx_t)), "malloc dispatch ctx");
+    dispatch_init(ctx, e, rdata, itable, twin_locks);
+    event_schedule(0, dispatch_task, ctx);
+}
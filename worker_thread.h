@@ -12,44 +12,91 @@
 // timeout massimo per priorità 0: 1 giorno
 // usata per evitare overflow (siccome INT_MAX + qualsiasi int ha rischio di overflow)
 #define TIMEOUT_MAX 86400
-#define INTENT_REFRESH_INTERVAL 200
+// Intervallo (ms virtuali) tra due tentativi di assegnazione di un'emergenza
+#define DISPATCH_RETRY_MS 5
+// Numero minimo di tentativi (da 5ms) tra due refresh dovuti a spostamenti della flotta
+#define INTENT_REFRESH_MIN_INTERVAL 20
 
-typedef struct {
-  intent_table_t *itable;
-  rescuer_data_t *rdata;
-  mtx_t *twin_locks;
-  emergency_withID_t *emergency;
-} worker_args_t;
 
-typedef struct {
-  int arrived;
-  int returned;
-  mtx_t mutex;
-  cnd_t all_arrived;
-  cnd_t all_returned;
-} emergency_sync_t;
+// Stati del job che simula un twin assegnato ad un'emergenza
+typedef enum {
+  JOB_RESERVED,   // twin prenotato, in attesa che termini il lavoro precedente
+  JOB_STARTING,   // twin assegnato, il viaggio deve ancora iniziare
+  JOB_EN_ROUTE,   // in viaggio verso il luogo dell'emergenza
+  JOB_AT_BARRIER, // sul posto, in attesa degli altri twin
+  JOB_ON_SCENE,   // intervento in corso
+  JOB_RETURNING,  // rientro alla base
+  JOB_DONE
+} twin_job_state_t;
 
-typedef struct {
+typedef struct emergency_sync emergency_sync_t;
+
+// Job di un twin: macchina a stati eseguita dal motore a eventi (event.h)
+struct twin_job {
   rescuer_digital_twin_t *twin;
   emergency_withID_t *e;
   emergency_sync_t *sync;
-} twin_arg_t;
+  mtx_t *twin_locks;
+  unsigned int assignment;
+  int req_index;
+  int completed;
+  twin_job_state_t state;
+  long long due; // istante (ms) di fine dell'attività in corso
+  int token;     // gettone degli eventi del job (event.h), annullato da job_done
+};
+typedef struct twin_job twin_job_t;
 
-typedef struct {
+struct emergency_sync {
   emergency_withID_t *e;
-  emergency_sync_t *sync;
-} em_arg_t;
+  twin_job_t *jobs;
+  int expected;
+  int arrived;
+  int returned;
+  int paused;
+  int timed_out;
+  int finished;
+  int started;
+  int active;
+  int pending;
+  time_t work_started;
+  void *waiter; // task (dispatch_ctx_t) sospeso in attesa della fine dei job
+  mtx_t mutex;
+};
 
 typedef struct {
     rescuer_digital_twin_t *twin;
     int travel_time;
+    int penalty;
+    int preempt;
 } twin_candidate_t;
 
+// Esito di un passo del dispatcher (dispatch_step)
+typedef enum {
+  DISPATCH_AGAIN, // eseguire subito un altro passo
+  DISPATCH_RETRY, // riprovare dopo 5ms
+  DISPATCH_WAIT,  // attendere la fine dei job (emergency_settled)
+  DISPATCH_DONE   // emergenza terminata: il chiamante libera l'istanza
+} dispatch_result_t;
+
+// Fase del dispatcher di un'emergenza
+typedef enum {
+  DISPATCH_ASSIGNING, // in attesa di ottenere i twin
+  DISPATCH_FILLING,   // intervento avviato, posti mancanti da riempire
+  DISPATCH_RUNNING    // intervento avviato, in attesa della fine dei job
+} dispatch_phase_t;
+
+// Stato del dispatcher di un'emergenza, conservato tra un passo e l'altro
 typedef struct {
-        char type[NAME_SIZE];
-        int ids[MAX_TWINS];
-        int count;
-} group_t;
+  emergency_withID_t *e;
+  rescuer_data_t *rdata;
+  intent_table_t *itable;
+  mtx_t *twin_locks;
+  intent_t *intent;
+  int replace_intent_counter;
+  dispatch_phase_t phase;
+  emergency_sync_t *sync;
+  rescuer_digital_twin_t **assigned_twins;
+} dispatch_ctx_t;
 
 int check_deadline(emergency_withID_t *e);
 int check_reachability(emergency_withID_t *e, rescuer_data_t *rdata);
@@ -57,10 +104,20 @@ int assign_rescuers_to_emergency(emergency_withID_t *e,
                                  rescuer_data_t *rdata,
                                  rescuer_digital_twin_t **assigned_twins,
                                  mtx_t *twin_locks); 
-void handle_emergency(emergency_withID_t *e,
-                      rescuer_digital_twin_t **assigned_twins);
-int run_twin_task(void *arg);
-int run_emergency_task(void *arg);
-int worker_thread(void *arg);
+emergency_sync_t *emergency_begin(emergency_withID_t *e,
+                                  rescuer_digital_twin_t **assigned_twins,
+                                  mtx_t *twin_locks);
+int emergency_fill_step(emergency_withID_t *e, emergency_sync_t *sync,
+                        rescuer_data_t *rdata,
+                        rescuer_digital_twin_t **assigned_twins,
+                        mtx_t *twin_locks);
+int emergency_settled(emergency_sync_t *sync);
+int emergency_end(emergency_withID_t *e, emergency_sync_t *sync);
+void dispatch_init(dispatch_ctx_t *ctx, emergency_withID_t *e, rescuer_data_t *rdata,
+                   intent_table_t *itable, mtx_t *twin_locks);
+dispatch_result_t dispatch_step(dispatch_ctx_t *ctx);
+void dispatch_task(void *arg);
+void dispatch_submit(emergency_withID_t *e, rescuer_data_t *rdata,
+                     intent_table_t *itable, mtx_t *twin_locks);
 
 #endif